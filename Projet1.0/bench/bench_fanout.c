@@ -0,0 +1,100 @@
+#define _GNU_SOURCE
+#include "../include/Commun.h"
+#include "../include/envoi.h"
+#include "../include/protocole.h"
+#include <time.h>
+#include <fcntl.h>
+
+/* Compare le fan-out historique (un sendto par destinataire) avec le lot
+ * sendmmsg de envoi.c : appels système et temps par message diffusé.
+ * Usage: bench_fanout [nb_destinataires] [nb_messages]
+ */
+
+static double maintenant_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static void vider(int *socks, int n)
+{
+    char buf[256];
+    for (int i = 0; i < n; ++i)
+        while (recv(socks[i], buf, sizeof(buf), MSG_DONTWAIT) > 0)
+            ;
+}
+
+static void afficher(const char *mode, int nb_dest, int nb_msg,
+                     unsigned long appels, unsigned long echecs, double ns)
+{
+    printf("%-10s %13d %9d %15.2f %12.0f %7lu\n",
+           mode, nb_dest, nb_msg, (double)appels / nb_msg, ns / nb_msg, echecs);
+}
+
+int main(int argc, char *argv[])
+{
+    int nb_dest = argc > 1 ? atoi(argv[1]) : 16;
+    int nb_msg  = argc > 2 ? atoi(argv[2]) : 20000;
+    if (nb_dest <= 0 || nb_msg <= 0) {
+        fprintf(stderr, "Usage: %s [nb_destinataires] [nb_messages]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    int *socks = calloc((size_t)nb_dest, sizeof(int));
+    struct sockaddr_in *dests = calloc((size_t)nb_dest, sizeof(*dests));
+    EnvoiLot *lot = malloc(sizeof(*lot));
+    check_fatal(!socks || !dests || !lot, "calloc");
+
+    for (int i = 0; i < nb_dest; ++i) {
+        socks[i] = create_udp_socket();
+        fill_sockaddr(&dests[i], "127.0.0.1", 0);
+        check_fatal(bind(socks[i], (struct sockaddr *)&dests[i], sizeof(dests[i])) < 0, "bind");
+        socklen_t len = sizeof(dests[i]);
+        getsockname(socks[i], (struct sockaddr *)&dests[i], &len);
+    }
+
+    int sock = create_udp_socket();
+    ISYMessage msg;
+    memset(&msg, 0, sizeof(msg));
+    strcpy(msg.ordre, ORDRE_MSG);
+    snprintf(msg.emetteur, MAX_USERNAME, "bench");
+    snprintf(msg.groupe, MAX_GROUP_NAME, "bench");
+    snprintf(msg.texte, MAX_TEXT, "message de test pour le fan-out");
+
+    printf("%-10s %13s %9s %15s %12s %7s\n",
+           "mode", "destinataires", "messages", "appels/message", "ns/message", "echecs");
+
+    /* Avant : un sendto par destinataire */
+    unsigned long appels = 0, echecs = 0;
+    double t0 = maintenant_ns();
+    for (int m = 0; m < nb_msg; ++m) {
+        for (int d = 0; d < nb_dest; ++d) {
+            if (sendto(sock, &msg, PROTO_V1_TAILLE, 0,
+                       (struct sockaddr *)&dests[d], sizeof(dests[d])) < 0)
+                echecs++;
+            appels++;
+        }
+        if ((m & 63) == 0) vider(socks, nb_dest);
+    }
+    afficher("sendto", nb_dest, nb_msg, appels, echecs, maintenant_ns() - t0);
+    vider(socks, nb_dest);
+
+    /* Après : lot sendmmsg */
+    envoi_init(lot, sock);
+    t0 = maintenant_ns();
+    for (int m = 0; m < nb_msg; ++m) {
+        for (int d = 0; d < nb_dest; ++d)
+            envoi_ajouter(lot, &msg, PROTO_V1_TAILLE, &dests[d], NULL);
+        envoi_flush(lot);
+        if ((m & 63) == 0) vider(socks, nb_dest);
+    }
+    afficher("sendmmsg", nb_dest, nb_msg, lot->nb_appels, lot->nb_echecs, maintenant_ns() - t0);
+
+    for (int i = 0; i < nb_dest; ++i) close(socks[i]);
+    close(sock);
+    free(socks);
+    free(dests);
+    free(lot);
+    return 0;
+}
@@ -0,0 +1,267 @@
+#define _GNU_SOURCE
+#include "../include/Commun.h"
+#include "../include/bannis.h"
+#include "../include/membres.h"
+#include "../include/protocole.h"
+#include "../include/registre.h"
+#include <time.h>
+
+/* Microbenchmarks des fonctions appelées à chaque message : emojis
+ * (Commun.h), recherche d'un membre (membres.c), index des bannis,
+ * analyse d'une commande du serveur. Chaque cas tourne sur des entrées
+ * tirées d'une graine fixe : deux exécutions mesurent exactement le même
+ * travail. Les allocations sont comptées par les malloc/free définis plus
+ * bas, qui remplacent ceux de la libc dans tout le programme.
+ * Usage: bench_micro [--iterations N] [--graine G] [--cas nom]
+ */
+
+#define MICRO_ENTREES 1024          /* entrées différentes par cas (puissance de 2) */
+#define MICRO_REPETITIONS 5         /* mesures par cas, la médiane est gardée */
+#define MICRO_GROUPES 1000          /* groupes du registre pour les commandes */
+#define MICRO_BANNIS 256            /* préfixes bannis */
+#define MICRO_MEMBRES 4096          /* membres du groupe, 4 par IP */
+#define MICRO_PAR_IP 4
+
+/* Compteurs d'allocation */
+
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void *, size_t);
+extern void  __libc_free(void *);
+
+static unsigned long long nb_allocs, octets_alloues;
+
+void *malloc(size_t n)
+{
+    nb_allocs++;
+    octets_alloues += n;
+    return __libc_malloc(n);
+}
+
+void *calloc(size_t nb, size_t n)
+{
+    nb_allocs++;
+    octets_alloues += nb * n;
+    return __libc_calloc(nb, n);
+}
+
+void *realloc(void *p, size_t n)
+{
+    nb_allocs++;
+    octets_alloues += n;
+    return __libc_realloc(p, n);
+}
+
+void free(void *p)
+{
+    __libc_free(p);
+}
+
+/* Entrées */
+
+static uint64_t alea;
+
+static uint32_t tirer(void)
+{
+    alea ^= alea << 13;
+    alea ^= alea >> 7;
+    alea ^= alea << 17;
+    return (uint32_t)(alea >> 32);
+}
+
+static char noms[MICRO_ENTREES][MAX_USERNAME];
+static char ips[MICRO_ENTREES][INET_ADDRSTRLEN];
+static uint32_t ips_bin[MICRO_ENTREES];              /* ordre hôte */
+static TableMembres membres;
+static int cherches[MICRO_ENTREES];                  /* case du membre cherché */
+static BanIndex bannis;
+static unsigned char trames_v1[MICRO_ENTREES][PROTO_TRAME_MAX];
+static unsigned char trames_v2[MICRO_ENTREES][PROTO_TRAME_MAX];
+static size_t tailles_v2[MICRO_ENTREES];
+
+static volatile unsigned int puits;  /* empêche d'éliminer le travail mesuré */
+
+static void preparer(void)
+{
+    for (int i = 0; i < MICRO_ENTREES; ++i) {
+        int n = 3 + (int)(tirer() % (MAX_USERNAME - 4));
+        for (int k = 0; k < n; ++k) noms[i][k] = (char)('a' + tirer() % 26);
+        noms[i][n] = '\0';
+        ips_bin[i] = 0x0A000000u | (tirer() & 0x00FFFFFFu);       /* 10.x.y.z */
+        struct in_addr a = { htonl(ips_bin[i]) };
+        inet_ntop(AF_INET, &a, ips[i], sizeof(ips[i]));
+    }
+
+    /* Plusieurs membres par IP (NAT) ; on cherche le dernier de sa chaîne */
+    membres_init(&membres);
+    for (int k = 0; k < MICRO_MEMBRES; ++k)
+        membres_ajouter(&membres, htonl(0xC0A80000u | (uint32_t)(k / MICRO_PAR_IP)),
+                        htons((uint16_t)(9000 + k % MICRO_PAR_IP)), noms[k % MICRO_ENTREES]);
+    for (int i = 0; i < MICRO_ENTREES; ++i)
+        cherches[i] = (int)(tirer() % (MICRO_MEMBRES / MICRO_PAR_IP)) * MICRO_PAR_IP + 1;
+
+    bannis_init(&bannis);
+    for (int i = 0; i < MICRO_BANNIS; ++i)
+        bannis_ajouter(&bannis, 0x0A000000u | (tirer() & 0x00FFFF00u), 24 + (int)(tirer() % 9));
+
+    registre_init(MICRO_GROUPES);
+    for (int i = 0; i < MICRO_GROUPES; ++i) {
+        char nom[MAX_GROUP_NAME];
+        snprintf(nom, sizeof(nom), "groupe%04d", i);
+        registre_allouer(nom);
+    }
+
+    /* JOIN d'un groupe existant, en v1 et en v2 */
+    for (int i = 0; i < MICRO_ENTREES; ++i) {
+        ISYMessage msg;
+        memset(&msg, 0, sizeof(msg));
+        strcpy(msg.ordre, ORDRE_CMD);
+        memcpy(msg.emetteur, noms[i], MAX_USERNAME);
+        snprintf(msg.texte, MAX_TEXT, "JOIN groupe%04u", tirer() % MICRO_GROUPES);
+        proto_ecrire(&msg, PROTO_V1, PROTO_GROUPE_AUCUN, PROTO_MEMBRE_AUCUN, trames_v1[i]);
+        tailles_v2[i] = proto_ecrire(&msg, PROTO_V2, PROTO_GROUPE_AUCUN,
+                                     PROTO_MEMBRE_AUCUN, trames_v2[i]);
+    }
+}
+
+/* Cas mesurés : une opération = un appel pour l'entrée i */
+
+static void cas_emoji_nom(int i)
+{
+    char emoji[MAX_EMOJI];
+    choose_emoji_from_username(noms[i], emoji);
+    puits += (unsigned char)emoji[3];
+}
+
+static void cas_emoji_ip(int i)
+{
+    char emoji[MAX_EMOJI];
+    choose_emoji_from_ip(ips[i], emoji);
+    puits += (unsigned char)emoji[3];
+}
+
+/* Recherche par clé complète (add_client, au CON) */
+static void cas_membre_cle(int i)
+{
+    const ClientInfo *m = membres_case(&membres, cherches[i]);
+    puits += (unsigned int)membres_chercher(&membres, m->addr_cli.sin_addr.s_addr,
+                                            m->addr_cli.sin_port, m->nom);
+}
+
+/* Recherche par IP et nom dans la chaîne de l'IP (completer_emetteur) */
+static void cas_membre_ip(int i)
+{
+    const ClientInfo *m = membres_case(&membres, cherches[i]);
+    puits += (unsigned int)membres_chercher_ip(&membres, m->addr_cli.sin_addr.s_addr, m->nom);
+}
+
+static void cas_bannis(int i)
+{
+    puits += (unsigned int)bannis_contient(&bannis, ips_bin[i]);
+}
+
+/* handle_command jusqu'à la réponse : décodage, mot-clé, sscanf des
+ * arguments, recherche du groupe, texte de la réponse */
+static void commande(const unsigned char *trame, size_t len)
+{
+    ISYMessage msg, reply;
+    ProtoInfo info;
+    reply.texte[0] = '\0';
+    if (proto_lire(trame, len, &msg, &info) < 0) return;
+    const char *args;
+    if (proto_mot(msg.texte, &args) != MOT_JOIN) return;
+    char arg1[64] = {0};
+    sscanf(args, "%63s", arg1);
+    int idx = registre_chercher(arg1);
+    if (idx >= 0)
+        snprintf(reply.texte, MAX_TEXT, "OK %d %d", registre_groupe(idx)->port_groupe, idx);
+    puits += (unsigned char)reply.texte[0];
+}
+
+static void cas_commande_v1(int i)
+{
+    commande(trames_v1[i], PROTO_V1_TAILLE);
+}
+
+static void cas_commande_v2(int i)
+{
+    commande(trames_v2[i], tailles_v2[i]);
+}
+
+typedef struct {
+    const char *nom;
+    void (*fn)(int i);
+} Cas;
+
+static const Cas tous_cas[] = {
+    { "emoji_nom",     cas_emoji_nom },
+    { "emoji_ip",      cas_emoji_ip },
+    { "membre_cle",    cas_membre_cle },
+    { "membre_ip",     cas_membre_ip },
+    { "bannis",        cas_bannis },
+    { "commande_v1",   cas_commande_v1 },
+    { "commande_v2",   cas_commande_v2 },
+};
+
+static double maintenant_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static int par_valeur(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+int main(int argc, char *argv[])
+{
+    long iterations = 1000000;
+    unsigned long long graine = 42;
+    const char *filtre = NULL;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+            iterations = atol(argv[++i]);
+        else if (strcmp(argv[i], "--graine") == 0 && i + 1 < argc)
+            graine = strtoull(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "--cas") == 0 && i + 1 < argc)
+            filtre = argv[++i];
+        else {
+            fprintf(stderr, "Usage: %s [--iterations N] [--graine G] [--cas nom]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (iterations <= 0) iterations = 1;
+    alea = graine ? graine : 1;
+    preparer();
+
+    printf("%-14s %10s %10s %12s %12s\n", "cas", "iterations", "ns/op", "allocs/op", "octets/op");
+    for (size_t c = 0; c < sizeof(tous_cas) / sizeof(tous_cas[0]); ++c) {
+        const Cas *cas = &tous_cas[c];
+        if (filtre && strcmp(filtre, cas->nom) != 0) continue;
+
+        for (int i = 0; i < MICRO_ENTREES; ++i) cas->fn(i);      /* chauffe */
+
+        double mesures[MICRO_REPETITIONS];
+        unsigned long long allocs = nb_allocs, octets = octets_alloues;
+        for (int r = 0; r < MICRO_REPETITIONS; ++r) {
+            double t0 = maintenant_ns();
+            for (long k = 0; k < iterations; ++k)
+                cas->fn((int)(k & (MICRO_ENTREES - 1)));
+            mesures[r] = (maintenant_ns() - t0) / (double)iterations;
+        }
+        qsort(mesures, MICRO_REPETITIONS, sizeof(mesures[0]), par_valeur);
+        double total = (double)iterations * MICRO_REPETITIONS;
+        printf("%-14s %10ld %10.1f %12.3f %12.1f\n", cas->nom, iterations,
+               mesures[MICRO_REPETITIONS / 2],
+               (double)(nb_allocs - allocs) / total,
+               (double)(octets_alloues - octets) / total);
+    }
+
+    membres_liberer(&membres);
+    bannis_liberer(&bannis);
+    registre_detruire();
+    return 0;
+}
@@ -0,0 +1,346 @@
+#define _GNU_SOURCE
+#include "../include/Commun.h"
+#include "../include/protocole.h"
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+/* Générateur de charge pour un GroupeISY local.
+ * N clients simulés rejoignent le groupe (CON), chacun depuis sa propre
+ * adresse 127.0.0.x : le groupe identifie ses membres par IP. Les M
+ * premiers émettent des MES au débit demandé, répartis à tour de rôle ;
+ * chaque message porte son émetteur, son numéro et l'heure d'envoi. Un
+ * thread reçoit le fan-out sur les N sockets et mesure la latence de bout
+ * en bout. Le résultat est une ligne JSON sur stdout, pour comparer deux
+ * versions du groupe.
+ *
+ * Usage: chargeISY [--clients N] [--emetteurs M] [--debit msg/s] [--duree s]
+ *                  [--taille octets] [--v2] [--groupe nom | --port p]
+ *                  [--serveur ip] [--attente ms] [--trace]
+ * --trace (avec --v2) ajoute à chaque MES le bloc d'horodatage de trace.h :
+ * le groupe remplit alors ses histogrammes d'étapes (isytop, C>G_p99).
+ */
+
+#define CHARGE_ECHANTILLONS_MAX (4u << 20)  /* latences gardées (tirage au-delà) */
+#define CHARGE_LOT 64
+#define CHARGE_CLIENTS_MAX 1024           /* sockets ouvertes par le générateur */
+#define CHARGE_EMETTEURS_MAX 64
+#define CHARGE_BASE_IP 0x7F00000Au          /* 127.0.0.10 : premier client */
+
+typedef struct {
+    int sock;
+    struct sockaddr_in addr;       /* adresse locale = adresse d'affichage */
+    char nom[MAX_USERNAME];
+    uint32_t prochain[CHARGE_EMETTEURS_MAX];  /* numéro attendu par émetteur */
+} Client;
+
+static Client clients[CHARGE_CLIENTS_MAX];
+static int nb_clients = 8;
+static int nb_emetteurs = 1;
+static int version = PROTO_V1;
+static int tracer;                 /* --trace : bloc d'horodatage v2 */
+static atomic_int arret;
+
+/* Compteurs du thread de réception */
+static unsigned long long nb_recus, nb_desordres, nb_etrangers;
+static uint64_t *latences;
+static size_t nb_latences;
+static unsigned long long nb_tirages;
+static uint64_t latence_max;
+static uint64_t alea = 0x9E3779B97F4A7C15ull;
+
+static uint64_t maintenant_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t xorshift(void)
+{
+    alea ^= alea << 13;
+    alea ^= alea >> 7;
+    alea ^= alea << 17;
+    return alea;
+}
+
+/* Échantillon de latence : tous jusqu'à la capacité, puis tirage uniforme
+ * (réservoir) pour que les percentiles restent représentatifs */
+static void noter_latence(uint64_t ns)
+{
+    if (ns > latence_max) latence_max = ns;
+    nb_tirages++;
+    if (nb_latences < CHARGE_ECHANTILLONS_MAX) {
+        latences[nb_latences++] = ns;
+        return;
+    }
+    uint64_t k = xorshift() % nb_tirages;
+    if (k < CHARGE_ECHANTILLONS_MAX) latences[k] = ns;
+}
+
+static void recevoir_trame(Client *c, const unsigned char *trame, size_t len)
+{
+    ISYMessage msg;
+    ProtoInfo info;
+    if (proto_lire(trame, len, &msg, &info) < 0 || info.opcode != OP_MES) return;
+
+    /* En v2 le texte complet est dans la charge */
+    char texte[64];
+    size_t n = info.version == PROTO_V2 ? info.nb_charge : strnlen(msg.texte, sizeof(msg.texte));
+    const char *src = info.version == PROTO_V2 ? (const char *)info.charge : msg.texte;
+    if (n > sizeof(texte) - 1) n = sizeof(texte) - 1;
+    memcpy(texte, src, n);
+    texte[n] = '\0';
+
+    int emetteur;
+    unsigned int num;
+    unsigned long long envoi;
+    if (sscanf(texte, "CHG %d %u %llu", &emetteur, &num, &envoi) != 3 ||
+        emetteur < 0 || emetteur >= nb_emetteurs) {
+        nb_etrangers++;            /* avis SERVER, rejeu d'un ancien test... */
+        return;
+    }
+    uint64_t t = maintenant_ns();
+    noter_latence(t > envoi ? t - envoi : 0);
+    nb_recus++;
+    if (num < c->prochain[emetteur]) nb_desordres++;
+    else c->prochain[emetteur] = num + 1;
+}
+
+static void *recepteur(void *arg)
+{
+    (void)arg;
+    static unsigned char trames[CHARGE_LOT][PROTO_TRAME_MAX];
+    struct mmsghdr hdrs[CHARGE_LOT];
+    struct iovec iovs[CHARGE_LOT];
+    struct pollfd pfds[CHARGE_CLIENTS_MAX];
+    for (int i = 0; i < nb_clients; ++i) {
+        pfds[i].fd = clients[i].sock;
+        pfds[i].events = POLLIN;
+    }
+
+    while (!atomic_load_explicit(&arret, memory_order_relaxed)) {
+        if (poll(pfds, (nfds_t)nb_clients, 50) <= 0) continue;
+        for (int i = 0; i < nb_clients; ++i) {
+            if (!(pfds[i].revents & POLLIN)) continue;
+            for (;;) {
+                for (int k = 0; k < CHARGE_LOT; ++k) {
+                    iovs[k].iov_base = trames[k];
+                    iovs[k].iov_len = sizeof(trames[k]);
+                    memset(&hdrs[k], 0, sizeof(hdrs[k]));
+                    hdrs[k].msg_hdr.msg_iov = &iovs[k];
+                    hdrs[k].msg_hdr.msg_iovlen = 1;
+                }
+                int r = recvmmsg(clients[i].sock, hdrs, CHARGE_LOT, MSG_DONTWAIT, NULL);
+                if (r <= 0) break;
+                for (int k = 0; k < r; ++k)
+                    recevoir_trame(&clients[i], trames[k], hdrs[k].msg_len);
+                if (r < CHARGE_LOT) break;
+            }
+        }
+    }
+    return NULL;
+}
+
+/* Commande au serveur (v1), réponse dans 'reponse' */
+static int commande(const char *ip, const char *texte, char *reponse, size_t cap)
+{
+    int sock = create_udp_socket();
+    struct timeval tv = { 2, 0 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    struct sockaddr_in srv;
+    fill_sockaddr(&srv, ip, SERVER_PORT);
+
+    ISYMessage msg;
+    memset(&msg, 0, sizeof(msg));
+    strcpy(msg.ordre, ORDRE_CMD);
+    snprintf(msg.emetteur, MAX_USERNAME, "charge");
+    snprintf(msg.texte, MAX_TEXT, "%s", texte);
+    sendto(sock, &msg, PROTO_V1_TAILLE, 0, (struct sockaddr *)&srv, sizeof(srv));
+
+    unsigned char trame[PROTO_TRAME_MAX];
+    ssize_t n = recv(sock, trame, sizeof(trame), 0);
+    close(sock);
+    ProtoInfo info;
+    if (n <= 0 || proto_lire(trame, (size_t)n, &msg, &info) < 0) return -1;
+    snprintf(reponse, cap, "%s", msg.texte);
+    return 0;
+}
+
+static void vider(void)
+{
+    unsigned char trame[PROTO_TRAME_MAX];
+    for (int i = 0; i < nb_clients; ++i)
+        while (recv(clients[i].sock, trame, sizeof(trame), MSG_DONTWAIT) > 0)
+            ;
+}
+
+static int par_valeur(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile_us(double p)
+{
+    if (nb_latences == 0) return 0.0;
+    size_t k = (size_t)(p * (double)(nb_latences - 1) + 0.5);
+    return (double)latences[k] / 1000.0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [--clients N] [--emetteurs M] [--debit msg/s] "
+                    "[--duree s] [--taille octets] [--v2] [--groupe nom | --port p] "
+                    "[--serveur ip] [--attente ms] [--trace]\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    double debit = 1000.0, duree = 5.0;
+    int taille = 32, port = 0, attente_ms = 500;
+    const char *groupe = "charge";
+    const char *serveur = "127.0.0.1";
+
+    for (int i = 1; i < argc; ++i) {
+        const char *a = argv[i];
+        if (strcmp(a, "--v2") == 0) { version = PROTO_V2; continue; }
+        if (strcmp(a, "--trace") == 0) { tracer = 1; continue; }
+        if (i + 1 >= argc) usage(argv[0]);
+        const char *v = argv[++i];
+        if (strcmp(a, "--clients") == 0) nb_clients = atoi(v);
+        else if (strcmp(a, "--emetteurs") == 0) nb_emetteurs = atoi(v);
+        else if (strcmp(a, "--debit") == 0) debit = atof(v);
+        else if (strcmp(a, "--duree") == 0) duree = atof(v);
+        else if (strcmp(a, "--taille") == 0) taille = atoi(v);
+        else if (strcmp(a, "--groupe") == 0) groupe = v;
+        else if (strcmp(a, "--port") == 0) port = atoi(v);
+        else if (strcmp(a, "--serveur") == 0) serveur = v;
+        else if (strcmp(a, "--attente") == 0) attente_ms = atoi(v);
+        else usage(argv[0]);
+    }
+    if (nb_clients < 1 || nb_clients > CHARGE_CLIENTS_MAX) {
+        fprintf(stderr, "chargeISY: 1 à %d clients par groupe\n", CHARGE_CLIENTS_MAX);
+        return EXIT_FAILURE;
+    }
+    if (nb_emetteurs < 1 || nb_emetteurs > nb_clients || nb_emetteurs > CHARGE_EMETTEURS_MAX ||
+        debit <= 0 || duree <= 0)
+        usage(argv[0]);
+    /* Le texte tient dans une trame : pas de fragments à réassembler */
+    int taille_max = version == PROTO_V2 ? 1024 : MAX_TEXT - 1;
+    if (taille > taille_max) taille = taille_max;
+
+    /* Groupe : port donné, ou créé/rejoint par le serveur ("OK <port> <id>") */
+    int id = -1;
+    if (port == 0) {
+        char cmd[MAX_TEXT], rep[MAX_TEXT];
+        snprintf(cmd, sizeof(cmd), "CREATE %s", groupe);
+        commande(serveur, cmd, rep, sizeof(rep));
+        snprintf(cmd, sizeof(cmd), "JOIN %s", groupe);
+        if (commande(serveur, cmd, rep, sizeof(rep)) < 0 || sscanf(rep, "OK %d %d", &port, &id) < 1) {
+            fprintf(stderr, "chargeISY: groupe %s introuvable sur %s\n", groupe, serveur);
+            return EXIT_FAILURE;
+        }
+    }
+    struct sockaddr_in addr_grp;
+    fill_sockaddr(&addr_grp, serveur, port);
+    uint16_t id_groupe = id >= 0 ? (uint16_t)id :
+                         port >= GROUP_PORT_BASE ?
+                         (uint16_t)(port - GROUP_PORT_BASE) : PROTO_GROUPE_AUCUN;
+
+    unsigned char trame[PROTO_TRAME_MAX];
+    ISYMessage msg;
+    for (int i = 0; i < nb_clients; ++i) {
+        Client *c = &clients[i];
+        c->sock = create_udp_socket();
+        int rcvbuf = 4 << 20;
+        setsockopt(c->sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+        memset(&c->addr, 0, sizeof(c->addr));
+        c->addr.sin_family = AF_INET;
+        c->addr.sin_addr.s_addr = htonl(CHARGE_BASE_IP + (uint32_t)i);
+        check_fatal(bind(c->sock, (struct sockaddr *)&c->addr, sizeof(c->addr)) < 0, "bind");
+        socklen_t len = sizeof(c->addr);
+        getsockname(c->sock, (struct sockaddr *)&c->addr, &len);
+        snprintf(c->nom, sizeof(c->nom), "charge%02d", i);
+
+        memset(&msg, 0, sizeof(msg));
+        strcpy(msg.ordre, ORDRE_CON);
+        snprintf(msg.emetteur, MAX_USERNAME, "%s", c->nom);
+        snprintf(msg.groupe, MAX_GROUP_NAME, "%s", groupe);
+        /* Pas de rejeu de l'historique : il fausserait le comptage */
+        snprintf(msg.texte, MAX_TEXT, "%d LAST 0", ntohs(c->addr.sin_port));
+        size_t n = proto_ecrire(&msg, version, id_groupe, PROTO_MEMBRE_AUCUN, trame);
+        sendto(c->sock, trame, n, 0, (struct sockaddr *)&addr_grp, sizeof(addr_grp));
+    }
+    usleep(200000);
+    vider();
+
+    latences = malloc(CHARGE_ECHANTILLONS_MAX * sizeof(*latences));
+    check_fatal(!latences, "malloc latences");
+    pthread_t th;
+    check_fatal(pthread_create(&th, NULL, recepteur, NULL) != 0, "pthread_create");
+
+    /* Envoi cadencé sur une échéance absolue : un retard est rattrapé */
+    unsigned long long total = (unsigned long long)(debit * duree);
+    unsigned int numeros[CHARGE_EMETTEURS_MAX] = {0};
+    char texte[1100];
+    uint64_t debut = maintenant_ns();
+    double pas_ns = 1e9 / debit;
+    unsigned long long envoyes = 0, echecs = 0;
+    for (unsigned long long k = 0; k < total; ++k) {
+        uint64_t echeance = debut + (uint64_t)((double)k * pas_ns);
+        if (maintenant_ns() < echeance) {
+            struct timespec ts = { (time_t)(echeance / 1000000000ull),
+                                   (long)(echeance % 1000000000ull) };
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        }
+        int e = (int)(k % (unsigned long long)nb_emetteurs);
+        Client *c = &clients[e];
+        int nb = snprintf(texte, sizeof(texte), "CHG %d %u %llu ", e, numeros[e]++,
+                          (unsigned long long)maintenant_ns());
+        while (nb < taille) texte[nb++] = 'x';
+        texte[nb] = '\0';
+
+        memset(&msg, 0, sizeof(msg));
+        strcpy(msg.ordre, ORDRE_MSG);
+        snprintf(msg.emetteur, MAX_USERNAME, "%s", c->nom);
+        snprintf(msg.groupe, MAX_GROUP_NAME, "%s", groupe);
+        ProtoTrace trace = { trace_maintenant(), 0, 0 };
+        size_t n = proto_ecrire_texte(&msg, texte, (size_t)nb, version, id_groupe,
+                                      PROTO_MEMBRE_AUCUN, trame, sizeof(trame),
+                                      tracer ? &trace : NULL);
+        if (sendto(c->sock, trame, n, 0, (struct sockaddr *)&addr_grp, sizeof(addr_grp)) < 0)
+            echecs++;
+        else
+            envoyes++;
+    }
+    double secondes_envoi = (double)(maintenant_ns() - debut) / 1e9;
+
+    usleep((useconds_t)attente_ms * 1000);
+    atomic_store(&arret, 1);
+    pthread_join(th, NULL);
+    double secondes_total = (double)(maintenant_ns() - debut) / 1e9;
+
+    qsort(latences, nb_latences, sizeof(*latences), par_valeur);
+    unsigned long long attendus = envoyes * (unsigned long long)nb_clients;
+    double perte = attendus ? 1.0 - (double)nb_recus / (double)attendus : 0.0;
+    if (perte < 0) perte = 0;
+
+    printf("{\"version\":%d,\"port\":%d,\"clients\":%d,\"emetteurs\":%d,\"taille\":%d,"
+           "\"debit_cible\":%.1f,\"duree_s\":%.3f,\"envoyes\":%llu,\"echecs_envoi\":%llu,"
+           "\"debit_envoi\":%.1f,\"attendus\":%llu,\"recus\":%llu,\"perte\":%.6f,"
+           "\"desordres\":%llu,\"etrangers\":%llu,\"debit_reception\":%.1f,"
+           "\"latence_us\":{\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,\"p999\":%.1f,"
+           "\"max\":%.1f,\"echantillons\":%zu}}\n",
+           version, port, nb_clients, nb_emetteurs, taille, debit, secondes_envoi,
+           envoyes, echecs, (double)envoyes / secondes_envoi, attendus, nb_recus, perte,
+           nb_desordres, nb_etrangers, (double)nb_recus / secondes_total,
+           percentile_us(0.50), percentile_us(0.90), percentile_us(0.99),
+           percentile_us(0.999), (double)latence_max / 1000.0, nb_latences);
+
+    for (int i = 0; i < nb_clients; ++i) close(clients[i].sock);
+    free(latences);
+    return 0;
+}
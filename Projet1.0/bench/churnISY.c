@@ -0,0 +1,407 @@
+#define _GNU_SOURCE
+#include "../include/Commun.h"
+#include "../include/annuaire.h"
+#include "../include/protocole.h"
+#include <time.h>
+#include <poll.h>
+#include <dirent.h>
+
+/* Benchmark du plan de contrôle : CREATE/JOIN/CHECKBAN/DELETE/MERGE en
+ * rafale contre un ServeurISY local déjà lancé (classique ou moteur).
+ * K voies envoient chacune une commande à la fois, tirée au hasard (graine
+ * fixe) parmi les groupes vivants ; les groupes naissent et meurent donc
+ * pendant toute la mesure. À la fin, les groupes restants sont supprimés
+ * puis on vérifie, via /proc et l'annuaire du serveur, qu'il ne reste ni
+ * GroupeISY, ni zombie, ni segment de métriques, ni fichier infoGroup/.
+ * Code de sortie 2 en cas de fuite.
+ *
+ * Usage: churnISY [--operations N] [--voies K] [--groupes G] [--graine S]
+ *                 [--serveur ip] [--delai ms]
+ */
+
+#define CHURN_VOIES_MAX 64
+#define CHURN_NOM "churn"
+
+enum { C_CREATE, C_JOIN, C_CHECKBAN, C_DELETE, C_MERGE, C_NB };
+
+static const char *const noms_cmd[C_NB] = {
+    "CREATE", "JOIN", "CHECKBAN", "DELETE", "MERGE"
+};
+/* Poids du tirage (CREATE seulement sous le plafond de groupes) */
+static const int poids[C_NB] = { 25, 30, 20, 15, 10 };
+/* Début de la réponse attendue en cas de succès */
+static const char *const succes[C_NB] = {
+    "Groupe ", "OK ", "OK", "Groupe ", "Groupe "
+};
+
+/* Groupes connus du benchmark */
+enum { G_LIBRE, G_OCCUPE, G_VIVANT };
+
+typedef struct {
+    char nom[MAX_GROUP_NAME];
+    int  etat;
+} Groupe;
+
+typedef struct {
+    int sock;
+    int cmd;                       /* -1 : au repos */
+    int g1, g2;                    /* groupes visés */
+    long long depart_ns;
+} Voie;
+
+typedef struct {
+    double *ms;
+    size_t nb, cap;
+    unsigned long echecs, delais;
+} Mesures;
+
+static Groupe *groupes;
+static int nb_groupes_max = 50;
+static Mesures mesures[C_NB];
+static uint64_t alea;
+static unsigned int prochain_nom;
+static struct sockaddr_in addr_srv;
+
+static long long maintenant_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000ll + ts.tv_nsec;
+}
+
+static uint32_t tirer(void)
+{
+    alea ^= alea << 13;
+    alea ^= alea >> 7;
+    alea ^= alea << 17;
+    return (uint32_t)(alea >> 32);
+}
+
+static void noter(Mesures *m, double ms)
+{
+    if (m->nb == m->cap) {
+        m->cap = m->cap ? m->cap * 2 : 1024;
+        m->ms = realloc(m->ms, m->cap * sizeof(*m->ms));
+        check_fatal(!m->ms, "realloc mesures");
+    }
+    m->ms[m->nb++] = ms;
+}
+
+static int compter(int etat)
+{
+    int n = 0;
+    for (int i = 0; i < nb_groupes_max; ++i) n += groupes[i].etat == etat;
+    return n;
+}
+
+/* Groupe au hasard dans l'état demandé, -1 s'il n'y en a pas */
+static int tirer_groupe(int etat, int sauf)
+{
+    int n = compter(etat) - (sauf >= 0 && groupes[sauf].etat == etat);
+    if (n <= 0) return -1;
+    int k = (int)(tirer() % (uint32_t)n);
+    for (int i = 0; i < nb_groupes_max; ++i) {
+        if (groupes[i].etat != etat || i == sauf) continue;
+        if (k-- == 0) return i;
+    }
+    return -1;
+}
+
+static void envoyer(int sock, const char *texte)
+{
+    ISYMessage msg;
+    memset(&msg, 0, sizeof(msg));
+    strcpy(msg.ordre, ORDRE_CMD);
+    snprintf(msg.emetteur, MAX_USERNAME, CHURN_NOM);
+    snprintf(msg.texte, MAX_TEXT, "%s", texte);
+    if (sendto(sock, &msg, PROTO_V1_TAILLE, 0, (struct sockaddr *)&addr_srv, sizeof(addr_srv)) < 0)
+        perror("sendto churn");
+}
+
+/* Choisit et envoie la prochaine commande de la voie ; 0 si rien à faire */
+static int lancer(Voie *v)
+{
+    int vivants = compter(G_VIVANT);
+    int creables = compter(G_VIVANT) + compter(G_OCCUPE) < nb_groupes_max;
+    int total = 0, w[C_NB];
+    for (int c = 0; c < C_NB; ++c) {
+        w[c] = poids[c];
+        if (c == C_CREATE && !creables) w[c] = 0;
+        if (c != C_CREATE && vivants < (c == C_MERGE ? 2 : 1)) w[c] = 0;
+        total += w[c];
+    }
+    if (total == 0) return 0;
+    int r = (int)(tirer() % (uint32_t)total), c = 0;
+    while (r >= w[c]) r -= w[c++];
+
+    char texte[MAX_TEXT];
+    v->cmd = c;
+    v->g1 = v->g2 = -1;
+    if (c == C_CREATE) {
+        v->g1 = tirer_groupe(G_LIBRE, -1);
+        snprintf(groupes[v->g1].nom, MAX_GROUP_NAME, CHURN_NOM "%05u", prochain_nom++);
+        groupes[v->g1].etat = G_OCCUPE;
+        snprintf(texte, sizeof(texte), "CREATE %s", groupes[v->g1].nom);
+    } else {
+        v->g1 = tirer_groupe(G_VIVANT, -1);
+        if (c == C_MERGE) v->g2 = tirer_groupe(G_VIVANT, v->g1);
+        /* Un groupe qui disparaît n'est plus proposé aux autres voies */
+        if (c == C_DELETE || c == C_MERGE) groupes[v->g1].etat = G_OCCUPE;
+        if (c == C_MERGE)
+            snprintf(texte, sizeof(texte), "MERGE %s %s", groupes[v->g1].nom, groupes[v->g2].nom);
+        else
+            snprintf(texte, sizeof(texte), "%s %s", noms_cmd[c], groupes[v->g1].nom);
+    }
+    v->depart_ns = maintenant_ns();
+    envoyer(v->sock, texte);
+    return 1;
+}
+
+static void terminer(Voie *v, const char *reponse)
+{
+    Mesures *m = &mesures[v->cmd];
+    noter(m, (double)(maintenant_ns() - v->depart_ns) / 1e6);
+    int ok = reponse && strncmp(reponse, succes[v->cmd], strlen(succes[v->cmd])) == 0 &&
+             !strstr(reponse, "introuvable") && !strstr(reponse, "existant");
+    if (!reponse) m->delais++;
+    else if (!ok) m->echecs++;
+
+    switch (v->cmd) {
+    case C_CREATE:
+        /* Sans réponse, le groupe existe peut-être : il sera supprimé à la fin */
+        groupes[v->g1].etat = ok || !reponse ? G_VIVANT : G_LIBRE;
+        break;
+    case C_DELETE:
+    case C_MERGE:
+        groupes[v->g1].etat = ok ? G_LIBRE : G_VIVANT;
+        break;
+    default:
+        break;
+    }
+    v->cmd = -1;
+}
+
+/* Réponse du serveur, NULL si illisible */
+static const char *lire_reponse(int sock, ISYMessage *msg)
+{
+    unsigned char trame[PROTO_TRAME_MAX];
+    ProtoInfo info;
+    ssize_t n = recv(sock, trame, sizeof(trame), MSG_DONTWAIT);
+    if (n <= 0 || proto_lire(trame, (size_t)n, msg, &info) < 0) return NULL;
+    return msg->texte;
+}
+
+/* Commande synchrone (nettoyage) */
+static void commande(int sock, const char *texte, int delai_ms)
+{
+    envoyer(sock, texte);
+    struct pollfd p = { sock, POLLIN, 0 };
+    ISYMessage msg;
+    if (poll(&p, 1, delai_ms) > 0) lire_reponse(sock, &msg);
+}
+
+static int par_valeur(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile(const Mesures *m, double p)
+{
+    if (m->nb == 0) return 0.0;
+    return m->ms[(size_t)(p * (double)(m->nb - 1) + 0.5)];
+}
+
+/* Vérifications après coup */
+
+typedef struct {
+    int enfants, zombies, segments, fichiers;
+} Restes;
+
+/* GroupeISY encore dans la réserve du serveur : lancé en "--reserve fd",
+ * il garde son canal ouvert tant qu'aucun groupe ne lui a été confié
+ * (la ligne de commande, elle, reste la même après la remise). */
+static int en_reserve(const char *pid)
+{
+    char chemin[300], ligne[256];
+    snprintf(chemin, sizeof(chemin), "/proc/%s/cmdline", pid);
+    FILE *f = fopen(chemin, "r");
+    if (!f) return 0;
+    size_t n = fread(ligne, 1, sizeof(ligne) - 1, f);
+    fclose(f);
+    ligne[n] = '\0';
+    /* Arguments séparés par des '\0' : programme, "--reserve", fd */
+    const char *arg1 = ligne + strlen(ligne) + 1;
+    if (arg1 >= ligne + n || strcmp(arg1, "--reserve") != 0) return 0;
+    const char *canal = arg1 + strlen(arg1) + 1;
+    if (canal >= ligne + n) return 0;
+    snprintf(chemin, sizeof(chemin), "/proc/%s/fd/%d", pid, atoi(canal));
+    return access(chemin, F_OK) == 0;
+}
+
+static void compter_enfants(pid_t serveur, Restes *r)
+{
+    DIR *d = opendir("/proc");
+    if (!d) return;
+    struct dirent *e;
+    while ((e = readdir(d))) {
+        char chemin[300], ligne[512];
+        if (e->d_name[0] < '0' || e->d_name[0] > '9') continue;
+        snprintf(chemin, sizeof(chemin), "/proc/%s/stat", e->d_name);
+        FILE *f = fopen(chemin, "r");
+        if (!f) continue;
+        size_t n = fread(ligne, 1, sizeof(ligne) - 1, f);
+        fclose(f);
+        ligne[n] = '\0';
+        /* "pid (comm) S ppid ..." : comm peut contenir des espaces */
+        char *fin = strrchr(ligne, ')');
+        char etat;
+        int ppid;
+        if (!fin || sscanf(fin + 1, " %c %d", &etat, &ppid) != 2 || ppid != serveur)
+            continue;
+        if (etat == 'Z') r->zombies++;
+        else if (strstr(ligne, "(GroupeISY)") && !en_reserve(e->d_name)) r->enfants++;
+    }
+    closedir(d);
+}
+
+static void compter_segments(uint32_t capacite, Restes *r)
+{
+    FILE *f = fopen("/proc/sysvipc/shm", "r");
+    if (!f) return;
+    char ligne[512];
+    if (!fgets(ligne, sizeof(ligne), f)) {
+        fclose(f);
+        return;
+    }
+    while (fgets(ligne, sizeof(ligne), f)) {
+        long long key;
+        if (sscanf(ligne, "%lld", &key) == 1 && key >= SHM_GROUP_KEY_BASE &&
+            key < SHM_GROUP_KEY_BASE + (long long)capacite)
+            r->segments++;
+    }
+    fclose(f);
+}
+
+static void compter_fichiers(pid_t serveur, Restes *r)
+{
+    char chemin[64];
+    snprintf(chemin, sizeof(chemin), "/proc/%d/cwd/infoGroup", (int)serveur);
+    DIR *d = opendir(chemin);
+    if (!d) return;
+    struct dirent *e;
+    while ((e = readdir(d)))
+        if (strncmp(e->d_name, CHURN_NOM, strlen(CHURN_NOM)) == 0) r->fichiers++;
+    closedir(d);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [--operations N] [--voies K] [--groupes G] "
+                    "[--graine S] [--serveur ip] [--delai ms]\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    long operations = 2000;
+    int nb_voies = 8, delai_ms = 5000;
+    unsigned long long graine = 42;
+    const char *serveur = "127.0.0.1";
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 >= argc) usage(argv[0]);
+        const char *a = argv[i], *v = argv[++i];
+        if (strcmp(a, "--operations") == 0) operations = atol(v);
+        else if (strcmp(a, "--voies") == 0) nb_voies = atoi(v);
+        else if (strcmp(a, "--groupes") == 0) nb_groupes_max = atoi(v);
+        else if (strcmp(a, "--graine") == 0) graine = strtoull(v, NULL, 0);
+        else if (strcmp(a, "--serveur") == 0) serveur = v;
+        else if (strcmp(a, "--delai") == 0) delai_ms = atoi(v);
+        else usage(argv[0]);
+    }
+    if (operations <= 0 || nb_voies < 1 || nb_voies > CHURN_VOIES_MAX ||
+        nb_groupes_max < 2 || delai_ms <= 0)
+        usage(argv[0]);
+    alea = graine ? graine : 1;
+    fill_sockaddr(&addr_srv, serveur, SERVER_PORT);
+
+    /* L'annuaire donne le pid du serveur, pour les vérifications */
+    const Annuaire *a = annuaire_attacher();
+    if (!a) {
+        fprintf(stderr, "churnISY: annuaire absent (ServeurISY lancé ?)\n");
+        return EXIT_FAILURE;
+    }
+    pid_t pid_serveur = a->pid_serveur;
+    uint32_t capacite = a->capacite;
+    shmdt(a);
+
+    groupes = calloc((size_t)nb_groupes_max, sizeof(*groupes));
+    check_fatal(!groupes, "calloc groupes");
+    Voie voies[CHURN_VOIES_MAX];
+    struct pollfd pfds[CHURN_VOIES_MAX];
+    for (int i = 0; i < nb_voies; ++i) {
+        voies[i].sock = create_udp_socket();
+        voies[i].cmd = -1;
+        pfds[i].fd = voies[i].sock;
+        pfds[i].events = POLLIN;
+    }
+
+    long lancees = 0, finies = 0;
+    long long debut = maintenant_ns();
+    while (finies < lancees || lancees < operations) {
+        for (int i = 0; i < nb_voies && lancees < operations; ++i)
+            if (voies[i].cmd < 0 && lancer(&voies[i])) lancees++;
+
+        int r = poll(pfds, (nfds_t)nb_voies, 100);
+        long long t = maintenant_ns();
+        for (int i = 0; i < nb_voies; ++i) {
+            Voie *v = &voies[i];
+            if (v->cmd < 0) continue;
+            ISYMessage msg;
+            const char *rep = r > 0 && (pfds[i].revents & POLLIN) ?
+                              lire_reponse(v->sock, &msg) : NULL;
+            if (rep || t - v->depart_ns > (long long)delai_ms * 1000000) {
+                terminer(v, rep);
+                finies++;
+            }
+        }
+    }
+    double secondes = (double)(maintenant_ns() - debut) / 1e9;
+
+    printf("%-9s %7s %7s %7s %9s %9s %9s %9s\n",
+           "commande", "nb", "echecs", "delais", "p50_ms", "p90_ms", "p99_ms", "max_ms");
+    for (int c = 0; c < C_NB; ++c) {
+        Mesures *m = &mesures[c];
+        qsort(m->ms, m->nb, sizeof(*m->ms), par_valeur);
+        printf("%-9s %7zu %7lu %7lu %9.3f %9.3f %9.3f %9.3f\n", noms_cmd[c], m->nb,
+               m->echecs, m->delais, percentile(m, 0.50), percentile(m, 0.90),
+               percentile(m, 0.99), m->nb ? m->ms[m->nb - 1] : 0.0);
+    }
+    printf("debit: %.1f commandes/s (%ld en %.2f s, %d voies, %d groupes max)\n",
+           (double)finies / secondes, finies, secondes, nb_voies, nb_groupes_max);
+
+    /* Nettoyage, puis le serveur a quelques secondes pour récupérer ses fils */
+    for (int i = 0; i < nb_groupes_max; ++i) {
+        if (groupes[i].etat == G_LIBRE) continue;
+        char texte[MAX_TEXT];
+        snprintf(texte, sizeof(texte), "DELETE %s", groupes[i].nom);
+        commande(voies[0].sock, texte, delai_ms);
+    }
+    Restes restes;
+    for (int essai = 0; essai < 50; ++essai) {
+        memset(&restes, 0, sizeof(restes));
+        compter_enfants(pid_serveur, &restes);
+        compter_segments(capacite, &restes);
+        compter_fichiers(pid_serveur, &restes);
+        if (!restes.enfants && !restes.zombies && !restes.segments && !restes.fichiers)
+            break;
+        usleep(100000);
+    }
+    printf("restes: %d GroupeISY, %d zombies, %d segments, %d fichiers\n",
+           restes.enfants, restes.zombies, restes.segments, restes.fichiers);
+
+    for (int i = 0; i < nb_voies; ++i) close(voies[i].sock);
+    for (int c = 0; c < C_NB; ++c) free(mesures[c].ms);
+    free(groupes);
+    return restes.enfants || restes.zombies || restes.segments || restes.fichiers ? 2 : 0;
+}
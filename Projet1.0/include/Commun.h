@@ -19,15 +19,17 @@
 #include <arpa/inet.h>
 #include <signal.h>
 
+#include "bannis.h"
+#include "trace.h"
+
 /* Paramètres généraux */
 
 #define SERVER_PORT       8000       
 #define GROUP_PORT_BASE   8100        
-#define MAX_GROUPS        10
 #define MAX_GROUP_NAME    32
 #define MAX_USERNAME      20
 #define MAX_TEXT          100
-#define MAX_CLIENTS_GROUP 16
+#define MAX_CLIENTS_GROUP 16384      /* membres par groupe */
 #define MAX_EMOJI         8           
 
 #define SHM_CLIENT_KEY    0x1234     
@@ -40,6 +42,17 @@
 #define ORDRE_MSG "MES"   
 /* Ordre de gestion envoyé par le serveur au groupe (ex: MIGRATE) */
 #define ORDRE_MGR "MGR"
+/* Demande de retransmission "premier dernier" d'un affichage à son groupe ;
+ * en réponse, le groupe signale ainsi les messages sortis de son historique */
+#define ORDRE_NAK "NAK"
+/* Table des membres d'un groupe (protocole v2 seulement, voir protocole.h) */
+#define ORDRE_MBR "MBR"
+/* Fragment d'un message v2 plus long qu'un datagramme (voir fragment.h) */
+#define ORDRE_FRG "FRG"
+/* Passage d'un affichage v2 à la diffusion multicast du groupe (groupe.h) */
+#define ORDRE_MCA "MCA"
+/* Inscription et suivi des relais de diffusion d'un groupe (relais.h) */
+#define ORDRE_RLY "RLY"
 
 /* Structure de message réseau (énoncé) */
 typedef struct {
@@ -48,8 +61,18 @@ typedef struct {
     char emoji[MAX_EMOJI];         
     char groupe[MAX_GROUP_NAME];   
     char texte[MAX_TEXT];         
+    uint32_t seq;                  /* numéro dans l'historique du groupe, 0 sinon ;
+                                      hors de la trame v1 de l'énoncé, voir
+                                      PROTO_V1_TAILLE */
 } ISYMessage;
 
+/* Cycle de vie du processus GroupeISY d'un slot */
+#define PROC_LIBRE      0
+#define PROC_DEMARRAGE  1          /* fork fait, attente du signal "prêt" */
+#define PROC_ACTIF      2
+#define PROC_MIGRATION  3          /* MIGRATE envoyé, attente de l'acquittement */
+#define PROC_ARRET      4          /* SIGTERM envoyé, attente de la fin du fils */
+
 /* Description d’un groupe côté serveur */
 typedef struct {
     int  actif;
@@ -57,8 +80,16 @@ typedef struct {
     char moderateur[MAX_USERNAME];
     int  port_groupe;              
     key_t shm_key;                 
-    int   shm_id;
+    int   shm_id;                  /* -1 : pas de segment */
     pid_t pid;                     
+    int   etat;                    /* PROC_* */
+    int   pidfd;                   /* -1 si absent */
+    int   fd_pret;                 /* tube "prêt" du fils, -1 si absent */
+    long long echeance_ms;         /* délai de l'état courant, 0 si aucun */
+    int   supprimer_fichiers;      /* effacer infoGroup/<nom>* à la fin du fils */
+    struct sockaddr_in demandeur;  /* client à qui répondre au CREATE */
+    int   version_demandeur;       /* version du protocole de sa requête */
+    BanIndex bannis;               /* copie de l'index du groupe, pour CHECKBAN */
 } GroupeInfo;
 
 
@@ -67,13 +98,16 @@ typedef struct {
     char notify[MAX_TEXT];         
     int  notify_flag;             
     char sound_name[256];          
+    int  ecoute;                       /* l'affichage a lié sa socket */
+    char hist_groupe[MAX_GROUP_NAME];  /* groupe du dernier message numéroté */
+    uint32_t hist_seq;                 /* son numéro : reprise par "CON port AFTER n" */
+    unsigned int nb_trous;             /* ruptures de séquence détectées */
+    unsigned int nb_nacks;             /* NAK envoyés au groupe */
+    unsigned int nb_perdus;            /* messages abandonnés après les relances */
+    unsigned int nb_doublons;          /* messages reçus deux fois (ignorés) */
+    uint64_t trace[TRACE_NB][TRACE_CLASSES];  /* messages tracés, par étape */
 } ClientDisplayShm;
 
-typedef struct {
-    int nb_messages;
-    int nb_clients;
-} GroupStats;
-
 /* Fonctions utilitaires communes */
 
 static inline void check_fatal(int cond, const char *msg)
@@ -102,97 +136,50 @@ static inline void fill_sockaddr(struct sockaddr_in *addr,
                             inet_addr(ip);
 }
 
+/* Emojis attribués aux utilisateurs : U+1F600 à U+1F62F (48 emojis),
+ * encodés en UTF-8 une fois pour toutes. EMOJIS[0] (😀) sert de défaut. */
+#define NB_EMOJIS 48
+static const char EMOJIS[NB_EMOJIS][5] = {
+    "\xF0\x9F\x98\x80", "\xF0\x9F\x98\x81", "\xF0\x9F\x98\x82", "\xF0\x9F\x98\x83",
+    "\xF0\x9F\x98\x84", "\xF0\x9F\x98\x85", "\xF0\x9F\x98\x86", "\xF0\x9F\x98\x87",
+    "\xF0\x9F\x98\x88", "\xF0\x9F\x98\x89", "\xF0\x9F\x98\x8A", "\xF0\x9F\x98\x8B",
+    "\xF0\x9F\x98\x8C", "\xF0\x9F\x98\x8D", "\xF0\x9F\x98\x8E", "\xF0\x9F\x98\x8F",
+    "\xF0\x9F\x98\x90", "\xF0\x9F\x98\x91", "\xF0\x9F\x98\x92", "\xF0\x9F\x98\x93",
+    "\xF0\x9F\x98\x94", "\xF0\x9F\x98\x95", "\xF0\x9F\x98\x96", "\xF0\x9F\x98\x97",
+    "\xF0\x9F\x98\x98", "\xF0\x9F\x98\x99", "\xF0\x9F\x98\x9A", "\xF0\x9F\x98\x9B",
+    "\xF0\x9F\x98\x9C", "\xF0\x9F\x98\x9D", "\xF0\x9F\x98\x9E", "\xF0\x9F\x98\x9F",
+    "\xF0\x9F\x98\xA0", "\xF0\x9F\x98\xA1", "\xF0\x9F\x98\xA2", "\xF0\x9F\x98\xA3",
+    "\xF0\x9F\x98\xA4", "\xF0\x9F\x98\xA5", "\xF0\x9F\x98\xA6", "\xF0\x9F\x98\xA7",
+    "\xF0\x9F\x98\xA8", "\xF0\x9F\x98\xA9", "\xF0\x9F\x98\xAA", "\xF0\x9F\x98\xAB",
+    "\xF0\x9F\x98\xAC", "\xF0\x9F\x98\xAD", "\xF0\x9F\x98\xAE", "\xF0\x9F\x98\xAF",
+};
+
+/* Emoji de "SERVER" : EMOJIS[hache_texte("SERVER") % NB_EMOJIS] (😃) */
+#define EMOJI_SERVEUR EMOJIS[3]
+
+/* Hache des noms et des IP : choix de l'emoji, filtre des recherches par nom */
+static inline unsigned int hache_texte(const char *texte)
+{
+    unsigned int hash = 0;
+    for (const unsigned char *p = (const unsigned char *)texte; *p; ++p)
+        hash = (hash * 31u) + *p;
+    return hash;
+}
+
 /* Retourne un emoji Unicode basé sur le nom d'utilisateur.
- * Utilise la plage U+1F600 à U+1F64F (48 emojis).
  * Permet d'obtenir un emoji déterministe pour chaque nom.
  */
 static inline void choose_emoji_from_username(const char *username, char *emoji_buf)
 {
-    if (!username || username[0] == '\0') {
-        strcpy(emoji_buf, "😀");  
-        return;
-    }
-
-    /* Calcul du hash du nom d'utilisateur */
-    size_t n = strlen(username);
-    unsigned int hash = 0;
-    for (size_t i = 0; i < n; ++i) {
-        hash = (hash * 31u) + (unsigned char)username[i];
-    }
-
-    /* Sélectionner un emoji dans la plage U+1F600 à U+1F64F (48 emojis) */
-    int emoji_index = hash % 48;
-    unsigned int codepoint = 0x1F600 + emoji_index;
-
-    /* Encoder le codepoint en UTF-8 */
-    if (codepoint <= 0x7F) {
-        /* 1 byte */
-        emoji_buf[0] = (char)codepoint;
-        emoji_buf[1] = '\0';
-    } else if (codepoint <= 0x7FF) {
-        /* 2 bytes */
-        emoji_buf[0] = (char)(0xC0 | (codepoint >> 6));
-        emoji_buf[1] = (char)(0x80 | (codepoint & 0x3F));
-        emoji_buf[2] = '\0';
-    } else if (codepoint <= 0xFFFF) {
-        /* 3 bytes */
-        emoji_buf[0] = (char)(0xE0 | (codepoint >> 12));
-        emoji_buf[1] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
-        emoji_buf[2] = (char)(0x80 | (codepoint & 0x3F));
-        emoji_buf[3] = '\0';
-    } else {
-        /* 4 bytes (for emojis) */
-        emoji_buf[0] = (char)(0xF0 | (codepoint >> 18));
-        emoji_buf[1] = (char)(0x80 | ((codepoint >> 12) & 0x3F));
-        emoji_buf[2] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
-        emoji_buf[3] = (char)(0x80 | (codepoint & 0x3F));
-        emoji_buf[4] = '\0';
-    }
+    unsigned int i = username ? hache_texte(username) % NB_EMOJIS : 0;
+    memcpy(emoji_buf, EMOJIS[i], sizeof(EMOJIS[i]));
 }
 
 /* Choose emoji based on IP address (deterministic, same IP always gets same emoji) */
 static inline void choose_emoji_from_ip(const char *ip_str, char *emoji_buf)
 {
-    if (!ip_str || ip_str[0] == '\0') {
-        strcpy(emoji_buf, "😀");  
-        return;
-    }
-
-    /* Calcul du hash de l'IP */
-    size_t n = strlen(ip_str);
-    unsigned int hash = 0;
-    for (size_t i = 0; i < n; ++i) {
-        hash = (hash * 31u) + (unsigned char)ip_str[i];
-    }
-
-    /* Sélectionner un emoji dans la plage U+1F600 à U+1F64F (48 emojis) */
-    int emoji_index = hash % 48;
-    unsigned int codepoint = 0x1F600 + emoji_index;
-
-    /* Encoder le codepoint en UTF-8 */
-    if (codepoint <= 0x7F) {
-        /* 1 byte */
-        emoji_buf[0] = (char)codepoint;
-        emoji_buf[1] = '\0';
-    } else if (codepoint <= 0x7FF) {
-        /* 2 bytes */
-        emoji_buf[0] = (char)(0xC0 | (codepoint >> 6));
-        emoji_buf[1] = (char)(0x80 | (codepoint & 0x3F));
-        emoji_buf[2] = '\0';
-    } else if (codepoint <= 0xFFFF) {
-        /* 3 bytes */
-        emoji_buf[0] = (char)(0xE0 | (codepoint >> 12));
-        emoji_buf[1] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
-        emoji_buf[2] = (char)(0x80 | (codepoint & 0x3F));
-        emoji_buf[3] = '\0';
-    } else {
-        /* 4 bytes (for emojis) */
-        emoji_buf[0] = (char)(0xF0 | (codepoint >> 18));
-        emoji_buf[1] = (char)(0x80 | ((codepoint >> 12) & 0x3F));
-        emoji_buf[2] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
-        emoji_buf[3] = (char)(0x80 | (codepoint & 0x3F));
-        emoji_buf[4] = '\0';
-    }
+    unsigned int i = ip_str ? hache_texte(ip_str) % NB_EMOJIS : 0;
+    memcpy(emoji_buf, EMOJIS[i], sizeof(EMOJIS[i]));
 }
 
 #endif 
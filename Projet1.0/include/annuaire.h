@@ -0,0 +1,55 @@
+#ifndef ANNUAIRE_H
+#define ANNUAIRE_H
+
+#include "Commun.h"
+#include <stdatomic.h>
+#include <stdint.h>
+
+/* Annuaire des groupes : copie du registre du serveur publiée dans un
+ * segment SysV (SHM_ANNUAIRE_KEY) pour les observateurs comme isytop.
+ * Une case par slot ; le serveur, seul écrivain, la met à jour à chaque
+ * changement d'état du groupe. Chaque case est protégée par un compteur de
+ * séquence (impair pendant l'écriture) : un lecteur relit la case si elle a
+ * changé pendant sa copie, sans jamais bloquer le serveur.
+ */
+
+#define SHM_ANNUAIRE_KEY  0x1FFF
+#define ANNUAIRE_MAGIC    0x41595349u   /* "ISYA" */
+#define ANNUAIRE_VERSION  1
+
+typedef struct {
+    _Atomic uint32_t seq;
+    int32_t pid;                   /* GroupeISY, ou le serveur (moteur) */
+    int32_t etat;                  /* PROC_*, PROC_LIBRE : case vide */
+    int32_t port;
+    int32_t shm_key;               /* métriques du groupe, 0 : aucune (moteur) */
+    char    nom[MAX_GROUP_NAME];
+} AnnuaireEntree;
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t taille_entree;        /* sizeof(AnnuaireEntree) */
+    int32_t  pid_serveur;
+    uint32_t capacite;
+    _Atomic uint32_t etendue;      /* cases [0, etendue) déjà utilisées */
+    AnnuaireEntree groupes[];
+} Annuaire;
+
+/* Serveur : crée (ou recrée) le segment pour 'capacite' slots */
+int  annuaire_creer(int capacite);
+
+/* Serveur : publie l'état d'un slot du registre */
+void annuaire_publier(int slot, const GroupeInfo *gi);
+
+/* Serveur : détache et supprime le segment */
+void annuaire_detruire(void);
+
+/* Observateur : attache l'annuaire en lecture seule, NULL s'il est absent
+ * ou d'une autre version */
+const Annuaire *annuaire_attacher(void);
+
+/* Observateur : copie cohérente de la case ; 1 si le slot est occupé */
+int  annuaire_lire(const Annuaire *a, int slot, AnnuaireEntree *copie);
+
+#endif
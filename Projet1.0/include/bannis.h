@@ -0,0 +1,45 @@
+#ifndef BANNIS_H
+#define BANNIS_H
+
+#include <stdint.h>
+
+/* Index des adresses bannies d'un groupe : trie binaire sur les bits de
+ * l'adresse IPv4 (ordre hôte). Un noeud marqué banni couvre tout son
+ * sous-arbre, ce qui donne les plages CIDR ; une recherche parcourt au plus
+ * 32 noeuds, sans aucun accès fichier.
+ */
+
+typedef struct {
+    uint32_t fils[2];              /* index des fils, 0 : absent (0 = racine) */
+    uint8_t  banni;
+} BanNoeud;
+
+typedef struct {
+    BanNoeud *noeuds;              /* noeuds[0] est la racine */
+    uint32_t  nb;
+    uint32_t  cap;
+    uint32_t  nb_entrees;          /* préfixes insérés */
+} BanIndex;
+
+/* Index vide (aucune allocation avant le premier ajout) */
+void bannis_init(BanIndex *b);
+
+void bannis_liberer(BanIndex *b);
+
+/* Lit "a.b.c.d" ou "a.b.c.d/n" : 0 si OK, -1 si invalide.
+ * Les bits hors préfixe sont mis à zéro.
+ */
+int  bannis_parser(const char *texte, uint32_t *reseau, int *longueur);
+
+/* Bannit le préfixe reseau/longueur (0..32). 0 si OK, -1 si mémoire épuisée */
+int  bannis_ajouter(BanIndex *b, uint32_t reseau, int longueur);
+
+/* 1 si l'adresse (ordre hôte) est couverte par un préfixe banni */
+int  bannis_contient(const BanIndex *b, uint32_t ip);
+
+/* Appelle f pour chaque préfixe banni (ceux couverts par un préfixe plus
+ * court n'y sont pas) */
+void bannis_parcourir(const BanIndex *b,
+                      void (*f)(void *arg, uint32_t reseau, int longueur), void *arg);
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef ENVOI_H
+#define ENVOI_H
+
+#include "Commun.h"
+#include <sys/uio.h>
+
+/* Envoi groupé de datagrammes (fan-out) avec sendmmsg (nécessite _GNU_SOURCE).
+ * On accumule les destinataires dans un lot puis on les envoie en un ou
+ * quelques appels système au lieu d'un sendto par destinataire.
+ */
+
+#define ENVOI_LOT_MAX 256   /* datagrammes par appel sendmmsg */
+
+typedef struct {
+    int sock;
+    int n;
+    struct mmsghdr     hdrs[ENVOI_LOT_MAX];
+    struct iovec       iovs[ENVOI_LOT_MAX];
+    struct sockaddr_in dests[ENVOI_LOT_MAX];
+    unsigned int      *echecs[ENVOI_LOT_MAX];  /* compteur du destinataire, ou NULL */
+    unsigned long nb_appels;                   /* appels système effectués */
+    unsigned long nb_envoyes;
+    unsigned long nb_octets;                   /* octets des datagrammes envoyés */
+    unsigned long nb_echecs;
+} EnvoiLot;
+
+/* Prépare un lot vide pour la socket donnée (les compteurs sont remis à 0) */
+void envoi_init(EnvoiLot *lot, int sock);
+
+/* Ajoute un datagramme au lot. 'buf' doit rester valide jusqu'au prochain
+ * envoi_flush ; le lot est envoyé automatiquement lorsqu'il est plein.
+ * 'echecs' (optionnel) est incrémenté si l'envoi vers ce destinataire échoue.
+ */
+void envoi_ajouter(EnvoiLot *lot, const void *buf, size_t len,
+                   const struct sockaddr_in *dest, unsigned int *echecs);
+
+/* Envoie tout le lot ; renvoie le nombre de datagrammes en échec */
+int envoi_flush(EnvoiLot *lot);
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef FRAGMENT_H
+#define FRAGMENT_H
+
+#include "Commun.h"
+#include "protocole.h"
+#include <stdint.h>
+
+/* Fragmentation des trames v2 plus longues qu'un datagramme.
+ * La trame complète (entête v2 compris) est découpée en morceaux de
+ * FRAGMENT_CHARGE octets ; chacun part dans une trame OP_FRAGMENT dont la
+ * charge commence par un FragmentEntete. Le destinataire recopie chaque
+ * morceau à sa place dans un slab préalloué : une fois complet, le slab
+ * contient la trame d'origine, décodée sur place (ProtoInfo.charge pointe
+ * dans le slab) puis rendu au réassembleur.
+ * Les slabs sont de taille fixe (message_max) et en nombre limité
+ * (memoire / message_max) ; un réassemblage incomplet au bout de
+ * FRAGMENT_DELAI_MS libère sa place au premier message qui en manque.
+ */
+
+typedef struct {
+    uint32_t id;                   /* message, propre à l'émetteur */
+    uint16_t index;                /* 0 .. nombre-1 */
+    uint16_t nombre;               /* fragments du message */
+    uint32_t total;                /* octets de la trame complète */
+} FragmentEntete;                  /* ordre réseau */
+
+#define FRAGMENT_CHARGE   (PROTO_TRAME_MAX - sizeof(ProtoEntete) - sizeof(FragmentEntete))
+#define FRAGMENT_NB_MAX   ((PROTO_MESSAGE_MAX + FRAGMENT_CHARGE - 1) / FRAGMENT_CHARGE)
+#define FRAGMENT_DELAI_MS 2000
+#define FRAGMENT_MEMOIRE_DEFAUT (4 * PROTO_MESSAGE_MAX)   /* par réassembleur */
+
+typedef struct {
+    struct sockaddr_in src;
+    uint32_t id;
+    uint32_t total;
+    uint16_t nombre;
+    uint16_t recus;
+    uint64_t vus;                  /* bit i : fragment i reçu */
+    long long debut_ms;
+    int etat;                      /* libre, en cours, prêté */
+} Reassemblage;
+
+typedef struct {
+    unsigned char *zone;           /* nb_slabs * taille_slab, NULL avant le
+                                      premier fragment */
+    Reassemblage *slabs;
+    int nb_slabs;
+    size_t taille_slab;            /* message_max au moment de l'init */
+    int nb_complets;               /* messages réassemblés */
+    int nb_perdus;                 /* expirés ou refusés faute de place */
+} Reassembleur;
+
+/* Taille maximale d'une trame v2 (bornée à PROTO_MESSAGE_MAX) et mémoire
+ * de chaque réassembleur initialisé ensuite */
+void   fragment_configurer(size_t message_max, size_t memoire);
+size_t fragment_message_max(void);
+
+/* Nombre de fragments d'une trame de n octets (1 : pas de fragmentation) */
+int    fragment_nombre(size_t n);
+
+/* Écrit le fragment k de 'trame' (n octets) dans 'out' (PROTO_TRAME_MAX
+ * octets). Renvoie la taille du datagramme. */
+size_t fragment_ecrire(const void *trame, size_t n, uint32_t id, uint16_t groupe,
+                       int k, void *out);
+
+/* Aucune allocation ici : la zone des slabs est réservée d'un bloc au
+ * premier fragment reçu */
+void   reassembleur_init(Reassembleur *r);
+void   reassembleur_liberer(Reassembleur *r);
+
+/* Range un fragment (trame OP_FRAGMENT décodée) venu de 'src'. Quand il
+ * complète son message, *trame et *len désignent la trame d'origine dans
+ * le slab et l'indice du slab est renvoyé ; -1 sinon (fragment en attente,
+ * doublon ou refusé). Le slab reste réservé jusqu'à reassembleur_rendre. */
+int    reassembleur_ajouter(Reassembleur *r, const ProtoInfo *info,
+                            const struct sockaddr_in *src,
+                            const unsigned char **trame, size_t *len);
+
+void   reassembleur_rendre(Reassembleur *r, int slab);
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef GROUPE_H
+#define GROUPE_H
+
+#include "Commun.h"
+#include "bannis.h"
+#include "journal.h"
+#include "historique.h"
+#include "protocole.h"
+#include "fragment.h"
+#include "metriques.h"
+#include "membres.h"
+#include "relais.h"
+
+/* Relais inscrit auprès d'un groupe ; ses changements de tranche sont
+ * accumulés pendant le lot et partent avant la diffusion suivante */
+typedef struct {
+    int actif;
+    struct sockaddr_in addr;
+    int nb_membres;                  /* taille de sa tranche */
+    long long vu_ms;                 /* dernier ordre reçu (CLOCK_MONOTONIC) */
+    uint32_t seq;                    /* numéro de la dernière MAJ envoyée */
+    int reinit;                      /* la prochaine MAJ vide la tranche */
+    size_t nb_maj;
+    char maj[RELAIS_MAJ_MAX];        /* entrées pas encore envoyées */
+} GroupeRelais;
+
+/* Membres servis en unicast, publiés pour le fan-out d'un groupe partagé */
+typedef struct GroupeInstantane GroupeInstantane;
+
+/* Etat d'un groupe de discussion.
+ * Utilisé tel quel par GroupeISY (un groupe par processus) et par le moteur
+ * multi-groupes de ServeurISY (plusieurs milliers de groupes par processus).
+ */
+typedef struct {
+    uint16_t id;                     /* identifiant v2 : port - GROUP_PORT_BASE */
+    char nom[MAX_GROUP_NAME];
+    char moderateur[MAX_USERNAME];
+    int  sock;                       /* socket UDP sur laquelle le groupe écoute */
+    GroupStats *stats;               /* SHM du groupe ou stats_locales */
+    GroupStats stats_locales;
+    JournalGroupe *journal;          /* NULL : membres non persistés */
+    BanIndex bannis;                 /* adresses et plages bannies */
+    Historique historique;           /* derniers messages, rejoués au CON ;
+                                        projection de --historique messages */
+    Reassembleur reassemblage;       /* messages fragmentés en cours ; slabs
+                                        alloués au premier fragment, inutilisé
+                                        sur le port partagé du moteur */
+    uint32_t prochain_fragment;      /* id du prochain message fragmenté */
+    TableMembres membres;
+    struct sockaddr_in multicast;    /* adresse de diffusion, sin_family 0 :
+                                        unicast seulement */
+    int nb_multicast;                /* membres SERVICE_MULTICAST */
+    GroupeRelais *relais;            /* alloué à la première inscription */
+    int nb_relais;                   /* cases utilisées, actives ou non */
+    int relais_en_attente;           /* un relais a des entrées non envoyées */
+    int partage;                     /* traité par plusieurs threads (groupe_partager) */
+    GroupeInstantane *instantane;    /* dernier publié, NULL : pas encore */
+} GroupeEtat;
+
+#define MULTICAST_PORT_DEFAUT 8400
+
+/* Diffusion multicast, désactivée par défaut. Le groupe d'id n reçoit
+ * l'adresse base + n et le port de 'spec' ("239.255.81.0" ou
+ * "239.255.81.0:8400") ; 'interface' est l'adresse locale de l'interface
+ * d'émission (NULL : celle de la table de routage, "127.0.0.1" pour la
+ * boucle locale). Un affichage v2 rejoint l'adresse après son CON et ne
+ * reçoit plus qu'une copie par diffusion ; les autres membres restent
+ * servis en unicast. À appeler avant groupe_init ; -1 si une adresse est
+ * invalide. */
+int  groupe_configurer_multicast(const char *spec, const char *interface);
+
+/* Prépare à l'émission multicast une socket partagée par plusieurs groupes
+ * (port partagé du moteur) ; 0 sans multicast configuré, -1 en cas d'échec */
+int  groupe_preparer_socket(int sock);
+
+/* Initialise l'état d'un groupe (les stats pointent sur stats_locales) */
+void groupe_init(GroupeEtat *g, int id, const char *nom, const char *moderateur, int sock);
+
+/* Recharge membres et bannis (infoGroup/<nom>.snap puis <nom>.journal),
+ * ouvre le journal si l'écrivain tourne et projette l'historique */
+void groupe_charger(GroupeEtat *g);
+
+/* Envoie au serveur un avis BANNED par préfixe banni chargé, qui remplit
+ * son index pour CHECKBAN. À appeler une fois la socket liée. */
+void groupe_annoncer_bannis(GroupeEtat *g);
+
+/* Ferme le journal (écritures en attente terminées) et libère le groupe */
+void groupe_liberer(GroupeEtat *g);
+
+/* Traite un paquet décodé (v1 ou v2) reçu sur la socket du groupe. Les
+ * réponses partent dans la version du paquet, les diffusions dans celle de
+ * chaque membre. Elles sont mises en lot : appeler groupe_fin_lot() après
+ * chaque lot de paquets.
+ */
+void groupe_traiter(GroupeEtat *g, ISYMessage *msg, const ProtoInfo *info,
+                    const struct sockaddr_in *src);
+
+/* Envoie les messages en attente (sendmmsg) */
+void groupe_fin_lot(GroupeEtat *g);
+
+#define GROUPE_WORKERS_MAX 64
+
+/* Groupe traité par plusieurs threads, chacun sous un même verrou
+ * (GroupeISY --workers). Le fan-out unicast d'une diffusion ne lit plus la
+ * table des membres mais un instantané immuable, republié quand la table
+ * change et libéré par son dernier lecteur : groupe_fin_lot garde alors
+ * les envois du lot, que groupe_diffuser fait après le verrou, en
+ * parallèle des autres threads. */
+void groupe_partager(GroupeEtat *g);
+
+/* Envoie ce que groupe_fin_lot a laissé à un groupe partagé ; à appeler
+ * sans le verrou, par le même thread */
+void groupe_diffuser(GroupeEtat *g);
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef HISTORIQUE_H
+#define HISTORIQUE_H
+
+#include "Commun.h"
+#include <stdint.h>
+
+/* Historique des messages d'un groupe : anneau de ISYMessage projeté en
+ * mémoire (infoGroup/<nom>.hist, mmap partagé). Chaque message de
+ * discussion reçoit un numéro de séquence croissant (1, 2, ...) ; le message
+ * n est rangé dans la case n % capacite. Le noyau écrit les pages modifiées :
+ * l'historique survit à un redémarrage du groupe sans écriture explicite.
+ */
+
+#define HISTORIQUE_MAGIC        0x48595349u   /* "ISYH" */
+#define HISTORIQUE_VERSION      1
+#define HISTORIQUE_DEFAUT       256   /* messages conservés par groupe */
+#define HISTORIQUE_REJEU_DEFAUT 20    /* CON sans précision : derniers messages */
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t taille_message;       /* sizeof(ISYMessage), garde-fou */
+    uint32_t capacite;
+    uint32_t prochain;             /* numéro du prochain message */
+} HistoriqueEntete;                /* suivi de capacite ISYMessage */
+
+typedef struct {
+    HistoriqueEntete *entete;      /* NULL : pas d'historique */
+    ISYMessage *messages;
+    size_t taille;                 /* octets projetés */
+} Historique;
+
+/* Capacité des anneaux ouverts ensuite (0 : pas d'historique) */
+void historique_configurer(int capacite);
+
+/* Projette l'historique du groupe, créé vide s'il n'existe pas ou si sa
+ * capacité a changé. 0 si OK, -1 sinon (h reste sans historique). */
+int  historique_ouvrir(Historique *h, const char *nom_groupe);
+
+void historique_fermer(Historique *h);
+
+/* Numérote le message (msg->seq) et le range dans l'anneau.
+ * Renvoie le numéro attribué, 0 sans historique. */
+uint32_t historique_ajouter(Historique *h, ISYMessage *msg);
+
+/* Messages encore présents de numéro > apres, au plus 'max' (les plus
+ * récents). Renvoie leur nombre et le premier numéro dans *premier.
+ * Un 'apres' au-delà du dernier numéro (historique recréé depuis) vaut 0. */
+int  historique_apres(const Historique *h, uint32_t apres, int max, uint32_t *premier);
+
+/* Numéro du dernier message rangé, 0 si aucun */
+uint32_t historique_dernier(const Historique *h);
+
+/* Message de numéro seq (présent d'après historique_apres) */
+const ISYMessage *historique_message(const Historique *h, uint32_t seq);
+
+#endif
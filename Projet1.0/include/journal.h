@@ -0,0 +1,106 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "Commun.h"
+#include "metriques.h"
+#include <stdint.h>
+
+/* Persistance d'un groupe : membres et bannis.
+ * - infoGroup/<nom>.snap : instantané binaire versionné (entête puis
+ *   enregistrements de taille fixe), projeté en mémoire par mmap au
+ *   chargement ; aucun texte à analyser.
+ * - infoGroup/<nom>.journal : enregistrements binaires de taille fixe ajoutés
+ *   depuis le dernier instantané.
+ * Un thread écrivain unique par processus ajoute les enregistrements au
+ * journal : le fil de réception ne fait qu'une copie en mémoire. L'écrivain
+ * regroupe ce qui s'est accumulé pendant son écriture précédente (group
+ * commit), fait un fsync tous les N commits et réécrit régulièrement
+ * l'instantané (compactage).
+ */
+
+#define JOURNAL_MAGIC              0x53595349u   /* "ISYS" */
+#define JOURNAL_VERSION            1
+#define JOURNAL_FSYNC_DEFAUT       1     /* fsync à chaque commit */
+#define JOURNAL_COMPACTAGE_DEFAUT  256   /* enregistrements avant compactage */
+#define JOURNAL_FD_MAX             256   /* journaux gardés ouverts ; au-delà,
+                                            ouverts le temps d'une écriture */
+
+/* Enregistrements sur disque (ordre des octets de la machine) */
+typedef struct {
+    uint32_t ip;                   /* ordre réseau, comme sin_addr */
+    char nom[MAX_USERNAME];
+    char emoji[MAX_EMOJI];
+} JournalMembre;
+
+typedef struct {
+    uint32_t reseau;               /* ordre hôte, bits hors préfixe à 0 */
+    uint32_t longueur;
+} JournalBan;
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t taille_membre;        /* sizeof(JournalMembre), garde-fou */
+    uint32_t nb_membres;
+    uint32_t nb_bannis;
+} JournalEntete;                   /* suivi de nb_membres puis nb_bannis enregistrements */
+
+/* Etat sauvegardé d'un groupe */
+typedef struct {
+    JournalMembre *membres;
+    int nb_membres, cap_membres;
+    JournalBan *bannis;
+    int nb_bannis, cap_bannis;
+} JournalEtat;
+
+typedef struct JournalGroupe JournalGroupe;
+
+/* Démarre le thread écrivain. fsync_lot : fsync tous les N commits
+ * (0 : jamais) ; compactage : enregistrements avant réécriture de l'instantané.
+ */
+int  journal_demarrer(int fsync_lot, int compactage);
+
+/* Écrit tout ce qui est en attente, puis arrête l'écrivain */
+void journal_arreter(void);
+
+/* Charge l'état du groupe : instantané (mmap) puis rejeu du journal.
+ * Un groupe sans fichier donne un état vide. -1 si l'instantané est invalide.
+ */
+int  journal_charger(const char *nom_groupe, JournalEtat *etat);
+
+void journal_etat_liberer(JournalEtat *etat);
+
+/* Ouvre le journal d'un groupe dont l'état courant est 'etat'. L'écrivain
+ * tient à jour la file et la latence des commits dans 'stats' (optionnel).
+ * NULL si l'écrivain n'est pas démarré (pas de persistance).
+ */
+JournalGroupe *journal_ouvrir(const char *nom_groupe, const JournalEtat *etat,
+                              GroupStats *stats);
+
+/* Enregistre l'ajout (ou la mise à jour, par IP et nom) d'un membre */
+void journal_ajouter(JournalGroupe *j, const char *nom, struct in_addr ip,
+                     const char *emoji);
+
+/* Enregistre le départ du membre ayant cette IP et ce nom */
+void journal_retirer(JournalGroupe *j, const char *nom, struct in_addr ip);
+
+/* Enregistre un préfixe banni */
+void journal_bannir(JournalGroupe *j, uint32_t reseau, int longueur);
+
+/* Attend l'écriture des enregistrements en attente, compacte et libère */
+void journal_fermer(JournalGroupe *j);
+
+/* Comme journal_fermer, sans attendre : l'écrivain libère lui-même le
+ * groupe, puis range 'etiquette' pour journal_liberes() et signale
+ * journal_evfd(). Un groupe NULL (sans persistance) est signalé aussitôt. */
+void journal_lacher(JournalGroupe *j, uint32_t etiquette);
+
+/* eventfd lisible quand des groupes lâchés ont été libérés ; -1 si
+ * l'écrivain n'est pas démarré */
+int  journal_evfd(void);
+
+/* Donne au plus 'max' étiquettes de groupes lâchés puis libérés ; s'il en
+ * reste, journal_evfd() reste lisible */
+int  journal_liberes(uint32_t *etiquettes, int max);
+
+#endif
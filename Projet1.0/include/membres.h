@@ -0,0 +1,126 @@
+#ifndef MEMBRES_H
+#define MEMBRES_H
+
+#include "Commun.h"
+#include <stdint.h>
+
+/* Table des membres d'un groupe.
+ * Un membre est identifié par (adresse, port d'affichage, nom) : deux
+ * utilisateurs derrière la même IP (NAT, même machine) sont distincts. Les
+ * membres sont rangés par case dans des blocs alloués à la demande et jamais
+ * déplacés (le lot d'envoi garde l'adresse de leur compteur d'échecs) ; la
+ * case d'un membre ne change pas tant qu'il reste dans le groupe.
+ * - un index à adressage ouvert sur (adresse, port, nom) donne la case ;
+ * - les membres d'une même IP sont chaînés, la tête de chaîne étant indexée
+ *   par IP : recherche de l'émetteur, ban d'une adresse, NAK ;
+ * - la liste dense des cases actives sert au fan-out : les membres servis
+ *   en unicast par le groupe d'abord, puis ceux qui reçoivent la diffusion
+ *   autrement (multicast, relais).
+ * Ajout, recherche et retrait se font en temps constant.
+ */
+
+#define MEMBRES_PAR_BLOC 64
+
+/* Qui envoie la diffusion au membre (ClientInfo.service) */
+#define SERVICE_DIRECT    0       /* le groupe, en unicast */
+#define SERVICE_MULTICAST 1       /* l'adresse multicast du groupe */
+#define SERVICE_RELAIS    2       /* le relais r : SERVICE_RELAIS + r */
+
+typedef struct {
+    int actif;
+    struct sockaddr_in addr_cli;  /* IP et port d'affichage (ordre réseau) */
+    char nom[MAX_USERNAME];
+    unsigned int hache_nom;       /* hache_texte(nom) */
+    char emoji[MAX_EMOJI];        /* calculé une fois, depuis l'IP */
+    unsigned int echecs_envoi;    /* datagrammes du fan-out non envoyés */
+    int version;                  /* PROTO_V1 ou PROTO_V2, d'après son CON */
+    int service;                  /* SERVICE_*, SERVICE_DIRECT à l'ajout */
+    int32_t rang;                 /* position dans la liste des actifs */
+    int32_t ip_suivant;           /* chaîne des membres de même IP, -1 : fin */
+    int32_t ip_precedent;
+} ClientInfo;
+
+/* Case d'un index : le hash est gardé pour éviter la plupart des comparaisons */
+typedef struct {
+    uint32_t hash;
+    int32_t  slot;
+} MembresCase;
+
+typedef struct {
+    MembresCase *cases;
+    uint32_t taille;              /* puissance de 2, 0 : pas encore alloué */
+    uint32_t nb;
+} MembresIndex;
+
+typedef struct {
+    ClientInfo **blocs;
+    int nb_blocs;
+    int etendue;                  /* cases [0, etendue) déjà attribuées */
+    int32_t *libres;              /* cases rendues, réutilisées d'abord */
+    int nb_libres, cap_libres;
+    int32_t *actifs;              /* cases des membres, dans le désordre */
+    int nb, cap_actifs;
+    int nb_directs;               /* actifs [0, nb_directs) : SERVICE_DIRECT */
+    MembresIndex par_cle;         /* (adresse, port, nom) -> case */
+    MembresIndex par_ip;          /* adresse -> première case de sa chaîne */
+    uint32_t generation;          /* change à chaque ajout, retrait, changement
+                                     d'adresse ou de service */
+} TableMembres;
+
+/* Table vide (aucune allocation avant le premier ajout) */
+void membres_init(TableMembres *t);
+
+void membres_liberer(TableMembres *t);
+
+/* Membre de la case c (c < etendue) */
+static inline ClientInfo *membres_case(const TableMembres *t, int c)
+{
+    return &t->blocs[c / MEMBRES_PAR_BLOC][c % MEMBRES_PAR_BLOC];
+}
+
+/* k-ième membre de la liste des actifs (0 <= k < nb). Un retrait ne déplace
+ * que des membres de rang supérieur : un parcours qui retire va à rebours. */
+static inline ClientInfo *membres_actif(const TableMembres *t, int k)
+{
+    return membres_case(t, t->actifs[k]);
+}
+
+/* Case active c, ou NULL */
+static inline ClientInfo *membres_valide(const TableMembres *t, int c)
+{
+    if (c < 0 || c >= t->etendue) return NULL;
+    ClientInfo *m = membres_case(t, c);
+    return m->actif ? m : NULL;
+}
+
+/* Case du membre (ip, port en ordre réseau, nom), -1 s'il est absent */
+int  membres_chercher(const TableMembres *t, uint32_t ip, uint16_t port, const char *nom);
+
+/* Premier membre de cette IP portant ce nom (NULL : le premier de l'IP),
+ * -1 s'il n'y en a pas */
+int  membres_chercher_ip(const TableMembres *t, uint32_t ip, const char *nom);
+
+/* Membre de cette IP et de ce port d'affichage, -1 sinon */
+int  membres_chercher_affichage(const TableMembres *t, uint32_t ip, uint16_t port);
+
+/* Premier membre de l'IP (-1 : aucun) ; les suivants par ip_suivant */
+int  membres_premier_ip(const TableMembres *t, uint32_t ip);
+
+/* Ajoute un membre absent de la table. Les champs autres que la clé sont à
+ * remplir par l'appelant. Renvoie sa case, -1 si la table est pleine
+ * (MAX_CLIENTS_GROUP) ou la mémoire épuisée. */
+int  membres_ajouter(TableMembres *t, uint32_t ip, uint16_t port, const char *nom);
+
+/* Change le port d'affichage ou le nom du membre ; sa case ne change pas.
+ * -1 si la nouvelle clé est déjà prise. */
+int  membres_renommer(TableMembres *t, int c, uint16_t port, const char *nom);
+
+/* Change le service du membre (SERVICE_*) : il passe au besoin dans l'autre
+ * partie de la liste des actifs */
+void membres_servir(TableMembres *t, int c, int service);
+
+/* Retire le membre : la case est rendue, son contenu reste lisible jusqu'au
+ * prochain ajout */
+void membres_retirer(TableMembres *t, int c);
+
+#endif
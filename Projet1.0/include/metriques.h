@@ -0,0 +1,103 @@
+#ifndef METRIQUES_H
+#define METRIQUES_H
+
+#include "Commun.h"
+#include <stdatomic.h>
+#include <stdint.h>
+
+/* Métriques d'un groupe, dans le segment SysV SHM_GROUP_KEY_BASE + slot
+ * (ou en mémoire locale dans le moteur).
+ * - L'entête (magic, version, taille) est écrit avant les compteurs : un
+ *   lecteur d'une autre version ou d'une autre taille s'abstient.
+ * - Chaque champ n'a qu'un écrivain à la fois (fil qui traite le groupe, ou
+ *   écrivain du journal sous son verrou) : une mise à jour est un load puis
+ *   un store relaxed, sans instruction verrouillée ni barrière dans la
+ *   boucle du groupe. Exceptions, cumulées par addition atomique
+ *   (STAT_CUMULER) : les compteurs d'envoi d'un groupe partagé entre
+ *   workers, mis à jour hors de leur verrou (groupe_partager), et les
+ *   histogrammes de trace, rares.
+ * - Les lecteurs externes (isytop) échantillonnent par loads relaxed : pas
+ *   d'instantané cohérent entre champs, mais aucun effet sur l'écrivain.
+ */
+
+#define METRIQUES_MAGIC   0x4D595349u   /* "ISYM" */
+#define METRIQUES_VERSION 3             /* 1 : ancien GroupStats à 7 int,
+                                           2 : sans histogrammes de trace */
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t taille;               /* sizeof(GroupStats) */
+    int32_t  pid;                  /* processus qui tient le groupe */
+    uint32_t id;                   /* slot du groupe */
+    char     nom[MAX_GROUP_NAME];
+
+    /* Trafic (compteurs croissants) */
+    _Atomic uint64_t paquets_recus;
+    _Atomic uint64_t octets_recus;
+    _Atomic uint64_t paquets_envoyes;
+    _Atomic uint64_t octets_envoyes;
+    _Atomic uint64_t nb_messages;           /* MES reçus */
+    _Atomic uint64_t diffusions;            /* messages diffusés aux membres */
+    _Atomic uint64_t destinataires;         /* somme des destinataires par diffusion */
+    _Atomic uint64_t nb_echecs_envoi;       /* datagrammes refusés par sendmmsg */
+    _Atomic uint64_t rejets_bannis;         /* CON refusés : adresse bannie */
+    _Atomic uint64_t nb_nacks;              /* demandes de retransmission reçues */
+    _Atomic uint64_t nb_retransmis;         /* messages renvoyés depuis l'historique */
+    _Atomic uint64_t nb_reassembles;        /* messages fragmentés reçus complets */
+    _Atomic uint64_t nb_reassemblages_perdus;
+
+    /* Persistance : délai entre la mise en file d'un changement de membres
+     * et son écriture (fsync compris), par commit du journal */
+    _Atomic uint64_t journal_commits;
+    _Atomic uint64_t journal_latence_ns;    /* somme */
+    _Atomic uint64_t journal_latence_max_ns;
+
+    /* Messages tracés (trace.h) : histogrammes des étapes vues par le
+     * groupe, et somme des durées pour la moyenne */
+    _Atomic uint64_t trace[TRACE_ETAPES_GROUPE][TRACE_CLASSES];
+    _Atomic uint64_t trace_total_ns[TRACE_ETAPES_GROUPE];
+
+    /* Jauges */
+    _Atomic uint32_t nb_clients;
+    _Atomic uint32_t file_journal;          /* enregistrements pas encore écrits */
+    _Atomic uint32_t dernier_lot;           /* datagrammes lus au dernier réveil */
+    _Atomic uint32_t dernier_envoi;         /* datagrammes du dernier sendmmsg groupé */
+    _Atomic uint64_t activite_ms;           /* CLOCK_MONOTONIC du dernier lot */
+} GroupStats;
+
+#define STAT_LIRE(s, champ) \
+    atomic_load_explicit(&(s)->champ, memory_order_relaxed)
+#define STAT_FIXER(s, champ, v) \
+    atomic_store_explicit(&(s)->champ, (v), memory_order_relaxed)
+#define STAT_AJOUTER(s, champ, n) \
+    STAT_FIXER(s, champ, STAT_LIRE(s, champ) + (n))
+#define STAT_RETIRER(s, champ, n) \
+    STAT_FIXER(s, champ, STAT_LIRE(s, champ) - (n))
+#define STAT_CUMULER(s, champ, n) \
+    atomic_fetch_add_explicit(&(s)->champ, (n), memory_order_relaxed)
+
+/* Remet le bloc à zéro et écrit son entête */
+void metriques_init(GroupStats *s, int id, const char *nom);
+
+/* Crée le segment du slot (un segment périmé d'une autre taille est
+ * supprimé puis recréé). Renvoie son shm_id, -1 en cas d'échec. */
+int  metriques_creer(key_t key);
+
+/* Attache le segment existant : en écriture pour le groupe, en lecture
+ * seule pour un observateur. NULL s'il est absent ou trop petit. */
+GroupStats *metriques_attacher(key_t key, int lecture_seule);
+
+/* Côté lecteur : le bloc est initialisé et de cette version */
+int  metriques_valides(const GroupStats *s);
+
+void metriques_detacher(GroupStats *s);
+
+/* Groupe : compte la durée fin - debut de l'étape (TRACE_CLIENT_GROUPE ou
+ * TRACE_GROUPE) d'un message tracé. Sûr entre workers d'un même groupe. */
+void metriques_tracer(GroupStats *s, int etape, uint64_t debut, uint64_t fin);
+
+/* Lecteur : copie l'histogramme d'une étape */
+void metriques_lire_trace(const GroupStats *s, int etape, uint64_t compte[TRACE_CLASSES]);
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef MOTEUR_H
+#define MOTEUR_H
+
+#include "groupe.h"
+
+/* Moteur multi-groupes : un seul processus héberge tous les groupes.
+ * Chaque groupe garde sa socket UDP (port GROUP_PORT_BASE + slot) mais son
+ * état vit dans une table en mémoire ; un pool de threads traite les sockets
+ * prêtes via epoll. Créer un groupe revient à insérer une entrée dans la table.
+ *
+ * Port partagé : tous les groupes écoutent le même port. Chaque thread y
+ * lie sa propre socket (SO_REUSEPORT) ; le noyau répartit les émetteurs
+ * entre elles, un émetteur donné arrivant toujours au même thread (ordre et
+ * réassemblage préservés). Une trame v2 va au groupe dont l'id (le slot)
+ * est dans son entête ; les trames v1, sans id, sont ignorées. Le groupe
+ * répond par la socket du thread qui a reçu la requête.
+ */
+
+#define MOTEUR_MAX_GROUPS     57344     /* un port par groupe : 8100 + slot < 65536 */
+#define MOTEUR_SLOTS_PAR_BLOC 256
+#define MOTEUR_THREADS_DEFAUT 4
+#define MOTEUR_PORT_PARTAGE_DEFAUT 8090  /* hors de la plage des ports de groupe */
+
+/* Démarre le pool de threads (nb_threads <= 0 : MOTEUR_THREADS_DEFAUT).
+ * port_partage > 0 : tous les groupes sur ce port, 0 : un port par groupe.
+ * Un port par groupe coûte un descripteur par groupe : la limite douce
+ * RLIMIT_NOFILE est portée vers la limite dure, et moteur_capacite() en
+ * tient compte. */
+int  moteur_demarrer(int nb_threads, int port_partage);
+
+/* Groupes hébergeables (après moteur_demarrer) : MOTEUR_MAX_GROUPS, ou
+ * moins si les descripteurs manquent pour les ports par groupe */
+int  moteur_capacite(void);
+
+/* Crée le groupe dans le slot donné et l'écoute sur 'port' (ignoré avec un
+ * port partagé). 0 si OK, -1 sinon */
+int  moteur_creer_groupe(int slot, const char *nom, const char *moderateur, int port);
+
+/* Fait traiter aussitôt la trame par le groupe du slot, dans le thread
+ * appelant, comme si elle venait de 'src' (ordres du serveur qui doivent
+ * précéder une suppression). 0 si OK, -1 si le groupe ou la trame est
+ * invalide. */
+int  moteur_remettre(int slot, const void *trame, size_t len,
+                     const struct sockaddr_in *src);
+
+/* Traite les paquets encore en attente puis retire le groupe du slot, sans
+ * attendre son journal : le slot est rendu par moteur_groupes_fermes() une
+ * fois les écritures du groupe terminées (moteur_evfd() lisible) */
+void moteur_supprimer_groupe(int slot);
+
+/* eventfd lisible quand des groupes supprimés ont fini d'écrire */
+int  moteur_evfd(void);
+
+/* Slots (au plus 'max') dont le groupe supprimé a fini d'écrire ; leurs
+ * fichiers peuvent être effacés et le slot réutilisé */
+int  moteur_groupes_fermes(int *slots, int max);
+
+/* Arrête les threads et libère tous les groupes */
+void moteur_arreter(void);
+
+#endif
@@ -0,0 +1,149 @@
+#ifndef PROTOCOLE_H
+#define PROTOCOLE_H
+
+#include "Commun.h"
+#include "trace.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* Format des datagrammes.
+ * - v1 : les champs de taille fixe de l'ISYMessage (164 octets, énoncé),
+ *   suivis du numéro d'historique seq (4 octets, ordre réseau) s'il est non
+ *   nul. Un pair de l'énoncé lit les 164 premiers octets et ignore la
+ *   suite ; une trame de 164 octets a le numéro 0.
+ * - v2 : entête de 12 octets puis une charge de longueur variable. Le groupe
+ *   et l'émetteur sont désignés par des identifiants (slot du groupe, case
+ *   du membre) ; les noms ne circulent que s'ils n'ont pas d'identifiant.
+ * Le premier octet distingue les deux : une lettre de l'ordre en v1,
+ * PROTO_V2 en v2. Chacun répond dans la version de la requête ; le
+ * décodage ramène les deux formats à un ISYMessage.
+ */
+
+#define PROTO_V1 1
+#define PROTO_V2 2
+
+#define PROTO_V1_TAILLE     offsetof(ISYMessage, seq)
+#define PROTO_V1_TAILLE_SEQ (PROTO_V1_TAILLE + sizeof(uint32_t))
+
+/* Opcodes v2, équivalents des ordres v1 */
+enum {
+    OP_CMD = 1,     /* "CMD" client -> serveur */
+    OP_RPL,         /* "RPL" serveur -> client */
+    OP_CON,         /* "CON" connexion d'un affichage au groupe */
+    OP_MES,         /* "MES" message de discussion */
+    OP_MGR,         /* "MGR" gestion serveur <-> groupe */
+    OP_NAK,         /* "NAK" demande de retransmission */
+    OP_MEMBRES,     /* "MBR" table id -> nom/emoji des membres */
+    OP_FRAGMENT,    /* "FRG" morceau d'une trame v2 plus longue (fragment.h) */
+    OP_MULTICAST,   /* "MCA" adresse multicast du groupe, sonde, confirmation */
+    OP_RELAIS,      /* "RLY" relais de diffusion <-> groupe, avis à l'affichage */
+    OP_NB
+};
+
+/* Mots-clés des commandes (CMD) et ordres de gestion (MGR) : un octet en v2,
+ * dispatch par table côté serveur et groupe */
+enum {
+    MOT_AUCUN = 0,
+    MOT_LIST, MOT_CREATE, MOT_JOIN, MOT_CHECKBAN, MOT_MERGE, MOT_DELETE,
+    MOT_MIGRATE, MOT_MIGRATEEXIST, MOT_ADDCLIENT, MOT_MIGRATED, MOT_BANNED,
+    MOT_NB
+};
+
+#define PROTO_GROUPE_AUCUN 0xFFFFu
+#define PROTO_MEMBRE_AUCUN 0xFFu
+
+/* Membres ayant un id v2 : la table des membres tient dans une trame */
+#define PROTO_MEMBRES_MAX  16
+
+/* Champs texte présents dans la charge v2 (dans cet ordre, octet de
+ * longueur puis octets), le texte occupant le reste de la charge */
+#define PROTO_CHAMP_EMETTEUR 0x01
+#define PROTO_CHAMP_EMOJI    0x02
+#define PROTO_CHAMP_GROUPE   0x04
+/* Bloc ProtoTrace juste après l'entête, avant les champs texte */
+#define PROTO_CHAMP_TRACE    0x08
+
+typedef struct {
+    uint8_t  version;              /* PROTO_V2 */
+    uint8_t  opcode;               /* OP_* */
+    uint16_t longueur;             /* octets de charge (ordre réseau) */
+    uint32_t seq;                  /* numéro d'historique (ordre réseau) */
+    uint16_t groupe;               /* id du groupe, PROTO_GROUPE_AUCUN */
+    uint8_t  emetteur;             /* id du membre, PROTO_MEMBRE_AUCUN */
+    uint8_t  champs;               /* PROTO_CHAMP_* */
+} ProtoEntete;
+
+/* Horodatages d'un message tracé (ns CLOCK_REALTIME, 0 : inconnu), en
+ * ordre réseau sur le fil */
+typedef struct {
+    uint64_t client_envoi;
+    uint64_t groupe_reception;
+    uint64_t groupe_envoi;
+} ProtoTrace;
+
+/* Plus grand datagramme échangé : tient dans le MTU minimal d'IPv6 (1280)
+ * moins les entêtes IP/UDP. Au-delà, la trame v2 est fragmentée. */
+#define PROTO_TRAME_MAX 1232
+
+/* Plus grande trame v2 (la longueur de la charge tient sur 16 bits) */
+#define PROTO_MESSAGE_MAX (sizeof(ProtoEntete) + 0xFFFFu)
+
+/* Informations de la trame décodée */
+typedef struct {
+    int      version;
+    int      opcode;
+    uint16_t groupe;
+    uint8_t  emetteur;
+    const unsigned char *charge;   /* charge brute (v2), dans la trame reçue :
+                                      texte complet d'un MES, même au-delà
+                                      de MAX_TEXT */
+    size_t   nb_charge;
+    size_t   taille;               /* octets du datagramme */
+    int      trace;                /* la trame porte un bloc ProtoTrace */
+    ProtoTrace horodatage;
+    uint64_t recu_ns;              /* réception noyau (SO_TIMESTAMPNS), 0 si
+                                      inconnue ; rempli par reception_lot */
+} ProtoInfo;
+
+/* Entrée de la table des membres (OP_MEMBRES) */
+typedef struct {
+    uint8_t id;
+    char nom[MAX_USERNAME];
+    char emoji[MAX_EMOJI];
+} ProtoMembre;
+
+/* Opcode d'un ordre v1 ("MES" -> OP_MES), 0 si inconnu */
+int  proto_opcode(const char *ordre);
+
+/* Code du premier mot du texte (MOT_*), *args pointe sur la suite */
+int  proto_mot(const char *texte, const char **args);
+
+/* Décode un datagramme v1 ou v2. 0 si OK, -1 si la trame est invalide. */
+int  proto_lire(const void *trame, size_t len, ISYMessage *msg, ProtoInfo *info);
+
+/* Encode msg dans 'trame' (au moins PROTO_TRAME_MAX octets). En v2, les
+ * identifiants connus remplacent les noms. Renvoie la taille écrite. */
+size_t proto_ecrire(const ISYMessage *msg, int version, uint16_t groupe,
+                    uint8_t emetteur, void *trame);
+
+/* Comme proto_ecrire, mais avec 'texte' (nb octets) à la place de
+ * msg->texte. En v2 la trame peut dépasser PROTO_TRAME_MAX (jusqu'à 'cap'
+ * octets, texte tronqué au-delà) et doit alors être fragmentée. 'trace'
+ * non NULL ajoute ses horodatages (v2 seulement). */
+size_t proto_ecrire_texte(const ISYMessage *msg, const char *texte, size_t nb,
+                          int version, uint16_t groupe, uint8_t emetteur,
+                          void *trame, size_t cap, const ProtoTrace *trace);
+
+/* Trame v2 tracée (hors fragment) : y inscrit l'heure d'envoi du groupe et
+ * renvoie 1 avec l'heure de réception du groupe dans *reception ; 0 sinon */
+int    proto_horodater_envoi(void *trame, size_t len, uint64_t envoi,
+                             uint64_t *reception);
+
+/* Table des membres d'un groupe (v2). Renvoie la taille écrite. */
+size_t proto_ecrire_membres(const char *nom_groupe, uint16_t groupe,
+                            const ProtoMembre *membres, int nb, void *trame);
+
+/* Lit la table reçue (info->charge) ; renvoie le nombre d'entrées */
+int  proto_lire_membres(const ProtoInfo *info, ProtoMembre *membres, int max);
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef RECEPTION_H
+#define RECEPTION_H
+
+#include "Commun.h"
+#include "protocole.h"
+#include "fragment.h"
+#include <sys/uio.h>
+
+/* Réception groupée de datagrammes avec recvmmsg (nécessite _GNU_SOURCE).
+ * Un réveil draine jusqu'à 'max' datagrammes déjà arrivés sur la socket ;
+ * chacun est décodé (v1 ou v2) en ISYMessage, les trames invalides sont
+ * écartées. Les fragments sont confiés au réassembleur : un message
+ * complété prend place dans le lot, décodé dans son slab, jusqu'à
+ * reception_rendre.
+ */
+
+#define RECEPTION_LOT_MAX     256
+#define RECEPTION_LOT_DEFAUT  64
+
+typedef struct {
+    int n;                                      /* messages du dernier appel */
+    ISYMessage         msgs[RECEPTION_LOT_MAX];
+    ProtoInfo          infos[RECEPTION_LOT_MAX];
+    struct sockaddr_in srcs[RECEPTION_LOT_MAX];
+    unsigned char      trames[RECEPTION_LOT_MAX][PROTO_TRAME_MAX];
+    struct mmsghdr     hdrs[RECEPTION_LOT_MAX];
+    struct iovec       iovs[RECEPTION_LOT_MAX];
+    unsigned char      controles[RECEPTION_LOT_MAX][TRACE_CONTROLE];
+    Reassembleur      *reassembleur;           /* du dernier appel */
+    int                nb_slabs;               /* slabs prêtés au lot */
+    int                slabs[RECEPTION_LOT_MAX];
+} ReceptionLot;
+
+/* Reçoit au plus 'max' datagrammes. Sans MSG_DONTWAIT dans 'flags', l'appel
+ * bloque jusqu'au premier datagramme puis prend ceux déjà en file.
+ * Sur une socket horodatée (trace_horodater), infos[i].recu_ns donne
+ * l'heure d'arrivée relevée par le noyau.
+ * Sans réassembleur (r NULL), les fragments sont ignorés.
+ * Renvoie le nombre de messages valides décodés, ou -1 (errno positionné).
+ */
+int reception_lot(int sock, ReceptionLot *lot, int max, int flags, Reassembleur *r);
+
+/* Rend au réassembleur les slabs des messages du dernier appel, une fois
+ * ceux-ci traités */
+void reception_rendre(ReceptionLot *lot);
+
+#endif
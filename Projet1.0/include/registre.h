@@ -0,0 +1,47 @@
+#ifndef REGISTRE_H
+#define REGISTRE_H
+
+#include "Commun.h"
+
+/* Registre des groupes du serveur.
+ * Les GroupeInfo sont rangés par slot (port = GROUP_PORT_BASE + slot) dans
+ * des blocs alloués à la demande et jamais déplacés ; un index par nom
+ * (table de hachage à adressage ouvert) donne le slot d'un groupe actif.
+ */
+
+#define REGISTRE_SLOTS_PAR_BLOC 256
+/* Tous les slots doivent avoir un port valide (8100 + 57344 < 65536) */
+#define REGISTRE_MAX_GROUPES    57344
+
+/* Prépare un registre vide d'au plus 'capacite' groupes (<= 0 : maximum) */
+int  registre_init(int capacite);
+
+/* Libère le registre (les processus et SHM ne sont pas touchés) */
+void registre_detruire(void);
+
+/* GroupeInfo du slot, NULL si ce slot n'a jamais été alloué */
+GroupeInfo *registre_groupe(int slot);
+
+/* Slot du groupe actif portant ce nom, -1 sinon */
+int  registre_chercher(const char *nom);
+
+/* Réserve un slot libre pour un nouveau groupe actif et l'indexe par son nom.
+ * Renvoie le slot, ou -1 si le registre est plein.
+ */
+int  registre_allouer(const char *nom);
+
+/* Le groupe n'est plus actif : son nom est désindexé (réutilisable aussitôt)
+ * mais le slot reste réservé jusqu'à registre_liberer().
+ */
+void registre_retirer(int slot);
+
+/* Rend le slot réutilisable (processus du groupe terminé) */
+void registre_liberer(int slot);
+
+/* 1 + plus grand slot jamais alloué : borne des parcours de la table */
+int  registre_etendue(void);
+
+/* Nombre de groupes actifs */
+int  registre_nb_actifs(void);
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef RELAIS_H
+#define RELAIS_H
+
+#include <stddef.h>
+#include <netinet/in.h>
+
+/* Relais de diffusion d'un groupe (RelaisISY).
+ * Un relais reçoit du groupe une seule copie de chaque diffusion v2 et la
+ * renvoie aux membres de sa tranche ; le groupe répartit ses membres v2
+ * entre les relais inscrits, au moins chargé. Ordres RLY (v2) :
+ * - relais -> groupe : "INSCRIRE", "VIVANT" (toutes les RELAIS_VIVANT_MS),
+ *   "SYNC" (trou dans les mises à jour) ;
+ * - groupe -> relais : "BIENVENUE r", "INCONNU" (relais oublié : il se
+ *   réinscrit), "MAJ n [=] +a.b.c.d:p -a.b.c.d:p..." : changements de la
+ *   tranche, numérotés ; '=' vide d'abord la tranche (inscription, SYNC) ;
+ * - groupe -> affichage : "RELAIS a.b.c.d p", les diffusions reçues de
+ *   cette adresse viennent du groupe (NAK et table des membres restent
+ *   demandés au groupe).
+ * Un relais muet depuis RELAIS_SILENCE_MS est oublié : ses membres sont
+ * répartis entre les autres, ou servis par le groupe.
+ */
+
+#define RELAIS_MAX        32      /* relais par groupe */
+#define RELAIS_VIVANT_MS  1000
+#define RELAIS_SILENCE_MS 3000
+#define RELAIS_MAJ_MAX    960     /* texte d'une MAJ : tient dans une trame */
+
+/* Ajoute l'entrée "+a.b.c.d:p" (ajout) ou "-a.b.c.d:p" au texte maj de
+ * *nb octets (cap au plus) ; -1 si elle n'y tient pas */
+int relais_ecrire_entree(char *maj, size_t cap, size_t *nb, int ajout,
+                         const struct sockaddr_in *addr);
+
+/* Lit l'entrée en tête de p ; renvoie la suite du texte, NULL à la fin ou
+ * sur une entrée invalide */
+const char *relais_lire_entree(const char *p, int *ajout, struct sockaddr_in *addr);
+
+#endif
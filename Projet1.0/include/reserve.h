@@ -0,0 +1,35 @@
+#ifndef RESERVE_H
+#define RESERVE_H
+
+#include "Commun.h"
+
+/* Réserve de processus GroupeISY (ServeurISY --reserve N).
+ * Le serveur lance d'avance des GroupeISY sans groupe ("GroupeISY --reserve
+ * fd ...") : exec, options et journal sont faits, le processus attend sur
+ * un socketpair SEQPACKET. Un CREATE en confie un : l'ordre donne le
+ * groupe, et ses sockets déjà liées au port passent par SCM_RIGHTS. Le
+ * serveur répond sans attendre le fils ; les datagrammes arrivés entre-temps
+ * attendent dans les sockets. Un canal fermé sans ordre (arrêt du serveur)
+ * termine le processus en réserve.
+ */
+
+#define RESERVE_MAX         64    /* processus en réserve au plus */
+#define RESERVE_SOCKETS_MAX 64    /* sockets par ordre : une par worker */
+
+typedef struct {
+    char nom[MAX_GROUP_NAME];
+    char moderateur[MAX_USERNAME];
+    int  port;
+    int  id;                      /* slot du groupe : SHM et id v2 */
+} ReserveOrdre;
+
+/* Envoie l'ordre et les nb sockets du groupe (1 <= nb <= RESERVE_SOCKETS_MAX) ;
+ * -1 si le processus n'écoute plus (errno EPIPE) */
+int reserve_envoyer(int canal, const ReserveOrdre *o, const int *socks, int nb);
+
+/* Attend l'ordre. Renvoie le nombre de sockets reçues (au plus max, en
+ * FD_CLOEXEC), 0 si le canal est fermé sans ordre, -1 sur erreur (EINTR :
+ * signal reçu pendant l'attente). */
+int reserve_recevoir(int canal, ReserveOrdre *o, int *socks, int max);
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/socket.h>
+
+/* Traçage de bout en bout d'un message de discussion (v2). ClientISY
+ * horodate l'envoi ; le groupe ajoute la réception (horodatage noyau
+ * SO_TIMESTAMPNS) et l'envoi de la diffusion ; l'affichage, sa réception
+ * et la fin de l'affichage (texte et son). Toutes les dates sont en
+ * CLOCK_REALTIME, l'horloge des horodatages noyau : les écarts entre
+ * machines incluent le décalage de leurs horloges.
+ *
+ * Chaque étape alimente un histogramme à classes logarithmiques : la
+ * classe c compte les durées de [2^(c-1), 2^c[ µs, la classe 0 celles de
+ * moins d'1 µs, la dernière tout ce qui dépasse.
+ */
+
+#define TRACE_CLASSES 24                /* jusqu'à ~4 s */
+
+enum {
+    TRACE_CLIENT_GROUPE,                /* envoi ClientISY -> réception groupe */
+    TRACE_GROUPE,                       /* réception -> envoi de la diffusion */
+    TRACE_GROUPE_AFFICHAGE,             /* envoi groupe -> réception affichage */
+    TRACE_AFFICHAGE,                    /* réception -> message affiché, son lancé */
+    TRACE_NB
+};
+#define TRACE_ETAPES_GROUPE 2           /* étapes mesurées par le groupe */
+
+/* Message de contrôle d'un horodatage noyau */
+#define TRACE_CONTROLE CMSG_SPACE(sizeof(struct timespec))
+
+/* CLOCK_REALTIME en ns */
+uint64_t    trace_maintenant(void);
+
+/* Classe de la durée fin - debut (0 si l'horloge a reculé) */
+int         trace_classe(uint64_t debut, uint64_t fin);
+
+/* Borne haute (µs) de la classe contenant le percentile p (0..1) */
+double      trace_percentile_us(const uint64_t compte[TRACE_CLASSES], double p);
+
+const char *trace_nom(int etape);
+
+/* Demande au noyau d'horodater chaque datagramme reçu sur la socket
+ * (SO_TIMESTAMPNS). 0 si OK. */
+int         trace_horodater(int sock);
+
+/* Heure d'arrivée (ns) portée par un message reçu sur une socket
+ * horodatée, 0 si absente */
+uint64_t    trace_heure(const struct msghdr *mh);
+
+#endif
@@ -1,10 +1,542 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE            /* struct ip_mreq */
 #include "../include/Commun.h"
 #include "../include/notif.h"
+#include "../include/protocole.h"
+#include "../include/fragment.h"
+#include <poll.h>
+#include <time.h>
 
+/* Remise en ordre des messages numérotés (seq). Un trou dans la séquence
+ * déclenche un NAK vers le groupe, qui renvoie les messages manquants depuis
+ * son historique ; les messages arrivés en avance attendent ici.
+ */
+#define REORDRE_FENETRE 64      /* messages en avance gardés en attente */
+#define NAK_DELAI_MS    200     /* relance d'un NAK resté sans réponse */
+#define NAK_ESSAIS      3       /* relances avant d'abandonner les manquants */
 
 static char sonsList[MAX_SONS][MAX_NOM];
 static int nbSons = 0;
 
+static ClientDisplayShm *shm;
+static int sock;
+static const char *username;
+
+static ISYMessage en_attente[REORDRE_FENETRE];
+static char *textes_longs[REORDRE_FENETRE];  /* texte complet d'un message
+                                                long en attente, sinon NULL */
+static int present[REORDRE_FENETRE];
+static struct sockaddr_in addr_groupe;     /* source des messages numérotés */
+static uint16_t id_groupe = PROTO_GROUPE_AUCUN; /* id v2 du groupe, mis dans
+                                                   l'entête de nos requêtes */
+static long long echeance_nak = 0;         /* 0 : aucun trou en cours */
+static int essais_nak = 0;
+
+/* v2 : table id -> nom/emoji du groupe, reçue du groupe (OP_MEMBRES) */
+#define MEMBRES_DELAI_MS 200    /* entre deux demandes de la table */
+static int version_groupe = PROTO_V1;      /* version des trames du groupe */
+static uint16_t id_table = PROTO_GROUPE_AUCUN;
+static char nom_table[MAX_GROUP_NAME];
+static ProtoMembre membres[PROTO_MEMBRES_MAX];
+static int nb_membres = 0;
+static long long derniere_demande = 0;
+
+/* Messages v2 fragmentés : réassemblés dans un slab et affichés depuis
+ * celui-ci ; seul un message long arrivé en avance est recopié */
+static Reassembleur reassemblage;
+
+/* Diffusion multicast du groupe (ordre MCA). Après le CON, le groupe
+ * annonce son adresse ; l'affichage la rejoint et demande une sonde, que le
+ * groupe envoie sur le multicast. La sonde reçue est confirmée, et le
+ * groupe ne sert plus l'affichage qu'en multicast (ACTIF) ; d'ici là, ce
+ * qui arrive sur le multicast est ignoré. Sans sonde après MCA_ESSAIS
+ * demandes, l'affichage quitte l'adresse et reste servi en unicast. */
+#define MCA_DELAI_MS 200
+#define MCA_ESSAIS   3
+static int sock_mca = -1;
+static struct sockaddr_in addr_mca;        /* adresse multicast rejointe */
+static struct sockaddr_in groupe_mca;      /* groupe qui l'a annoncée */
+static int mca_actif = 0;
+static unsigned long jeton_mca;
+static long long echeance_mca = 0;         /* 0 : aucune sonde attendue */
+static int essais_mca = 0;
+
+/* Relais du groupe (ordre RLY "RELAIS a.b.c.d p") : ce qui en arrive est
+ * traité comme venant du groupe, à qui partent NAK et demandes de table */
+static struct sockaddr_in addr_relais;     /* sin_port 0 : aucun */
+static struct sockaddr_in groupe_relais;
+
+/* Message tracé en cours : sa réception, pour mesurer son affichage */
+static uint64_t trace_recu = 0;            /* 0 : aucun */
+static uint32_t trace_seq = 0;
+
+static long long maintenant_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void compter_trace(int etape, uint64_t debut, uint64_t fin)
+{
+    if (debut && fin) shm->trace[etape][trace_classe(debut, fin)]++;
+}
+
+/* 'texte' (nb octets) : texte complet d'un message long, NULL sinon */
+static void afficher(const ISYMessage *msg, const char *texte, size_t nb)
+{
+    if (!texte) {
+        texte = msg->texte;
+        nb = strlen(msg->texte);
+    }
+    printf("[%s] %s %s : %.*s\n",
+           msg->groupe,
+           msg->emoji,
+           msg->emetteur,
+           (int)nb, texte);
+    fflush(stdout);
+
+    /* Dernier message numéroté : point de reprise du prochain CON */
+    if (msg->seq != 0) {
+        snprintf(shm->hist_groupe, MAX_GROUP_NAME, "%.*s",
+                 MAX_GROUP_NAME - 1, msg->groupe);
+        shm->hist_seq = msg->seq;
+    }
+
+    if (shm->sound_name[0] != '\0') {
+        jouerSon(shm->sound_name);
+    } else if (nbSons > 0) {
+        jouerSon(sonsList[0]);
+    }
+
+    if (strncmp(msg->texte, "MIGRATE ", 7) == 0) {
+        snprintf(shm->notify, MAX_TEXT, "%s", msg->texte);
+        shm->notify_flag = 1;
+    }
+
+    if (trace_recu && msg->seq == trace_seq) {
+        compter_trace(TRACE_AFFICHAGE, trace_recu, trace_maintenant());
+        trace_recu = 0;
+    }
+}
+
+/* Affiche le message en attente dans la case i et la libère */
+static void afficher_attente(int i)
+{
+    present[i] = 0;
+    afficher(&en_attente[i], textes_longs[i],
+             textes_longs[i] ? strlen(textes_longs[i]) : 0);
+    free(textes_longs[i]);
+    textes_longs[i] = NULL;
+}
+
+static void vider_fenetre(void)
+{
+    for (int i = 0; i < REORDRE_FENETRE; ++i) {
+        free(textes_longs[i]);
+        textes_longs[i] = NULL;
+    }
+    memset(present, 0, sizeof(present));
+}
+
+static uint32_t plus_grand_en_attente(void)
+{
+    uint32_t max = 0;
+    for (int i = 0; i < REORDRE_FENETRE; ++i)
+        if (present[i] && en_attente[i].seq > max) max = en_attente[i].seq;
+    return max;
+}
+
+/* Demande au groupe les messages suivant le dernier affiché jusqu'au plus
+ * récent en attente (les doublons éventuels sont ignorés à l'arrivée) */
+static void envoyer_nak(void)
+{
+    uint32_t max = plus_grand_en_attente();
+    if (max <= shm->hist_seq + 1) return;
+
+    ISYMessage nak;
+    memset(&nak, 0, sizeof(nak));
+    strcpy(nak.ordre, ORDRE_NAK);
+    snprintf(nak.emetteur, MAX_USERNAME, "%.*s", MAX_USERNAME - 1, username);
+    snprintf(nak.groupe, MAX_GROUP_NAME, "%s", shm->hist_groupe);
+    snprintf(nak.texte, sizeof(nak.texte), "%u %u",
+             (unsigned)shm->hist_seq + 1, (unsigned)max - 1);
+
+    unsigned char trame[PROTO_TRAME_MAX];
+    size_t n = proto_ecrire(&nak, version_groupe, id_groupe,
+                            PROTO_MEMBRE_AUCUN, trame);
+    if (sendto(sock, trame, n, 0,
+               (struct sockaddr *)&addr_groupe, sizeof(addr_groupe)) >= 0)
+        shm->nb_nacks++;
+}
+
+/* Affiche les messages devenus consécutifs ; arme un NAK s'il reste un trou */
+static void vider_attente(void)
+{
+    for (;;) {
+        int i = (shm->hist_seq + 1) % REORDRE_FENETRE;
+        if (!present[i] || en_attente[i].seq != shm->hist_seq + 1) break;
+        afficher_attente(i);
+    }
+
+    if (plus_grand_en_attente() == 0) {
+        echeance_nak = 0;
+    } else if (echeance_nak == 0) {
+        shm->nb_trous++;
+        essais_nak = 0;
+        envoyer_nak();
+        echeance_nak = maintenant_ms() + NAK_DELAI_MS;
+    }
+}
+
+/* Renonce aux messages manquants jusqu'à 'jusqua' inclus : ceux déjà en
+ * attente sont affichés, les autres comptés comme perdus */
+static void abandonner(uint32_t jusqua)
+{
+    uint32_t fin = jusqua - shm->hist_seq > REORDRE_FENETRE ?
+                   shm->hist_seq + REORDRE_FENETRE : jusqua;
+    for (uint32_t s = shm->hist_seq + 1; s <= fin; ++s) {
+        int i = s % REORDRE_FENETRE;
+        if (present[i] && en_attente[i].seq == s) {
+            afficher_attente(i);
+        } else {
+            shm->nb_perdus++;
+        }
+    }
+    shm->nb_perdus += jusqua - fin;
+    shm->hist_seq = jusqua;
+    echeance_nak = 0;
+    vider_attente();
+}
+
+/* Demande la table des membres au groupe (au plus une fois par délai) */
+static void demander_membres(const struct sockaddr_in *src)
+{
+    long long now = maintenant_ms();
+    if (derniere_demande && now - derniere_demande < MEMBRES_DELAI_MS) return;
+    derniere_demande = now;
+
+    ISYMessage demande;
+    memset(&demande, 0, sizeof(demande));
+    strcpy(demande.ordre, ORDRE_MBR);
+    unsigned char trame[PROTO_TRAME_MAX];
+    size_t n = proto_ecrire(&demande, PROTO_V2, id_groupe,
+                            PROTO_MEMBRE_AUCUN, trame);
+    if (sendto(sock, trame, n, 0, (const struct sockaddr *)src, sizeof(*src)) < 0)
+        perror("sendto table membres");
+}
+
+static void recevoir_membres(const ISYMessage *msg, const ProtoInfo *info)
+{
+    id_table = info->groupe;
+    snprintf(nom_table, sizeof(nom_table), "%s", msg->groupe);
+    nb_membres = proto_lire_membres(info, membres, PROTO_MEMBRES_MAX);
+}
+
+static void envoyer_mca(const char *texte)
+{
+    ISYMessage mca;
+    memset(&mca, 0, sizeof(mca));
+    strcpy(mca.ordre, ORDRE_MCA);
+    snprintf(mca.texte, sizeof(mca.texte), "%s", texte);
+    unsigned char trame[PROTO_TRAME_MAX];
+    size_t n = proto_ecrire(&mca, PROTO_V2, id_groupe, PROTO_MEMBRE_AUCUN, trame);
+    if (sendto(sock, trame, n, 0, (const struct sockaddr *)&groupe_mca,
+               sizeof(groupe_mca)) < 0)
+        perror("sendto multicast");
+}
+
+static void demander_sonde(void)
+{
+    char texte[32];
+    snprintf(texte, sizeof(texte), "SONDE %lu", jeton_mca);
+    envoyer_mca(texte);
+    echeance_mca = maintenant_ms() + MCA_DELAI_MS;
+}
+
+static void quitter_multicast(void)
+{
+    if (sock_mca >= 0) close(sock_mca);    /* la fermeture quitte l'adresse */
+    sock_mca = -1;
+    mca_actif = 0;
+    echeance_mca = 0;
+}
+
+/* Rejoint l'adresse sur l'interface par laquelle on atteint le groupe */
+static int rejoindre_multicast(const struct sockaddr_in *mca, const struct sockaddr_in *groupe)
+{
+    struct sockaddr_in locale;
+    socklen_t lg = sizeof(locale);
+    int s = socket(AF_INET, SOCK_DGRAM, 0);
+    if (s < 0) return -1;
+    /* connect d'une socket UDP : choix de la route, sans rien envoyer */
+    int ok = connect(s, (const struct sockaddr *)groupe, sizeof(*groupe)) == 0 &&
+             getsockname(s, (struct sockaddr *)&locale, &lg) == 0;
+    close(s);
+    if (!ok) return -1;
+
+    s = socket(AF_INET, SOCK_DGRAM, 0);
+    if (s < 0) return -1;
+    int un = 1;
+    struct ip_mreq mreq;
+    mreq.imr_multiaddr = mca->sin_addr;
+    mreq.imr_interface = locale.sin_addr;
+    /* Plusieurs affichages d'une machine partagent l'adresse et le port */
+    if (setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &un, sizeof(un)) < 0 ||
+        bind(s, (const struct sockaddr *)mca, sizeof(*mca)) < 0 ||
+        setsockopt(s, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+        perror("multicast affichage");
+        close(s);
+        return -1;
+    }
+    if (trace_horodater(s) < 0) perror("SO_TIMESTAMPNS multicast");
+    sock_mca = s;
+    addr_mca = *mca;
+    return 0;
+}
+
+/* Ordre MCA reçu du groupe (ADRESSE, ACTIF) ou sur le multicast (SONDE) */
+static void recevoir_mca(const ISYMessage *msg, const struct sockaddr_in *src,
+                         int par_multicast)
+{
+    unsigned long jeton;
+    if (par_multicast) {
+        if (echeance_mca && sscanf(msg->texte, "SONDE %lu", &jeton) == 1 &&
+            jeton == jeton_mca) {
+            char texte[32];
+            snprintf(texte, sizeof(texte), "OK %lu", jeton);
+            envoyer_mca(texte);
+            echeance_mca = 0;
+        }
+        return;
+    }
+    if (strcmp(msg->texte, "ACTIF") == 0) {
+        if (sock_mca >= 0 && echeance_mca == 0 && !mca_actif) {
+            mca_actif = 1;
+            char adresse[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &addr_mca.sin_addr, adresse, sizeof(adresse));
+            printf("Diffusion multicast du groupe reçue sur %s:%u\n",
+                   adresse, (unsigned)ntohs(addr_mca.sin_port));
+            fflush(stdout);
+        }
+        return;
+    }
+
+    char adresse[INET_ADDRSTRLEN];
+    unsigned int port;
+    struct sockaddr_in mca;
+    memset(&mca, 0, sizeof(mca));
+    mca.sin_family = AF_INET;
+    if (sscanf(msg->texte, "ADRESSE %15s %u", adresse, &port) != 2 ||
+        inet_pton(AF_INET, adresse, &mca.sin_addr) != 1 || port == 0 || port > 65535)
+        return;
+    mca.sin_port = htons((uint16_t)port);
+
+    /* Nouveau CON : le groupe nous sert en unicast jusqu'à la confirmation */
+    mca_actif = 0;
+    if (sock_mca < 0 || addr_mca.sin_addr.s_addr != mca.sin_addr.s_addr ||
+        addr_mca.sin_port != mca.sin_port) {
+        quitter_multicast();
+        if (rejoindre_multicast(&mca, src) < 0) return;
+    }
+    groupe_mca = *src;
+    jeton_mca = (unsigned long)getpid() << 20 ^ (unsigned long)maintenant_ms();
+    essais_mca = 0;
+    demander_sonde();
+}
+
+static void recevoir_relais(const ISYMessage *msg, const struct sockaddr_in *src)
+{
+    char adresse[INET_ADDRSTRLEN];
+    unsigned int port;
+    struct sockaddr_in relais;
+    memset(&relais, 0, sizeof(relais));
+    relais.sin_family = AF_INET;
+    if (sscanf(msg->texte, "RELAIS %15s %u", adresse, &port) != 2 ||
+        inet_pton(AF_INET, adresse, &relais.sin_addr) != 1 || port == 0 || port > 65535)
+        return;
+    relais.sin_port = htons((uint16_t)port);
+    addr_relais = relais;
+    groupe_relais = *src;
+}
+
+/* v2 : remet les noms désignés par leur id. Un id inconnu (table perdue
+ * ou périmée) fait redemander la table ; le message s'affiche avec l'id. */
+static void resoudre_ids(ISYMessage *msg, const ProtoInfo *info,
+                         const struct sockaddr_in *src)
+{
+    if (info->version != PROTO_V2) return;
+    int inconnu = 0;
+
+    if (info->groupe != PROTO_GROUPE_AUCUN && msg->groupe[0] == '\0') {
+        if (info->groupe == id_table) {
+            snprintf(msg->groupe, MAX_GROUP_NAME, "%s", nom_table);
+        } else {
+            snprintf(msg->groupe, MAX_GROUP_NAME, "#%u", (unsigned)info->groupe);
+            inconnu = 1;
+        }
+    }
+    if (info->emetteur != PROTO_MEMBRE_AUCUN && msg->emetteur[0] == '\0') {
+        int k = 0;
+        while (k < nb_membres && membres[k].id != info->emetteur) k++;
+        if (k < nb_membres && info->groupe == id_table) {
+            snprintf(msg->emetteur, MAX_USERNAME, "%s", membres[k].nom);
+            snprintf(msg->emoji, MAX_EMOJI, "%s", membres[k].emoji);
+        } else {
+            snprintf(msg->emetteur, MAX_USERNAME, "#%u", (unsigned)info->emetteur);
+            inconnu = 1;
+        }
+    }
+    if (inconnu) demander_membres(src);
+}
+
+static void recevoir_numerote(const ISYMessage *msg, const char *texte, size_t nb,
+                              const struct sockaddr_in *src)
+{
+    /* Autre groupe, ou numérotation repartie de zéro (groupe recréé) */
+    if (strncmp(msg->groupe, shm->hist_groupe, MAX_GROUP_NAME) != 0 ||
+        shm->hist_seq == 0 || msg->seq + REORDRE_FENETRE < shm->hist_seq) {
+        vider_fenetre();
+        echeance_nak = 0;
+        addr_groupe = *src;
+        afficher(msg, texte, nb);
+        return;
+    }
+    addr_groupe = *src;
+
+    if (msg->seq <= shm->hist_seq) {
+        shm->nb_doublons++;
+        return;
+    }
+    if (msg->seq - shm->hist_seq > REORDRE_FENETRE)
+        abandonner(msg->seq - REORDRE_FENETRE);
+
+    int i = msg->seq % REORDRE_FENETRE;
+    if (present[i] && en_attente[i].seq == msg->seq) {
+        shm->nb_doublons++;
+        return;
+    }
+    /* Le suivant attendu s'affiche sans passer par la fenêtre */
+    if (msg->seq == shm->hist_seq + 1) {
+        afficher(msg, texte, nb);
+        vider_attente();
+        return;
+    }
+    en_attente[i] = *msg;
+    free(textes_longs[i]);
+    textes_longs[i] = texte ? strndup(texte, nb) : NULL;
+    present[i] = 1;
+    vider_attente();
+}
+
+/* Traite une trame décodée (éventuellement réassemblée). Renvoie 1 si
+ * l'affichage doit s'arrêter. */
+static int traiter(ISYMessage *msg, ProtoInfo *info, const struct sockaddr_in *src)
+{
+    /* On répond au groupe dans la version qu'il emploie */
+    version_groupe = info->version;
+    if (info->opcode == OP_MEMBRES) {
+        recevoir_membres(msg, info);
+        return 0;
+    }
+    resoudre_ids(msg, info, src);
+
+    if (info->opcode == OP_NAK) {
+        /* Messages sortis de l'historique du groupe : inutile d'attendre */
+        unsigned long a = 0, b = 0;
+        if (sscanf(msg->texte, "%lu %lu", &a, &b) == 2 &&
+            strncmp(msg->groupe, shm->hist_groupe, MAX_GROUP_NAME) == 0 &&
+            a <= shm->hist_seq + 1 && b > shm->hist_seq)
+            abandonner((uint32_t)b);
+    }
+    else if (info->opcode == OP_MES) {
+        if (strcmp(msg->texte, "VOUS_ETES_BANNI") == 0) {
+            printf("\n🚫 VOUS AVEZ ÉTÉ BANNI DE CE GROUPE!\n\n");
+            fflush(stdout);
+
+            shm->running = 0;
+            return 1;
+        }
+
+        /* v2 au-delà de MAX_TEXT : le texte complet est dans la charge */
+        const char *texte = NULL;
+        size_t nb = 0;
+        if (info->version == PROTO_V2 && info->nb_charge >= MAX_TEXT) {
+            texte = (const char *)info->charge;
+            nb = info->nb_charge;
+        }
+        if (info->trace) {
+            const ProtoTrace *t = &info->horodatage;
+            trace_recu = info->recu_ns ? info->recu_ns : trace_maintenant();
+            trace_seq = msg->seq;
+            compter_trace(TRACE_CLIENT_GROUPE, t->client_envoi, t->groupe_reception);
+            compter_trace(TRACE_GROUPE, t->groupe_reception, t->groupe_envoi);
+            compter_trace(TRACE_GROUPE_AFFICHAGE, t->groupe_envoi, trace_recu);
+        }
+        if (msg->seq != 0)
+            recevoir_numerote(msg, texte, nb, src);
+        else
+            afficher(msg, texte, nb);
+        trace_recu = 0;            /* mis en attente : son affichage n'est pas mesuré */
+    }
+    return 0;
+}
+
+/* Lit un datagramme de la socket s (affichage ou multicast) et le traite.
+ * Renvoie 1 si l'affichage doit s'arrêter, -1 si la lecture échoue. */
+static int recevoir(int s)
+{
+    ISYMessage msg;
+    ProtoInfo info;
+    struct sockaddr_in addr_src;
+    unsigned char trame[PROTO_TRAME_MAX];
+    unsigned char controle[TRACE_CONTROLE];
+    struct iovec iov = { trame, sizeof(trame) };
+    struct msghdr mh = {
+        .msg_name = &addr_src, .msg_namelen = sizeof(addr_src),
+        .msg_iov = &iov, .msg_iovlen = 1,
+        .msg_control = controle, .msg_controllen = sizeof(controle),
+    };
+    ssize_t n = recvmsg(s, &mh, MSG_DONTWAIT);
+    if (n < 0) return errno == EINTR || errno == EAGAIN ? 0 : -1;
+    uint64_t recu = trace_heure(&mh);
+    if (proto_lire(trame, (size_t)n, &msg, &info) < 0)
+        return 0;
+
+    int par_multicast = s == sock_mca;
+    if (addr_relais.sin_port && addr_src.sin_port == addr_relais.sin_port &&
+        addr_src.sin_addr.s_addr == addr_relais.sin_addr.s_addr)
+        addr_src = groupe_relais;
+    /* Sur un port partagé par plusieurs groupes, seul l'id désigne le nôtre */
+    if (info.groupe != PROTO_GROUPE_AUCUN && !par_multicast)
+        id_groupe = info.groupe;
+    if (info.opcode == OP_RELAIS) {
+        if (!par_multicast) recevoir_relais(&msg, &addr_src);
+        return 0;
+    }
+    if (info.opcode == OP_MULTICAST) {
+        recevoir_mca(&msg, &addr_src, par_multicast);
+        return 0;
+    }
+    if (par_multicast && !mca_actif) return 0;
+
+    int slab = -1;
+    if (info.opcode == OP_FRAGMENT) {
+        const unsigned char *complet;
+        size_t len;
+        slab = reassembleur_ajouter(&reassemblage, &info, &addr_src, &complet, &len);
+        if (slab < 0) return 0;
+        if (proto_lire(complet, len, &msg, &info) < 0 || info.opcode == OP_FRAGMENT) {
+            reassembleur_rendre(&reassemblage, slab);
+            return 0;
+        }
+    }
+    info.recu_ns = recu;
+    int fin = traiter(&msg, &info, &addr_src);
+    if (slab >= 0) reassembleur_rendre(&reassemblage, slab);
+    return fin;
+}
+
 int main(int argc, char *argv[])
 {
     if (argc < 3) {
@@ -15,32 +547,34 @@ int main(int argc, char *argv[])
     }
 
     int port = atoi(argv[1]);
-    const char *username = argv[2];
+    username = argv[2];
 
   
     int shm_id = shmget(SHM_CLIENT_KEY, sizeof(ClientDisplayShm),
                         IPC_CREAT | 0666);
     check_fatal(shm_id < 0, "shmget client");
-    ClientDisplayShm *shm =
-        (ClientDisplayShm *)shmat(shm_id, NULL, 0);
+    shm = (ClientDisplayShm *)shmat(shm_id, NULL, 0);
     check_fatal(shm == (void *)-1, "shmat client");
 
     shm->running = 1;
     shm->notify_flag = 0;
     shm->notify[0] = '\0';
 
-    int sock = create_udp_socket();
-    struct sockaddr_in addr_local, addr_src;
-    socklen_t addrlen = sizeof(addr_src);
+    sock = create_udp_socket();
+    struct sockaddr_in addr_local;
 
     fill_sockaddr(&addr_local, NULL, port);
     check_fatal(bind(sock, (struct sockaddr *)&addr_local,
                      sizeof(addr_local)) < 0, "bind affichage");
+    shm->ecoute = 1;
+    memset(shm->trace, 0, sizeof(shm->trace));
+    if (trace_horodater(sock) < 0) perror("SO_TIMESTAMPNS affichage");
 
     printf("AffichageISY (%s) écoute sur port %d\n",
            username, port);
 
   
+    reassembleur_init(&reassemblage);
     nbSons = listerSons(sonsList);
     if (nbSons > 0) {
         printf("Sons disponibles: ");
@@ -50,57 +584,74 @@ int main(int argc, char *argv[])
         printf("\n");
     }
 
-    ISYMessage msg;
-
     while (shm->running) {
-        ssize_t n = recvfrom(sock, &msg, sizeof(msg), 0,
-                             (struct sockaddr *)&addr_src, &addrlen);
-        if (n < 0) {
-            if (errno == EINTR) continue;
-            perror("recvfrom affichage");
+        /* Réveil périodique : relance des NAK et des sondes, suivi de
+         * shm->running */
+        struct pollfd pfds[2] = {
+            { .fd = sock, .events = POLLIN },
+            { .fd = sock_mca, .events = POLLIN },
+        };
+        long long now = maintenant_ms();
+        long long echeance = now + NAK_DELAI_MS;
+        if (echeance_nak && echeance_nak < echeance) echeance = echeance_nak;
+        if (echeance_mca && echeance_mca < echeance) echeance = echeance_mca;
+        int pr = poll(pfds, sock_mca >= 0 ? 2 : 1, echeance > now ? (int)(echeance - now) : 0);
+        if (pr < 0 && errno != EINTR) {
+            perror("poll affichage");
             break;
         }
-
-
-
-        if (strncmp(msg.ordre, ORDRE_MSG, 3) == 0) {
-            
-            if (strcmp(msg.texte, "VOUS_ETES_BANNI") == 0) {
-                printf("\n🚫 VOUS AVEZ ÉTÉ BANNI DE CE GROUPE!\n\n");
-                fflush(stdout);
-                
-                shm->running = 0;
-                break;
+        if (echeance_nak && maintenant_ms() >= echeance_nak) {
+            if (essais_nak < NAK_ESSAIS) {
+                essais_nak++;
+                envoyer_nak();
+                echeance_nak = maintenant_ms() + NAK_DELAI_MS;
+            } else {
+                abandonner(plus_grand_en_attente() - 1);
             }
-            
-            printf("[%s] %s %s : %s\n",
-                   msg.groupe,
-                   msg.emoji,
-                   msg.emetteur,
-                   msg.texte);
-            fflush(stdout);
-
-            
-            if (shm->sound_name[0] != '\0') {
-                jouerSon(shm->sound_name);
-            } else if (nbSons > 0) {
-                
-                jouerSon(sonsList[0]);
+        }
+        if (echeance_mca && maintenant_ms() >= echeance_mca) {
+            if (essais_mca < MCA_ESSAIS) {
+                essais_mca++;
+                demander_sonde();
+            } else {
+                printf("Multicast injoignable : diffusion reçue en unicast\n");
+                fflush(stdout);
+                quitter_multicast();
             }
+        }
+        if (pr <= 0) continue;
 
-            
-            if (strncmp(msg.texte, "MIGRATE ", 7) == 0) {
-                
-                snprintf(shm->notify, MAX_TEXT, "%s", msg.texte);
-                shm->notify_flag = 1;
-            }
+        int fin = 0;
+        for (int k = 0; k < 2 && fin == 0; ++k) {
+            /* La socket multicast a pu changer en traitant la première */
+            if (!(pfds[k].revents & POLLIN) || (k == 1 && pfds[k].fd != sock_mca)) continue;
+            fin = recevoir(pfds[k].fd);
         }
+        if (fin < 0) perror("recvmsg affichage");
+        if (fin) break;
     }
 
+    quitter_multicast();
     close(sock);
+    vider_fenetre();
+    reassembleur_liberer(&reassemblage);
+    printf("AffichageISY termine (trous=%u nacks=%u perdus=%u doublons=%u "
+           "longs=%d incomplets=%d)\n",
+           shm->nb_trous, shm->nb_nacks, shm->nb_perdus, shm->nb_doublons,
+           reassemblage.nb_complets, reassemblage.nb_perdus);
+    for (int e = 0; e < TRACE_NB; ++e) {
+        uint64_t total = 0;
+        for (int c = 0; c < TRACE_CLASSES; ++c) total += shm->trace[e][c];
+        if (total > 0)
+            printf("trace %-16s n=%llu p50<=%.0fus p99<=%.0fus max<=%.0fus\n",
+                   trace_nom(e), (unsigned long long)total,
+                   trace_percentile_us(shm->trace[e], 0.50),
+                   trace_percentile_us(shm->trace[e], 0.99),
+                   trace_percentile_us(shm->trace[e], 1.0));
+    }
+    shm->ecoute = 0;
     shmdt(shm);  
                   
 
-    printf("AffichageISY termine\n");
     return 0;
 }
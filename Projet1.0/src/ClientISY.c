@@ -1,6 +1,9 @@
 #define _POSIX_C_SOURCE 200809L
 #include "../include/Commun.h"
 #include "../include/notif.h"
+#include "../include/historique.h"
+#include "../include/protocole.h"
+#include "../include/fragment.h"
 #include <sys/shm.h>
 #include <sys/time.h>
 #include <time.h>
@@ -15,8 +18,12 @@
 
 typedef struct {
     char username[MAX_USERNAME];
+    char emoji[MAX_EMOJI];         /* d'après username, calculé au chargement */
     char server_ip[64];
     int  display_port;   
+    int  protocole;                /* version préférée (protocole=1|2) */
+    size_t message_max;            /* plus grande trame v2 (message_max=) */
+    int  trace;                    /* horodater les messages (trace=1, v2) */
 } ClientConfig;
 
 static ClientConfig cfg;
@@ -25,6 +32,15 @@ static int shm_id   = -1;
 static ClientDisplayShm *shm_cli = NULL;
 static pid_t pid_affichage = -1;
 static char selected_sound[256] = "notif.wav";  
+/* Version employée : celle de la config, ou v1 si le serveur ne répond
+ * pas en v2 (serveur v1, qui ignore ces trames) */
+static int version_proto = PROTO_V2;
+static int v2_confirme = 0;            /* le serveur a déjà répondu en v2 */
+#define ESSAIS_AVANT_REPLI 2
+/* Messages longs (v2) : trame complète avant découpage, et ligne saisie */
+static unsigned char trame_longue[PROTO_MESSAGE_MAX];
+static char saisie[PROTO_MESSAGE_MAX];
+static uint32_t prochain_fragment;
 
 /*  Chargement de la configuration client */
 static void load_config(const char *path)
@@ -45,6 +61,12 @@ static void load_config(const char *path)
                 cfg.server_ip[sizeof(cfg.server_ip) - 1] = '\0';
             } else if (strcmp(key, "display_port") == 0) {
                 cfg.display_port = atoi(val);
+            } else if (strcmp(key, "protocole") == 0) {
+                cfg.protocole = atoi(val);
+            } else if (strcmp(key, "message_max") == 0) {
+                cfg.message_max = strtoul(val, NULL, 10);
+            } else if (strcmp(key, "trace") == 0) {
+                cfg.trace = atoi(val);
             }
         }
     }
@@ -54,6 +76,7 @@ static void load_config(const char *path)
         fprintf(stderr, "Config client: username manquant\n");
         exit(EXIT_FAILURE);
     }
+    choose_emoji_from_username(cfg.username, cfg.emoji);
     if (cfg.server_ip[0] == '\0') {
         fprintf(stderr, "Config client: server_ip manquant (sera peut-être remplacé par l’auto-discovery)\n");
     }
@@ -61,6 +84,59 @@ static void load_config(const char *path)
         fprintf(stderr, "Config client: display_port invalide\n");
         exit(EXIT_FAILURE);
     }
+    if (cfg.protocole != PROTO_V1)
+        cfg.protocole = PROTO_V2;
+    version_proto = cfg.protocole;
+    if (cfg.message_max > 0)
+        fragment_configurer(cfg.message_max, FRAGMENT_MEMOIRE_DEFAUT);
+    prochain_fragment = (uint32_t)getpid() << 16 ^ (uint32_t)time(NULL);
+}
+
+/* Id v2 du groupe : celui annoncé par le serveur ("OK <port> <id>"), sinon
+ * celui d'un groupe sur son propre port (port - GROUP_PORT_BASE) */
+static uint16_t id_groupe(int port_groupe, int id)
+{
+    if (id >= 0 && id < (int)PROTO_GROUPE_AUCUN) return (uint16_t)id;
+    return port_groupe >= GROUP_PORT_BASE ?
+           (uint16_t)(port_groupe - GROUP_PORT_BASE) : PROTO_GROUPE_AUCUN;
+}
+
+/* Encode le message dans la version négociée et l'envoie. En v2, le groupe
+ * destinataire est désigné par son id (id_groupe). */
+static ssize_t envoyer_isy(const ISYMessage *msg, const struct sockaddr_in *dest,
+                           uint16_t id)
+{
+    unsigned char trame[PROTO_TRAME_MAX];
+    size_t n = proto_ecrire(msg, version_proto, id, PROTO_MEMBRE_AUCUN, trame);
+    return sendto(sock_cli, trame, n, 0, (const struct sockaddr *)dest, sizeof(*dest));
+}
+
+/* Message de discussion au texte complet : en v2, une trame plus longue
+ * qu'un datagramme part en fragments (texte tronqué en v1). Avec trace=1,
+ * la trame v2 porte son heure d'envoi. */
+static ssize_t envoyer_isy_texte(const ISYMessage *msg, const char *texte,
+                                 const struct sockaddr_in *dest, uint16_t id)
+{
+    ProtoTrace trace = { trace_maintenant(), 0, 0 };
+    size_t n = proto_ecrire_texte(msg, texte, strlen(texte), version_proto, id,
+                                  PROTO_MEMBRE_AUCUN, trame_longue,
+                                  fragment_message_max(), cfg.trace ? &trace : NULL);
+    int k = fragment_nombre(n);
+    if (k == 1)
+        return sendto(sock_cli, trame_longue, n, 0,
+                      (const struct sockaddr *)dest, sizeof(*dest));
+
+    uint32_t id_message = prochain_fragment++;
+    unsigned char trame[PROTO_TRAME_MAX];
+    ssize_t total = 0;
+    for (int f = 0; f < k; ++f) {
+        size_t t = fragment_ecrire(trame_longue, n, id_message, id, f, trame);
+        ssize_t e = sendto(sock_cli, trame, t, 0,
+                           (const struct sockaddr *)dest, sizeof(*dest));
+        if (e < 0) return -1;
+        total += e;
+    }
+    return total;
 }
 
 /*  Gestion SHM & AffichageISY */
@@ -154,6 +230,7 @@ static pid_t start_affichage(void)
 {
     if (!shm_cli)
         init_shm_client();
+    shm_cli->ecoute = 0;
 
     pid_t pid = fork();
     check_fatal(pid < 0, "fork affichage");
@@ -215,7 +292,10 @@ static pid_t start_affichage(void)
         _exit(EXIT_FAILURE);
     }
 
-    
+    /* Le rejeu de l'historique suit le CON : on attend (au plus 2 s) que
+     * l'affichage écoute pour ne pas le perdre */
+    for (int i = 0; i < 100 && !shm_cli->ecoute; ++i)
+        sleep_ms(20);
     return pid;
 }
 
@@ -252,7 +332,7 @@ static void stop_affichage(void)
 static void send_command_to_server(const char *cmd,
                                    char *reply_buf, size_t reply_sz,
                                    char *group_name_opt,
-                                   int *port_groupe_opt)
+                                   int *port_groupe_opt, int *id_groupe_opt)
 {
     struct sockaddr_in addr_srv;
     fill_sockaddr(&addr_srv, cfg.server_ip, SERVER_PORT);
@@ -261,7 +341,7 @@ static void send_command_to_server(const char *cmd,
     memset(&msg, 0, sizeof(msg));
     strcpy(msg.ordre, ORDRE_CMD);
     snprintf(msg.emetteur, MAX_USERNAME, "%s", cfg.username);
-    choose_emoji_from_username(cfg.username, msg.emoji);
+    memcpy(msg.emoji, cfg.emoji, MAX_EMOJI);
     msg.emetteur[MAX_USERNAME - 1] = '\0';
     snprintf(msg.texte, MAX_TEXT, "%s", cmd);
 
@@ -271,6 +351,8 @@ static void send_command_to_server(const char *cmd,
     struct sockaddr_in from;
     socklen_t len = sizeof(from);
     ISYMessage reply;
+    ProtoInfo info;
+    unsigned char trame[PROTO_TRAME_MAX];
     struct timeval tv;
     tv.tv_sec = 1; 
     tv.tv_usec = 0;
@@ -280,19 +362,32 @@ static void send_command_to_server(const char *cmd,
     int attempt;
     ssize_t n = -1;
     for (attempt = 0; attempt < max_retries; ++attempt) {
-        ssize_t sent = sendto(sock_cli, &msg, sizeof(msg), 0,
-                              (struct sockaddr *)&addr_srv, sizeof(addr_srv));
+        ssize_t sent = envoyer_isy(&msg, &addr_srv, PROTO_GROUPE_AUCUN);
         if (sent < 0) {
             perror("sendto serveur");
             sleep_ms(200);
             continue;
         }
 
-        n = recvfrom(sock_cli, &reply, sizeof(reply), 0,
+        len = sizeof(from);
+        n = recvfrom(sock_cli, trame, sizeof(trame), 0,
                      (struct sockaddr *)&from, &len);
-        if (n >= 0) break; 
+        if (n >= 0 && proto_lire(trame, (size_t)n, &reply, &info) == 0 &&
+            info.opcode == OP_RPL) {
+            if (info.version == PROTO_V2) v2_confirme = 1;
+            break;
+        }
+        if (n >= 0) {
+            n = -1;               /* trame illisible : traitée comme une perte */
+            errno = EAGAIN;
+        }
 
         if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            if (version_proto == PROTO_V2 && !v2_confirme &&
+                attempt + 1 == ESSAIS_AVANT_REPLI) {
+                printf("[CLIENT] Pas de reponse en v2, repli sur le protocole v1\n");
+                version_proto = PROTO_V1;
+            }
             
             if (attempt < max_retries - 1) {
                 printf("[CLIENT] Aucun reponse du serveur, tentative %d/%d...\n", attempt + 1, max_retries);
@@ -303,6 +398,7 @@ static void send_command_to_server(const char *cmd,
                 
                 snprintf(reply_buf, reply_sz, "Aucun reponse du serveur (timeout)");
                 if (port_groupe_opt) *port_groupe_opt = -1;
+                if (id_groupe_opt) *id_groupe_opt = -1;
                 if (group_name_opt) group_name_opt[0] = '\0';
                 return;
             }
@@ -317,11 +413,11 @@ static void send_command_to_server(const char *cmd,
     snprintf(reply_buf, reply_sz, "%s", reply.texte);
 
     if (port_groupe_opt) {
-        int port = -1;
-        if (sscanf(reply.texte, "OK %d", &port) == 1)
-            *port_groupe_opt = port;
-        else
-            *port_groupe_opt = -1;
+        int port = -1, id = -1;
+        if (sscanf(reply.texte, "OK %d %d", &port, &id) < 1)
+            port = id = -1;
+        *port_groupe_opt = port;
+        if (id_groupe_opt) *id_groupe_opt = id;
     }
 
     if (group_name_opt) {
@@ -332,7 +428,7 @@ static void send_command_to_server(const char *cmd,
     }
 }
 
-static void connect_to_group(const char *group_name, int port_groupe)
+static void connect_to_group(const char *group_name, int port_groupe, int id)
 {
     struct sockaddr_in addr_grp;
     /* Les processus GroupeISY tournent sur la même machine que le serveur */
@@ -342,18 +438,25 @@ static void connect_to_group(const char *group_name, int port_groupe)
     memset(&msg, 0, sizeof(msg));
     strcpy(msg.ordre, ORDRE_CON);
     safe_strncpy(msg.emetteur, MAX_USERNAME, cfg.username);
-    choose_emoji_from_username(cfg.username, msg.emoji);
+    memcpy(msg.emoji, cfg.emoji, MAX_EMOJI);
     safe_strncpy(msg.groupe, MAX_GROUP_NAME, group_name);
-    snprintf(msg.texte, sizeof(msg.texte), "%d", cfg.display_port);
-
-    ssize_t n = sendto(sock_cli, &msg, sizeof(msg), 0,
-                       (struct sockaddr *)&addr_grp, sizeof(addr_grp));
+    /* Retour dans le groupe du dernier message affiché : on reprend après
+     * lui ; sinon le groupe rejoue ses derniers messages */
+    if (shm_cli && shm_cli->hist_seq > 0 &&
+        strncmp(shm_cli->hist_groupe, group_name, MAX_GROUP_NAME) == 0)
+        snprintf(msg.texte, sizeof(msg.texte), "%d AFTER %u",
+                 cfg.display_port, (unsigned)shm_cli->hist_seq);
+    else
+        snprintf(msg.texte, sizeof(msg.texte), "%d LAST %d",
+                 cfg.display_port, HISTORIQUE_REJEU_DEFAUT);
+
+    ssize_t n = envoyer_isy(&msg, &addr_grp, id_groupe(port_groupe, id));
     check_fatal(n < 0, "sendto groupe CON");
 }
 
 /*  Envoi d’un message MES au GroupeISY */
 static void send_message_to_group(const char *group_name,
-                                  int port_groupe,
+                                  int port_groupe, int id,
                                   const char *texte)
 {
     struct sockaddr_in addr_grp;
@@ -363,12 +466,12 @@ static void send_message_to_group(const char *group_name,
     memset(&msg, 0, sizeof(msg));
     strcpy(msg.ordre, ORDRE_MSG);
     safe_strncpy(msg.emetteur, MAX_USERNAME, cfg.username);
-    choose_emoji_from_username(cfg.username, msg.emoji);
+    memcpy(msg.emoji, cfg.emoji, MAX_EMOJI);
     safe_strncpy(msg.groupe, MAX_GROUP_NAME, group_name);
-    snprintf(msg.texte, MAX_TEXT, "%.*s", (int)MAX_TEXT - 1, texte ? texte : "");
+    if (!texte) texte = "";
+    snprintf(msg.texte, MAX_TEXT, "%.*s", (int)MAX_TEXT - 1, texte);
 
-    ssize_t n = sendto(sock_cli, &msg, sizeof(msg), 0,
-                       (struct sockaddr *)&addr_grp, sizeof(addr_grp));
+    ssize_t n = envoyer_isy_texte(&msg, texte, &addr_grp, id_groupe(port_groupe, id));
     check_fatal(n < 0, "sendto groupe MES");
 }
 
@@ -401,21 +504,21 @@ int main(void)
             snprintf(notif, sizeof(notif), "%s", shm_cli->notify);
             shm_cli->notify_flag = 0;
             shm_cli->notify[0] = '\0';
-            char newname[MAX_GROUP_NAME]; int newport;
-            if (sscanf(notif, "MIGRATE %31s %d", newname, &newport) == 2) {
+            char newname[MAX_GROUP_NAME]; int newport, newid = -1;
+            if (sscanf(notif, "MIGRATE %31s %d %d", newname, &newport, &newid) >= 2) {
                 printf("[AUTOJOIN] Migration notice: %s -> %d\n", newname, newport);
                 fflush(stdout);
                 char joincmd[128];
                 snprintf(joincmd, sizeof(joincmd), "JOIN %s", newname);
-                char reply[256]; int port_g = -1;
-                send_command_to_server(joincmd, reply, sizeof(reply), NULL, &port_g);
+                char reply[256]; int port_g = -1, id_g = -1;
+                send_command_to_server(joincmd, reply, sizeof(reply), NULL, &port_g, &id_g);
                 if (port_g > 0) {
                     if (pid_affichage <= 0) pid_affichage = start_affichage();
-                    connect_to_group(newname, port_g);
+                    connect_to_group(newname, port_g, id_g);
                     printf("[AUTOJOIN] Rejoint le groupe %s (port %d) via server reply\n", newname, port_g);
                 } else if (newport > 0) {
                     if (pid_affichage <= 0) pid_affichage = start_affichage();
-                    connect_to_group(newname, newport);
+                    connect_to_group(newname, newport, newid);
                     printf("[AUTOJOIN] Rejoint le groupe %s (port %d) via MIGRATE port\n", newname, newport);
                 }
             }
@@ -450,9 +553,9 @@ int main(void)
             snprintf(cmd, sizeof(cmd), "JOIN %s", group_name);
 
             char reply[256];
-            int  port_groupe = -1;
+            int  port_groupe = -1, id = -1;
             send_command_to_server(cmd, reply, sizeof(reply),
-                                   NULL, &port_groupe);
+                                   NULL, &port_groupe, &id);
 
             printf("Réponse serveur : %s\n", reply);
 
@@ -461,7 +564,7 @@ int main(void)
                 snprintf(checkban_cmd, sizeof(checkban_cmd), "CHECKBAN %s", group_name);
                 
                 char ban_reply[256];
-                send_command_to_server(checkban_cmd, ban_reply, sizeof(ban_reply), NULL, NULL);
+                send_command_to_server(checkban_cmd, ban_reply, sizeof(ban_reply), NULL, NULL, NULL);
                 
                 if (strncmp(ban_reply, "BANNED", 6) == 0) {
                     printf("\n❌ ERREUR: Vous avez été banni de ce groupe et ne pouvez pas le rejoindre.\n\n");
@@ -471,7 +574,7 @@ int main(void)
                 if (pid_affichage <= 0) {
                     pid_affichage = start_affichage();
                 }
-                connect_to_group(group_name, port_groupe);
+                connect_to_group(group_name, port_groupe, id);
 
                 /* Boucle de dialogue avec monitoring du processus d'affichage */
                 printf("Entrez vos messages (\"quit\" pour revenir au menu) :\n");
@@ -508,11 +611,11 @@ int main(void)
                     
                     printf("> ");
                     fflush(stdout);
-                    if (!fgets(buffer, sizeof(buffer), stdin))
+                    if (!fgets(saisie, sizeof(saisie), stdin))
                         break;
-                    buffer[strcspn(buffer, "\n")] = '\0';
+                    saisie[strcspn(saisie, "\n")] = '\0';
 
-                    if (strcmp(buffer, "quit") == 0){
+                    if (strcmp(saisie, "quit") == 0){
                         if (pid_affichage > 0) {
                             pid_t g = -pid_affichage;
                             if (kill(g, SIGTERM) < 0) {
@@ -536,7 +639,7 @@ int main(void)
                         }
                         break;
                     }
-                    send_message_to_group(group_name, port_groupe, buffer);
+                    send_message_to_group(group_name, port_groupe, id, saisie);
                 }
             }
         }
@@ -553,13 +656,13 @@ int main(void)
             char reply[256];
             int port_groupe = -1;
             send_command_to_server(cmd, reply, sizeof(reply),
-                                   NULL, &port_groupe);
+                                   NULL, &port_groupe, NULL);
             printf("Réponse serveur : %s\n", reply);
         }
         else if (choice == 3) {
             char reply[512];
             send_command_to_server("LIST", reply, sizeof(reply),
-                                   NULL, NULL);
+                                   NULL, NULL, NULL);
             printf("Groupes disponibles :\n%s\n", reply);
         }
         else if (choice == 4) {
@@ -580,7 +683,7 @@ int main(void)
             char cmd[256];
             snprintf(cmd, sizeof(cmd), "MERGE %s %s %s", g1, g2, newname);
             char reply[256];
-            send_command_to_server(cmd, reply, sizeof(reply), NULL, NULL);
+            send_command_to_server(cmd, reply, sizeof(reply), NULL, NULL, NULL);
             printf("Réponse serveur : %s\n", reply);
         }
         else if (choice == 5) {
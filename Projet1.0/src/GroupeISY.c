@@ -1,580 +1,407 @@
+#define _GNU_SOURCE
 #include "../include/Commun.h"
-#include <strings.h>
+#include "../include/groupe.h"
+#include "../include/reception.h"
+#include "../include/journal.h"
+#include "../include/reserve.h"
 #include <fcntl.h>
-#include <sys/stat.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/prctl.h>
 
-static void ensure_infogroup_dir(void)
-{
-    mkdir("infoGroup", 0755);  
-}
+static GroupeEtat groupe;
+static ReceptionLot reception;
+static int running = 1;
+static int taille_lot = RECEPTION_LOT_DEFAUT;
+static int verbose = 0;
+
+/* --workers N : N sockets liées au port du groupe (SO_REUSEPORT), un thread
+ * chacune. Le noyau répartit les datagrammes selon leur adresse source :
+ * ceux d'un émetteur arrivent tous au même thread, qui les traite dans
+ * l'ordre. Le traitement se fait sous 'verrou', le fan-out après
+ * (groupe_partager), si bien que les diffusions d'un groupe très suivi
+ * occupent autant de cœurs que de workers. */
+typedef struct {
+    int sock;
+    Reassembleur reassemblage;
+    ReceptionLot *reception;
+    pthread_t thread;
+} Poste;
+
+static Poste *postes;
+static int nb_postes;
+static pthread_mutex_t verrou = PTHREAD_MUTEX_INITIALIZER;
+static int evfd_arret = -1;
 
-static void build_group_file_path(const char *group_name, char *path, size_t path_size)
+void handle_sigint(int sig)
 {
-    snprintf(path, path_size, "infoGroup/%s.txt", group_name);
+    (void)sig;
+    running = 0;
 }
 
-
-
-
-static void build_banned_file_path(const char *group_name, char *path, size_t path_size)
+static void tracer_paquet(const ReceptionLot *r, int i)
 {
-    snprintf(path, path_size, "infoGroup/%s_banned.txt", group_name);
+    char ip_src[64];
+    inet_ntop(AF_INET, &r->srcs[i].sin_addr, ip_src, sizeof(ip_src));
+    printf("[DEBUG GROUPE] paquet v%d reçu ordre='%s' emetteur='%s' texte='%s' depuis %s:%d (%zu octets)\n",
+           r->infos[i].version, r->msgs[i].ordre, r->msgs[i].emetteur, r->msgs[i].texte, ip_src,
+           ntohs(r->srcs[i].sin_port), r->infos[i].taille);
 }
 
-static int is_ip_banned(const char *group_name, const char *ip)
+static void *worker(void *arg)
 {
-    char filepath[256];
-    build_banned_file_path(group_name, filepath, sizeof(filepath));
-    
-    FILE *f = fopen(filepath, "r");
-    if (!f) return 0; 
-    
-    char line[64];
-    int found = 0;
-    while (fgets(line, sizeof(line), f)) {
-        char *p = strchr(line, '\n');
-        if (p) *p = '\0';
-        if (strcmp(line, ip) == 0) {
-            found = 1;
+    Poste *p = arg;
+    struct pollfd pfd[2] = {
+        { .fd = p->sock,     .events = POLLIN },
+        { .fd = evfd_arret,  .events = POLLIN },
+    };
+
+    for (;;) {
+        if (poll(pfd, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll groupe");
             break;
         }
-    }
-    fclose(f);
-    return found;
-}
-
-static void ban_ip_from_group(const char *group_name, const char *ip)
-{
-    ensure_infogroup_dir();
-    char filepath[256];
-    build_banned_file_path(group_name, filepath, sizeof(filepath));
-    
-    FILE *f = fopen(filepath, "a");
-    if (f) {
-        fprintf(f, "%s\n", ip);
-        fclose(f);
-    }
-}
-
-/* Liste des clients d'un groupe */
-typedef struct {
-    int actif;
-    struct sockaddr_in addr_cli;  
-    char nom[MAX_USERNAME];
-    char emoji[MAX_EMOJI];       
-} ClientInfo;
-
-static ClientInfo clients[MAX_CLIENTS_GROUP];
-static int sock_grp;
-static int running = 1;
-static GroupStats *stats = NULL;
-static char g_group_name[MAX_GROUP_NAME];
+        if (pfd[1].revents)
+            break;
 
-static void rebuild_group_file(const char *group_name)
-{
-    ensure_infogroup_dir();
-    char filepath[256];
-    build_group_file_path(group_name, filepath, sizeof(filepath));
-    
-    unlink(filepath);
-    
-   
-    FILE *f = fopen(filepath, "w");
-    if (f) {
-        for (int i = 0; i < MAX_CLIENTS_GROUP; ++i) {
-            if (clients[i].actif) {
-                char ip_str[64];
-                inet_ntop(AF_INET, &clients[i].addr_cli.sin_addr, ip_str, sizeof(ip_str));
-                fprintf(f, "%s:%s:%s\n", clients[i].nom, ip_str, clients[i].emoji);
+        for (;;) {
+            int n = reception_lot(p->sock, p->reception, taille_lot, MSG_DONTWAIT,
+                                  &p->reassemblage);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            /* Les réponses partent de la socket qui a reçu le lot */
+            pthread_mutex_lock(&verrou);
+            groupe.sock = p->sock;
+            for (int i = 0; i < n; ++i) {
+                if (verbose) tracer_paquet(p->reception, i);
+                groupe_traiter(&groupe, &p->reception->msgs[i], &p->reception->infos[i],
+                               &p->reception->srcs[i]);
             }
+            groupe_fin_lot(&groupe);
+            pthread_mutex_unlock(&verrou);
+            groupe_diffuser(&groupe);
+            reception_rendre(p->reception);
+            if (verbose) fflush(stdout);
+            if (n < taille_lot) break;
         }
-        fclose(f);
     }
+    return NULL;
 }
 
-void handle_sigint(int sig)
+/* Sockets des nb workers sur le port : 'liees' sont déjà liées, la
+ * première étant celle du groupe ; les autres sont ouvertes ici. Toutes le
+ * sont avant que le serveur n'annonce le groupe, la répartition du noyau ne
+ * change donc plus ensuite. */
+static int ouvrir_postes(const int *liees, int nb_liees, int port, int nb)
 {
-    (void)sig;
-    running = 0;
-}
+    postes = calloc((size_t)nb, sizeof(Poste));
+    if (!postes) return -1;
+    nb_postes = nb;
+    for (int i = 0; i < nb; ++i) {
+        Poste *p = &postes[i];
+        p->sock = i < nb_liees ? liees[i] : socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (p->sock < 0) {
+            perror("socket worker");
+            return -1;
+        }
+        p->reception = malloc(sizeof(ReceptionLot));
+        if (!p->reception) return -1;
+        reassembleur_init(&p->reassemblage);
+        if (i == 0) continue;
+        if (i < nb_liees) {
+            if (trace_horodater(p->sock) < 0) perror("SO_TIMESTAMPNS worker");
+            if (groupe_preparer_socket(p->sock) < 0) perror("IP_MULTICAST_IF worker");
+            continue;
+        }
 
-static void load_group_file_into_memory(const char *group_name)
-{
-    ensure_infogroup_dir();
-    char filepath[256];
-    build_group_file_path(group_name, filepath, sizeof(filepath));
-    
-    FILE *f = fopen(filepath, "r");
-    if (!f) {
-        printf("[GROUP] No existing group file to load for %s\n", group_name);
-        return;
-    }
-    
-    printf("[GROUP] Loading members from %s...\n", filepath);
-    
-    int loaded = 0;
-    char line[256];
-    while (fgets(line, sizeof(line), f) && loaded < MAX_CLIENTS_GROUP) {
-        char username[MAX_USERNAME];
-        char ip[64];
-        char emoji[MAX_EMOJI];
-        
-        if (sscanf(line, "%19[^:]:%63[^:]:%7s", username, ip, emoji) == 3) {
-           
-            struct sockaddr_in addr;
-            memset(&addr, 0, sizeof(addr));
-            addr.sin_family = AF_INET;
-            inet_pton(AF_INET, ip, &addr.sin_addr);
-            addr.sin_port = htons(0);  
-            
-           
-            for (int i = 0; i < MAX_CLIENTS_GROUP; ++i) {
-                if (!clients[i].actif) {
-                    clients[i].actif = 1;
-                    snprintf(clients[i].nom, MAX_USERNAME, "%s", username);
-                    clients[i].addr_cli = addr;
-                    snprintf(clients[i].emoji, MAX_EMOJI, "%s", emoji);
-                    printf("[GROUP]   Loaded: %s (%s) emoji=%s\n", username, ip, emoji);
-                    loaded++;
-                    break;
-                }
-            }
+        int un = 1;
+        if (setsockopt(p->sock, SOL_SOCKET, SO_REUSEPORT, &un, sizeof(un)) < 0) {
+            perror("SO_REUSEPORT worker");
+            return -1;
         }
+        struct sockaddr_in addr;
+        fill_sockaddr(&addr, NULL, port);
+        if (bind(p->sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+            perror("bind worker");
+            return -1;
+        }
+        if (trace_horodater(p->sock) < 0) perror("SO_TIMESTAMPNS worker");
+        if (groupe_preparer_socket(p->sock) < 0) perror("IP_MULTICAST_IF worker");
     }
-    fclose(f);
-    printf("[GROUP] Loaded %d members from group file\n", loaded);
+    return 0;
 }
 
-
-static int add_client(const char *name,
-                       struct sockaddr_in *addr, int display_port)
+/* Workers lancés avec SIGINT et SIGTERM bloqués : seul le thread principal
+ * les reçoit, puis les arrête par l'eventfd */
+static void servir_workers(void)
 {
-    char ip_str[64];
-    inet_ntop(AF_INET, &addr->sin_addr, ip_str, sizeof(ip_str));
-    
-    if (is_ip_banned(g_group_name, ip_str)) {
-        printf("Client %s (%s) rejected: IP is banned from group %s\n", 
-               name, ip_str, g_group_name);
-        return 1;  
-    }
-    
-    for (int i = 0; i < MAX_CLIENTS_GROUP; ++i) {
-        if (clients[i].actif) {
-            char existing_ip[64];
-            inet_ntop(AF_INET, &clients[i].addr_cli.sin_addr, existing_ip, sizeof(existing_ip));
-            if (strcmp(existing_ip, ip_str) == 0) {
-                printf("Client %s (%s) already connected to group %s, updating info\n",
-                       name, ip_str, g_group_name);
-                snprintf(clients[i].nom, MAX_USERNAME, "%s", name);
-                clients[i].addr_cli.sin_port = htons(display_port);
-                return 0; 
-            }
-        }
-    }
-    
-    for (int i = 0; i < MAX_CLIENTS_GROUP; ++i) {
-        if (!clients[i].actif) {
-            clients[i].actif = 1;
-            snprintf(clients[i].nom, MAX_USERNAME, "%s", name);
-            clients[i].addr_cli = *addr;
-            clients[i].addr_cli.sin_port = htons(display_port);
-            
-            char emoji_from_ip[MAX_EMOJI];
-            choose_emoji_from_ip(ip_str, emoji_from_ip);
-            snprintf(clients[i].emoji, MAX_EMOJI, "%s", emoji_from_ip);
-            
-            if (stats) stats->nb_clients++;
-            printf("Client %s ajouté (port %d, IP: %s, emoji: %s)\n",
-                   name, display_port, ip_str, emoji_from_ip);
-
-            rebuild_group_file(g_group_name);
-            
-            return 0;  
+    sigset_t signaux, ancien;
+    sigemptyset(&signaux);
+    sigaddset(&signaux, SIGINT);
+    sigaddset(&signaux, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signaux, &ancien);
+
+    evfd_arret = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    check_fatal(evfd_arret < 0, "eventfd groupe");
+    groupe_partager(&groupe);
+    int lances = 0;
+    for (; lances < nb_postes; ++lances)
+        if (pthread_create(&postes[lances].thread, NULL, worker, &postes[lances]) != 0) {
+            perror("pthread_create worker");
+            running = 0;
+            break;
         }
-    }
-    printf("Plus de place pour de nouveaux clients dans ce groupe\n");
-    return 2;  
+
+    while (running)
+        sigsuspend(&ancien);
+    pthread_sigmask(SIG_SETMASK, &ancien, NULL);
+
+    uint64_t un = 1;
+    if (write(evfd_arret, &un, sizeof(un)) != sizeof(un))
+        perror("write eventfd groupe");
+    for (int i = 0; i < lances; ++i)
+        pthread_join(postes[i].thread, NULL);
+    close(evfd_arret);
 }
 
-static void add_client_direct(const char *name, const char *ip, int display_port, const char *emoji)
+static void fermer_postes(void)
 {
-    struct sockaddr_in addr;
-    memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    inet_pton(AF_INET, ip, &addr.sin_addr);
-    for (int i = 0; i < MAX_CLIENTS_GROUP; ++i) {
-        if (clients[i].actif) {
-            char existing_ip[64];
-            inet_ntop(AF_INET, &clients[i].addr_cli.sin_addr, existing_ip, sizeof(existing_ip));
-            if (strcmp(existing_ip, ip) == 0 && ntohs(clients[i].addr_cli.sin_port) == display_port) {
-                snprintf(clients[i].nom, MAX_USERNAME, "%s", name);
-                snprintf(clients[i].emoji, MAX_EMOJI, "%s", emoji);
-                return;
-            }
-        }
+    for (int i = 1; i < nb_postes; ++i)
+        if (postes[i].sock >= 0) close(postes[i].sock);
+    for (int i = 0; i < nb_postes; ++i) {
+        reassembleur_liberer(&postes[i].reassemblage);
+        free(postes[i].reception);
     }
-    add_client(name, &addr, display_port);
+    free(postes);
 }
 
-static void broadcast_message(ISYMessage *msg)
+/* Processus en réserve (reserve.h) : attend le groupe que le serveur lui
+ * confie. Renvoie le nombre de sockets reçues, 0 pour sortir sans groupe. */
+static int attendre_groupe(int canal, ReserveOrdre *ordre, int *socks)
 {
-    for (int i = 0; i < MAX_CLIENTS_GROUP; ++i) {
-        if (clients[i].actif && strcmp(clients[i].nom, msg->emetteur) == 0) {
-            char ip_str[64];
-            inet_ntop(AF_INET, &clients[i].addr_cli.sin_addr, ip_str, sizeof(ip_str));
-            choose_emoji_from_ip(ip_str, msg->emoji);
-            break;
-        }
-    }
-    
-    for (int i = 0; i < MAX_CLIENTS_GROUP; ++i) {
-        if (clients[i].actif) {
-            sendto(sock_grp, msg, sizeof(*msg), 0,
-                   (struct sockaddr *)&clients[i].addr_cli,
-                   sizeof(clients[i].addr_cli));
-        }
+    printf("GroupeISY en reserve (pid %d)\n", (int)getpid());
+    fflush(stdout);
+    int nb;
+    while ((nb = reserve_recevoir(canal, ordre, socks, RESERVE_SOCKETS_MAX)) < 0 &&
+           errno == EINTR && running)
+        ;
+    if (nb < 0 && errno != EINTR) perror("reserve GroupeISY");
+    close(canal);
+    return nb > 0 ? nb : 0;
+}
+
+/* Lance un RelaisISY, qui s'inscrit de lui-même auprès du groupe et meurt
+ * avec lui */
+static void lancer_relais(int port)
+{
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork RelaisISY");
+        return;
     }
+    if (pid > 0) return;
+
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    char port_str[16];
+    snprintf(port_str, sizeof(port_str), "%d", port);
+    char *args[] = { "bin/RelaisISY", port_str, NULL };
+    execv("bin/RelaisISY", args);
+    perror("execv RelaisISY");
+    _exit(EXIT_FAILURE);
 }
 
 int main(int argc, char *argv[])
 {
-    if (argc < 4) {
+    /* "--reserve fd" : processus en réserve, le groupe arrive par le canal */
+    int canal = -1;
+    int premiere_option = 4;
+    if (argc >= 3 && strcmp(argv[1], "--reserve") == 0) {
+        canal = atoi(argv[2]);
+        premiere_option = 3;
+    } else if (argc < 4) {
         fprintf(stderr,
-                "Usage: %s <nom_groupe> <moderateur> <port>\n",
-                argv[0]);
+                "Usage: %s <nom_groupe> <moderateur> <port> [--lot N] [--fsync N] "
+                "[--compactage N] [--historique N] [--message-max N] "
+                "[--reassemblage N] [--multicast adresse[:port]] "
+                "[--multicast-if adresse] [--relais N] [--workers N] [--verbose] "
+                "[--pret fd]\n"
+                "       %s --reserve fd [options]\n",
+                argv[0], argv[0]);
         return EXIT_FAILURE;
     }
 
-    const char *nom_groupe = argv[1];
-    const char *moderateur = argv[2];
-    int port = atoi(argv[3]);
-
-    snprintf(g_group_name, sizeof(g_group_name), "%s", nom_groupe);
-
-    memset(clients, 0, sizeof(clients));
-    
-    load_group_file_into_memory(nom_groupe);
-
-    key_t key = SHM_GROUP_KEY_BASE + (port - GROUP_PORT_BASE);
-    int shm_id = shmget(key, sizeof(GroupStats), 0666);
-    if (shm_id >= 0) {
-        stats = shmat(shm_id, NULL, 0);
-        if (stats != (void *)-1) {
-            stats->nb_clients = 0;
-            stats->nb_messages = 0;
-        } else {
-            stats = NULL;
+    ReserveOrdre ordre;
+    memset(&ordre, 0, sizeof(ordre));
+    if (canal < 0) {
+        snprintf(ordre.nom, sizeof(ordre.nom), "%s", argv[1]);
+        snprintf(ordre.moderateur, sizeof(ordre.moderateur), "%s", argv[2]);
+        ordre.port = atoi(argv[3]);
+        ordre.id = ordre.port - GROUP_PORT_BASE;
+    }
+    int fsync_lot = JOURNAL_FSYNC_DEFAUT;
+    int compactage = JOURNAL_COMPACTAGE_DEFAUT;
+    int fd_pret = -1;             /* tube vers ServeurISY, signalé après le bind */
+    size_t message_max = PROTO_MESSAGE_MAX;
+    size_t memoire_reassemblage = FRAGMENT_MEMOIRE_DEFAUT;
+    const char *multicast = NULL, *multicast_if = NULL;
+    int nb_relais = 0;
+    int nb_workers = 1;
+
+    for (int i = premiere_option; i < argc; ++i) {
+        if (strcmp(argv[i], "--lot") == 0 && i + 1 < argc)
+            taille_lot = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--verbose") == 0)
+            verbose = 1;
+        else if (strcmp(argv[i], "--fsync") == 0 && i + 1 < argc)
+            fsync_lot = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--compactage") == 0 && i + 1 < argc)
+            compactage = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--historique") == 0 && i + 1 < argc)
+            historique_configurer(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--message-max") == 0 && i + 1 < argc)
+            message_max = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--reassemblage") == 0 && i + 1 < argc)
+            memoire_reassemblage = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--multicast") == 0 && i + 1 < argc)
+            multicast = argv[++i];
+        else if (strcmp(argv[i], "--multicast-if") == 0 && i + 1 < argc)
+            multicast_if = argv[++i];
+        else if (strcmp(argv[i], "--relais") == 0 && i + 1 < argc)
+            nb_relais = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc)
+            nb_workers = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--pret") == 0 && i + 1 < argc)
+            fd_pret = atoi(argv[++i]);
+    }
+    if (multicast && groupe_configurer_multicast(multicast, multicast_if) < 0) {
+        fprintf(stderr, "GroupeISY: adresse multicast invalide (%s)\n", multicast);
+        return EXIT_FAILURE;
+    }
+    if (nb_relais < 0 || nb_relais > RELAIS_MAX) {
+        fprintf(stderr, "GroupeISY: 0 à %d relais\n", RELAIS_MAX);
+        return EXIT_FAILURE;
+    }
+    if (nb_workers < 1 || nb_workers > GROUPE_WORKERS_MAX) {
+        fprintf(stderr, "GroupeISY: 1 à %d workers\n", GROUPE_WORKERS_MAX);
+        return EXIT_FAILURE;
+    }
+    if (taille_lot < 1) taille_lot = 1;
+    if (taille_lot > RECEPTION_LOT_MAX) taille_lot = RECEPTION_LOT_MAX;
+    fragment_configurer(message_max, memoire_reassemblage);
+    /* Les changements de membres partent au journal, écrit en tâche de fond */
+    check_fatal(journal_demarrer(fsync_lot, compactage) < 0, "journal_demarrer");
+
+    /* Sans SA_RESTART : SIGTERM doit interrompre recvmmsg (ou l'attente en
+     * réserve) pour sortir */
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_sigint;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    /* En réserve : sockets liées par le serveur, une par worker */
+    int socks[RESERVE_SOCKETS_MAX];
+    int nb_liees = 0;
+    if (canal >= 0) {
+        nb_liees = attendre_groupe(canal, &ordre, socks);
+        if (nb_liees == 0) {
+            journal_arreter();
+            return running ? EXIT_FAILURE : 0;
         }
+        nb_workers = nb_liees;
+    }
+    const char *nom_groupe = ordre.nom;
+    const char *moderateur = ordre.moderateur;
+    int port = ordre.port;
+
+    int sock_grp = nb_liees > 0 ? socks[0] : create_udp_socket();
+    /* Heure d'arrivée noyau des messages tracés */
+    if (trace_horodater(sock_grp) < 0) perror("SO_TIMESTAMPNS groupe");
+    groupe_init(&groupe, ordre.id, nom_groupe, moderateur, sock_grp);
+
+    /* Métriques dans le segment créé par le serveur, avant le chargement
+     * qui y compte les membres et y relie le journal */
+    GroupStats *stats = metriques_attacher(SHM_GROUP_KEY_BASE + ordre.id, 0);
+    if (stats) {
+        metriques_init(stats, ordre.id, nom_groupe);
+        groupe.stats = stats;
     }
 
-    signal(SIGINT, handle_sigint);
-    signal(SIGTERM, handle_sigint);
-
-    sock_grp = create_udp_socket();
-    int flags_grp = fcntl(sock_grp, F_GETFD);
-    if (flags_grp != -1) fcntl(sock_grp, F_SETFD, flags_grp | FD_CLOEXEC);
-    struct sockaddr_in addr_grp, addr_src;
-    socklen_t addrlen = sizeof(addr_src);
-
-    fill_sockaddr(&addr_grp, NULL, port);
-    check_fatal(bind(sock_grp, (struct sockaddr *)&addr_grp,
-                     sizeof(addr_grp)) < 0, "bind groupe");
-    printf("[GROUPE] Bind success on port %d\n", port);
+    groupe_charger(&groupe);
+
+    if (nb_liees == 0) {
+        int flags_grp = fcntl(sock_grp, F_GETFD);
+        if (flags_grp != -1) fcntl(sock_grp, F_SETFD, flags_grp | FD_CLOEXEC);
+        struct sockaddr_in addr_grp;
+
+        fill_sockaddr(&addr_grp, NULL, port);
+        int un = 1;
+        check_fatal(nb_workers > 1 &&
+                    setsockopt(sock_grp, SOL_SOCKET, SO_REUSEPORT, &un, sizeof(un)) < 0,
+                    "SO_REUSEPORT groupe");
+        check_fatal(bind(sock_grp, (struct sockaddr *)&addr_grp,
+                         sizeof(addr_grp)) < 0, "bind groupe");
+        socks[nb_liees++] = sock_grp;
+        printf("[GROUPE] Bind success on port %d\n", port);
+    } else {
+        printf("[GROUPE] Socket du port %d recue du serveur\n", port);
+    }
+    if (nb_workers > 1)
+        check_fatal(ouvrir_postes(socks, nb_liees, port, nb_workers) < 0, "workers groupe");
+    /* Bannis chargés : au serveur avant le signal "prêt", donc avant la
+     * réponse au CREATE */
+    groupe_annoncer_bannis(&groupe);
     fflush(stdout);
-    printf("GroupeISY '%s' lancé, moderateur=%s, port=%d\n",
-           nom_groupe, moderateur, port);
-
-    ISYMessage msg;
+    if (fd_pret >= 0) {
+        if (write(fd_pret, "1", 1) != 1)
+            perror("write pret");
+        close(fd_pret);
+    }
+    printf("GroupeISY '%s' lancé, moderateur=%s, port=%d, lot=%d, workers=%d\n",
+           nom_groupe, moderateur, port, taille_lot, nb_workers);
+
+    /* Relais après le bind : leur inscription trouve le groupe à l'écoute.
+     * Ils ne sont pas attendus (SIGCHLD ignoré, pas de zombies). */
+    if (nb_relais > 0) signal(SIGCHLD, SIG_IGN);
+    for (int r = 0; r < nb_relais; ++r)
+        lancer_relais(port);
+
+    if (nb_workers > 1) {
+        servir_workers();
+        fermer_postes();
+    }
 
+    /* Un réveil draine jusqu'à taille_lot paquets ; réponses, diffusions et
+     * sauvegarde des membres sont faites une seule fois par lot. */
     while (running) {
-        ssize_t n = recvfrom(sock_grp, &msg, sizeof(msg), 0, (struct sockaddr *)&addr_src, &addrlen);
+        int n = reception_lot(sock_grp, &reception, taille_lot, 0,
+                              &groupe.reassemblage);
         if (n < 0) {
             if (errno == EINTR) continue;
-            perror("recvfrom groupe");
+            perror("recvmmsg groupe");
             break;
         }
 
-        addrlen = sizeof(addr_src);              
-        {
-            char ip_src[64];
-            inet_ntop(AF_INET, &addr_src.sin_addr, ip_src, sizeof(ip_src));
-            printf("[DEBUG GROUPE] paquet reçu ordre='%s' emetteur='%s' texte='%s' depuis %s:%d\n",
-                   msg.ordre, msg.emetteur, msg.texte, ip_src, ntohs(addr_src.sin_port));
-            fflush(stdout);
-        }
-
-        if (strncmp(msg.ordre, ORDRE_CON, 3) == 0) {
-            /* msg.texte contient le port d'affichage du client */
-            int display_port = atoi(msg.texte);
-            int status = add_client(msg.emetteur, &addr_src, display_port);
-            
-            if (status == 1) {
-                ISYMessage error_msg;
-                memset(&error_msg, 0, sizeof(error_msg));
-                strcpy(error_msg.ordre, ORDRE_MSG);
-                snprintf(error_msg.emetteur, MAX_USERNAME, "SERVER");
-                choose_emoji_from_username("SERVER", error_msg.emoji);
-                strncpy(error_msg.groupe, nom_groupe, MAX_GROUP_NAME - 1);
-                error_msg.groupe[MAX_GROUP_NAME - 1] = '\0';
-                snprintf(error_msg.texte, sizeof(error_msg.texte), "VOUS_ETES_BANNI");
-                
-                struct sockaddr_in addr_display;
-                memcpy(&addr_display, &addr_src, sizeof(addr_src));
-                addr_display.sin_port = htons(display_port);
-                ssize_t s = sendto(sock_grp, &error_msg, sizeof(error_msg), 0,
-                                   (struct sockaddr *)&addr_display, sizeof(addr_display));
-                if (s < 0) perror("sendto ban error");
-            }
-        }
-        else if (strncmp(msg.ordre, ORDRE_MSG, 3) == 0) {
-            if (stats) stats->nb_messages++;
-            snprintf(msg.groupe, MAX_GROUP_NAME, "%s", nom_groupe);
-
-           
-            if (strcasecmp(msg.texte, "list") == 0) {
-                if (strcmp(msg.emetteur, moderateur) == 0) {
-                    char buf[2048]; buf[0] = '\0'; 
-                    char filepath[256];
-                    build_group_file_path(nom_groupe, filepath, sizeof(filepath));
-                    
-                    FILE *f = fopen(filepath, "r");
-                    if (f) {
-                        char line[256];
-                        int first = 1;
-                        while (fgets(line, sizeof(line), f)) {
-                            char username[MAX_USERNAME];
-                            char ip_str[64];
-                            char emoji[MAX_EMOJI];
-                            if (sscanf(line, "%19[^:]:%63[^:]:%s", username, ip_str, emoji) == 3) {
-                                if (!first) {
-                                    size_t buf_len = strlen(buf);
-                                    size_t remaining = sizeof(buf) - buf_len - 1;
-                                    if (remaining > 2) {
-                                        snprintf(buf + buf_len, remaining + 1, ", ");
-                                    }
-                                }
-                                char member_line[128];
-                                snprintf(member_line, sizeof(member_line), "%s %s (%s)", 
-                                        emoji, ip_str, username);
-                                size_t buf_len = strlen(buf);
-                                size_t remaining = sizeof(buf) - buf_len - 1;
-                                if (remaining > 0) {
-                                    snprintf(buf + buf_len, remaining + 1, "%s", member_line);
-                                }
-                                first = 0;
-                            }
-                        }
-                        fclose(f);
-                    }
-                    if (buf[0] == '\0') snprintf(buf, sizeof(buf), "Aucun membre\n");
-
-                    ISYMessage resp;
-                    memset(&resp, 0, sizeof(resp));
-                    strcpy(resp.ordre, ORDRE_MSG);
-                    strncpy(resp.emetteur, "SERVER", MAX_USERNAME - 1);
-                    resp.emetteur[MAX_USERNAME - 1] = '\0';
-                    choose_emoji_from_username("SERVER", resp.emoji);
-                    strncpy(resp.groupe, nom_groupe, MAX_GROUP_NAME - 1);
-                    resp.groupe[MAX_GROUP_NAME - 1] = '\0';
-                    snprintf(resp.texte, sizeof(resp.texte), "%s", buf);
-
-                    int found = 0;
-                    struct sockaddr_in target;
-                    memset(&target, 0, sizeof(target));
-                    for (int i = 0; i < MAX_CLIENTS_GROUP; ++i) {
-                        if (clients[i].actif && strcmp(clients[i].nom, msg.emetteur) == 0) {
-                            target = clients[i].addr_cli;
-                            found = 1;
-                            break;
-                        }
-                    }
-                    if (!found) {
-                        target = addr_src;
-                    }
-                    ssize_t s = sendto(sock_grp, &resp, sizeof(resp), 0, (struct sockaddr *)&target, sizeof(target));
-                    if (s < 0) perror("sendto list reply");
-                } else {
-                    ISYMessage deny;
-                    memset(&deny,0,sizeof(deny));
-                    strcpy(deny.ordre, ORDRE_MSG);
-                    strncpy(deny.emetteur, "SERVER", MAX_USERNAME-1);
-                    deny.emetteur[MAX_USERNAME-1] = '\0';
-                    choose_emoji_from_username("SERVER", deny.emoji);
-                    snprintf(deny.texte, sizeof(deny.texte), "Permission refusee: seul le moderateur peut lister les membres");
-                    ssize_t s = sendto(sock_grp, &deny, sizeof(deny), 0, (struct sockaddr *)&addr_src, sizeof(addr_src));
-                    if (s < 0) perror("sendto deny");
-                }
-            } else if (strncmp(msg.texte, "ban ", 4) == 0) {
-                if (strcmp(msg.emetteur, moderateur) == 0) {
-                    char ban_ip[64] = {0};
-                    if (sscanf(msg.texte, "ban %63s", ban_ip) == 1) {
-                        int found_client = -1;
-                        for (int i = 0; i < MAX_CLIENTS_GROUP; ++i) {
-                            if (clients[i].actif) {
-                                char client_ip[64];
-                                inet_ntop(AF_INET, &clients[i].addr_cli.sin_addr, client_ip, sizeof(client_ip));
-                                if (strcmp(client_ip, ban_ip) == 0) {
-                                    found_client = i;
-                                    break;
-                                }
-                            }
-                        }
-                        
-                        if (found_client != -1) {
-                            ban_ip_from_group(nom_groupe, ban_ip);
-                            
-                            char banned_username[MAX_USERNAME];
-                            snprintf(banned_username, sizeof(banned_username), "%s", clients[found_client].nom);
-                            clients[found_client].actif = 0;
-                            if (stats) stats->nb_clients--;
-                            
-                            ISYMessage ban_msg;
-                            memset(&ban_msg, 0, sizeof(ban_msg));
-                            strcpy(ban_msg.ordre, ORDRE_MSG);
-                            snprintf(ban_msg.emetteur, MAX_USERNAME, "SERVER");
-                            choose_emoji_from_username("SERVER", ban_msg.emoji);
-                            strncpy(ban_msg.groupe, nom_groupe, MAX_GROUP_NAME - 1);
-                            snprintf(ban_msg.texte, sizeof(ban_msg.texte), "VOUS_ETES_BANNI");
-                            
-                            struct sockaddr_in addr_banned;
-                            memset(&addr_banned, 0, sizeof(addr_banned));
-                            addr_banned.sin_family = AF_INET;
-                            addr_banned.sin_addr = clients[found_client].addr_cli.sin_addr;
-                            addr_banned.sin_port = clients[found_client].addr_cli.sin_port;
-                            
-                            ssize_t s = sendto(sock_grp, &ban_msg, sizeof(ban_msg), 0,
-                                               (struct sockaddr *)&addr_banned, sizeof(addr_banned));
-                            if (s < 0) perror("sendto force ban message");
-                            
-                            ISYMessage ban_notice;
-                            memset(&ban_notice, 0, sizeof(ban_notice));
-                            strcpy(ban_notice.ordre, ORDRE_MSG);
-                            snprintf(ban_notice.emetteur, MAX_USERNAME, "SERVER");
-                            choose_emoji_from_username("SERVER", ban_notice.emoji);
-                            strncpy(ban_notice.groupe, nom_groupe, MAX_GROUP_NAME - 1);
-                            ban_notice.groupe[MAX_GROUP_NAME - 1] = '\0';
-                            snprintf(ban_notice.texte, sizeof(ban_notice.texte), "%s a ete banni du groupe (%s)", 
-                                    banned_username, ban_ip);
-                            broadcast_message(&ban_notice);
-                            
-                            rebuild_group_file(nom_groupe);
-                            
-                            printf("Client %s (%s) a ete banni du groupe %s\n", 
-                                   banned_username, ban_ip, nom_groupe);
-                        } else {
-                            ISYMessage error;
-                            memset(&error, 0, sizeof(error));
-                            strcpy(error.ordre, ORDRE_MSG);
-                            snprintf(error.emetteur, MAX_USERNAME, "SERVER");
-                            choose_emoji_from_username("SERVER", error.emoji);
-                            snprintf(error.texte, sizeof(error.texte), "IP %s non trouvee dans le groupe", ban_ip);
-                            ssize_t s = sendto(sock_grp, &error, sizeof(error), 0, (struct sockaddr *)&addr_src, sizeof(addr_src));
-                            if (s < 0) perror("sendto ban error");
-                        }
-                    }
-                } else {
-                    ISYMessage deny;
-                    memset(&deny, 0, sizeof(deny));
-                    strcpy(deny.ordre, ORDRE_MSG);
-                    snprintf(deny.emetteur, MAX_USERNAME, "SERVER");
-                    choose_emoji_from_username("SERVER", deny.emoji);
-                    snprintf(deny.texte, sizeof(deny.texte), "Permission refusee: seul le moderateur peut bannir");
-                    ssize_t s = sendto(sock_grp, &deny, sizeof(deny), 0, (struct sockaddr *)&addr_src, sizeof(addr_src));
-                    if (s < 0) perror("sendto deny ban");
-                }
-            } else {
-                broadcast_message(&msg);
-            }
-        }
-        else if (strncmp(msg.ordre, ORDRE_MGR, 3) == 0) {
-            /* On convertit pour informer les clients et leur montrer où se connecter */
-            ISYMessage notice;
-            memset(&notice, 0, sizeof(notice));
-            strcpy(notice.ordre, ORDRE_MSG);
-            strncpy(notice.emetteur, "SERVER", MAX_USERNAME - 1);
-            notice.emetteur[MAX_USERNAME - 1] = '\0';
-            choose_emoji_from_username("SERVER", notice.emoji);
-            strncpy(notice.groupe, nom_groupe, MAX_GROUP_NAME - 1);
-            notice.groupe[MAX_GROUP_NAME - 1] = '\0';
-            char newname[MAX_GROUP_NAME] = {0};
-            int newport = -1;
-            if (sscanf(msg.texte, "MIGRATE %31s %d", newname, &newport) == 2) {
-                snprintf(notice.texte, sizeof(notice.texte), "Groupe fusionné → %s (port %d)", newname, newport);
-                ISYMessage control;
-                memset(&control, 0, sizeof(control));
-                strcpy(control.ordre, ORDRE_MSG);
-                strncpy(control.emetteur, "SERVER", MAX_USERNAME - 1);
-                control.emetteur[MAX_USERNAME - 1] = '\0';
-                snprintf(control.emoji, MAX_EMOJI, "%s", notice.emoji);
-                snprintf(control.texte, sizeof(control.texte), "MIGRATE %s %d", newname, newport);
-                broadcast_message(&control);
-            }
-            else if (sscanf(msg.texte, "MIGRATEEXIST %31s %d", newname, &newport) == 2) {
-                struct sockaddr_in addr_target;
-                fill_sockaddr(&addr_target, "127.0.0.1", newport);
-                for (int i = 0; i < MAX_CLIENTS_GROUP; ++i) {
-                    if (!clients[i].actif) continue;
-                    char ipstr[64];
-                    inet_ntop(AF_INET, &clients[i].addr_cli.sin_addr, ipstr, sizeof(ipstr));
-                    ISYMessage addmsg;
-                    memset(&addmsg, 0, sizeof(addmsg));
-                    strcpy(addmsg.ordre, ORDRE_MGR);
-                    strncpy(addmsg.emetteur, nom_groupe, MAX_USERNAME - 1);
-                    addmsg.emetteur[MAX_USERNAME - 1] = '\0';
-                    snprintf(addmsg.emoji, MAX_EMOJI, "%s", clients[i].emoji);
-                    snprintf(addmsg.texte, sizeof(addmsg.texte), "ADDCLIENT %s %s %d", clients[i].nom, ipstr, ntohs(clients[i].addr_cli.sin_port));
-                    ssize_t r = sendto(sock_grp, &addmsg, sizeof(addmsg), 0, (struct sockaddr *)&addr_target, sizeof(addr_target));
-                    if (r < 0) perror("sendto ADDCLIENT");
-                }
-                {
-                    const char prefix[] = "Groupe fusionné → ";
-                    size_t avail = sizeof(notice.texte) - 1;
-                    strncpy(notice.texte, prefix, avail);
-                    notice.texte[avail] = '\0';
-                    size_t used = strlen(notice.texte);
-                    if (used < avail) {
-                        char buf[64];
-                        snprintf(buf, sizeof(buf), "%s (port %d)", newname, newport);
-                        strncat(notice.texte, buf, avail - used);
-                    }
-                }
-                ISYMessage control;
-                memset(&control, 0, sizeof(control));
-                strcpy(control.ordre, ORDRE_MSG);
-                strncpy(control.emetteur, "SERVER", MAX_USERNAME - 1);
-                control.emetteur[MAX_USERNAME - 1] = '\0';
-                snprintf(control.emoji, MAX_EMOJI, "%s", notice.emoji);
-                snprintf(control.texte, sizeof(control.texte), "MIGRATE %s %d", newname, newport);
-                broadcast_message(&control);
-            }
-            else if (strncmp(msg.texte, "ADDCLIENT", 9) == 0) {
-                char name[MAX_USERNAME] = {0};
-                char ipstr[64] = {0};
-                int port = 0;
-                if (sscanf(msg.texte, "ADDCLIENT %19s %63s %d", name, ipstr, &port) >= 3) {
-                    add_client_direct(name, ipstr, port, msg.emoji);
-                }
-                continue;
-            } else {
-                {
-                    const char prefix[] = "Groupe fusionné → ";
-                    size_t avail = sizeof(notice.texte) - 1;
-                    strncpy(notice.texte, prefix, avail);
-                    notice.texte[avail] = '\0';
-                    size_t used = strlen(notice.texte);
-                    if (used < avail) {
-                        snprintf(notice.texte + used, avail - used + 1, "%.*s", (int)(avail - used), msg.texte);
-                    }
-                }
-            }
-            broadcast_message(&notice);
+        for (int i = 0; i < n; ++i) {
+            if (verbose) tracer_paquet(&reception, i);
+            groupe_traiter(&groupe, &reception.msgs[i], &reception.infos[i], &reception.srcs[i]);
         }
+        reception_rendre(&reception);
+        groupe_fin_lot(&groupe);
+        if (verbose) fflush(stdout);
     }
 
     close(sock_grp);
-    if (stats && stats != (void *)-1)
-        shmdt(stats);
+    groupe_liberer(&groupe);
+    journal_arreter();
+    if (groupe.stats != &groupe.stats_locales)
+        metriques_detacher(groupe.stats);
 
     printf("GroupeISY '%s' termine\n", nom_groupe);
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,222 @@
+#define _GNU_SOURCE
+#include "../include/Commun.h"
+#include "../include/protocole.h"
+#include "../include/envoi.h"
+#include "../include/membres.h"
+#include "../include/relais.h"
+#include <poll.h>
+#include <time.h>
+
+/* Relais de diffusion d'un GroupeISY local (relais.h). Il s'inscrit auprès
+ * du groupe, tient sa tranche de membres à jour d'après les MAJ reçues et
+ * renvoie chaque diffusion à toute la tranche, par lots sendmmsg. Chaque
+ * relais occupe son propre cœur : le fan-out d'un grand groupe se répartit
+ * entre eux au lieu de saturer le processus du groupe.
+ *
+ * Usage: RelaisISY <port_groupe> [id_groupe]
+ * GroupeISY --relais N en lance N lui-même. L'id n'est requis que pour un
+ * groupe du moteur sur le port partagé (moteur.h).
+ */
+
+#define RELAIS_LOT 64             /* datagrammes lus par réveil */
+
+static int running = 1;
+static int sock;
+static struct sockaddr_in addr_groupe;
+static uint16_t id_groupe = PROTO_GROUPE_AUCUN;
+static TableMembres tranche;      /* membres servis, tous v2 */
+static EnvoiLot lot;
+static int inscrit = 0;
+static uint32_t seq_attendue = 0; /* prochaine MAJ, 0 : tranche pas encore reçue */
+static int sync_demandee = 0;     /* SYNC en cours, relancé au VIVANT suivant */
+static unsigned long long nb_diffusions = 0;
+
+void handle_sigint(int sig)
+{
+    (void)sig;
+    running = 0;
+}
+
+static long long maintenant_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void envoyer_ordre(const char *texte)
+{
+    ISYMessage rly;
+    memset(&rly, 0, sizeof(rly));
+    strcpy(rly.ordre, ORDRE_RLY);
+    snprintf(rly.texte, sizeof(rly.texte), "%s", texte);
+    unsigned char trame[PROTO_TRAME_MAX];
+    size_t n = proto_ecrire(&rly, PROTO_V2, id_groupe, PROTO_MEMBRE_AUCUN, trame);
+    if (sendto(sock, trame, n, 0, (struct sockaddr *)&addr_groupe, sizeof(addr_groupe)) < 0)
+        perror("sendto relais");
+}
+
+/* MAJ "n [=] +a.b.c.d:p -a.b.c.d:p..." : appliquée dans l'ordre des
+ * numéros ; un trou fait redemander toute la tranche */
+static void appliquer_maj(const char *texte)
+{
+    unsigned int seq;
+    int lus = 0;
+    if (sscanf(texte, "MAJ %u%n", &seq, &lus) != 1) return;
+    const char *p = texte + lus;
+
+    if (strncmp(p, " =", 2) == 0) {
+        p += 2;
+        membres_liberer(&tranche);
+        sync_demandee = 0;
+    } else if (seq != seq_attendue) {
+        if (seq > seq_attendue && !sync_demandee) {
+            envoyer_ordre("SYNC");
+            sync_demandee = 1;
+        }
+        return;
+    }
+    seq_attendue = seq + 1;
+
+    int ajout;
+    struct sockaddr_in addr;
+    while ((p = relais_lire_entree(p, &ajout, &addr)) != NULL) {
+        int c = membres_chercher(&tranche, addr.sin_addr.s_addr, addr.sin_port, "");
+        if (ajout && c < 0) {
+            c = membres_ajouter(&tranche, addr.sin_addr.s_addr, addr.sin_port, "");
+            if (c >= 0) membres_case(&tranche, c)->version = PROTO_V2;
+        } else if (!ajout && c >= 0) {
+            membres_retirer(&tranche, c);
+        }
+    }
+}
+
+static void traiter_ordre(const char *texte)
+{
+    int numero;
+    if (sscanf(texte, "BIENVENUE %d", &numero) == 1) {
+        if (!inscrit) {
+            printf("RelaisISY inscrit auprès du groupe (relais %d)\n", numero);
+            fflush(stdout);
+        }
+        inscrit = 1;
+    } else if (strcmp(texte, "INCONNU") == 0) {
+        /* Le groupe a redémarré ou nous a oubliés : tranche reprise */
+        inscrit = 0;
+        membres_liberer(&tranche);
+        seq_attendue = 0;
+        envoyer_ordre("INSCRIRE");
+    } else {
+        appliquer_maj(texte);
+    }
+}
+
+/* Trame reçue du groupe : ordre RLY, ou diffusion renvoyée telle quelle */
+static void recevoir_trame(const unsigned char *trame, size_t len)
+{
+    const ProtoEntete *h = (const ProtoEntete *)trame;
+    if (len < sizeof(*h) || h->version != PROTO_V2) return;
+    if (h->opcode != OP_RELAIS) {
+        for (int k = 0; k < tranche.nb; ++k) {
+            ClientInfo *c = membres_actif(&tranche, k);
+            envoi_ajouter(&lot, trame, len, &c->addr_cli, &c->echecs_envoi);
+        }
+        nb_diffusions++;
+        return;
+    }
+
+    ISYMessage msg;
+    ProtoInfo info;
+    if (proto_lire(trame, len, &msg, &info) < 0) return;
+    char texte[RELAIS_MAJ_MAX + 32];
+    size_t n = info.nb_charge < sizeof(texte) ? info.nb_charge : sizeof(texte) - 1;
+    memcpy(texte, info.charge, n);
+    texte[n] = '\0';
+    traiter_ordre(texte);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <port_groupe> [id_groupe]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    fill_sockaddr(&addr_groupe, "127.0.0.1", atoi(argv[1]));
+    if (argc > 2) id_groupe = (uint16_t)atoi(argv[2]);
+
+    sock = create_udp_socket();
+    int taille = 4 << 20;
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &taille, sizeof(taille));
+    setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &taille, sizeof(taille));
+    struct sockaddr_in addr_local;
+    fill_sockaddr(&addr_local, "127.0.0.1", 0);
+    check_fatal(bind(sock, (struct sockaddr *)&addr_local, sizeof(addr_local)) < 0,
+                "bind relais");
+    socklen_t lg = sizeof(addr_local);
+    getsockname(sock, (struct sockaddr *)&addr_local, &lg);
+
+    /* Sans SA_RESTART : SIGTERM doit interrompre poll pour sortir */
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_sigint;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    membres_init(&tranche);
+    envoi_init(&lot, sock);
+    printf("RelaisISY sur port %d pour le groupe du port %s\n",
+           ntohs(addr_local.sin_port), argv[1]);
+    fflush(stdout);
+
+    static unsigned char trames[RELAIS_LOT][PROTO_TRAME_MAX];
+    struct mmsghdr hdrs[RELAIS_LOT];
+    struct iovec iovs[RELAIS_LOT];
+    struct sockaddr_in srcs[RELAIS_LOT];
+
+    envoyer_ordre("INSCRIRE");
+    long long prochain = maintenant_ms() + RELAIS_VIVANT_MS;
+    while (running) {
+        struct pollfd pfd = { .fd = sock, .events = POLLIN };
+        long long now = maintenant_ms();
+        int pr = poll(&pfd, 1, prochain > now ? (int)(prochain - now) : 0);
+        if (pr < 0 && errno != EINTR) {
+            perror("poll relais");
+            break;
+        }
+        if (maintenant_ms() >= prochain) {
+            envoyer_ordre(inscrit ? "VIVANT" : "INSCRIRE");
+            sync_demandee = 0;
+            prochain = maintenant_ms() + RELAIS_VIVANT_MS;
+        }
+        if (pr <= 0) continue;
+
+        /* Un lot lu, renvoyé, puis le suivant : les trames restent valides
+         * jusqu'au sendmmsg */
+        for (;;) {
+            for (int k = 0; k < RELAIS_LOT; ++k) {
+                iovs[k].iov_base = trames[k];
+                iovs[k].iov_len = sizeof(trames[k]);
+                memset(&hdrs[k], 0, sizeof(hdrs[k]));
+                hdrs[k].msg_hdr.msg_name = &srcs[k];
+                hdrs[k].msg_hdr.msg_namelen = sizeof(srcs[k]);
+                hdrs[k].msg_hdr.msg_iov = &iovs[k];
+                hdrs[k].msg_hdr.msg_iovlen = 1;
+            }
+            int r = recvmmsg(sock, hdrs, RELAIS_LOT, MSG_DONTWAIT, NULL);
+            if (r <= 0) break;
+            for (int k = 0; k < r; ++k)
+                if (srcs[k].sin_addr.s_addr == addr_groupe.sin_addr.s_addr &&
+                    srcs[k].sin_port == addr_groupe.sin_port)
+                    recevoir_trame(trames[k], hdrs[k].msg_len);
+            envoi_flush(&lot);
+            if (r < RELAIS_LOT) break;
+        }
+    }
+
+    printf("RelaisISY termine (membres=%d diffusions=%llu envoyes=%lu echecs=%lu)\n",
+           tranche.nb, nb_diffusions, lot.nb_envoyes, lot.nb_echecs);
+    membres_liberer(&tranche);
+    close(sock);
+    return 0;
+}
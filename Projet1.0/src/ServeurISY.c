@@ -1,26 +1,127 @@
 //pomme
-#define _POSIX_C_SOURCE 200809L
-#define _DEFAULT_SOURCE
+#define _GNU_SOURCE
 #include "../include/Commun.h"
 #include <signal.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <stdint.h>
 #include <time.h>
 #include <fcntl.h>
 #include <dirent.h>
-static void msleep_ms(long ms) {
+#include "../include/moteur.h"
+#include "../include/envoi.h"
+#include "../include/reception.h"
+#include "../include/registre.h"
+#include "../include/journal.h"
+#include "../include/metriques.h"
+#include "../include/annuaire.h"
+#include "../include/reserve.h"
+
+/* Délais du cycle de vie asynchrone des GroupeISY (ms) */
+#define DELAI_DEMARRAGE_MS  2000      /* CREATE : attente du signal "prêt" */
+#define DELAI_MIGRATION_MS  1000      /* MERGE : attente de l'acquittement MIGRATE */
+#define DELAI_ARRET_MS      3000      /* SIGTERM avant SIGKILL */
+
+/* Sources d'événements epoll (32 bits de poids fort de data.u64) */
+#define EV_SERVEUR  1u
+#define EV_PRET     2u
+#define EV_PIDFD    3u
+#define EV_SIGCHLD  4u
+#define EV_RESERVE  5u                /* pidfd d'un GroupeISY en réserve (data : pid) */
+#define EV_ARRET    6u                /* SIGINT/SIGTERM via signalfd */
+#define EV_JOURNAL  7u                /* moteur : journaux de groupes supprimés écrits */
+
+#define RESERVE_DELAI_MS 20           /* complément de la réserve après un CREATE */
+
+static long long maintenant_ms(void)
+{
     struct timespec ts;
-    ts.tv_sec = ms/1000;
-    ts.tv_nsec = (ms%1000) * 1000000L;
-    nanosleep(&ts, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 }
 
-extern int kill(pid_t pid, int sig);
-
 static int sock_srv;
-static GroupeInfo groupes[MAX_GROUPS];
+static int capacite_groupes = 0;  /* --max-groupes, 0 : maximum du registre */
+static int mode_moteur = 0;       /* 1 : groupes hébergés par le moteur, sans fork */
+static int port_partage = 0;      /* --port-partage : port commun aux groupes du moteur */
+static int verbose = 0;
+static int taille_lot = RECEPTION_LOT_DEFAUT;
+static int fsync_lot = JOURNAL_FSYNC_DEFAUT;
+static int compactage = JOURNAL_COMPACTAGE_DEFAUT;
+static int historique = HISTORIQUE_DEFAUT;
+static size_t message_max = PROTO_MESSAGE_MAX;
+static size_t memoire_reassemblage = FRAGMENT_MEMOIRE_DEFAUT;
+static const char *multicast = NULL;      /* --multicast adresse[:port] */
+static const char *multicast_if = NULL;   /* --multicast-if adresse */
+static int nb_relais = 0;                 /* --relais N, par GroupeISY */
+static int nb_workers = 1;                /* --workers N, par GroupeISY */
+static int taille_reserve = 0;            /* --reserve N : GroupeISY lancés d'avance */
 static int running = 1;
+static int epfd = -1;
+static int sigfd = -1;            /* signalfd SIGCHLD si pidfd_open est indisponible */
+static int arretfd = -1;          /* signalfd SIGINT/SIGTERM : arrêt par la boucle */
+
+/* GroupeISY en réserve (reserve.h), pris par les CREATE depuis la fin */
+typedef struct {
+    pid_t pid;
+    int pidfd;                    /* -1 : fin signalée par SIGCHLD */
+    int canal;                    /* côté serveur du socketpair */
+} GroupeReserve;
+
+/* Groupe confié pendant le tour, ordre pas encore envoyé */
+typedef struct {
+    pid_t pid;
+    int canal;
+    ReserveOrdre ordre;
+    int socks[GROUPE_WORKERS_MAX];
+    int nb;
+} OrdreDiffere;
+
+static GroupeReserve reserve[RESERVE_MAX];
+static int nb_reserve = 0;
+static OrdreDiffere ordres[RESERVE_MAX];
+static int nb_ordres = 0;
+static long long reserve_echeance_ms = 0;  /* complément prévu, 0 : aucun */
+
+/* Slots ayant une échéance armée : seuls eux sont parcourus par la boucle */
+static int *suivis = NULL;
+static int nb_suivis = 0;
+static int cap_suivis = 0;
+static unsigned char en_suivi[REGISTRE_MAX_GROUPES];
+
+/* Moteur : slots supprimés dont le journal s'écrit encore (PROC_ARRET) ;
+ * leur nom ne resert qu'une fois les fichiers effacés */
+static int *fermetures = NULL;
+static int nb_fermetures = 0;
+static int cap_fermetures = 0;
+
+/* Réponses du lot de commandes en cours, envoyées ensemble par sendmmsg */
+static ReceptionLot reception;
+static EnvoiLot lot_reponses;
+static unsigned char reponses[RECEPTION_LOT_MAX][PROTO_TRAME_MAX];
+static int nb_reponses = 0;
+
+static void vider_reponses(void)
+{
+    envoi_flush(&lot_reponses);
+    nb_reponses = 0;
+}
+
+/* Réponse encodée dans la version de la requête du client */
+static void repondre(const ISYMessage *reply, int version, const struct sockaddr_in *dest)
+{
+    if (nb_reponses == RECEPTION_LOT_MAX)
+        vider_reponses();
+    size_t n = proto_ecrire(reply, version, PROTO_GROUPE_AUCUN, PROTO_MEMBRE_AUCUN,
+                            reponses[nb_reponses]);
+    envoi_ajouter(&lot_reponses, reponses[nb_reponses], n, dest, NULL);
+    nb_reponses++;
+}
 
 
 static void cleanup_infogroup_files(void)
@@ -39,450 +140,1058 @@ static void cleanup_infogroup_files(void)
     closedir(dir);
 }
 
-/* Nettoyage sur CTRL-C */
-void handle_sigint(int sig)
+/* Cherche un groupe actif par nom, renvoie son index ou -1 */
+static int find_group(const char *name)
 {
-    (void)sig;
-    running = 0;
-    cleanup_infogroup_files();  
-    exit(0);
+    return registre_chercher(name);
 }
 
-/* Cherche un groupe par nom, renvoie son index ou -1 */
-static int find_group(const char *name)
+/* Copie l'état du slot dans l'annuaire lu par isytop */
+static void publier(int index)
+{
+    annuaire_publier(index, registre_groupe(index));
+}
+
+static void armer_echeance(int index, int delai_ms)
+{
+    registre_groupe(index)->echeance_ms = maintenant_ms() + delai_ms;
+    if (en_suivi[index]) return;
+    if (nb_suivis == cap_suivis) {
+        int cap = cap_suivis ? cap_suivis * 2 : 64;
+        int *p = realloc(suivis, (size_t)cap * sizeof(int));
+        check_fatal(p == NULL, "realloc suivis");
+        suivis = p;
+        cap_suivis = cap;
+    }
+    suivis[nb_suivis++] = index;
+    en_suivi[index] = 1;
+}
+
+static void surveiller(int fd, uint32_t type, int slot)
 {
-    for (int i = 0; i < MAX_GROUPS; ++i) {
-        if (groupes[i].actif && strcmp(groupes[i].nom, name) == 0)
-            return i;
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = ((uint64_t)type << 32) | (uint32_t)slot;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+        perror("epoll_ctl ADD");
+}
+
+static void resurveiller(int fd, uint32_t type, int slot)
+{
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = ((uint64_t)type << 32) | (uint32_t)slot;
+    if (epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev) < 0)
+        perror("epoll_ctl MOD");
+}
+
+static void oublier(int *fd)
+{
+    if (*fd >= 0) {
+        epoll_ctl(epfd, EPOLL_CTL_DEL, *fd, NULL);
+        close(*fd);
+        *fd = -1;
     }
+}
+
+static int pidfd_ouvrir(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void)pid;
+    errno = ENOSYS;
     return -1;
+#endif
 }
 
-/* Crée un GroupeISY (processus) */
+static void liberer_shm(GroupeInfo *gi)
+{
+    if (gi->shm_id >= 0) {
+        shmctl(gi->shm_id, IPC_RMID, NULL);
+        gi->shm_id = -1;
+    }
+    gi->shm_key = 0;
+}
+
+/* Le groupe a-t-il un état sauvegardé (reprise après un arrêt brutal) ? */
+static int fichiers_groupe(const char *nom)
+{
+    char filepath[512];
+    snprintf(filepath, sizeof(filepath), "infoGroup/%s.snap", nom);
+    if (access(filepath, F_OK) == 0) return 1;
+    snprintf(filepath, sizeof(filepath), "infoGroup/%s.journal", nom);
+    return access(filepath, F_OK) == 0;
+}
+
+static void supprimer_fichiers_groupe(const char *nom)
+{
+    char filepath[512];
+    snprintf(filepath, sizeof(filepath), "infoGroup/%s.snap", nom);
+    unlink(filepath);
+    snprintf(filepath, sizeof(filepath), "infoGroup/%s.snap.tmp", nom);
+    unlink(filepath);
+    snprintf(filepath, sizeof(filepath), "infoGroup/%s.journal", nom);
+    unlink(filepath);
+    snprintf(filepath, sizeof(filepath), "infoGroup/%s.hist", nom);
+    unlink(filepath);
+}
+
+/* Exécute bin/GroupeISY dans le fils : ses premiers arguments ('tete'),
+ * puis les options du serveur. Ne revient pas. */
+static void executer_groupe(char *tete[], int nb_tete)
+{
+    char lot_str[16];
+    char fsync_str[16];
+    char compactage_str[16];
+    char historique_str[16];
+    char message_max_str[24];
+    char reassemblage_str[24];
+    char relais_str[16];
+    char workers_str[16];
+    snprintf(lot_str, sizeof(lot_str), "%d", taille_lot);
+    snprintf(fsync_str, sizeof(fsync_str), "%d", fsync_lot);
+    snprintf(compactage_str, sizeof(compactage_str), "%d", compactage);
+    snprintf(historique_str, sizeof(historique_str), "%d", historique);
+    snprintf(message_max_str, sizeof(message_max_str), "%zu", message_max);
+    snprintf(reassemblage_str, sizeof(reassemblage_str), "%zu", memoire_reassemblage);
+
+    char *args[40] = { "bin/GroupeISY" };
+    int n = 1;
+    for (int k = 0; k < nb_tete; ++k) args[n++] = tete[k];
+    char *options[] = {
+        "--lot", lot_str,
+        "--fsync", fsync_str,
+        "--compactage", compactage_str,
+        "--historique", historique_str,
+        "--message-max", message_max_str,
+        "--reassemblage", reassemblage_str,
+    };
+    for (size_t k = 0; k < sizeof(options) / sizeof(options[0]); ++k)
+        args[n++] = options[k];
+    if (multicast) {
+        args[n++] = "--multicast";
+        args[n++] = (char *)multicast;
+    }
+    if (multicast_if) {
+        args[n++] = "--multicast-if";
+        args[n++] = (char *)multicast_if;
+    }
+    if (nb_relais > 0) {
+        snprintf(relais_str, sizeof(relais_str), "%d", nb_relais);
+        args[n++] = "--relais";
+        args[n++] = relais_str;
+    }
+    if (nb_workers > 1) {
+        snprintf(workers_str, sizeof(workers_str), "%d", nb_workers);
+        args[n++] = "--workers";
+        args[n++] = workers_str;
+    }
+    if (verbose) args[n++] = "--verbose";
+    args[n] = NULL;
+    execv("bin/GroupeISY", args);
+
+    perror("execv GroupeISY");
+    _exit(EXIT_FAILURE);
+}
+
+/* Crée un GroupeISY (processus). Le fils écrit un octet dans le tube
+ * "prêt" une fois sa socket liée ; la réponse au CREATE part à ce moment. */
 static int create_group_process(int index)
 {
+    int tube[2];
+    if (pipe2(tube, O_CLOEXEC) < 0) {
+        perror("pipe2 GroupeISY");
+        return -1;
+    }
+
     pid_t pid = fork();
-    check_fatal(pid < 0, "fork GroupeISY");
+    if (pid < 0) {
+        perror("fork GroupeISY");
+        close(tube[0]);
+        close(tube[1]);
+        return -1;
+    }
 
     if (pid == 0) {
         /* Processus fils : exécuter GroupeISY */
+        sigset_t vide;
+        sigemptyset(&vide);
+        sigprocmask(SIG_SETMASK, &vide, NULL);
+        close(tube[0]);
+        fcntl(tube[1], F_SETFD, 0);
+
         char port_str[16];
-        snprintf(port_str, sizeof(port_str), "%d", groupes[index].port_groupe);
+        char pret_str[16];
+        snprintf(port_str, sizeof(port_str), "%d", registre_groupe(index)->port_groupe);
+        snprintf(pret_str, sizeof(pret_str), "%d", tube[1]);
+        char *tete[] = {
+            registre_groupe(index)->nom,
+            registre_groupe(index)->moderateur,
+            port_str,
+            "--pret", pret_str,
+        };
+        executer_groupe(tete, sizeof(tete) / sizeof(tete[0]));
+    }
 
-        execl("bin/GroupeISY", "bin/GroupeISY",
-              groupes[index].nom,
-              groupes[index].moderateur,
-              port_str,
-              (char *)NULL);
+    close(tube[1]);
+    GroupeInfo *gi = registre_groupe(index);
+    gi->pid = pid;
+    gi->etat = PROC_DEMARRAGE;
+    armer_echeance(index, DELAI_DEMARRAGE_MS);
+    gi->fd_pret = tube[0];
+    surveiller(gi->fd_pret, EV_PRET, index);
+    gi->pidfd = (sigfd < 0) ? pidfd_ouvrir(pid) : -1;
+    if (gi->pidfd >= 0)
+        surveiller(gi->pidfd, EV_PIDFD, index);
+    publier(index);
+    return 0;
+}
 
-        perror("execl GroupeISY");
-        _exit(EXIT_FAILURE);
+/* Lance un GroupeISY en réserve : exec, options et journal faits, il
+ * attend son groupe sur le canal */
+static int lancer_reserve(void)
+{
+    int canal[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, canal) < 0) {
+        perror("socketpair reserve");
+        return -1;
     }
 
-    groupes[index].pid = pid;
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork reserve");
+        close(canal[0]);
+        close(canal[1]);
+        return -1;
+    }
+
+    if (pid == 0) {
+        sigset_t vide;
+        sigemptyset(&vide);
+        sigprocmask(SIG_SETMASK, &vide, NULL);
+        close(canal[0]);
+        fcntl(canal[1], F_SETFD, 0);
+
+        char canal_str[16];
+        snprintf(canal_str, sizeof(canal_str), "%d", canal[1]);
+        char *tete[] = { "--reserve", canal_str };
+        executer_groupe(tete, sizeof(tete) / sizeof(tete[0]));
+    }
+
+    close(canal[1]);
+    GroupeReserve *r = &reserve[nb_reserve++];
+    r->pid = pid;
+    r->canal = canal[0];
+    r->pidfd = (sigfd < 0) ? pidfd_ouvrir(pid) : -1;
+    if (r->pidfd >= 0)
+        surveiller(r->pidfd, EV_RESERVE, (int)pid);
     return 0;
 }
 
-static void handle_command(ISYMessage *msg,
-                           struct sockaddr_in *src, socklen_t src_len)
+/* Complète la réserve. Un GroupeISY mort en réserve n'est remplacé qu'au
+ * CREATE suivant, ce qui évite de relancer en boucle un exec qui échoue. */
+static void completer_reserve(void)
 {
-    char src_ip[INET_ADDRSTRLEN];
-    inet_ntop(AF_INET, &src->sin_addr, src_ip, sizeof(src_ip));
-    int src_port = ntohs(src->sin_port);
-    printf("[SERVER] Command from %s:%d -> %s\n", src_ip, src_port, msg->texte);
-    fflush(stdout);
+    while (nb_reserve < taille_reserve && lancer_reserve() == 0)
+        ;
+    reserve_echeance_ms = 0;
+}
+
+/* Complément après RESERVE_DELAI_MS : les forks passent entre les
+ * commandes, pas devant la réponse au CREATE ni ceux d'une rafale */
+static void prevoir_complement(void)
+{
+    if (reserve_echeance_ms == 0)
+        reserve_echeance_ms = maintenant_ms() + RESERVE_DELAI_MS;
+}
+
+/* Fin d'un GroupeISY en réserve : il en est retiré */
+static void reserve_terminee(pid_t pid)
+{
+    for (int k = 0; k < nb_reserve; ++k) {
+        GroupeReserve *r = &reserve[k];
+        if (r->pid != pid) continue;
+        if (waitpid(pid, NULL, WNOHANG) == 0) return;
+        fprintf(stderr, "[SERVER] GroupeISY en reserve (pid %d) s'est arrete\n", (int)pid);
+        close(r->canal);
+        oublier(&r->pidfd);
+        *r = reserve[--nb_reserve];
+        return;
+    }
+}
+
+/* nb sockets liées au port du groupe (SO_REUSEPORT entre workers), pour le
+ * GroupeISY qui le servira ; -1 si le port est pris */
+static int lier_sockets(int port, int *socks, int nb)
+{
+    struct sockaddr_in addr;
+    fill_sockaddr(&addr, NULL, port);
+    int un = 1;
+    for (int i = 0; i < nb; ++i) {
+        int sock = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (sock < 0 ||
+            (nb > 1 && setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &un, sizeof(un)) < 0) ||
+            bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+            perror("bind groupe");
+            if (sock >= 0) close(sock);
+            while (i > 0) close(socks[--i]);
+            return -1;
+        }
+        socks[i] = sock;
+    }
+    return 0;
+}
+
+/* Confie le groupe à un GroupeISY de la réserve, avec ses sockets déjà
+ * liées : le groupe est aussitôt joignable, le fils le charge ensuite.
+ * 0 : groupe actif, 1 : réserve vide (démarrage classique), -1 : port
+ * indisponible. */
+static int confier_a_reserve(int index)
+{
+    _Static_assert(GROUPE_WORKERS_MAX <= RESERVE_SOCKETS_MAX,
+                   "une socket par worker dans l'ordre de la réserve");
+    if (nb_reserve == 0) return 1;
+    GroupeInfo *gi = registre_groupe(index);
+    OrdreDiffere *o = &ordres[nb_ordres];
+    if (lier_sockets(gi->port_groupe, o->socks, nb_workers) < 0) return -1;
+
+    GroupeReserve *r = &reserve[--nb_reserve];
+    o->nb = nb_workers;
+    o->canal = r->canal;
+    o->pid = r->pid;
+    memset(&o->ordre, 0, sizeof(o->ordre));
+    snprintf(o->ordre.nom, sizeof(o->ordre.nom), "%s", gi->nom);
+    snprintf(o->ordre.moderateur, sizeof(o->ordre.moderateur), "%s", gi->moderateur);
+    o->ordre.port = gi->port_groupe;
+    o->ordre.id = index;
+    nb_ordres++;
+
+    gi->pid = r->pid;
+    gi->pidfd = r->pidfd;
+    if (gi->pidfd >= 0)
+        resurveiller(gi->pidfd, EV_PIDFD, index);
+    gi->etat = PROC_ACTIF;
+    publier(index);
+    prevoir_complement();
+    return 0;
+}
+
+/* Ordres envoyés après les réponses du tour : réveiller le fils ne retarde
+ * pas la réponse au CREATE. Un fils mort entre-temps refuse l'ordre ; tué,
+ * sa fin retire le groupe comme celle de tout GroupeISY. */
+static void envoyer_ordres(void)
+{
+    for (int i = 0; i < nb_ordres; ++i) {
+        OrdreDiffere *o = &ordres[i];
+        if (reserve_envoyer(o->canal, &o->ordre, o->socks, o->nb) < 0) {
+            perror("ordre reserve");
+            if (registre_groupe(o->ordre.id)->pid == o->pid)
+                kill(o->pid, SIGKILL);
+        }
+        close(o->canal);
+        for (int k = 0; k < o->nb; ++k) close(o->socks[k]);
+    }
+    nb_ordres = 0;
+}
+
+/* Demande l'arrêt d'un GroupeISY sans l'attendre : la fin du fils est
+ * signalée par son pidfd (ou SIGCHLD), SIGKILL part après DELAI_ARRET_MS. */
+static void arreter_groupe(int index)
+{
+    GroupeInfo *gi = registre_groupe(index);
+    oublier(&gi->fd_pret);
+    if (gi->pid > 0) {
+        kill(gi->pid, SIGTERM);
+        gi->etat = PROC_ARRET;
+        armer_echeance(index, DELAI_ARRET_MS);
+        publier(index);
+    }
+}
+
+static void repondre_creation(int index, int ok)
+{
+    GroupeInfo *gi = registre_groupe(index);
     ISYMessage reply;
     memset(&reply, 0, sizeof(reply));
     strcpy(reply.ordre, ORDRE_RPL);
-    strncpy(reply.emetteur, "SERVER", MAX_USERNAME - 1);
-    reply.emetteur[MAX_USERNAME - 1] = '\0';
-    choose_emoji_from_username("SERVER", reply.emoji);
+    snprintf(reply.emetteur, MAX_USERNAME, "SERVER");
+    memcpy(reply.emoji, EMOJI_SERVEUR, sizeof(EMOJI_SERVEUR));
+    if (ok)
+        snprintf(reply.texte, MAX_TEXT, "Groupe %s cree sur port %d",
+                 gi->nom, gi->port_groupe);
+    else
+        snprintf(reply.texte, MAX_TEXT, "Erreur: echec demarrage GroupeISY");
+    repondre(&reply, gi->version_demandeur, &gi->demandeur);
+}
 
-    char cmd[16] = {0};
-    char arg1[64] = {0};
+/* Tube "prêt" lisible : un octet = groupe à l'écoute, EOF = échec au démarrage */
+static void groupe_pret(int index)
+{
+    GroupeInfo *gi = registre_groupe(index);
+    char c;
+    ssize_t n = read(gi->fd_pret, &c, 1);
+    if (n < 0 && (errno == EINTR || errno == EAGAIN)) return;
+    oublier(&gi->fd_pret);
+    if (gi->etat != PROC_DEMARRAGE) return;
 
-    sscanf(msg->texte, "%15s %63s", cmd, arg1);
-
-    if (strcmp(cmd, "LIST") == 0) {
-        /* Liste des groupes actifs */
-        strcpy(reply.groupe, "");
-        char buffer[ MAX_TEXT ];
-        buffer[0] = '\0';
-
-        for (int i = 0; i < MAX_GROUPS; ++i) {
-            if (groupes[i].actif) {
-                char line[64];
-                snprintf(line, sizeof(line), "%s (port %d)\n",
-                         groupes[i].nom, groupes[i].port_groupe);
-                if (strlen(buffer) + strlen(line) < sizeof(buffer))
-                    strcat(buffer, line);
-            }
-        }
-        if (buffer[0] == '\0')
-            strcpy(buffer, "Aucun groupe\n");
+    if (n == 1) {
+        gi->etat = PROC_ACTIF;
+        gi->echeance_ms = 0;
+        publier(index);
+        repondre_creation(index, 1);
+    } else {
+        repondre_creation(index, 0);
+        registre_retirer(index);
+        arreter_groupe(index);
+    }
+}
 
-        strncpy(reply.texte, buffer, MAX_TEXT - 1);
-        reply.texte[MAX_TEXT - 1] = '\0';
+/* Fin d'un GroupeISY : on le récupère et on libère son slot */
+static void enfant_termine(int index)
+{
+    GroupeInfo *gi = registre_groupe(index);
+    if (gi->pid <= 0) return;
+    pid_t r = waitpid(gi->pid, NULL, WNOHANG);
+    if (r == 0) return;
+
+    if (gi->etat == PROC_DEMARRAGE) {
+        repondre_creation(index, 0);
+    } else if (gi->etat == PROC_ACTIF) {
+        fprintf(stderr, "[SERVER] GroupeISY '%s' (pid %d) s'est arrete\n",
+                gi->nom, (int)gi->pid);
     }
-    else if (strcmp(cmd, "CREATE") == 0) {
-        if (arg1[0] == '\0') {
-            strcpy(reply.texte, "Nom de groupe manquant");
-        } else if (find_group(arg1) != -1) {
-            strcpy(reply.texte, "Groupe deja existant");
-        } else {
-            int slot = -1;
-            for (int i = 0; i < MAX_GROUPS; ++i) {
-                if (!groupes[i].actif) { slot = i; break; }
-            }
-            if (slot == -1) {
-                strcpy(reply.texte, "Plus de place pour de nouveaux groupes");
-            } else {
-                groupes[slot].actif = 1;
-                snprintf(groupes[slot].nom, MAX_GROUP_NAME, "%.*s", (int)(MAX_GROUP_NAME - 1), arg1);
-                snprintf(groupes[slot].moderateur, MAX_USERNAME, "%.*s", (int)(MAX_USERNAME - 1), msg->emetteur);
-                groupes[slot].port_groupe = GROUP_PORT_BASE + slot;
-
-                key_t key = SHM_GROUP_KEY_BASE + slot;
-                int shm_id = shmget(key, sizeof(GroupStats),
-                                    IPC_CREAT | 0666);
-                check_fatal(shm_id < 0, "shmget group");
-                groupes[slot].shm_key = key;
-                groupes[slot].shm_id  = shm_id;
-
-                    create_group_process(slot);
-                            {
-                                FILE *f = fopen("group_members.txt", "r");
-                                int seen = 0;
-                                if (f) {
-                                    char line[256];
-                                    while (fgets(line, sizeof(line), f)) {
-                                        if (strncmp(line, "GROUP:", 6) == 0) {
-                                            char *gname = line + 6;
-                                            char *p = strchr(gname, '\n'); if (p) *p = '\0';
-                                            if (strcmp(gname, groupes[slot].nom) == 0) { seen = 1; break; }
-                                        }
-                                    }
-                                    fclose(f);
-                                }
-                                if (!seen) {
-                                    FILE *fa = fopen("group_members.txt", "a");
-                                    if (fa) {
-                                        fprintf(fa, "GROUP:%s\n", groupes[slot].nom);
-                                        fclose(fa);
-                                    }
-                                }
-                            }
-                msleep_ms(100); 
-                if (groupes[slot].pid > 0) {
-                    int status;
-                    pid_t r = waitpid(groupes[slot].pid, &status, WNOHANG);
-                    if (r == groupes[slot].pid) {
-                            strncpy(reply.texte, "Erreur: echec demarrage GroupeISY", MAX_TEXT - 1);
-                            reply.texte[MAX_TEXT - 1] = '\0';
-                        
-                        groupes[slot].actif = 0;
-                        if (groupes[slot].shm_id > 0) { shmctl(groupes[slot].shm_id, IPC_RMID, NULL); groupes[slot].shm_id = 0; }
-                        groupes[slot].shm_key = 0;
-                        groupes[slot].pid = 0;
-                        sendto(sock_srv, &reply, sizeof(reply), 0,
-                               (struct sockaddr *)src, src_len);
-                        return;
-                    }
-                }
-                snprintf(reply.texte, MAX_TEXT,
-                         "Groupe %s cree sur port %d",
-                         groupes[slot].nom,
-                         groupes[slot].port_groupe);
-
-                {
-                    FILE *f = fopen("group_members.txt", "r");
-                    int seen = 0;
-                    if (f) {
-                        char line[256];
-                        while (fgets(line, sizeof(line), f)) {
-                            if (strncmp(line, "GROUP:", 6) == 0) {
-                                char *gname = line + 6;
-                                char *p = strchr(gname, '\n'); if (p) *p = '\0';
-                                if (strcmp(gname, groupes[slot].nom) == 0) { seen = 1; break; }
-                            }
-                        }
-                        fclose(f);
-                    }
-                    if (!seen) {
-                        FILE *fa = fopen("group_members.txt", "a");
-                        if (fa) {
-                            fprintf(fa, "GROUP:%s\n", groupes[slot].nom);
-                            fclose(fa);
-                        }
-                    }
-                }
-            }
+    oublier(&gi->fd_pret);
+    oublier(&gi->pidfd);
+    liberer_shm(gi);
+    /* Le fils a pu réécrire ses fichiers avant de sortir */
+    if (gi->supprimer_fichiers && find_group(gi->nom) < 0)
+        supprimer_fichiers_groupe(gi->nom);
+    gi->supprimer_fichiers = 0;
+    gi->pid = 0;
+    gi->etat = PROC_LIBRE;
+    gi->echeance_ms = 0;
+    registre_liberer(index);
+    publier(index);
+}
+
+/* Repli sans pidfd : SIGCHLD via signalfd, on teste chaque fils */
+static void sigchld_recu(void)
+{
+    struct signalfd_siginfo si;
+    while (read(sigfd, &si, sizeof(si)) == sizeof(si))
+        ;
+    for (int i = 0; i < registre_etendue(); ++i) {
+        if (registre_groupe(i)->pid > 0)
+            enfant_termine(i);
+    }
+    /* À rebours : un retrait ramène en k une case déjà vue */
+    for (int k = nb_reserve - 1; k >= 0; --k)
+        reserve_terminee(reserve[k].pid);
+}
+
+static int prochaine_echeance(void)
+{
+    long long proche = 0;
+    int n = 0;
+    for (int k = 0; k < nb_suivis; ++k) {
+        int i = suivis[k];
+        long long e = registre_groupe(i)->echeance_ms;
+        if (e == 0) {
+            en_suivi[i] = 0;          /* échéance désarmée : on l'oublie */
+            continue;
         }
+        suivis[n++] = i;
+        if (proche == 0 || e < proche) proche = e;
     }
-    else if (strcmp(cmd, "JOIN") == 0) {
-        int idx = find_group(arg1);
-        if (idx < 0) {
-            snprintf(reply.texte, MAX_TEXT,
-                     "Groupe %s introuvable", arg1);
+    nb_suivis = n;
+    if (reserve_echeance_ms && (proche == 0 || reserve_echeance_ms < proche))
+        proche = reserve_echeance_ms;
+    if (proche == 0) return -1;
+    long long reste = proche - maintenant_ms();
+    return reste > 0 ? (int)reste : 0;
+}
+
+static void traiter_echeances(void)
+{
+    long long now = maintenant_ms();
+    int n = nb_suivis;                /* les réarmements ne s'ajoutent pas */
+    for (int k = 0; k < n; ++k) {
+        int i = suivis[k];
+        GroupeInfo *gi = registre_groupe(i);
+        if (gi->echeance_ms == 0 || gi->echeance_ms > now) continue;
+
+        if (gi->etat == PROC_DEMARRAGE) {
+            fprintf(stderr, "[SERVER] GroupeISY '%s' ne repond pas au demarrage\n", gi->nom);
+            repondre_creation(i, 0);
+            registre_retirer(i);
+            arreter_groupe(i);
+            kill(gi->pid, SIGKILL);
+        } else if (gi->etat == PROC_MIGRATION) {
+            /* Pas d'acquittement du MIGRATE : on arrête quand même */
+            arreter_groupe(i);
+        } else if (gi->etat == PROC_ARRET) {
+            kill(gi->pid, SIGKILL);
+            gi->echeance_ms = 0;
         } else {
-            snprintf(reply.texte, MAX_TEXT,
-                     "OK %d", groupes[idx].port_groupe);
-            strncpy(reply.groupe, groupes[idx].nom, MAX_GROUP_NAME - 1);
-            reply.groupe[MAX_GROUP_NAME - 1] = '\0';
+            gi->echeance_ms = 0;
         }
     }
-    else if (strcmp(cmd, "CHECKBAN") == 0) {
-        
-        char group_name[64] = {0};
-        sscanf(msg->texte, "%15s %63s", cmd, group_name);
-        
-        if (group_name[0] == '\0') {
-            strcpy(reply.texte, "Usage: CHECKBAN <group_name>");
-        } else {
-            char client_ip[INET_ADDRSTRLEN];
-            inet_ntop(AF_INET, &src->sin_addr, client_ip, sizeof(client_ip));
-            
-            char filepath[512];  
-            snprintf(filepath, sizeof(filepath), "infoGroup/%s_banned.txt", group_name);
-            
-            int is_banned = 0;
-            FILE *f = fopen(filepath, "r");
-            if (f) {
-                char line[64];
-                while (fgets(line, sizeof(line), f)) {
-                    char *p = strchr(line, '\n');
-                    if (p) *p = '\0';
-                    if (strcmp(line, client_ip) == 0) {
-                        is_banned = 1;
-                        break;
-                    }
+}
+
+/* Le groupe n'est plus joignable ; son slot est rendu dès qu'aucun
+ * processus GroupeISY ne l'occupe plus (sinon à la fin du fils) ni aucune
+ * écriture du moteur (sinon à la fin de son journal). */
+static void retirer_groupe(int index)
+{
+    GroupeInfo *gi = registre_groupe(index);
+    registre_retirer(index);
+    if (gi->pid <= 0 && gi->etat != PROC_ARRET) {
+        liberer_shm(gi);
+        registre_liberer(index);
+    }
+    publier(index);
+}
+
+/* Moteur : le groupe quitte la table sans attendre son journal ; slot et
+ * fichiers sont rendus par groupes_fermes() */
+static void fermer_groupe_moteur(int index)
+{
+    GroupeInfo *gi = registre_groupe(index);
+    moteur_supprimer_groupe(index);
+    gi->etat = PROC_ARRET;
+    gi->supprimer_fichiers = 1;
+    if (nb_fermetures == cap_fermetures) {
+        int cap = cap_fermetures ? cap_fermetures * 2 : 64;
+        int *p = realloc(fermetures, (size_t)cap * sizeof(int));
+        check_fatal(p == NULL, "realloc fermetures");
+        fermetures = p;
+        cap_fermetures = cap;
+    }
+    fermetures[nb_fermetures++] = index;
+}
+
+/* eventfd du journal lisible : ces groupes du moteur ont fini d'écrire */
+static void groupes_fermes(void)
+{
+    int slots[64];
+    int n;
+    do {
+        n = moteur_groupes_fermes(slots, 64);
+        for (int k = 0; k < n; ++k) {
+            GroupeInfo *gi = registre_groupe(slots[k]);
+            if (!gi || gi->etat != PROC_ARRET) continue;
+            for (int f = 0; f < nb_fermetures; ++f) {
+                if (fermetures[f] == slots[k]) {
+                    fermetures[f] = fermetures[--nb_fermetures];
+                    break;
                 }
-                fclose(f);
-            }
-            
-            if (is_banned) {
-                snprintf(reply.texte, MAX_TEXT, "BANNED");
-            } else {
-                snprintf(reply.texte, MAX_TEXT, "OK");
             }
+            if (gi->supprimer_fichiers && find_group(gi->nom) < 0)
+                supprimer_fichiers_groupe(gi->nom);
+            gi->supprimer_fichiers = 0;
+            gi->etat = PROC_LIBRE;
+            registre_liberer(slots[k]);
+            publier(slots[k]);
         }
+    } while (n == 64);
+}
+
+static int en_fermeture(const char *nom)
+{
+    for (int f = 0; f < nb_fermetures; ++f)
+        if (strcmp(registre_groupe(fermetures[f])->nom, nom) == 0) return 1;
+    return 0;
+}
+
+/* Notifications d'un GroupeISY au serveur : MIGRATED après un MIGRATE,
+ * BANNED <groupe> <cidr> après un ban. */
+static void notice_migrated(int slot, GroupeInfo *gi, const char *args)
+{
+    char nom[MAX_GROUP_NAME] = {0};
+    if (sscanf(args, "%31s", nom) == 1 &&
+        gi->etat == PROC_MIGRATION && strcmp(gi->nom, nom) == 0)
+        arreter_groupe(slot);
+}
+
+static void notice_banned(int slot, GroupeInfo *gi, const char *args)
+{
+    (void)slot;
+    char nom[MAX_GROUP_NAME] = {0};
+    char cidr[64] = {0};
+    uint32_t reseau;
+    int longueur;
+    if (sscanf(args, "%31s %63s", nom, cidr) == 2 &&
+        gi->actif && strcmp(gi->nom, nom) == 0 &&
+        bannis_parser(cidr, &reseau, &longueur) == 0)
+        bannis_ajouter(&gi->bannis, reseau, longueur);
+}
+
+static void (*const notices[MOT_NB])(int slot, GroupeInfo *gi, const char *args) = {
+    [MOT_MIGRATED] = notice_migrated,
+    [MOT_BANNED]   = notice_banned,
+};
+
+/* Seuls les groupes locaux sont écoutés, reconnus à l'id de leur entête
+ * v2 (port partagé), sinon à leur port */
+static void handle_group_notice(ISYMessage *msg, const ProtoInfo *info,
+                                struct sockaddr_in *src)
+{
+    if (ntohl(src->sin_addr.s_addr) >> 24 != 127) return;
+
+    int slot = info->version == PROTO_V2 && info->groupe != PROTO_GROUPE_AUCUN ?
+               info->groupe : ntohs(src->sin_port) - GROUP_PORT_BASE;
+    GroupeInfo *gi = registre_groupe(slot);
+    if (!gi) return;
+
+    const char *args;
+    int mot = proto_mot(msg->texte, &args);
+    if (notices[mot])
+        notices[mot](slot, gi, args);
+}
+
+/* Journal des créations group_members.txt : simple ajout, jamais relu sur
+ * le chemin des commandes (l'unicité des noms est garantie par le registre) */
+static void register_group_name(const char *nom)
+{
+    FILE *fa = fopen("group_members.txt", "a");
+    if (fa) {
+        fprintf(fa, "GROUP:%s\n", nom);
+        fclose(fa);
     }
-    else if (strcmp(cmd, "MERGE") == 0) {
-        char g1[64] = {0};
-        char g2[64] = {0};
-        sscanf(msg->texte, "%15s %63s %63s", cmd, g1, g2);
+}
 
-        if (g1[0] == '\0' || g2[0] == '\0') {
-            strcpy(reply.texte, "Usage: MERGE <g1> <g2>");
-        } else {
-            int idx1 = find_group(g1);
-            int idx2 = find_group(g2);
-
-            if (idx1 < 0 || idx2 < 0) {
-                snprintf(reply.texte, MAX_TEXT,
-                         "Un ou plusieurs groupes introuvables (%s, %s)", g1, g2);
-            } else if (idx1 == idx2) {
-                snprintf(reply.texte, MAX_TEXT,
-                         "Les deux groupes doivent etre distincts: %s", g1);
-            } else {
-                
-                if (strcmp(msg->emetteur, groupes[idx1].moderateur) != 0 ||
-                    strcmp(msg->emetteur, groupes[idx2].moderateur) != 0) {
-                    snprintf(reply.texte, MAX_TEXT,
-                             "Permission refusee: vous devez etre le createur (moderateur) des deux groupes pour fusionner");
-                    ssize_t ret = sendto(sock_srv, &reply, sizeof(reply), 0,
-                           (struct sockaddr *)src, src_len);
-                    if (ret < 0) perror("sendto reply");
-                    return;
-                }
-                
-                
-                typedef struct {
-                    char username[MAX_USERNAME];
-                    char ip[64];
-                    char emoji[MAX_EMOJI];
-                } MergedMember;
-                
-                MergedMember members_g2[512];
-                int count_g2 = 0;
-                
-                {
-                    char filepath[512];  
-                    snprintf(filepath, sizeof(filepath), "infoGroup/%s.txt", g2);
-                    FILE *f = fopen(filepath, "r");
-                    if (f) {
-                        char line[256];
-                        while (fgets(line, sizeof(line), f) && count_g2 < 512) {
-                            char username[MAX_USERNAME];
-                            char ip[64];
-                            char emoji[MAX_EMOJI];
-                            if (sscanf(line, "%19[^:]:%63[^:]:%7s", username, ip, emoji) == 3) {
-                                snprintf(members_g2[count_g2].username, MAX_USERNAME, "%s", username);
-                                snprintf(members_g2[count_g2].ip, 64, "%s", ip);
-                                snprintf(members_g2[count_g2].emoji, MAX_EMOJI, "%s", emoji);
-                                count_g2++;
-                            }
-                        }
-                        fclose(f);
-                    }
-                }
-                
-                {
-                    char filepath[512];  
-                    snprintf(filepath, sizeof(filepath), "infoGroup/%s.txt", g1);
-                    FILE *f = fopen(filepath, "r");
-                    if (f) {
-                        char line[256];
-                        while (fgets(line, sizeof(line), f) && count_g2 < 512) {
-                            char username[MAX_USERNAME];
-                            char ip[64];
-                            char emoji[MAX_EMOJI];
-                            if (sscanf(line, "%19[^:]:%63[^:]:%7s", username, ip, emoji) == 3) {
-                                int ip_exists = 0;
-                                for (int i = 0; i < count_g2; ++i) {
-                                    if (strcmp(members_g2[i].ip, ip) == 0) {
-                                        ip_exists = 1;
-                                        break;
-                                    }
-                                }
-                                if (!ip_exists) {
-                                    snprintf(members_g2[count_g2].username, MAX_USERNAME, "%s", username);
-                                    snprintf(members_g2[count_g2].ip, 64, "%s", ip);
-                                    snprintf(members_g2[count_g2].emoji, MAX_EMOJI, "%s", emoji);
-                                    count_g2++;
-                                }
-                            }
-                        }
-                        fclose(f);
-                    }
-                }
-                
-                {
-                    char filepath[512];  
-                    snprintf(filepath, sizeof(filepath), "infoGroup/%s.txt", g2);
-                    FILE *f = fopen(filepath, "w");
-                    if (f) {
-                        for (int i = 0; i < count_g2; ++i) {
-                            fprintf(f, "%s:%s:%s\n", members_g2[i].username, members_g2[i].ip, members_g2[i].emoji);
-                        }
-                        fclose(f);
-                    }
-                }
-                
-                {
-                    char filepath[512];  
-                    snprintf(filepath, sizeof(filepath), "infoGroup/%s.txt", g1);
-                    unlink(filepath);
-                }
-                
-                ISYMessage migr_msg;
-                memset(&migr_msg, 0, sizeof(migr_msg));
-                strcpy(migr_msg.ordre, ORDRE_MGR);
-                strncpy(migr_msg.emetteur, "SERVER", MAX_USERNAME - 1);
-                migr_msg.emetteur[MAX_USERNAME - 1] = '\0';
-                choose_emoji_from_username("SERVER", migr_msg.emoji);
-                snprintf(migr_msg.texte, sizeof(migr_msg.texte), "MIGRATE %s %d", g2, groupes[idx2].port_groupe);
-                
-                struct sockaddr_in addr1;
-                fill_sockaddr(&addr1, "127.0.0.1", groupes[idx1].port_groupe);
-                ssize_t r = sendto(sock_srv, &migr_msg, sizeof(migr_msg), 0,
-                                   (struct sockaddr *)&addr1, sizeof(addr1));
-                if (r < 0) perror("sendto migrate g1->g2");
-                
-                if (groupes[idx1].pid > 0) {
-                    pid_t pid1 = groupes[idx1].pid;
-                    kill(pid1, SIGTERM);
-                    int gaveup = 0;
-                    for (int t = 0; t < 30; ++t) {
-                        pid_t r = waitpid(pid1, NULL, WNOHANG);
-                        if (r == pid1) break;
-                        msleep_ms(100);
-                        if (t == 29) gaveup = 1;
-                    }
-                    if (gaveup) {
-                        kill(pid1, SIGKILL);
-                        waitpid(pid1, NULL, 0);
-                    }
-                    groupes[idx1].pid = 0;
-                }
-                
-                if (groupes[idx1].shm_id > 0) {
-                    shmctl(groupes[idx1].shm_id, IPC_RMID, NULL);
-                    groupes[idx1].shm_id = 0;
-                }
-                
-                groupes[idx1].shm_key = 0;
-                groupes[idx1].actif = 0;
-                
-                {
-                    char filepath[512];  
-                    snprintf(filepath, sizeof(filepath), "infoGroup/%s_banned.txt", g1);
-                    unlink(filepath);
-                }
-                
-                snprintf(reply.texte, MAX_TEXT, "Groupe %s fusionne dans %s (port %d). Tous les membres sont maintenant dans %s.",
-                         g1, g2, groupes[idx2].port_groupe, g2);
-                printf("[SERVER] Merge: %s -> %s\n", g1, g2);
-                fflush(stdout);
+/* Commandes des clients. Chacune remplit 'reply' et renvoie 1 pour qu'elle
+ * parte aussitôt, 0 si la réponse est différée (CREATE d'un GroupeISY). */
+typedef int (*CommandeServeur)(const ISYMessage *msg, const char *args,
+                               struct sockaddr_in *src, int version, ISYMessage *reply);
+
+static int cmd_list(const ISYMessage *msg, const char *args,
+                    struct sockaddr_in *src, int version, ISYMessage *reply)
+{
+    (void)msg; (void)args; (void)src; (void)version;
+    /* Liste des groupes actifs */
+    char buffer[ MAX_TEXT ];
+    buffer[0] = '\0';
+
+    size_t used = 0;
+    for (int i = 0; i < registre_etendue() && used < sizeof(buffer) - 1; ++i) {
+        GroupeInfo *gi = registre_groupe(i);
+        if (gi->actif) {
+            char line[64];
+            int len = snprintf(line, sizeof(line), "%s (port %d)\n",
+                               gi->nom, gi->port_groupe);
+            if (used + (size_t)len < sizeof(buffer)) {
+                memcpy(buffer + used, line, (size_t)len + 1);
+                used += (size_t)len;
             }
         }
     }
-    else if (strcmp(cmd, "DELETE") == 0) {
-        int idx = find_group(arg1);
-        if (idx < 0) {
-            snprintf(reply.texte, MAX_TEXT,
-                     "Groupe %s introuvable", arg1);
+    if (buffer[0] == '\0')
+        strcpy(buffer, "Aucun groupe\n");
+
+    strncpy(reply->texte, buffer, MAX_TEXT - 1);
+    reply->texte[MAX_TEXT - 1] = '\0';
+    return 1;
+}
+
+static int cmd_create(const ISYMessage *msg, const char *args,
+                      struct sockaddr_in *src, int version, ISYMessage *reply)
+{
+    char arg1[64] = {0};
+    sscanf(args, "%63s", arg1);
+
+    if (arg1[0] == '\0') {
+        strcpy(reply->texte, "Nom de groupe manquant");
+        return 1;
+    }
+    if (find_group(arg1) != -1) {
+        strcpy(reply->texte, "Groupe deja existant");
+        return 1;
+    }
+
+    /* Un slot n'est réutilisé qu'une fois son ancien GroupeISY récupéré */
+    char nom[MAX_GROUP_NAME];
+    snprintf(nom, sizeof(nom), "%.*s", (int)(MAX_GROUP_NAME - 1), arg1);
+    if (en_fermeture(nom)) {
+        snprintf(reply->texte, MAX_TEXT,
+                 "Groupe %s en cours de suppression, reessayez", nom);
+        return 1;
+    }
+    int slot = registre_allouer(nom);
+    if (slot == -1) {
+        strcpy(reply->texte, "Plus de place pour de nouveaux groupes");
+        return 1;
+    }
+    GroupeInfo *gi = registre_groupe(slot);
+    if (port_partage) gi->port_groupe = port_partage;
+    snprintf(gi->moderateur, MAX_USERNAME, "%.*s", (int)(MAX_USERNAME - 1), msg->emetteur);
+    /* Les bannis sauvegardés arrivent par les avis BANNED du groupe, à son
+     * chargement : rien n'est lu ici */
+
+    if (mode_moteur) {
+        /* Moteur : simple insertion dans la table, ni fork ni SHM */
+        if (moteur_creer_groupe(slot, gi->nom, gi->moderateur, gi->port_groupe) < 0) {
+            retirer_groupe(slot);
+            strncpy(reply->texte, "Erreur: echec creation du groupe", MAX_TEXT - 1);
+            reply->texte[MAX_TEXT - 1] = '\0';
         } else {
-            groupes[idx].actif = 0;
-            snprintf(reply.texte, MAX_TEXT,
-                     "Groupe %s supprime", arg1);
-            /* Signaler le processus GroupeISY (SIGTERM + nettoyage SHM) */
-                if (groupes[idx].pid > 0) {
-                    kill(groupes[idx].pid, SIGTERM);
-                    waitpid(groupes[idx].pid, NULL, 0);
-                    groupes[idx].pid = 0;
-                }
-                if (groupes[idx].shm_id > 0) {
-                    shmctl(groupes[idx].shm_id, IPC_RMID, NULL);
-                    groupes[idx].shm_id = 0;
-                    groupes[idx].shm_key = 0;
-                }
-                {
-                    char filepath[512];  
-                    snprintf(filepath, sizeof(filepath), "infoGroup/%s.txt", arg1);
-                    unlink(filepath);  
-                    snprintf(filepath, sizeof(filepath), "infoGroup/%s_banned.txt", arg1);
-                    unlink(filepath);
-                }
+            snprintf(reply->texte, MAX_TEXT,
+                     "Groupe %s cree sur port %d", gi->nom, gi->port_groupe);
+            register_group_name(gi->nom);
+            publier(slot);
         }
+        return 1;
     }
-    else {
-        snprintf(reply.texte, MAX_TEXT,
-                 "Commande inconnue: %s", cmd);
+
+    key_t key = SHM_GROUP_KEY_BASE + slot;
+    int shm_id = metriques_creer(key);
+    if (shm_id < 0) {
+        /* SHMMNI atteint : le groupe est refusé, le serveur continue */
+        perror("shmget group");
+        retirer_groupe(slot);
+        strncpy(reply->texte, "Erreur: creation SHM du groupe impossible", MAX_TEXT - 1);
+        reply->texte[MAX_TEXT - 1] = '\0';
+        return 1;
     }
-    
-    ssize_t ret = sendto(sock_srv, &reply, sizeof(reply), 0,
-                         (struct sockaddr *)src, src_len);
-    if (ret < 0) {
-        perror("sendto reply");
+    gi->shm_key = key;
+    gi->shm_id  = shm_id;
+    gi->demandeur = *src;
+    gi->version_demandeur = version;
+
+    /* Un GroupeISY de la réserve : réponse immédiate. Un groupe sauvegardé
+     * passe par un nouveau GroupeISY, dont le signal "prêt" suit ses avis
+     * BANNED : un CHECKBAN après la réponse voit déjà ses bannis. */
+    int confie = fichiers_groupe(gi->nom) ? 1 : confier_a_reserve(slot);
+    if (confie == 0) {
+        snprintf(reply->texte, MAX_TEXT, "Groupe %s cree sur port %d",
+                 gi->nom, gi->port_groupe);
+        register_group_name(gi->nom);
+        return 1;
+    }
+    if (confie < 0 || create_group_process(slot) < 0) {
+        retirer_groupe(slot);
+        strncpy(reply->texte, "Erreur: echec demarrage GroupeISY", MAX_TEXT - 1);
+        reply->texte[MAX_TEXT - 1] = '\0';
+        return 1;
+    }
+    register_group_name(gi->nom);
+    /* La réponse part quand le fils signale qu'il est prêt */
+    return 0;
+}
+
+static int cmd_join(const ISYMessage *msg, const char *args,
+                    struct sockaddr_in *src, int version, ISYMessage *reply)
+{
+    (void)msg; (void)src; (void)version;
+    char arg1[64] = {0};
+    sscanf(args, "%63s", arg1);
+
+    int idx = find_group(arg1);
+    if (idx < 0) {
+        snprintf(reply->texte, MAX_TEXT,
+                 "Groupe %s introuvable", arg1);
+    } else if (registre_groupe(idx)->etat == PROC_DEMARRAGE) {
+        snprintf(reply->texte, MAX_TEXT,
+                 "Groupe %s en cours de creation, reessayez", arg1);
+    } else {
+        /* Port puis id du groupe, à mettre dans l'entête v2 : seul l'id
+         * désigne le groupe sur un port partagé */
+        snprintf(reply->texte, MAX_TEXT,
+                 "OK %d %d", registre_groupe(idx)->port_groupe, idx);
+        strncpy(reply->groupe, registre_groupe(idx)->nom, MAX_GROUP_NAME - 1);
+        reply->groupe[MAX_GROUP_NAME - 1] = '\0';
+    }
+    return 1;
+}
+
+static int cmd_checkban(const ISYMessage *msg, const char *args,
+                        struct sockaddr_in *src, int version, ISYMessage *reply)
+{
+    (void)msg; (void)version;
+    char group_name[64] = {0};
+    sscanf(args, "%63s", group_name);
+
+    if (group_name[0] == '\0') {
+        strcpy(reply->texte, "Usage: CHECKBAN <group_name>");
+        return 1;
+    }
+    /* Index en mémoire, tenu à jour par les avis BANNED des groupes */
+    int idx = find_group(group_name);
+    int is_banned = idx >= 0 &&
+        bannis_contient(&registre_groupe(idx)->bannis,
+                        ntohl(src->sin_addr.s_addr));
+
+    snprintf(reply->texte, MAX_TEXT, is_banned ? "BANNED" : "OK");
+    return 1;
+}
+
+static int cmd_merge(const ISYMessage *msg, const char *args,
+                     struct sockaddr_in *src, int version, ISYMessage *reply)
+{
+    (void)src; (void)version;
+    char g1[64] = {0};
+    char g2[64] = {0};
+    sscanf(args, "%63s %63s", g1, g2);
+
+    if (g1[0] == '\0' || g2[0] == '\0') {
+        strcpy(reply->texte, "Usage: MERGE <g1> <g2>");
+        return 1;
     }
+    int idx1 = find_group(g1);
+    int idx2 = find_group(g2);
+
+    if (idx1 < 0 || idx2 < 0) {
+        snprintf(reply->texte, MAX_TEXT,
+                 "Un ou plusieurs groupes introuvables (%s, %s)", g1, g2);
+        return 1;
+    }
+    if (registre_groupe(idx1)->etat == PROC_DEMARRAGE ||
+        registre_groupe(idx2)->etat == PROC_DEMARRAGE) {
+        snprintf(reply->texte, MAX_TEXT,
+                 "Groupe en cours de creation, reessayez");
+        return 1;
+    }
+    if (idx1 == idx2) {
+        snprintf(reply->texte, MAX_TEXT,
+                 "Les deux groupes doivent etre distincts: %s", g1);
+        return 1;
+    }
+    if (strcmp(msg->emetteur, registre_groupe(idx1)->moderateur) != 0 ||
+        strcmp(msg->emetteur, registre_groupe(idx2)->moderateur) != 0) {
+        snprintf(reply->texte, MAX_TEXT,
+                 "Permission refusee: vous devez etre le createur (moderateur) des deux groupes pour fusionner");
+        return 1;
+    }
+
+    /* g1 transmet lui-même ses membres à g2 (ADDCLIENT), qui les
+     * ajoute à son journal : aucun fichier n'est réécrit ici. */
+    ISYMessage migr_msg;
+    memset(&migr_msg, 0, sizeof(migr_msg));
+    strcpy(migr_msg.ordre, ORDRE_MGR);
+    strncpy(migr_msg.emetteur, "SERVER", MAX_USERNAME - 1);
+    migr_msg.emetteur[MAX_USERNAME - 1] = '\0';
+    memcpy(migr_msg.emoji, EMOJI_SERVEUR, sizeof(EMOJI_SERVEUR));
+    snprintf(migr_msg.texte, sizeof(migr_msg.texte), "MIGRATEEXIST %s %d %d",
+             g2, registre_groupe(idx2)->port_groupe, idx2);
+
+    unsigned char trame[PROTO_TRAME_MAX];
+    size_t taille = proto_ecrire(&migr_msg, PROTO_V2, (uint16_t)idx1,
+                                 PROTO_MEMBRE_AUCUN, trame);
+    if (port_partage) {
+        /* Port partagé : rien à vider avant la suppression, l'ordre est
+         * traité tout de suite (acquittement au port du serveur) */
+        struct sockaddr_in addr_srv;
+        fill_sockaddr(&addr_srv, "127.0.0.1", SERVER_PORT);
+        if (moteur_remettre(idx1, trame, taille, &addr_srv) < 0)
+            fprintf(stderr, "[SERVER] Merge: groupe %s absent du moteur\n", g1);
+    } else {
+        struct sockaddr_in addr1;
+        fill_sockaddr(&addr1, "127.0.0.1", registre_groupe(idx1)->port_groupe);
+        ssize_t r = sendto(sock_srv, trame, taille, 0,
+                           (struct sockaddr *)&addr1, sizeof(addr1));
+        if (r < 0) perror("sendto migrate g1->g2");
+    }
+
+    if (mode_moteur) {
+        fermer_groupe_moteur(idx1);
+    } else if (registre_groupe(idx1)->pid > 0) {
+        /* g1 est arrêté à réception de son acquittement MIGRATED
+         * (ou à l'échéance) ; ses fichiers sont effacés à sa fin. */
+        registre_groupe(idx1)->etat = PROC_MIGRATION;
+        armer_echeance(idx1, DELAI_MIGRATION_MS);
+        registre_groupe(idx1)->supprimer_fichiers = 1;
+    }
+    retirer_groupe(idx1);
+
+    snprintf(reply->texte, MAX_TEXT, "Groupe %s fusionne dans %s (port %d). Tous les membres sont maintenant dans %s.",
+             g1, g2, registre_groupe(idx2)->port_groupe, g2);
+    printf("[SERVER] Merge: %s -> %s\n", g1, g2);
+    fflush(stdout);
+    return 1;
+}
+
+static int cmd_delete(const ISYMessage *msg, const char *args,
+                      struct sockaddr_in *src, int version, ISYMessage *reply)
+{
+    (void)msg; (void)src; (void)version;
+    char arg1[64] = {0};
+    sscanf(args, "%63s", arg1);
+
+    int idx = find_group(arg1);
+    if (idx < 0) {
+        snprintf(reply->texte, MAX_TEXT,
+                 "Groupe %s introuvable", arg1);
+        return 1;
+    }
+    snprintf(reply->texte, MAX_TEXT,
+             "Groupe %s supprime", arg1);
+    /* Signaler le processus GroupeISY sans l'attendre : SHM et
+     * fichiers sont libérés quand le fils est récupéré. */
+    if (mode_moteur) {
+        fermer_groupe_moteur(idx);
+    } else if (registre_groupe(idx)->pid > 0) {
+        registre_groupe(idx)->supprimer_fichiers = 1;
+        arreter_groupe(idx);
+    }
+    retirer_groupe(idx);
+    supprimer_fichiers_groupe(arg1);
+    return 1;
 }
 
-int main(void)
+static const CommandeServeur commandes[MOT_NB] = {
+    [MOT_LIST]     = cmd_list,
+    [MOT_CREATE]   = cmd_create,
+    [MOT_JOIN]     = cmd_join,
+    [MOT_CHECKBAN] = cmd_checkban,
+    [MOT_MERGE]    = cmd_merge,
+    [MOT_DELETE]   = cmd_delete,
+};
+
+static void handle_command(ISYMessage *msg, int version, struct sockaddr_in *src)
 {
-    struct sockaddr_in addr_srv, addr_cli;
-    socklen_t addrlen = sizeof(addr_cli);
-    ISYMessage msg;
+    if (verbose) {
+        char src_ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &src->sin_addr, src_ip, sizeof(src_ip));
+        printf("[SERVER] Command v%d from %s:%d -> %s\n", version, src_ip,
+               ntohs(src->sin_port), msg->texte);
+    }
+    ISYMessage reply;
+    memset(&reply, 0, sizeof(reply));
+    strcpy(reply.ordre, ORDRE_RPL);
+    strncpy(reply.emetteur, "SERVER", MAX_USERNAME - 1);
+    reply.emetteur[MAX_USERNAME - 1] = '\0';
+    memcpy(reply.emoji, EMOJI_SERVEUR, sizeof(EMOJI_SERVEUR));
+
+    const char *args;
+    int mot = proto_mot(msg->texte, &args);
+    if (commandes[mot]) {
+        if (!commandes[mot](msg, args, src, version, &reply))
+            return;
+    } else {
+        snprintf(reply.texte, MAX_TEXT,
+                 "Commande inconnue: %.*s", (int)strcspn(msg->texte, " "), msg->texte);
+    }
 
-    memset(groupes, 0, sizeof(groupes));
+    repondre(&reply, version, src);
+}
+
+int main(int argc, char *argv[])
+{
+    struct sockaddr_in addr_srv;
+    int nb_threads = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--moteur") == 0) {
+            mode_moteur = 1;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                nb_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--port-partage") == 0) {
+            mode_moteur = 1;
+            port_partage = MOTEUR_PORT_PARTAGE_DEFAUT;
+            if (i + 1 < argc && argv[i + 1][0] != '-' &&
+                (port_partage = atoi(argv[++i])) <= 0)
+                port_partage = -1;
+        } else if (strcmp(argv[i], "--lot") == 0 && i + 1 < argc) {
+            taille_lot = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--verbose") == 0) {
+            verbose = 1;
+        } else if (strcmp(argv[i], "--max-groupes") == 0 && i + 1 < argc) {
+            capacite_groupes = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--fsync") == 0 && i + 1 < argc) {
+            fsync_lot = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--compactage") == 0 && i + 1 < argc) {
+            compactage = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--historique") == 0 && i + 1 < argc) {
+            historique = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--message-max") == 0 && i + 1 < argc) {
+            message_max = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--reassemblage") == 0 && i + 1 < argc) {
+            memoire_reassemblage = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--multicast") == 0 && i + 1 < argc) {
+            multicast = argv[++i];
+        } else if (strcmp(argv[i], "--multicast-if") == 0 && i + 1 < argc) {
+            multicast_if = argv[++i];
+        } else if (strcmp(argv[i], "--relais") == 0 && i + 1 < argc) {
+            nb_relais = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            nb_workers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--reserve") == 0 && i + 1 < argc) {
+            taille_reserve = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "Usage: %s [--moteur [nb_threads]] [--port-partage [port]] "
+                            "[--lot N] [--max-groupes N] "
+                            "[--fsync N] [--compactage N] [--historique N] "
+                            "[--message-max N] [--reassemblage N] "
+                            "[--multicast adresse[:port]] [--multicast-if adresse] "
+                            "[--relais N] [--workers N] [--reserve N] [--verbose]\n",
+                    argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (multicast && groupe_configurer_multicast(multicast, multicast_if) < 0) {
+        fprintf(stderr, "ServeurISY: adresse multicast invalide (%s)\n", multicast);
+        return EXIT_FAILURE;
+    }
+    if (port_partage < 0 || port_partage > 65535 || port_partage == SERVER_PORT) {
+        fprintf(stderr, "ServeurISY: port partagé invalide\n");
+        return EXIT_FAILURE;
+    }
+    if (nb_relais < 0 || nb_relais > RELAIS_MAX) {
+        fprintf(stderr, "ServeurISY: 0 à %d relais par groupe\n", RELAIS_MAX);
+        return EXIT_FAILURE;
+    }
+    if (nb_workers < 1 || nb_workers > GROUPE_WORKERS_MAX) {
+        fprintf(stderr, "ServeurISY: 1 à %d workers par groupe\n", GROUPE_WORKERS_MAX);
+        return EXIT_FAILURE;
+    }
+    /* Le moteur ne lance pas de processus : les relais s'y inscrivent */
+    if (mode_moteur && nb_relais > 0)
+        fprintf(stderr, "ServeurISY: --relais ignoré en mode moteur "
+                        "(lancer bin/RelaisISY <port> [id] par relais)\n");
+    if (taille_reserve < 0 || taille_reserve > RESERVE_MAX) {
+        fprintf(stderr, "ServeurISY: 0 à %d GroupeISY en réserve\n", RESERVE_MAX);
+        return EXIT_FAILURE;
+    }
+    if (mode_moteur && taille_reserve > 0) {
+        fprintf(stderr, "ServeurISY: --reserve ignoré en mode moteur "
+                        "(les groupes n'y ont pas de processus)\n");
+        taille_reserve = 0;
+    }
+    if (mode_moteur && nb_workers > 1)
+        fprintf(stderr, "ServeurISY: --workers ignoré en mode moteur "
+                        "(ses threads se partagent déjà les groupes)\n");
+    if (taille_lot < 1) taille_lot = 1;
+    if (taille_lot > RECEPTION_LOT_MAX) taille_lot = RECEPTION_LOT_MAX;
+
+    /* CTRL-C et SIGTERM passent par un signalfd : le nettoyage (annuaire,
+     * infoGroup) se fait à la sortie de la boucle, hors gestionnaire de
+     * signal. Bloqués avant les threads du moteur, qui héritent du masque ;
+     * les fils GroupeISY le remettent à zéro avant exec. */
+    sigset_t arret;
+    sigemptyset(&arret);
+    sigaddset(&arret, SIGINT);
+    sigaddset(&arret, SIGTERM);
+    sigprocmask(SIG_BLOCK, &arret, NULL);
+
+    if (mode_moteur) {
+        check_fatal(journal_demarrer(fsync_lot, compactage) < 0, "journal_demarrer");
+        historique_configurer(historique);
+        fragment_configurer(message_max, memoire_reassemblage);
+        check_fatal(moteur_demarrer(nb_threads, port_partage) < 0, "moteur_demarrer");
+        if (capacite_groupes <= 0 || capacite_groupes > moteur_capacite())
+            capacite_groupes = moteur_capacite();
+        check_fatal(capacite_groupes < 1, "descripteurs insuffisants pour le moteur");
+    }
+    check_fatal(registre_init(capacite_groupes) < 0, "registre_init");
+    if (annuaire_creer(capacite_groupes > 0 ? capacite_groupes : REGISTRE_MAX_GROUPES) < 0)
+        perror("annuaire_creer");
 
     {
         FILE *f = fopen("group_members.txt", "w");
         if (f) fclose(f);
     }
 
-    signal(SIGINT, handle_sigint);
-
     sock_srv = create_udp_socket();
     int flags = fcntl(sock_srv, F_GETFD);
     if (flags != -1) fcntl(sock_srv, F_SETFD, flags | FD_CLOEXEC);
@@ -492,34 +1201,129 @@ int main(void)
    
 
 
-    printf("ServeurISY en écoute sur port %d\n", SERVER_PORT);
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    check_fatal(epfd < 0, "epoll_create1");
+    surveiller(sock_srv, EV_SERVEUR, 0);
+    arretfd = signalfd(-1, &arret, SFD_CLOEXEC | SFD_NONBLOCK);
+    check_fatal(arretfd < 0, "signalfd arret");
+    surveiller(arretfd, EV_ARRET, 0);
+    if (mode_moteur)
+        surveiller(moteur_evfd(), EV_JOURNAL, 0);
 
-    while (running) {
-        printf("[SERVER] Waiting for message on port %d...\n", SERVER_PORT);
-        fflush(stdout);
+    /* Fin des GroupeISY : un pidfd par fils, sinon SIGCHLD via signalfd */
+    int test_pidfd = pidfd_ouvrir(getpid());
+    if (test_pidfd >= 0) {
+        close(test_pidfd);
+    } else if (!mode_moteur) {
+        sigset_t chld;
+        sigemptyset(&chld);
+        sigaddset(&chld, SIGCHLD);
+        sigprocmask(SIG_BLOCK, &chld, NULL);
+        sigfd = signalfd(-1, &chld, SFD_CLOEXEC | SFD_NONBLOCK);
+        check_fatal(sigfd < 0, "signalfd");
+        surveiller(sigfd, EV_SIGCHLD, 0);
+    }
 
-        ssize_t n = recvfrom(sock_srv, &msg, sizeof(msg), 0,
-                             (struct sockaddr *)&addr_cli, &addrlen);
-        if (n < 0) {
+    printf("ServeurISY en écoute sur port %d (lot=%d)\n", SERVER_PORT, taille_lot);
+    fflush(stdout);
+    completer_reserve();
+    envoi_init(&lot_reponses, sock_srv);
+
+    /* Boucle unique : commandes clients, démarrage et fin des GroupeISY,
+     * échéances. Aucune attente bloquante sur un fils. */
+    struct epoll_event evs[64];
+    while (running) {
+        int nev = epoll_wait(epfd, evs, 64, prochaine_echeance());
+        if (nev < 0) {
             if (errno == EINTR) continue;
-            perror("recvfrom");
+            perror("epoll_wait");
             break;
         }
 
-        printf("[SERVER] recvfrom returned %zd bytes from %s:%d\n",
-               n, inet_ntoa(addr_cli.sin_addr), ntohs(addr_cli.sin_port));
-        fflush(stdout);
+        for (int e = 0; e < nev; ++e) {
+            uint32_t type = (uint32_t)(evs[e].data.u64 >> 32);
+            int slot = (int)(evs[e].data.u64 & 0xFFFFFFFFu);
 
-        if (strncmp(msg.ordre, ORDRE_CMD, 3) == 0) {
-            handle_command(&msg, &addr_cli, addrlen);
-        } else {
-            /* Messages inattendus au serveur */
-            fprintf(stderr, "Ordre inconnu recu par serveur: %s\n",
-                    msg.ordre);
+            if (type == EV_PRET) {
+                groupe_pret(slot);
+                continue;
+            }
+            if (type == EV_PIDFD) {
+                enfant_termine(slot);
+                continue;
+            }
+            if (type == EV_SIGCHLD) {
+                sigchld_recu();
+                continue;
+            }
+            if (type == EV_RESERVE) {
+                reserve_terminee((pid_t)slot);
+                continue;
+            }
+            if (type == EV_ARRET) {
+                running = 0;
+                continue;
+            }
+            if (type == EV_JOURNAL) {
+                groupes_fermes();
+                continue;
+            }
+
+            if (verbose) {
+                printf("[SERVER] Waiting for message on port %d...\n", SERVER_PORT);
+                fflush(stdout);
+            }
+
+            int n = reception_lot(sock_srv, &reception, taille_lot, MSG_DONTWAIT, NULL);
+            if (n < 0) {
+                if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK)
+                    perror("recvmmsg");
+                continue;
+            }
+
+            for (int i = 0; i < n; ++i) {
+                ISYMessage *msg = &reception.msgs[i];
+                struct sockaddr_in *addr_cli = &reception.srcs[i];
+                const ProtoInfo *info = &reception.infos[i];
+                if (verbose)
+                    printf("[SERVER] recvmmsg returned %zu bytes (v%d) from %s:%d\n",
+                           info->taille, info->version, inet_ntoa(addr_cli->sin_addr),
+                           ntohs(addr_cli->sin_port));
+
+                if (info->opcode == OP_CMD) {
+                    handle_command(msg, info->version, addr_cli);
+                } else if (info->opcode == OP_MGR) {
+                    handle_group_notice(msg, info, addr_cli);
+                } else {
+                    /* Messages inattendus au serveur */
+                    fprintf(stderr, "Ordre inconnu recu par serveur: %s\n",
+                            msg->ordre);
+                }
+            }
         }
+        traiter_echeances();
+        vider_reponses();
+        envoyer_ordres();
+        if (reserve_echeance_ms && maintenant_ms() >= reserve_echeance_ms)
+            completer_reserve();
+        fflush(stdout);
     }
 
     close(sock_srv);
+    if (sigfd >= 0) close(sigfd);
+    close(arretfd);
+    close(epfd);
+    if (mode_moteur) {
+        moteur_arreter();
+        journal_arreter();
+    }
+    /* Segments marqués pour suppression : libérés au détachement des fils */
+    for (int i = 0; i < registre_etendue(); ++i)
+        liberer_shm(registre_groupe(i));
+    registre_detruire();
+    annuaire_detruire();
+    free(suivis);
+    free(fermetures);
     cleanup_infogroup_files(); 
     printf("ServeurISY termine\n");
     return 0;
@@ -0,0 +1,97 @@
+#define _GNU_SOURCE
+#include "../include/annuaire.h"
+
+static Annuaire *annuaire = NULL;
+static int annuaire_id = -1;
+
+int annuaire_creer(int capacite)
+{
+    size_t taille = sizeof(Annuaire) + (size_t)capacite * sizeof(AnnuaireEntree);
+
+    /* Segment d'un serveur précédent : remplacé */
+    int ancien = shmget(SHM_ANNUAIRE_KEY, 0, 0);
+    if (ancien >= 0) shmctl(ancien, IPC_RMID, NULL);
+
+    annuaire_id = shmget(SHM_ANNUAIRE_KEY, taille, IPC_CREAT | IPC_EXCL | 0644);
+    if (annuaire_id < 0) return -1;
+    void *p = shmat(annuaire_id, NULL, 0);
+    if (p == (void *)-1) {
+        shmctl(annuaire_id, IPC_RMID, NULL);
+        annuaire_id = -1;
+        return -1;
+    }
+
+    annuaire = p;                  /* segment neuf : déjà à zéro */
+    annuaire->version = ANNUAIRE_VERSION;
+    annuaire->taille_entree = sizeof(AnnuaireEntree);
+    annuaire->pid_serveur = (int32_t)getpid();
+    annuaire->capacite = (uint32_t)capacite;
+    atomic_thread_fence(memory_order_release);
+    *(volatile uint32_t *)&annuaire->magic = ANNUAIRE_MAGIC;
+    return 0;
+}
+
+void annuaire_publier(int slot, const GroupeInfo *gi)
+{
+    if (!annuaire || slot < 0 || (uint32_t)slot >= annuaire->capacite) return;
+    AnnuaireEntree *e = &annuaire->groupes[slot];
+
+    uint32_t seq = atomic_load_explicit(&e->seq, memory_order_relaxed);
+    atomic_store_explicit(&e->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    /* Les groupes du moteur restent PROC_LIBRE côté serveur, sans fils */
+    e->pid = gi->pid > 0 ? gi->pid : gi->actif ? annuaire->pid_serveur : 0;
+    e->etat = gi->etat != PROC_LIBRE ? gi->etat : gi->actif ? PROC_ACTIF : PROC_LIBRE;
+    e->port = gi->port_groupe;
+    e->shm_key = gi->shm_id >= 0 ? (int32_t)gi->shm_key : 0;
+    snprintf(e->nom, sizeof(e->nom), "%s", gi->nom);
+    atomic_store_explicit(&e->seq, seq + 2, memory_order_release);
+
+    if ((uint32_t)slot >= atomic_load_explicit(&annuaire->etendue, memory_order_relaxed))
+        atomic_store_explicit(&annuaire->etendue, (uint32_t)slot + 1, memory_order_release);
+}
+
+void annuaire_detruire(void)
+{
+    if (annuaire) shmdt(annuaire);
+    if (annuaire_id >= 0) shmctl(annuaire_id, IPC_RMID, NULL);
+    annuaire = NULL;
+    annuaire_id = -1;
+}
+
+const Annuaire *annuaire_attacher(void)
+{
+    int id = shmget(SHM_ANNUAIRE_KEY, 0, 0);
+    if (id < 0) return NULL;
+    const Annuaire *a = shmat(id, NULL, SHM_RDONLY);
+    if (a == (void *)-1) return NULL;
+
+    uint32_t magic = *(const volatile uint32_t *)&a->magic;
+    atomic_thread_fence(memory_order_acquire);
+    if (magic != ANNUAIRE_MAGIC || a->version != ANNUAIRE_VERSION ||
+        a->taille_entree != sizeof(AnnuaireEntree)) {
+        shmdt(a);
+        return NULL;
+    }
+    return a;
+}
+
+int annuaire_lire(const Annuaire *a, int slot, AnnuaireEntree *copie)
+{
+    const AnnuaireEntree *e = &a->groupes[slot];
+    /* Essais bornés : un serveur tué en pleine écriture laisse un impair */
+    for (int essai = 0;; ++essai) {
+        if (essai == 1000) return 0;
+        uint32_t avant = atomic_load_explicit(&e->seq, memory_order_acquire);
+        if (avant & 1) continue;
+        copie->pid = e->pid;
+        copie->etat = e->etat;
+        copie->port = e->port;
+        copie->shm_key = e->shm_key;
+        memcpy(copie->nom, e->nom, sizeof(copie->nom));
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&e->seq, memory_order_relaxed) == avant) break;
+    }
+    copie->nom[MAX_GROUP_NAME - 1] = '\0';
+    return copie->etat != PROC_LIBRE;
+}
@@ -0,0 +1,117 @@
+#include "../include/bannis.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+void bannis_init(BanIndex *b)
+{
+    b->noeuds = NULL;
+    b->nb = 0;
+    b->cap = 0;
+    b->nb_entrees = 0;
+}
+
+void bannis_liberer(BanIndex *b)
+{
+    free(b->noeuds);
+    bannis_init(b);
+}
+
+int bannis_parser(const char *texte, uint32_t *reseau, int *longueur)
+{
+    char ip[INET_ADDRSTRLEN];
+    int len = 32;
+    const char *slash = strchr(texte, '/');
+    size_t n = slash ? (size_t)(slash - texte) : strlen(texte);
+    if (n == 0 || n >= sizeof(ip)) return -1;
+    memcpy(ip, texte, n);
+    ip[n] = '\0';
+
+    if (slash) {
+        char *fin;
+        long l = strtol(slash + 1, &fin, 10);
+        if (fin == slash + 1 || *fin != '\0' || l < 0 || l > 32) return -1;
+        len = (int)l;
+    }
+
+    struct in_addr addr;
+    if (inet_pton(AF_INET, ip, &addr) != 1) return -1;
+    uint32_t masque = len ? 0xFFFFFFFFu << (32 - len) : 0;
+    *reseau = ntohl(addr.s_addr) & masque;
+    *longueur = len;
+    return 0;
+}
+
+static uint32_t nouveau_noeud(BanIndex *b)
+{
+    if (b->nb == b->cap) {
+        uint32_t cap = b->cap ? b->cap * 2 : 64;
+        BanNoeud *p = realloc(b->noeuds, cap * sizeof(BanNoeud));
+        if (!p) return 0;
+        b->noeuds = p;
+        b->cap = cap;
+    }
+    memset(&b->noeuds[b->nb], 0, sizeof(BanNoeud));
+    return b->nb++;
+}
+
+int bannis_ajouter(BanIndex *b, uint32_t reseau, int longueur)
+{
+    if (longueur < 0 || longueur > 32) return -1;
+    if (b->nb == 0) {
+        nouveau_noeud(b);                      /* racine */
+        if (b->nb == 0) return -1;
+    }
+
+    uint32_t n = 0;
+    for (int i = 0; i < longueur; ++i) {
+        if (b->noeuds[n].banni) return 0;        /* déjà couvert par un préfixe plus court */
+        int bit = (reseau >> (31 - i)) & 1;
+        if (b->noeuds[n].fils[bit] == 0) {
+            uint32_t f = nouveau_noeud(b);
+            if (f == 0) return -1;
+            b->noeuds[n].fils[bit] = f;
+        }
+        n = b->noeuds[n].fils[bit];
+    }
+    if (!b->noeuds[n].banni) {
+        b->noeuds[n].banni = 1;
+        b->nb_entrees++;
+    }
+    return 0;
+}
+
+/* Descente en profondeur : au plus 32 niveaux */
+static void parcourir(const BanIndex *b, uint32_t n, uint32_t reseau, int longueur,
+                      void (*f)(void *arg, uint32_t reseau, int longueur), void *arg)
+{
+    if (b->noeuds[n].banni) {
+        f(arg, reseau, longueur);
+        return;
+    }
+    if (longueur == 32) return;
+    for (int bit = 0; bit < 2; ++bit)
+        if (b->noeuds[n].fils[bit])
+            parcourir(b, b->noeuds[n].fils[bit],
+                      reseau | ((uint32_t)bit << (31 - longueur)), longueur + 1, f, arg);
+}
+
+void bannis_parcourir(const BanIndex *b,
+                      void (*f)(void *arg, uint32_t reseau, int longueur), void *arg)
+{
+    if (b->nb > 0) parcourir(b, 0, 0, 0, f, arg);
+}
+
+int bannis_contient(const BanIndex *b, uint32_t ip)
+{
+    if (b->nb == 0) return 0;
+
+    uint32_t n = 0;
+    for (int i = 0; ; ++i) {
+        if (b->noeuds[n].banni) return 1;
+        if (i == 32) return 0;
+        n = b->noeuds[n].fils[(ip >> (31 - i)) & 1];
+        if (n == 0) return 0;
+    }
+}
@@ -0,0 +1,58 @@
+#define _GNU_SOURCE
+#include "../include/envoi.h"
+
+void envoi_init(EnvoiLot *lot, int sock)
+{
+    lot->sock = sock;
+    lot->n = 0;
+    lot->nb_appels = 0;
+    lot->nb_envoyes = 0;
+    lot->nb_octets = 0;
+    lot->nb_echecs = 0;
+}
+
+void envoi_ajouter(EnvoiLot *lot, const void *buf, size_t len,
+                   const struct sockaddr_in *dest, unsigned int *echecs)
+{
+    if (lot->n == ENVOI_LOT_MAX)
+        envoi_flush(lot);
+
+    int i = lot->n++;
+    lot->dests[i] = *dest;
+    lot->iovs[i].iov_base = (void *)buf;
+    lot->iovs[i].iov_len  = len;
+    memset(&lot->hdrs[i], 0, sizeof(lot->hdrs[i]));
+    lot->hdrs[i].msg_hdr.msg_name    = &lot->dests[i];
+    lot->hdrs[i].msg_hdr.msg_namelen = sizeof(lot->dests[i]);
+    lot->hdrs[i].msg_hdr.msg_iov     = &lot->iovs[i];
+    lot->hdrs[i].msg_hdr.msg_iovlen  = 1;
+    lot->echecs[i] = echecs;
+}
+
+int envoi_flush(EnvoiLot *lot)
+{
+    int debut = 0;
+    int echecs = 0;
+
+    while (debut < lot->n) {
+        int r = sendmmsg(lot->sock, &lot->hdrs[debut],
+                         (unsigned int)(lot->n - debut), 0);
+        lot->nb_appels++;
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            /* sendmmsg s'arrête au premier datagramme en erreur :
+             * on l'impute à son destinataire et on reprend après lui */
+            if (lot->echecs[debut]) (*lot->echecs[debut])++;
+            echecs++;
+            debut++;
+            continue;
+        }
+        for (int i = debut; i < debut + r; ++i)
+            lot->nb_octets += lot->hdrs[i].msg_len;
+        debut += r;
+        lot->nb_envoyes += (unsigned long)r;
+    }
+    lot->nb_echecs += (unsigned long)echecs;
+    lot->n = 0;
+    return echecs;
+}
@@ -0,0 +1,174 @@
+#define _GNU_SOURCE
+#include "../include/fragment.h"
+#include <time.h>
+
+enum { SLAB_LIBRE = 0, SLAB_EN_COURS, SLAB_PRETE };
+
+_Static_assert(sizeof(FragmentEntete) == 12, "entete de fragment de 12 octets");
+_Static_assert(FRAGMENT_NB_MAX <= 64, "fragments suivis sur 64 bits");
+
+static size_t message_max = PROTO_MESSAGE_MAX;
+static size_t memoire_max = FRAGMENT_MEMOIRE_DEFAUT;
+
+void fragment_configurer(size_t max, size_t memoire)
+{
+    if (max < PROTO_TRAME_MAX) max = PROTO_TRAME_MAX;
+    if (max > PROTO_MESSAGE_MAX) max = PROTO_MESSAGE_MAX;
+    message_max = max;
+    memoire_max = memoire;
+}
+
+size_t fragment_message_max(void)
+{
+    return message_max;
+}
+
+static long long maintenant_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+int fragment_nombre(size_t n)
+{
+    return n <= PROTO_TRAME_MAX ? 1 : (int)((n + FRAGMENT_CHARGE - 1) / FRAGMENT_CHARGE);
+}
+
+size_t fragment_ecrire(const void *trame, size_t n, uint32_t id, uint16_t groupe,
+                       int k, void *out)
+{
+    size_t debut = (size_t)k * FRAGMENT_CHARGE;
+    size_t morceau = n - debut < FRAGMENT_CHARGE ? n - debut : FRAGMENT_CHARGE;
+
+    ProtoEntete h;
+    memset(&h, 0, sizeof(h));
+    h.version = PROTO_V2;
+    h.opcode = OP_FRAGMENT;
+    h.longueur = htons((uint16_t)(sizeof(FragmentEntete) + morceau));
+    h.groupe = htons(groupe);
+    h.emetteur = PROTO_MEMBRE_AUCUN;
+
+    FragmentEntete f;
+    f.id = htonl(id);
+    f.index = htons((uint16_t)k);
+    f.nombre = htons((uint16_t)fragment_nombre(n));
+    f.total = htonl((uint32_t)n);
+
+    unsigned char *p = out;
+    memcpy(p, &h, sizeof(h));
+    memcpy(p + sizeof(h), &f, sizeof(f));
+    memcpy(p + sizeof(h) + sizeof(f), (const unsigned char *)trame + debut, morceau);
+    return sizeof(h) + sizeof(f) + morceau;
+}
+
+void reassembleur_init(Reassembleur *r)
+{
+    memset(r, 0, sizeof(*r));
+    r->taille_slab = message_max;
+    r->nb_slabs = (int)(memoire_max / message_max);
+    if (r->nb_slabs < 1) r->nb_slabs = 1;
+}
+
+void reassembleur_liberer(Reassembleur *r)
+{
+    free(r->zone);
+    free(r->slabs);
+    r->zone = NULL;
+    r->slabs = NULL;
+}
+
+static int meme_source(const Reassemblage *s, const struct sockaddr_in *src, uint32_t id)
+{
+    return s->id == id && s->src.sin_addr.s_addr == src->sin_addr.s_addr &&
+           s->src.sin_port == src->sin_port;
+}
+
+/* Slab libre, ou à défaut celui d'un réassemblage expiré */
+static int slab_disponible(Reassembleur *r, long long now)
+{
+    int expire = -1;
+    for (int i = 0; i < r->nb_slabs; ++i) {
+        if (r->slabs[i].etat == SLAB_LIBRE) return i;
+        if (r->slabs[i].etat == SLAB_EN_COURS && expire < 0 &&
+            now - r->slabs[i].debut_ms > FRAGMENT_DELAI_MS)
+            expire = i;
+    }
+    if (expire >= 0) r->nb_perdus++;
+    return expire;
+}
+
+int reassembleur_ajouter(Reassembleur *r, const ProtoInfo *info,
+                         const struct sockaddr_in *src,
+                         const unsigned char **trame, size_t *len)
+{
+    FragmentEntete f;
+    if (info->nb_charge < sizeof(f)) return -1;
+    memcpy(&f, info->charge, sizeof(f));
+    uint32_t id = ntohl(f.id);
+    size_t index = ntohs(f.index);
+    size_t nombre = ntohs(f.nombre);
+    size_t total = ntohl(f.total);
+    size_t morceau = info->nb_charge - sizeof(f);
+
+    /* Le découpage doit être exactement celui de fragment_ecrire */
+    if (total > r->taille_slab || nombre < 2 || nombre > FRAGMENT_NB_MAX ||
+        (size_t)fragment_nombre(total) != nombre || index >= nombre)
+        return -1;
+    size_t attendu = index + 1 < nombre ? FRAGMENT_CHARGE
+                                        : total - (nombre - 1) * FRAGMENT_CHARGE;
+    if (morceau != attendu) return -1;
+
+    if (!r->zone) {
+        r->zone = malloc((size_t)r->nb_slabs * r->taille_slab);
+        r->slabs = calloc((size_t)r->nb_slabs, sizeof(*r->slabs));
+        if (!r->zone || !r->slabs) {
+            reassembleur_liberer(r);
+            return -1;
+        }
+    }
+
+    long long now = maintenant_ms();
+    int k = -1;
+    for (int i = 0; i < r->nb_slabs; ++i)
+        if (r->slabs[i].etat == SLAB_EN_COURS && meme_source(&r->slabs[i], src, id)) {
+            k = i;
+            break;
+        }
+    if (k < 0) {
+        k = slab_disponible(r, now);
+        if (k < 0) {
+            r->nb_perdus++;
+            return -1;
+        }
+        Reassemblage *s = &r->slabs[k];
+        memset(s, 0, sizeof(*s));
+        s->src = *src;
+        s->id = id;
+        s->total = (uint32_t)total;
+        s->nombre = (uint16_t)nombre;
+        s->debut_ms = now;
+        s->etat = SLAB_EN_COURS;
+    }
+
+    Reassemblage *s = &r->slabs[k];
+    if (s->total != total || s->nombre != nombre) return -1;
+    if (s->vus & (UINT64_C(1) << index)) return -1;
+
+    unsigned char *slab = r->zone + (size_t)k * r->taille_slab;
+    memcpy(slab + index * FRAGMENT_CHARGE, info->charge + sizeof(f), morceau);
+    s->vus |= UINT64_C(1) << index;
+    if (++s->recus < s->nombre) return -1;
+
+    s->etat = SLAB_PRETE;
+    r->nb_complets++;
+    *trame = slab;
+    *len = total;
+    return k;
+}
+
+void reassembleur_rendre(Reassembleur *r, int slab)
+{
+    if (r->slabs && slab >= 0 && slab < r->nb_slabs)
+        r->slabs[slab].etat = SLAB_LIBRE;
+}
@@ -0,0 +1,1386 @@
+#define _GNU_SOURCE
+#include "../include/groupe.h"
+#include "../include/envoi.h"
+#include "../include/journal.h"
+#include "../include/relais.h"
+#include <stdatomic.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <time.h>
+
+static void ensure_infogroup_dir(void)
+{
+    mkdir("infoGroup", 0755);
+}
+
+static void envoyer(GroupeEtat *g, const ISYMessage *msg, const struct sockaddr_in *dest);
+
+/* Avis au serveur (MGR "BANNED <groupe> <cidr>") pour qu'il garde le même
+ * index pour CHECKBAN */
+static void avis_banni(GroupeEtat *g, const char *texte)
+{
+    ISYMessage avis;
+    memset(&avis, 0, sizeof(avis));
+    strcpy(avis.ordre, ORDRE_MGR);
+    snprintf(avis.emetteur, MAX_USERNAME, "%.*s", MAX_USERNAME - 1, g->nom);
+    snprintf(avis.groupe, MAX_GROUP_NAME, "%s", g->nom);
+    snprintf(avis.texte, sizeof(avis.texte), "BANNED %s %s", g->nom, texte);
+    struct sockaddr_in addr_srv;
+    fill_sockaddr(&addr_srv, "127.0.0.1", SERVER_PORT);
+    envoyer(g, &avis, &addr_srv);
+}
+
+/* Ajoute un préfixe banni : index mémoire, journal, puis avis au serveur */
+static void ban_ip_from_group(GroupeEtat *g, const char *texte,
+                              uint32_t reseau, int longueur)
+{
+    bannis_ajouter(&g->bannis, reseau, longueur);
+    journal_bannir(g->journal, reseau, longueur);
+    avis_banni(g, texte);
+}
+
+/* Diffusion multicast (groupe_configurer_multicast) */
+static uint32_t multicast_base;            /* ordre hôte, 0 : désactivée */
+static uint16_t multicast_port = MULTICAST_PORT_DEFAUT;
+static struct in_addr multicast_interface; /* INADDR_ANY : table de routage */
+
+int groupe_configurer_multicast(const char *spec, const char *interface)
+{
+    char adresse[INET_ADDRSTRLEN];
+    int port = MULTICAST_PORT_DEFAUT;
+    struct in_addr base;
+    if (sscanf(spec, "%15[0-9.]:%d", adresse, &port) < 1 ||
+        inet_pton(AF_INET, adresse, &base) != 1 || !IN_MULTICAST(ntohl(base.s_addr)) ||
+        port <= 0 || port > 65535)
+        return -1;
+    if (interface && inet_pton(AF_INET, interface, &multicast_interface) != 1)
+        return -1;
+    multicast_base = ntohl(base.s_addr);
+    multicast_port = (uint16_t)port;
+    return 0;
+}
+
+/* Adresse multicast du groupe ; sans interface d'émission, la diffusion
+ * reste en unicast */
+int groupe_preparer_socket(int sock)
+{
+    if (!multicast_base) return 0;
+    return setsockopt(sock, IPPROTO_IP, IP_MULTICAST_IF, &multicast_interface,
+                      sizeof(multicast_interface));
+}
+
+static void activer_multicast(GroupeEtat *g)
+{
+    if (groupe_preparer_socket(g->sock) < 0) {
+        perror("IP_MULTICAST_IF groupe");
+        return;
+    }
+    g->multicast.sin_family = AF_INET;
+    g->multicast.sin_addr.s_addr = htonl(multicast_base + g->id);
+    g->multicast.sin_port = htons(multicast_port);
+}
+
+/* Id v2 du membre de la case c : seules les premières cases en ont un */
+static uint8_t id_case(int c)
+{
+    return c >= 0 && c < PROTO_MEMBRES_MAX ? (uint8_t)c : PROTO_MEMBRE_AUCUN;
+}
+
+/* Instantané des membres d'un groupe partagé (groupe_partager). Jamais
+ * modifié une fois publié : le groupe en garde une référence, chaque
+ * diffusion en attente une autre, et le dernier à le lâcher le libère. */
+struct GroupeInstantane {
+    _Atomic int references;
+    uint32_t generation;             /* TableMembres.generation à la publication */
+    int nb, nb_v2;                   /* les v2 d'abord : addr[0, nb_v2) */
+    struct sockaddr_in addr[];
+};
+
+static void lacher(GroupeInstantane *s)
+{
+    if (s && atomic_fetch_sub(&s->references, 1) == 1) free(s);
+}
+
+/* Instantané à jour des membres servis par le groupe, republié si la table
+ * a changé depuis ; faute de mémoire, le précédent (NULL : aucun) */
+static GroupeInstantane *instantane(GroupeEtat *g)
+{
+    const TableMembres *t = &g->membres;
+    if (g->instantane && g->instantane->generation == t->generation)
+        return g->instantane;
+
+    GroupeInstantane *s = malloc(sizeof(*s) + (size_t)t->nb_directs * sizeof(s->addr[0]));
+    if (!s) return g->instantane;
+    atomic_init(&s->references, 1);
+    s->generation = t->generation;
+    s->nb = t->nb_directs;
+    int v2 = 0, v1 = t->nb_directs;
+    for (int k = 0; k < t->nb_directs; ++k) {
+        const ClientInfo *c = membres_actif(t, k);
+        s->addr[c->version == PROTO_V2 ? v2++ : --v1] = c->addr_cli;
+    }
+    s->nb_v2 = v2;
+    lacher(g->instantane);
+    g->instantane = s;
+    return s;
+}
+
+void groupe_init(GroupeEtat *g, int id, const char *nom, const char *moderateur, int sock)
+{
+    memset(g, 0, sizeof(*g));
+    g->id = (uint16_t)id;
+    snprintf(g->nom, sizeof(g->nom), "%s", nom);
+    snprintf(g->moderateur, sizeof(g->moderateur), "%s", moderateur);
+    g->sock = sock;
+    g->stats = &g->stats_locales;
+    metriques_init(g->stats, id, nom);
+    bannis_init(&g->bannis);
+    membres_init(&g->membres);
+    reassembleur_init(&g->reassemblage);
+    g->prochain_fragment = (uint32_t)getpid() << 16 ^ (uint32_t)id << 8;
+    if (multicast_base) activer_multicast(g);
+}
+
+void groupe_liberer(GroupeEtat *g)
+{
+    journal_fermer(g->journal);
+    g->journal = NULL;
+    bannis_liberer(&g->bannis);
+    membres_liberer(&g->membres);
+    historique_fermer(&g->historique);
+    reassembleur_liberer(&g->reassemblage);
+    free(g->relais);
+    g->relais = NULL;
+    lacher(g->instantane);
+    g->instantane = NULL;
+}
+
+void groupe_charger(GroupeEtat *g)
+{
+    ensure_infogroup_dir();
+
+    /* Instantané binaire (mmap) + rejeu du journal */
+    JournalEtat etat;
+    journal_charger(g->nom, &etat);
+    for (int k = 0; k < etat.nb_bannis; ++k)
+        bannis_ajouter(&g->bannis, etat.bannis[k].reseau, (int)etat.bannis[k].longueur);
+    if (etat.nb_bannis > 0)
+        printf("[GROUP] %d entrees bannies chargees pour %s\n", etat.nb_bannis, g->nom);
+
+    g->journal = journal_ouvrir(g->nom, &etat, g->stats);
+    historique_ouvrir(&g->historique, g->nom);
+    if (etat.nb_membres == 0) {
+        printf("[GROUP] No existing group file to load for %s\n", g->nom);
+        journal_etat_liberer(&etat);
+        return;
+    }
+
+    printf("[GROUP] Loading members of %s...\n", g->nom);
+
+    /* Port d'affichage inconnu (0) jusqu'au prochain CON du membre */
+    int loaded = 0;
+    for (int k = 0; k < etat.nb_membres; ++k) {
+        const JournalMembre *m = &etat.membres[k];
+        int i = membres_ajouter(&g->membres, m->ip, htons(0), m->nom);
+        if (i < 0) break;
+        ClientInfo *c = membres_case(&g->membres, i);
+        c->version = PROTO_V1;    /* jusqu'à son prochain CON */
+        snprintf(c->emoji, MAX_EMOJI, "%s", m->emoji);
+
+        char ip_str[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &c->addr_cli.sin_addr, ip_str, sizeof(ip_str));
+        printf("[GROUP]   Loaded: %s (%s) emoji=%s\n", m->nom, ip_str, m->emoji);
+        loaded++;
+    }
+    journal_etat_liberer(&etat);
+    STAT_FIXER(g->stats, nb_clients, (uint32_t)loaded);
+    printf("[GROUP] Loaded %d members from group file\n", loaded);
+}
+
+/* La version d'un membre choisit sa trame de diffusion : l'instantané est
+ * à refaire quand elle change */
+static void changer_version(GroupeEtat *g, ClientInfo *c, int version)
+{
+    if (c->version != version) g->membres.generation++;
+    c->version = version;
+}
+
+/* Ajoute ou met à jour le membre (IP, port d'affichage, nom). Renvoie 0 et
+ * sa case dans *slot, 1 si l'IP est bannie, 2 si le groupe est plein. */
+static int add_client(GroupeEtat *g, const char *name,
+                      const struct sockaddr_in *addr, int display_port, int version,
+                      int *slot)
+{
+    TableMembres *t = &g->membres;
+    uint32_t ip = addr->sin_addr.s_addr;
+    uint16_t port = htons((uint16_t)display_port);
+    char ip_str[64];
+    inet_ntop(AF_INET, &addr->sin_addr, ip_str, sizeof(ip_str));
+
+    if (bannis_contient(&g->bannis, ntohl(ip))) {
+        printf("Client %s (%s) rejected: IP is banned from group %s\n",
+               name, ip_str, g->nom);
+        STAT_AJOUTER(g->stats, rejets_bannis, 1);
+        return 1;
+    }
+
+    /* Déjà membre ; ou même affichage sous un autre nom ; ou membre rechargé
+     * depuis le disque, dont le port d'affichage était inconnu */
+    int i = membres_chercher(t, ip, port, name);
+    if (i < 0) i = membres_chercher_affichage(t, ip, port);
+    if (i < 0) i = membres_chercher(t, ip, htons(0), name);
+    if (i >= 0) {
+        ClientInfo *c = membres_case(t, i);
+        printf("Client %s (%s:%d) already connected to group %s, updating info\n",
+               name, ip_str, display_port, g->nom);
+        if (strcmp(c->nom, name) != 0) journal_retirer(g->journal, c->nom, addr->sin_addr);
+        membres_renommer(t, i, port, name);
+        changer_version(g, c, version);
+        journal_ajouter(g->journal, name, addr->sin_addr, c->emoji);
+        *slot = i;
+        return 0;
+    }
+
+    i = membres_ajouter(t, ip, port, name);
+    if (i < 0) {
+        printf("Plus de place pour de nouveaux clients dans ce groupe\n");
+        return 2;
+    }
+    ClientInfo *c = membres_case(t, i);
+    c->version = version;
+    choose_emoji_from_ip(ip_str, c->emoji);
+
+    STAT_FIXER(g->stats, nb_clients, (uint32_t)t->nb);
+    printf("Client %s ajouté (port %d, IP: %s, emoji: %s, v%d)\n",
+           name, display_port, ip_str, c->emoji, version);
+
+    journal_ajouter(g->journal, name, addr->sin_addr, c->emoji);
+    *slot = i;
+    return 0;
+}
+
+/* Membre transmis par un groupe fusionné : il garde son emoji */
+static void add_client_direct(GroupeEtat *g, const char *name, const char *ip,
+                              int display_port, const char *emoji, int version)
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    inet_pton(AF_INET, ip, &addr.sin_addr);
+    int i = membres_chercher(&g->membres, addr.sin_addr.s_addr,
+                             htons((uint16_t)display_port), name);
+    if (i >= 0) {
+        ClientInfo *c = membres_case(&g->membres, i);
+        snprintf(c->emoji, MAX_EMOJI, "%s", emoji);
+        changer_version(g, c, version);
+        return;
+    }
+    add_client(g, name, &addr, display_port, version, &i);
+}
+
+/* Id v2 du membre ayant ce nom et cet emoji, sinon PROTO_MEMBRE_AUCUN.
+ * Seules les PROTO_MEMBRES_MAX premières cases ont un id. */
+static uint8_t id_membre(const GroupeEtat *g, const ISYMessage *msg)
+{
+    unsigned int h = hache_texte(msg->emetteur);
+    for (int i = 0; i < PROTO_MEMBRES_MAX && i < g->membres.etendue; ++i) {
+        const ClientInfo *c = membres_case(&g->membres, i);
+        if (c->actif && c->hache_nom == h && strcmp(c->nom, msg->emetteur) == 0 &&
+            strcmp(c->emoji, msg->emoji) == 0)
+            return (uint8_t)i;
+    }
+    return PROTO_MEMBRE_AUCUN;
+}
+
+/* Le paquet vient-il de l'affichage d'un membre (IP et port) ? */
+static int est_membre(const GroupeEtat *g, const struct sockaddr_in *src)
+{
+    return membres_chercher_affichage(&g->membres, src->sin_addr.s_addr, src->sin_port) >= 0;
+}
+
+/* Lot d'envoi du thread courant : un thread ne traite qu'un groupe à la fois.
+ * Les messages sortants sont encodés dans lot_trames et partent ensemble
+ * dans groupe_fin_lot(), ou plus tôt si le lot est plein. Un message long
+ * y occupe une trame par fragment.
+ */
+#define GROUPE_LOT_MSGS 64
+_Static_assert(FRAGMENT_NB_MAX + 1 <= GROUPE_LOT_MSGS,
+               "un message fragmenté et sa version v1 tiennent dans le lot");
+static _Thread_local EnvoiLot lot_envoi;
+static _Thread_local unsigned char lot_trames[GROUPE_LOT_MSGS][PROTO_TRAME_MAX];
+static _Thread_local size_t lot_tailles[GROUPE_LOT_MSGS];
+static _Thread_local int lot_nb_msgs;
+/* Trame v2 d'un message long, avant découpage en fragments */
+static _Thread_local unsigned char trame_longue[PROTO_MESSAGE_MAX];
+/* Version du paquet en cours de traitement : les réponses la reprennent */
+static _Thread_local int version_requete = PROTO_V1;
+/* Paquets traités depuis le dernier groupe_fin_lot */
+static _Thread_local uint32_t lot_recus;
+/* Horodatages du message tracé en cours de diffusion (NULL : aucun), et
+ * trames tracées du lot, horodatées juste avant l'envoi */
+static _Thread_local const ProtoTrace *trace_diffusion;
+static _Thread_local int lot_traces;
+/* Lot d'un groupe partagé (groupe_partager) : les envois y sont notés dans
+ * l'ordre et ne partent qu'au vider_envois, fait hors du verrou ; le
+ * fan-out unicast d'une diffusion est une seule note, sur l'instantané des
+ * membres. Chaque réservation de trames garde la place des notes qui
+ * peuvent la suivre : membres, multicast et relais. */
+#define GROUPE_LOT_NOTES (GROUPE_LOT_MSGS * 4)
+#define NOTES_PAR_RESERVATION (2 + RELAIS_MAX)
+typedef struct {
+    GroupeInstantane *instantane;    /* NULL : le seul destinataire dest */
+    struct sockaddr_in dest;
+    int premiers[2], nombres[2];     /* trames par version, [1] pour dest */
+} EnvoiNote;
+static _Thread_local EnvoiNote lot_notes[GROUPE_LOT_NOTES];
+static _Thread_local int lot_nb_notes;
+static _Thread_local int lot_partage;
+
+/* Heure d'envoi des trames tracées : celle du sendmmsg qui suit */
+static void horodater_envois(GroupeEtat *g)
+{
+    uint64_t envoi = trace_maintenant(), reception;
+    for (int i = 0; i < lot_nb_msgs; ++i)
+        if (proto_horodater_envoi(lot_trames[i], lot_tailles[i], envoi, &reception))
+            metriques_tracer(g->stats, TRACE_GROUPE, reception, envoi);
+    lot_traces = 0;
+}
+
+static void envoyer_trames(int premier, int k, const struct sockaddr_in *dest,
+                           unsigned int *echecs)
+{
+    for (int f = premier; f < premier + k; ++f)
+        envoi_ajouter(&lot_envoi, lot_trames[f], lot_tailles[f], dest, echecs);
+}
+
+/* Compteur d'envoi : les workers d'un groupe partagé le cumulent en même
+ * temps, hors du verrou */
+#define STAT_ENVOI(g, champ, n)                                \
+    do {                                                       \
+        if (lot_partage) STAT_CUMULER((g)->stats, champ, n);   \
+        else STAT_AJOUTER((g)->stats, champ, n);               \
+    } while (0)
+
+/* Hors du verrou pour un groupe partagé : n'y touche que ses stats */
+static void vider_envois(GroupeEtat *g)
+{
+    if (lot_traces > 0) horodater_envois(g);
+    for (int i = 0; i < lot_nb_notes; ++i) {
+        const EnvoiNote *x = &lot_notes[i];
+        const GroupeInstantane *s = x->instantane;
+        if (!s) {
+            envoyer_trames(x->premiers[1], x->nombres[1], &x->dest, NULL);
+            continue;
+        }
+        for (int k = 0; k < s->nb; ++k) {
+            int v2 = k < s->nb_v2;
+            envoyer_trames(x->premiers[v2], x->nombres[v2], &s->addr[k], NULL);
+        }
+        lacher(x->instantane);
+    }
+    lot_nb_notes = 0;
+    envoi_flush(&lot_envoi);
+    STAT_ENVOI(g, paquets_envoyes, lot_envoi.nb_envoyes);
+    STAT_ENVOI(g, octets_envoyes, lot_envoi.nb_octets);
+    STAT_FIXER(g->stats, dernier_envoi, (uint32_t)(lot_envoi.nb_envoyes + lot_envoi.nb_echecs));
+    if (lot_envoi.nb_echecs > 0)
+        STAT_ENVOI(g, nb_echecs_envoi, lot_envoi.nb_echecs);
+    lot_nb_msgs = 0;
+}
+
+/* Garantit n trames libres : les trames déjà réservées restent valides
+ * jusqu'à ce qu'une réservation vide le lot */
+static void reserver_place(GroupeEtat *g, int n)
+{
+    if (lot_nb_msgs + n > GROUPE_LOT_MSGS ||
+        lot_nb_notes + NOTES_PAR_RESERVATION > GROUPE_LOT_NOTES)
+        vider_envois(g);
+    if (lot_nb_msgs == 0) {
+        envoi_init(&lot_envoi, g->sock);
+        lot_partage = g->partage;
+    }
+}
+
+static unsigned char *reserver_envoi(GroupeEtat *g)
+{
+    reserver_place(g, 1);
+    return lot_trames[lot_nb_msgs++];
+}
+
+/* Encode msg avec le texte complet 'texte' (nb octets) dans le lot : une
+ * trame, ou les fragments de la trame v2 si elle dépasse un datagramme.
+ * 'marge' trames restent libres pour un encodage suivant. Renvoie le
+ * nombre de trames, la première en *premier. */
+static int encoder_texte(GroupeEtat *g, const ISYMessage *msg, const char *texte,
+                         size_t nb, int version, uint8_t emetteur, int marge,
+                         int *premier)
+{
+    const ProtoTrace *trace = version == PROTO_V2 ? trace_diffusion : NULL;
+    if (version != PROTO_V2 || nb < MAX_TEXT) {
+        reserver_place(g, 1 + marge);
+        *premier = lot_nb_msgs;
+        lot_tailles[lot_nb_msgs] = proto_ecrire_texte(msg, texte, nb, version, g->id,
+                                                      emetteur, lot_trames[lot_nb_msgs],
+                                                      PROTO_TRAME_MAX, trace);
+        lot_nb_msgs++;
+        if (trace) lot_traces++;
+        return 1;
+    }
+
+    /* Fragments : horodatés dès l'encodage, le bloc de trace y est découpé */
+    ProtoTrace t;
+    if (trace) {
+        t = *trace;
+        t.groupe_envoi = trace_maintenant();
+    }
+    size_t n = proto_ecrire_texte(msg, texte, nb, version, g->id, emetteur,
+                                  trame_longue, fragment_message_max(),
+                                  trace ? &t : NULL);
+    int k = fragment_nombre(n);
+    reserver_place(g, k + marge);
+    *premier = lot_nb_msgs;
+    if (k == 1) {
+        memcpy(lot_trames[lot_nb_msgs], trame_longue, n);
+        lot_tailles[lot_nb_msgs++] = n;
+        if (trace) lot_traces++;
+        return 1;
+    }
+    if (trace) metriques_tracer(g->stats, TRACE_GROUPE, t.groupe_reception, t.groupe_envoi);
+    uint32_t id = g->prochain_fragment++;
+    for (int f = 0; f < k; ++f, ++lot_nb_msgs)
+        lot_tailles[lot_nb_msgs] = fragment_ecrire(trame_longue, n, id, g->id, f,
+                                                   lot_trames[lot_nb_msgs]);
+    return k;
+}
+
+/* Envoi des trames [premier, +k) du lot à dest ; 'echecs' n'est pas
+ * compté dans un groupe partagé */
+static void ajouter_trames(int premier, int k, const struct sockaddr_in *dest,
+                           unsigned int *echecs)
+{
+    if (!lot_partage) {
+        envoyer_trames(premier, k, dest, echecs);
+        return;
+    }
+    EnvoiNote *x = &lot_notes[lot_nb_notes++];
+    x->instantane = NULL;
+    x->dest = *dest;
+    x->premiers[1] = premier;
+    x->nombres[1] = k;
+}
+
+/* Fan-out unicast des trames [premiers[v], +nombres[v]) aux membres servis
+ * par le groupe, selon leur version (nombres[v] 0 : aucune trame) */
+static void diffuser_directs(GroupeEtat *g, const int premiers[2], const int nombres[2])
+{
+    if (lot_partage) {
+        GroupeInstantane *s = instantane(g);
+        if (!s || s->nb == 0) return;
+        atomic_fetch_add(&s->references, 1);
+        EnvoiNote *x = &lot_notes[lot_nb_notes++];
+        x->instantane = s;
+        memcpy(x->premiers, premiers, sizeof(x->premiers));
+        memcpy(x->nombres, nombres, sizeof(x->nombres));
+        return;
+    }
+    const TableMembres *t = &g->membres;
+    for (int k = 0; k < t->nb_directs; ++k) {
+        ClientInfo *c = membres_actif(t, k);
+        int v2 = c->version == PROTO_V2;
+        ajouter_trames(premiers[v2], nombres[v2], &c->addr_cli, &c->echecs_envoi);
+    }
+}
+
+static void envoyer_texte(GroupeEtat *g, const ISYMessage *msg, const char *texte,
+                          size_t nb, int version, const struct sockaddr_in *dest,
+                          unsigned int *echecs)
+{
+    uint8_t emetteur = version == PROTO_V2 ? id_membre(g, msg) : PROTO_MEMBRE_AUCUN;
+    int premier;
+    int k = encoder_texte(g, msg, texte, nb, version, emetteur, 0, &premier);
+    ajouter_trames(premier, k, dest, echecs);
+}
+
+static void envoyer_v(GroupeEtat *g, const ISYMessage *msg, int version,
+                      const struct sockaddr_in *dest, unsigned int *echecs)
+{
+    envoyer_texte(g, msg, msg->texte, strnlen(msg->texte, sizeof(msg->texte)),
+                  version, dest, echecs);
+}
+
+/* Ordres internes (serveur, autres groupes) : toujours en v2 */
+static void envoyer(GroupeEtat *g, const ISYMessage *msg, const struct sockaddr_in *dest)
+{
+    envoyer_v(g, msg, PROTO_V2, dest, NULL);
+}
+
+/* Réponse à l'auteur du paquet en cours, dans sa version */
+static void repondre(GroupeEtat *g, const ISYMessage *msg, const struct sockaddr_in *dest)
+{
+    envoyer_v(g, msg, version_requete, dest, NULL);
+}
+
+/* Relais de diffusion (relais.h) */
+
+static long long maintenant_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Ordre RLY (v2) vers un relais ou un affichage ; 'texte' peut dépasser
+ * MAX_TEXT */
+static void envoyer_rly(GroupeEtat *g, const char *texte, size_t nb,
+                        const struct sockaddr_in *dest)
+{
+    ISYMessage rly;
+    memset(&rly, 0, sizeof(rly));
+    strcpy(rly.ordre, ORDRE_RLY);
+    snprintf(rly.groupe, MAX_GROUP_NAME, "%s", g->nom);
+    envoyer_texte(g, &rly, texte, nb, PROTO_V2, dest, NULL);
+}
+
+/* Envoie les entrées accumulées pour le relais r */
+static void envoyer_maj(GroupeEtat *g, int r)
+{
+    GroupeRelais *x = &g->relais[r];
+    char texte[RELAIS_MAJ_MAX + 32];
+    int n = snprintf(texte, sizeof(texte), "MAJ %u%s%s", (unsigned)++x->seq,
+                     x->reinit ? " =" : "", x->maj);
+    x->reinit = 0;
+    x->nb_maj = 0;
+    x->maj[0] = '\0';
+    envoyer_rly(g, texte, (size_t)n, &x->addr);
+}
+
+/* Ajout (1) ou retrait (0) du membre c dans la tranche du relais r */
+static void noter_relais(GroupeEtat *g, int r, int ajout, const ClientInfo *c)
+{
+    GroupeRelais *x = &g->relais[r];
+    if (relais_ecrire_entree(x->maj, sizeof(x->maj), &x->nb_maj, ajout, &c->addr_cli) < 0) {
+        envoyer_maj(g, r);
+        relais_ecrire_entree(x->maj, sizeof(x->maj), &x->nb_maj, ajout, &c->addr_cli);
+    }
+    g->relais_en_attente = 1;
+}
+
+/* Les relais reçoivent leurs changements avant toute diffusion : à appeler
+ * avant d'encoder celle-ci, l'envoi d'une MAJ pouvant vider le lot */
+static void publier_relais(GroupeEtat *g)
+{
+    if (!g->relais_en_attente) return;
+    for (int r = 0; r < g->nb_relais; ++r) {
+        const GroupeRelais *x = &g->relais[r];
+        if (x->actif && (x->nb_maj > 0 || x->reinit)) envoyer_maj(g, r);
+    }
+    g->relais_en_attente = 0;
+}
+
+/* Change le service du membre i ; les relais concernés et l'affichage
+ * confié à un relais en sont avertis */
+static void servir(GroupeEtat *g, int i, int service)
+{
+    ClientInfo *c = membres_valide(&g->membres, i);
+    if (!c || c->service == service) return;
+
+    if (c->service == SERVICE_MULTICAST) {
+        g->nb_multicast--;
+    } else if (c->service >= SERVICE_RELAIS) {
+        int r = c->service - SERVICE_RELAIS;
+        g->relais[r].nb_membres--;
+        if (g->relais[r].actif) noter_relais(g, r, 0, c);
+    }
+    membres_servir(&g->membres, i, service);
+    if (service == SERVICE_MULTICAST) {
+        g->nb_multicast++;
+    } else if (service >= SERVICE_RELAIS) {
+        int r = service - SERVICE_RELAIS;
+        g->relais[r].nb_membres++;
+        noter_relais(g, r, 1, c);
+
+        char ip[INET_ADDRSTRLEN], texte[64];
+        inet_ntop(AF_INET, &g->relais[r].addr.sin_addr, ip, sizeof(ip));
+        int n = snprintf(texte, sizeof(texte), "RELAIS %s %u", ip,
+                         (unsigned)ntohs(g->relais[r].addr.sin_port));
+        envoyer_rly(g, texte, (size_t)n, &c->addr_cli);
+    }
+}
+
+/* Confie le membre i, s'il est v2 et servi par le groupe, au relais actif
+ * le moins chargé */
+static void attribuer(GroupeEtat *g, int i)
+{
+    const ClientInfo *c = membres_valide(&g->membres, i);
+    if (!c || c->service != SERVICE_DIRECT || c->version != PROTO_V2 ||
+        c->addr_cli.sin_port == 0)
+        return;
+    int choix = -1;
+    for (int r = 0; r < g->nb_relais; ++r)
+        if (g->relais[r].actif &&
+            (choix < 0 || g->relais[r].nb_membres < g->relais[choix].nb_membres))
+            choix = r;
+    if (choix >= 0) servir(g, i, SERVICE_RELAIS + choix);
+}
+
+/* Répartit entre les relais les membres servis par le groupe */
+static void repartir(GroupeEtat *g)
+{
+    /* À rebours : un membre confié quitte la partie directe par sa fin */
+    for (int k = g->membres.nb_directs - 1; k >= 0; --k)
+        attribuer(g, g->membres.actifs[k]);
+}
+
+/* Tranche complète du relais r, qui remplace la sienne (inscription, SYNC) */
+static void resynchroniser(GroupeEtat *g, int r)
+{
+    const TableMembres *t = &g->membres;
+    GroupeRelais *x = &g->relais[r];
+    x->nb_maj = 0;
+    x->maj[0] = '\0';
+    x->reinit = 1;
+    g->relais_en_attente = 1;
+    for (int k = t->nb_directs; k < t->nb; ++k) {
+        const ClientInfo *c = membres_actif(t, k);
+        if (c->service == SERVICE_RELAIS + r) noter_relais(g, r, 1, c);
+    }
+}
+
+/* Relais r muet : ses membres repassent au groupe, puis aux autres relais */
+static void oublier_relais(GroupeEtat *g, int r)
+{
+    TableMembres *t = &g->membres;
+    char ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &g->relais[r].addr.sin_addr, ip, sizeof(ip));
+    printf("[GROUP] Relais %s:%d perdu (%d membres repris)\n", ip,
+           ntohs(g->relais[r].addr.sin_port), g->relais[r].nb_membres);
+
+    g->relais[r].actif = 0;
+    for (int k = t->nb_directs; k < t->nb; ++k)
+        if (membres_actif(t, k)->service == SERVICE_RELAIS + r)
+            servir(g, t->actifs[k], SERVICE_DIRECT);
+    repartir(g);
+}
+
+static void verifier_relais(GroupeEtat *g)
+{
+    long long now = maintenant_ms();
+    for (int r = 0; r < g->nb_relais; ++r)
+        if (g->relais[r].actif && now - g->relais[r].vu_ms > RELAIS_SILENCE_MS)
+            oublier_relais(g, r);
+}
+
+static int chercher_relais(const GroupeEtat *g, const struct sockaddr_in *src)
+{
+    for (int r = 0; r < g->nb_relais; ++r) {
+        const GroupeRelais *x = &g->relais[r];
+        if (x->actif && x->addr.sin_addr.s_addr == src->sin_addr.s_addr &&
+            x->addr.sin_port == src->sin_port)
+            return r;
+    }
+    return -1;
+}
+
+/* Première case libre de la table des relais, -1 si elle est pleine */
+static int inscrire_relais(GroupeEtat *g, const struct sockaddr_in *src)
+{
+    if (!g->relais) {
+        g->relais = calloc(RELAIS_MAX, sizeof(*g->relais));
+        if (!g->relais) return -1;
+    }
+    int r = 0;
+    while (r < g->nb_relais && g->relais[r].actif) r++;
+    if (r == RELAIS_MAX) return -1;
+    if (r == g->nb_relais) g->nb_relais++;
+
+    GroupeRelais *x = &g->relais[r];
+    memset(x, 0, sizeof(*x));
+    x->actif = 1;
+    x->addr = *src;
+
+    char ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &src->sin_addr, ip, sizeof(ip));
+    printf("[GROUP] Relais %d inscrit (%s:%d)\n", r, ip, ntohs(src->sin_port));
+    return r;
+}
+
+/* Table id -> nom/emoji des membres pour les affichages v2, dont les
+ * messages ne portent ensuite que l'id de l'émetteur. Seuls les membres des
+ * PROTO_MEMBRES_MAX premières cases ont un id ; les autres sont nommés dans
+ * chacun de leurs messages. 'dest' NULL : envoi à tous les membres v2
+ * (changement dans la table), une seule fois à l'adresse multicast et à
+ * chaque relais. */
+static void annoncer_membres(GroupeEtat *g, const struct sockaddr_in *dest)
+{
+    const TableMembres *t = &g->membres;
+    if (!dest) publier_relais(g);
+    ProtoMembre membres[PROTO_MEMBRES_MAX];
+    int nb = 0;
+    for (int i = 0; i < PROTO_MEMBRES_MAX && i < t->etendue; ++i) {
+        const ClientInfo *c = membres_case(t, i);
+        if (!c->actif) continue;
+        membres[nb].id = (uint8_t)i;
+        snprintf(membres[nb].nom, MAX_USERNAME, "%s", c->nom);
+        snprintf(membres[nb].emoji, MAX_EMOJI, "%s", c->emoji);
+        nb++;
+    }
+
+    unsigned char *trame = reserver_envoi(g);
+    int f = lot_nb_msgs - 1;
+    lot_tailles[f] = proto_ecrire_membres(g->nom, g->id, membres, nb, trame);
+    if (dest) {
+        ajouter_trames(f, 1, dest, NULL);
+        return;
+    }
+    diffuser_directs(g, (const int[2]){ f, f }, (const int[2]){ 0, 1 });
+    if (g->nb_multicast > 0)
+        ajouter_trames(f, 1, &g->multicast, NULL);
+    for (int r = 0; r < g->nb_relais; ++r)
+        if (g->relais[r].actif && g->relais[r].nb_membres > 0)
+            ajouter_trames(f, 1, &g->relais[r].addr, NULL);
+}
+
+/* Diffusion : un encodage par version présente dans le groupe. La v2 porte
+ * le texte complet (fragmenté au besoin), la v1 le texte tronqué. Les
+ * membres en multicast ou confiés à un relais (tous v2) en reçoivent une
+ * seule copie par adresse multicast ou par relais. 'membre' est la case de
+ * l'émetteur (son id v2), -1 pour un avis. */
+static void broadcast_texte(GroupeEtat *g, ISYMessage *msg, int membre,
+                            const char *texte, size_t nb)
+{
+    const TableMembres *t = &g->membres;
+    publier_relais(g);
+    int presents[2] = { 0, t->nb_directs < t->nb };
+    const GroupeInstantane *s = g->partage ? instantane(g) : NULL;
+    if (s) {
+        presents[0] = s->nb > s->nb_v2;
+        presents[1] |= s->nb_v2 > 0;
+    }
+    for (int k = 0; !s && k < t->nb_directs && !(presents[0] && presents[1]); ++k)
+        presents[membres_actif(t, k)->version == PROTO_V2] = 1;
+
+    /* La v2 en premier, en laissant la place de la v1 : aucune des deux
+     * ne doit vider le lot tant que l'autre n'est pas distribuée */
+    int premiers[2] = { 0, 0 }, nombres[2] = { 0, 0 };
+    if (presents[1])
+        nombres[1] = encoder_texte(g, msg, texte, nb, PROTO_V2, id_case(membre),
+                                   presents[0], &premiers[1]);
+    if (presents[0])
+        nombres[0] = encoder_texte(g, msg, texte, nb, PROTO_V1, PROTO_MEMBRE_AUCUN,
+                                   0, &premiers[0]);
+
+    diffuser_directs(g, premiers, nombres);
+    if (g->nb_multicast > 0) ajouter_trames(premiers[1], nombres[1], &g->multicast, NULL);
+    for (int r = 0; r < g->nb_relais; ++r)
+        if (g->relais[r].actif && g->relais[r].nb_membres > 0)
+            ajouter_trames(premiers[1], nombres[1], &g->relais[r].addr, NULL);
+    STAT_AJOUTER(g->stats, diffusions, 1);
+    STAT_AJOUTER(g->stats, destinataires, (uint64_t)t->nb);
+}
+
+/* Avis à tous les membres */
+static void broadcast_message(GroupeEtat *g, ISYMessage *msg)
+{
+    broadcast_texte(g, msg, -1, msg->texte, strnlen(msg->texte, sizeof(msg->texte)));
+}
+
+/* Message de "SERVER" adressé aux membres du groupe */
+static void preparer_avis(GroupeEtat *g, ISYMessage *avis, const char *texte)
+{
+    memset(avis, 0, sizeof(*avis));
+    strcpy(avis->ordre, ORDRE_MSG);
+    snprintf(avis->emetteur, MAX_USERNAME, "SERVER");
+    memcpy(avis->emoji, EMOJI_SERVEUR, sizeof(EMOJI_SERVEUR));
+    if (g) snprintf(avis->groupe, MAX_GROUP_NAME, "%s", g->nom);
+    snprintf(avis->texte, sizeof(avis->texte), "%s", texte);
+}
+
+/* Ordre MCA (v2) vers un affichage ou vers l'adresse multicast du groupe */
+static void envoyer_mca(GroupeEtat *g, const char *texte, const struct sockaddr_in *dest)
+{
+    ISYMessage mca;
+    memset(&mca, 0, sizeof(mca));
+    strcpy(mca.ordre, ORDRE_MCA);
+    snprintf(mca.groupe, MAX_GROUP_NAME, "%s", g->nom);
+    snprintf(mca.texte, sizeof(mca.texte), "%s", texte);
+    envoyer_v(g, &mca, PROTO_V2, dest, NULL);
+}
+
+/* Rejoue l'historique à un membre qui (re)joint le groupe. Le texte du CON
+ * est "<port>", "<port> LAST n" (n derniers messages) ou "<port> AFTER s"
+ * (tout ce qui suit le numéro s). Les messages partent par le lot d'envoi,
+ * soit un sendmmsg pour GROUPE_LOT_MSGS messages. */
+static void rejouer_historique(GroupeEtat *g, const char *texte,
+                               const struct sockaddr_in *dest)
+{
+    char mode[8] = {0};
+    unsigned long n = 0;
+    uint32_t apres = 0;
+    int max = HISTORIQUE_REJEU_DEFAUT;
+
+    if (sscanf(texte, "%*d %7s %lu", mode, &n) == 2) {
+        if (strcmp(mode, "LAST") == 0) {
+            max = n > INT32_MAX ? INT32_MAX : (int)n;
+        } else if (strcmp(mode, "AFTER") == 0) {
+            apres = n > UINT32_MAX ? 0 : (uint32_t)n;
+            max = INT32_MAX;
+        }
+    }
+
+    uint32_t premier = 0;
+    int nb = historique_apres(&g->historique, apres, max, &premier);
+    for (int k = 0; k < nb; ++k)
+        repondre(g, historique_message(&g->historique, premier + (uint32_t)k), dest);
+}
+
+/* NAK "a b" d'un membre : renvoie les messages a..b encore dans l'historique
+ * et signale par un NAK "a c" ceux qui en sont déjà sortis */
+static void retransmettre(GroupeEtat *g, const char *texte,
+                          const struct sockaddr_in *src)
+{
+    unsigned long a = 0, b = 0;
+    if (sscanf(texte, "%lu %lu", &a, &b) != 2) return;
+
+    uint32_t dernier = historique_dernier(&g->historique);
+    if (!est_membre(g, src) || a == 0 || a > b || a > dernier) return;
+    if (b > dernier) b = dernier;
+    STAT_AJOUTER(g->stats, nb_nacks, 1);
+
+    uint32_t premier = 0;
+    int nb = historique_apres(&g->historique, (uint32_t)a - 1, INT32_MAX, &premier);
+    if (premier > a) {
+        ISYMessage perdu;
+        memset(&perdu, 0, sizeof(perdu));
+        strcpy(perdu.ordre, ORDRE_NAK);
+        snprintf(perdu.groupe, MAX_GROUP_NAME, "%s", g->nom);
+        snprintf(perdu.texte, sizeof(perdu.texte), "%lu %lu", a,
+                 premier - 1 < b ? (unsigned long)premier - 1 : b);
+        repondre(g, &perdu, src);
+    }
+    for (uint32_t s = premier; nb > 0 && s <= b; ++s) {
+        repondre(g, historique_message(&g->historique, s), src);
+        STAT_AJOUTER(g->stats, nb_retransmis, 1);
+    }
+}
+
+void groupe_fin_lot(GroupeEtat *g)
+{
+    publier_relais(g);
+    if (lot_nb_msgs > 0 && !g->partage)
+        vider_envois(g);
+    GroupStats *s = g->stats;
+    STAT_FIXER(s, nb_reassembles, (uint64_t)g->reassemblage.nb_complets);
+    STAT_FIXER(s, nb_reassemblages_perdus, (uint64_t)g->reassemblage.nb_perdus);
+    STAT_FIXER(s, dernier_lot, lot_recus);
+    lot_recus = 0;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    STAT_FIXER(s, activite_ms, (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000);
+}
+
+void groupe_partager(GroupeEtat *g)
+{
+    g->partage = 1;
+}
+
+void groupe_diffuser(GroupeEtat *g)
+{
+    if (lot_nb_msgs > 0)
+        vider_envois(g);
+}
+
+static void annoncer_prefixe(void *arg, uint32_t reseau, int longueur)
+{
+    char ip_str[INET_ADDRSTRLEN], texte[INET_ADDRSTRLEN + 4];
+    struct in_addr a = { htonl(reseau) };
+    inet_ntop(AF_INET, &a, ip_str, sizeof(ip_str));
+    snprintf(texte, sizeof(texte), "%s/%d", ip_str, longueur);
+    avis_banni(arg, texte);
+}
+
+void groupe_annoncer_bannis(GroupeEtat *g)
+{
+    bannis_parcourir(&g->bannis, annoncer_prefixe, g);
+    if (lot_nb_msgs > 0) vider_envois(g);
+}
+
+/* Acquittement d'un MIGRATE : le serveur peut arrêter ce groupe sans risque
+ * de perdre l'avis de migration ni les ADDCLIENT déjà envoyés */
+static void acquitter_migration(GroupeEtat *g, const struct sockaddr_in *src)
+{
+    ISYMessage ack;
+    memset(&ack, 0, sizeof(ack));
+    strcpy(ack.ordre, ORDRE_MGR);
+    snprintf(ack.emetteur, MAX_USERNAME, "%.*s", MAX_USERNAME - 1, g->nom);
+    snprintf(ack.texte, sizeof(ack.texte), "MIGRATED %s", g->nom);
+    envoyer(g, &ack, src);
+}
+
+/* Exclut un membre banni : avis VOUS_ETES_BANNI puis annonce au groupe */
+static void exclure_client(GroupeEtat *g, int i, const char *ban_ip)
+{
+    const char *nom_groupe = g->nom;
+    const ClientInfo *c = membres_case(&g->membres, i);
+    char banned_username[MAX_USERNAME];
+    snprintf(banned_username, sizeof(banned_username), "%s", c->nom);
+    int version = c->version;
+
+    struct sockaddr_in addr_banned;
+    memset(&addr_banned, 0, sizeof(addr_banned));
+    addr_banned.sin_family = AF_INET;
+    addr_banned.sin_addr = c->addr_cli.sin_addr;
+    addr_banned.sin_port = c->addr_cli.sin_port;
+
+    servir(g, i, SERVICE_DIRECT);
+    membres_retirer(&g->membres, i);
+    STAT_FIXER(g->stats, nb_clients, (uint32_t)g->membres.nb);
+
+    ISYMessage ban_msg;
+    preparer_avis(g, &ban_msg, "VOUS_ETES_BANNI");
+    envoyer_v(g, &ban_msg, version, &addr_banned, NULL);
+
+    ISYMessage ban_notice;
+    preparer_avis(g, &ban_notice, "");
+    snprintf(ban_notice.texte, sizeof(ban_notice.texte), "%s a ete banni du groupe (%s)",
+            banned_username, ban_ip);
+    broadcast_message(g, &ban_notice);
+    if (id_case(i) != PROTO_MEMBRE_AUCUN) annoncer_membres(g, NULL);
+
+    journal_retirer(g->journal, banned_username, addr_banned.sin_addr);
+
+    printf("Client %s (%s) a ete banni du groupe %s\n",
+           banned_username, ban_ip, nom_groupe);
+}
+
+/* Commandes du modérateur tapées dans la discussion */
+
+static void commande_list(GroupeEtat *g, ISYMessage *msg, const char *args,
+                          const struct sockaddr_in *src)
+{
+    (void)args;
+    char buf[2048]; buf[0] = '\0';
+    size_t buf_len = 0;
+    for (int k = 0; k < g->membres.nb; ++k) {
+        const ClientInfo *c = membres_actif(&g->membres, k);
+        char ip_str[64];
+        inet_ntop(AF_INET, &c->addr_cli.sin_addr, ip_str, sizeof(ip_str));
+        int w = snprintf(buf + buf_len, sizeof(buf) - buf_len, "%s%s %s (%s)",
+                         buf_len ? ", " : "", c->emoji, ip_str, c->nom);
+        if (w < 0 || (size_t)w >= sizeof(buf) - buf_len) break;
+        buf_len += (size_t)w;
+    }
+    if (buf[0] == '\0') buf_len = (size_t)snprintf(buf, sizeof(buf), "Aucun membre\n");
+
+    /* La liste complète part en v2 (fragmentée au besoin), tronquée en v1 */
+    ISYMessage resp;
+    preparer_avis(g, &resp, buf);
+
+    /* Réponse sur l'affichage du modérateur s'il est membre */
+    int i = membres_chercher_ip(&g->membres, src->sin_addr.s_addr, msg->emetteur);
+    if (i >= 0) {
+        const ClientInfo *c = membres_case(&g->membres, i);
+        envoyer_texte(g, &resp, buf, buf_len, c->version, &c->addr_cli, NULL);
+        return;
+    }
+    envoyer_texte(g, &resp, buf, buf_len, version_requete, src, NULL);
+}
+
+static void commande_ban(GroupeEtat *g, ISYMessage *msg, const char *args,
+                         const struct sockaddr_in *src)
+{
+    (void)msg;
+    char ban_ip[64] = {0};
+    uint32_t reseau = 0;
+    int longueur = -1;
+    if (sscanf(args, "%63s", ban_ip) != 1) return;
+
+    /* "ban a.b.c.d" exclut un membre, "ban a.b.c.d/n" toute une plage */
+    TableMembres *t = &g->membres;
+    int nb_cibles = 0;
+    if (bannis_parser(ban_ip, &reseau, &longueur) == 0) {
+        uint32_t masque = longueur ? 0xFFFFFFFFu << (32 - longueur) : 0;
+        if (longueur == 32) {
+            for (int i = membres_premier_ip(t, htonl(reseau)); i >= 0;
+                 i = membres_case(t, i)->ip_suivant)
+                nb_cibles++;
+        } else {
+            for (int k = 0; k < t->nb; ++k)
+                if ((ntohl(membres_actif(t, k)->addr_cli.sin_addr.s_addr) & masque) == reseau)
+                    nb_cibles++;
+        }
+    }
+
+    ISYMessage reponse;
+    if (longueur >= 0 && (nb_cibles > 0 || longueur < 32)) {
+        ban_ip_from_group(g, ban_ip, reseau, longueur);
+        if (longueur == 32) {
+            int i;
+            while ((i = membres_premier_ip(t, htonl(reseau))) >= 0)
+                exclure_client(g, i, ban_ip);
+        } else {
+            /* À rebours : un retrait ne déplace que des membres déjà vus */
+            for (int k = t->nb - 1; k >= 0; --k)
+                if (bannis_contient(&g->bannis, ntohl(membres_actif(t, k)->addr_cli.sin_addr.s_addr)))
+                    exclure_client(g, t->actifs[k], ban_ip);
+        }
+        if (nb_cibles > 0) return;
+        preparer_avis(NULL, &reponse, "");
+        snprintf(reponse.texte, sizeof(reponse.texte), "Plage %s bannie", ban_ip);
+    } else {
+        preparer_avis(NULL, &reponse, "");
+        snprintf(reponse.texte, sizeof(reponse.texte), "IP %s non trouvee dans le groupe", ban_ip);
+    }
+    repondre(g, &reponse, src);
+}
+
+typedef void (*CommandeModerateur)(GroupeEtat *g, ISYMessage *msg, const char *args,
+                                   const struct sockaddr_in *src);
+
+static const struct {
+    const char *mot;
+    int avec_args;                 /* "list" seul, "ban <ip>" */
+    CommandeModerateur traiter;
+    const char *refus;
+} commandes_moderateur[] = {
+    { "list", 0, commande_list,
+      "Permission refusee: seul le moderateur peut lister les membres" },
+    { "ban",  1, commande_ban,
+      "Permission refusee: seul le moderateur peut bannir" },
+};
+
+/* Exécute la commande du modérateur contenue dans le message, s'il y en a
+ * une. Renvoie 0 pour un message de discussion ordinaire. */
+static int commande_moderateur(GroupeEtat *g, ISYMessage *msg,
+                               const struct sockaddr_in *src)
+{
+    size_t n = strcspn(msg->texte, " ");
+    const char *args = msg->texte + n;
+    while (*args == ' ') args++;
+
+    for (size_t k = 0; k < sizeof(commandes_moderateur) / sizeof(commandes_moderateur[0]); ++k) {
+        const char *mot = commandes_moderateur[k].mot;
+        if (strlen(mot) != n || strncasecmp(msg->texte, mot, n) != 0 ||
+            commandes_moderateur[k].avec_args != (*args != '\0'))
+            continue;
+
+        if (strcmp(msg->emetteur, g->moderateur) == 0) {
+            commandes_moderateur[k].traiter(g, msg, args, src);
+        } else {
+            ISYMessage deny;
+            preparer_avis(NULL, &deny, commandes_moderateur[k].refus);
+            repondre(g, &deny, src);
+        }
+        return 1;
+    }
+    return 0;
+}
+
+/* Ordres de gestion (MGR) du serveur ou d'un autre groupe. Renvoient 0 si
+ * les arguments sont invalides : l'ordre est alors relayé tel quel. */
+
+static void annoncer_migration(GroupeEtat *g, const char *newname, int newport,
+                               int newid, const struct sockaddr_in *src)
+{
+    /* Ordre lu par les affichages, qui font rejoindre le nouveau groupe */
+    ISYMessage control;
+    preparer_avis(NULL, &control, "");
+    snprintf(control.texte, sizeof(control.texte), "MIGRATE %s %d %d",
+             newname, newport, newid);
+    broadcast_message(g, &control);
+    acquitter_migration(g, src);
+
+    ISYMessage notice;
+    preparer_avis(g, &notice, "");
+    snprintf(notice.texte, sizeof(notice.texte), "Groupe fusionné → %s (port %d)",
+             newname, newport);
+    broadcast_message(g, &notice);
+}
+
+/* "<nom> <port> [id]" : sans id (ancien serveur), celui d'un groupe sur son
+ * propre port */
+static int lire_cible(const char *args, char *newname, int *newport, int *newid)
+{
+    *newid = -1;
+    if (sscanf(args, "%31s %d %d", newname, newport, newid) < 2) return -1;
+    if (*newid < 0 || *newid >= (int)PROTO_GROUPE_AUCUN) *newid = *newport - GROUP_PORT_BASE;
+    return 0;
+}
+
+static int gestion_migrate(GroupeEtat *g, const ISYMessage *msg, const char *args,
+                           const struct sockaddr_in *src)
+{
+    (void)msg;
+    char newname[MAX_GROUP_NAME] = {0};
+    int newport = -1, newid;
+    if (lire_cible(args, newname, &newport, &newid) < 0) return 0;
+    annoncer_migration(g, newname, newport, newid, src);
+    return 1;
+}
+
+/* Ordre interne pour un autre groupe : l'entête porte l'id du destinataire,
+ * seul moyen de le désigner sur un port partagé (moteur.h) */
+static void envoyer_groupe(GroupeEtat *g, const ISYMessage *msg, int id,
+                           const struct sockaddr_in *dest)
+{
+    unsigned char *trame = reserver_envoi(g);
+    int f = lot_nb_msgs - 1;
+    lot_tailles[f] = proto_ecrire(msg, PROTO_V2, (uint16_t)id, PROTO_MEMBRE_AUCUN, trame);
+    ajouter_trames(f, 1, dest, NULL);
+}
+
+static int gestion_migrate_exist(GroupeEtat *g, const ISYMessage *msg, const char *args,
+                                 const struct sockaddr_in *src)
+{
+    (void)msg;
+    char newname[MAX_GROUP_NAME] = {0};
+    int newport = -1, newid;
+    if (lire_cible(args, newname, &newport, &newid) < 0) return 0;
+
+    /* Les membres passent au groupe cible avant l'avis de migration */
+    struct sockaddr_in addr_target;
+    fill_sockaddr(&addr_target, "127.0.0.1", newport);
+    for (int k = 0; k < g->membres.nb; ++k) {
+        const ClientInfo *c = membres_actif(&g->membres, k);
+        char ipstr[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &c->addr_cli.sin_addr, ipstr, sizeof(ipstr));
+        ISYMessage addmsg;
+        memset(&addmsg, 0, sizeof(addmsg));
+        strcpy(addmsg.ordre, ORDRE_MGR);
+        snprintf(addmsg.emetteur, MAX_USERNAME, "%.*s", MAX_USERNAME - 1, g->nom);
+        snprintf(addmsg.emoji, MAX_EMOJI, "%s", c->emoji);
+        snprintf(addmsg.texte, sizeof(addmsg.texte), "ADDCLIENT %s %s %d %d",
+                 c->nom, ipstr, ntohs(c->addr_cli.sin_port), c->version);
+        envoyer_groupe(g, &addmsg, newid, &addr_target);
+    }
+    annoncer_migration(g, newname, newport, newid, src);
+    return 1;
+}
+
+static int gestion_addclient(GroupeEtat *g, const ISYMessage *msg, const char *args,
+                             const struct sockaddr_in *src)
+{
+    (void)src;
+    char name[MAX_USERNAME] = {0};
+    char ipstr[64] = {0};
+    int port = 0;
+    int version = PROTO_V1;        /* ADDCLIENT d'un groupe v1 : sans version */
+    if (sscanf(args, "%19s %63s %d %d", name, ipstr, &port, &version) >= 3) {
+        add_client_direct(g, name, ipstr, port, msg->emoji,
+                          version == PROTO_V2 ? PROTO_V2 : PROTO_V1);
+        annoncer_membres(g, NULL);
+    }
+    return 1;
+}
+
+typedef int (*GestionGroupe)(GroupeEtat *g, const ISYMessage *msg, const char *args,
+                             const struct sockaddr_in *src);
+
+static const GestionGroupe gestions[MOT_NB] = {
+    [MOT_MIGRATE]      = gestion_migrate,
+    [MOT_MIGRATEEXIST] = gestion_migrate_exist,
+    [MOT_ADDCLIENT]    = gestion_addclient,
+};
+
+/* Traitement par opcode */
+
+static void traiter_con(GroupeEtat *g, ISYMessage *msg, const ProtoInfo *info,
+                        const struct sockaddr_in *src)
+{
+    /* msg->texte contient le port d'affichage du client */
+    int display_port = atoi(msg->texte);
+    int i = -1;
+    int status = add_client(g, msg->emetteur, src, display_port, info->version, &i);
+
+    struct sockaddr_in addr_display = *src;
+    addr_display.sin_port = htons(display_port);
+    if (status == 0) {
+        /* Table des membres avant le rejeu, qui la référence : à tous si le
+         * membre y figure, sinon au seul arrivant */
+        if (id_case(i) != PROTO_MEMBRE_AUCUN) annoncer_membres(g, NULL);
+        else if (info->version == PROTO_V2) annoncer_membres(g, &addr_display);
+        rejouer_historique(g, msg->texte, &addr_display);
+        /* Un affichage (re)connecté est servi en unicast, ou par un relais,
+         * tant qu'il n'a pas confirmé recevoir le multicast */
+        servir(g, i, SERVICE_DIRECT);
+        if (g->multicast.sin_family && info->version == PROTO_V2) {
+            char adresse[INET_ADDRSTRLEN], texte[MAX_TEXT];
+            inet_ntop(AF_INET, &g->multicast.sin_addr, adresse, sizeof(adresse));
+            snprintf(texte, sizeof(texte), "ADRESSE %s %u", adresse,
+                     (unsigned)ntohs(g->multicast.sin_port));
+            envoyer_mca(g, texte, &addr_display);
+        }
+        attribuer(g, i);
+    } else if (status == 1) {
+        ISYMessage error_msg;
+        preparer_avis(g, &error_msg, "VOUS_ETES_BANNI");
+        repondre(g, &error_msg, &addr_display);
+    }
+}
+
+/* Case de l'émetteur, -1 s'il n'est pas membre. Un émetteur v2 peut se
+ * désigner par son id de membre au lieu de son nom ; à défaut, l'adresse
+ * source identifie le membre, dont le nom est alors repris. */
+static int completer_emetteur(GroupeEtat *g, ISYMessage *msg, const ProtoInfo *info,
+                              const struct sockaddr_in *src)
+{
+    const TableMembres *t = &g->membres;
+    uint32_t ip = src->sin_addr.s_addr;
+    if (msg->emetteur[0] != '\0') return membres_chercher_ip(t, ip, msg->emetteur);
+
+    int i = info->emetteur;
+    const ClientInfo *c = membres_valide(t, id_case(i) == PROTO_MEMBRE_AUCUN ? -1 : i);
+    if (!c || c->addr_cli.sin_addr.s_addr != ip) {
+        i = membres_premier_ip(t, ip);
+        if (i < 0) return -1;
+        c = membres_case(t, i);
+    }
+    memcpy(msg->emetteur, c->nom, MAX_USERNAME);
+    return i;
+}
+
+static void traiter_mes(GroupeEtat *g, ISYMessage *msg, const ProtoInfo *info,
+                        const struct sockaddr_in *src)
+{
+    STAT_AJOUTER(g->stats, nb_messages, 1);
+    snprintf(msg->groupe, MAX_GROUP_NAME, "%s", g->nom);
+    int membre = completer_emetteur(g, msg, info, src);
+
+    if (commande_moderateur(g, msg, src)) return;
+
+    /* Message de discussion : numéroté et conservé pour les rejeux (texte
+     * tronqué dans l'historique, complet dans la diffusion). L'emoji est
+     * celui calculé depuis l'IP du membre à son arrivée. */
+    if (membre >= 0) memcpy(msg->emoji, membres_case(&g->membres, membre)->emoji, MAX_EMOJI);
+    historique_ajouter(&g->historique, msg);
+    if (info->version != PROTO_V2) {
+        broadcast_texte(g, msg, membre, msg->texte, strnlen(msg->texte, sizeof(msg->texte)));
+        return;
+    }
+
+    /* Message tracé : la diffusion v2 reprend ses horodatages */
+    ProtoTrace trace;
+    if (info->trace) {
+        trace = info->horodatage;
+        trace.groupe_reception = info->recu_ns ? info->recu_ns : trace_maintenant();
+        trace.groupe_envoi = 0;
+        metriques_tracer(g->stats, TRACE_CLIENT_GROUPE, trace.client_envoi,
+                         trace.groupe_reception);
+        trace_diffusion = &trace;
+    }
+    broadcast_texte(g, msg, membre, (const char *)info->charge, info->nb_charge);
+    trace_diffusion = NULL;
+}
+
+static void traiter_nak(GroupeEtat *g, ISYMessage *msg, const ProtoInfo *info,
+                        const struct sockaddr_in *src)
+{
+    (void)info;
+    retransmettre(g, msg->texte, src);
+}
+
+/* Un affichage v2 qui ne connaît pas un id redemande la table */
+static void traiter_membres(GroupeEtat *g, ISYMessage *msg, const ProtoInfo *info,
+                            const struct sockaddr_in *src)
+{
+    (void)msg;
+    (void)info;
+    if (est_membre(g, src))
+        annoncer_membres(g, src);
+}
+
+/* Passage d'un affichage v2 au multicast : il rejoint l'adresse annoncée
+ * après son CON puis demande une sonde (SONDE <jeton>), que le groupe
+ * envoie sur le multicast ; l'affichage qui la reçoit la confirme
+ * (OK <jeton>) et n'est plus servi qu'en multicast (ACTIF). Sans
+ * confirmation, il reste en unicast. */
+static void traiter_multicast(GroupeEtat *g, ISYMessage *msg, const ProtoInfo *info,
+                              const struct sockaddr_in *src)
+{
+    (void)info;
+    int i = membres_chercher_affichage(&g->membres, src->sin_addr.s_addr, src->sin_port);
+    if (i < 0 || !g->multicast.sin_family) return;
+    ClientInfo *c = membres_case(&g->membres, i);
+    if (c->version != PROTO_V2) return;
+
+    unsigned long jeton;
+    if (sscanf(msg->texte, "SONDE %lu", &jeton) == 1) {
+        char texte[32];
+        snprintf(texte, sizeof(texte), "SONDE %lu", jeton);
+        envoyer_mca(g, texte, &g->multicast);
+    } else if (sscanf(msg->texte, "OK %lu", &jeton) == 1) {
+        servir(g, i, SERVICE_MULTICAST);
+        envoyer_mca(g, "ACTIF", &c->addr_cli);
+    }
+}
+
+/* Ordres d'un relais (relais.h). Seul un relais de la machine peut
+ * s'inscrire : il reçoit toutes les diffusions du groupe. */
+static void traiter_relais(GroupeEtat *g, ISYMessage *msg, const ProtoInfo *info,
+                           const struct sockaddr_in *src)
+{
+    (void)info;
+    int r = chercher_relais(g, src);
+    if (strcmp(msg->texte, "INSCRIRE") == 0) {
+        if (ntohl(src->sin_addr.s_addr) >> 24 != 127) return;
+        if (r < 0 && (r = inscrire_relais(g, src)) < 0) return;
+        g->relais[r].vu_ms = maintenant_ms();
+        char texte[32];
+        int n = snprintf(texte, sizeof(texte), "BIENVENUE %d", r);
+        envoyer_rly(g, texte, (size_t)n, src);
+        resynchroniser(g, r);
+        repartir(g);
+        return;
+    }
+    if (r < 0) {
+        /* Groupe redémarré, ou relais déclaré perdu : il se réinscrit */
+        envoyer_rly(g, "INCONNU", strlen("INCONNU"), src);
+        return;
+    }
+    g->relais[r].vu_ms = maintenant_ms();
+    if (strcmp(msg->texte, "SYNC") == 0) resynchroniser(g, r);
+}
+
+static void traiter_mgr(GroupeEtat *g, ISYMessage *msg, const ProtoInfo *info,
+                        const struct sockaddr_in *src)
+{
+    (void)info;
+    const char *args;
+    int mot = proto_mot(msg->texte, &args);
+    if (gestions[mot] && gestions[mot](g, msg, args, src))
+        return;
+
+    /* Ordre inconnu : relayé aux membres */
+    ISYMessage notice;
+    preparer_avis(g, &notice, "");
+    snprintf(notice.texte, sizeof(notice.texte), "Groupe fusionné → %.*s",
+             (int)(sizeof(notice.texte) - sizeof("Groupe fusionné → ")), msg->texte);
+    broadcast_message(g, &notice);
+}
+
+typedef void (*TraitementGroupe)(GroupeEtat *g, ISYMessage *msg, const ProtoInfo *info,
+                                 const struct sockaddr_in *src);
+
+static const TraitementGroupe traitements[OP_NB] = {
+    [OP_CON]     = traiter_con,
+    [OP_MES]     = traiter_mes,
+    [OP_NAK]     = traiter_nak,
+    [OP_MGR]     = traiter_mgr,
+    [OP_MEMBRES] = traiter_membres,
+    [OP_MULTICAST] = traiter_multicast,
+    [OP_RELAIS]  = traiter_relais,
+};
+
+void groupe_traiter(GroupeEtat *g, ISYMessage *msg, const ProtoInfo *info,
+                    const struct sockaddr_in *src)
+{
+    STAT_AJOUTER(g->stats, paquets_recus, 1);
+    STAT_AJOUTER(g->stats, octets_recus, info->taille);
+    /* Relais muets : vérifiés au premier paquet de chaque lot, leurs
+     * VIVANT réveillant le groupe au moins une fois par seconde */
+    if (lot_recus++ == 0 && g->nb_relais > 0) verifier_relais(g);
+    if (info->opcode <= 0 || info->opcode >= OP_NB || !traitements[info->opcode])
+        return;
+    version_requete = info->version;
+    traitements[info->opcode](g, msg, info, src);
+}
@@ -0,0 +1,114 @@
+#define _GNU_SOURCE
+#include "../include/historique.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static int capacite_defaut = HISTORIQUE_DEFAUT;
+
+void historique_configurer(int capacite)
+{
+    capacite_defaut = capacite < 0 ? 0 : capacite;
+}
+
+static int entete_valide(const HistoriqueEntete *e, uint32_t capacite)
+{
+    return e->magic == HISTORIQUE_MAGIC && e->version == HISTORIQUE_VERSION &&
+           e->taille_message == sizeof(ISYMessage) && e->capacite == capacite &&
+           e->prochain >= 1;
+}
+
+int historique_ouvrir(Historique *h, const char *nom_groupe)
+{
+    memset(h, 0, sizeof(*h));
+    if (capacite_defaut == 0) return 0;
+
+    uint32_t capacite = (uint32_t)capacite_defaut;
+    size_t taille = sizeof(HistoriqueEntete) + (size_t)capacite * sizeof(ISYMessage);
+
+    char path[256];
+    mkdir("infoGroup", 0755);
+    snprintf(path, sizeof(path), "infoGroup/%s.hist", nom_groupe);
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        perror("open historique");
+        return -1;
+    }
+
+    /* Un fichier d'une autre version ou capacité est remis à zéro */
+    HistoriqueEntete e;
+    memset(&e, 0, sizeof(e));
+    struct stat st;
+    int valide = fstat(fd, &st) == 0 && (size_t)st.st_size == taille &&
+                 pread(fd, &e, sizeof(e), 0) == (ssize_t)sizeof(e) &&
+                 entete_valide(&e, capacite);
+    if (!valide && (ftruncate(fd, 0) < 0 || ftruncate(fd, (off_t)taille) < 0)) {
+        perror("ftruncate historique");
+        close(fd);
+        return -1;
+    }
+
+    void *carte = mmap(NULL, taille, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (carte == MAP_FAILED) {
+        perror("mmap historique");
+        return -1;
+    }
+
+    h->entete = carte;
+    h->messages = (ISYMessage *)(h->entete + 1);
+    h->taille = taille;
+    if (!valide) {
+        h->entete->magic = HISTORIQUE_MAGIC;
+        h->entete->version = HISTORIQUE_VERSION;
+        h->entete->taille_message = sizeof(ISYMessage);
+        h->entete->capacite = capacite;
+        h->entete->prochain = 1;
+    }
+    return 0;
+}
+
+void historique_fermer(Historique *h)
+{
+    if (h->entete) munmap(h->entete, h->taille);
+    memset(h, 0, sizeof(*h));
+}
+
+uint32_t historique_ajouter(Historique *h, ISYMessage *msg)
+{
+    if (!h->entete) {
+        msg->seq = 0;
+        return 0;
+    }
+    uint32_t seq = h->entete->prochain;
+    msg->seq = seq;
+    h->messages[seq % h->entete->capacite] = *msg;
+    /* Le compteur n'avance qu'une fois la case écrite */
+    h->entete->prochain = seq + 1;
+    return seq;
+}
+
+int historique_apres(const Historique *h, uint32_t apres, int max, uint32_t *premier)
+{
+    if (!h->entete || max <= 0) return 0;
+
+    uint32_t prochain = h->entete->prochain;
+    uint32_t capacite = h->entete->capacite;
+    uint32_t plus_ancien = prochain > capacite ? prochain - capacite : 1;
+    if (apres >= prochain) apres = 0;
+
+    uint32_t debut = apres + 1 > plus_ancien ? apres + 1 : plus_ancien;
+    if (prochain - debut > (uint32_t)max) debut = prochain - (uint32_t)max;
+    *premier = debut;
+    return (int)(prochain - debut);
+}
+
+uint32_t historique_dernier(const Historique *h)
+{
+    return h->entete ? h->entete->prochain - 1 : 0;
+}
+
+const ISYMessage *historique_message(const Historique *h, uint32_t seq)
+{
+    return &h->messages[seq % h->entete->capacite];
+}
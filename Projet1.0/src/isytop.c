@@ -0,0 +1,289 @@
+#define _GNU_SOURCE
+#include "../include/Commun.h"
+#include "../include/annuaire.h"
+#include "../include/metriques.h"
+#include <time.h>
+
+/* isytop : moniteur des groupes façon top.
+ * L'annuaire publié par ServeurISY donne les slots occupés ; chaque segment
+ * de métriques est attaché en lecture seule et échantillonné une fois par
+ * intervalle. Les débits sont les écarts entre deux échantillons. La file
+ * de réception et les pertes de chaque socket viennent de /proc/net/udp :
+ * rien n'est demandé aux groupes eux-mêmes. C>G_p99 et GRP_p99 sont les
+ * bornes (µs) du 99e percentile des messages tracés depuis le démarrage du
+ * groupe : client -> groupe, puis traitement dans le groupe.
+ */
+
+#define ISYTOP_INACTIF_MS 3000     /* file non vide et aucun lot depuis : bloqué ? */
+
+/* Suivi d'un slot entre deux rafraîchissements */
+typedef struct {
+    int32_t pid;                   /* 0 : rien d'attaché */
+    int32_t shm_key;
+    GroupStats *stats;
+    uint64_t messages, paquets_in, paquets_out, octets_out;
+    uint64_t diffusions, destinataires, echecs, nacks;
+    uint64_t commits, latence_ns;
+} Suivi;
+
+/* Ligne affichée */
+typedef struct {
+    int slot;
+    AnnuaireEntree e;
+    const GroupStats *s;
+    double msg_s, in_s, out_s, ko_s, fanout, echecs_s, nak_s, jrn_ms;
+    double trace_us[TRACE_ETAPES_GROUPE];  /* p99 cumulé des messages tracés */
+    unsigned rxq, drops;
+    long long inactif_ms;
+    const char *alerte;
+} Ligne;
+
+static Suivi *suivis;
+static Ligne *lignes;
+
+/* File de réception et pertes par port UDP local */
+static unsigned file_port[65536];
+static unsigned pertes_port[65536];
+
+static long long maintenant_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Relit /proc/net/udp, une fois par rafraîchissement, dans file_port et
+ * pertes_port. Les sockets d'un même port (SO_REUSEPORT du port partagé,
+ * workers d'un GroupeISY) sont cumulées. */
+static void lire_files_udp(void)
+{
+    memset(file_port, 0, sizeof(file_port));
+    memset(pertes_port, 0, sizeof(pertes_port));
+    FILE *f = fopen("/proc/net/udp", "r");
+    if (!f) return;
+    char ligne[512];
+    if (!fgets(ligne, sizeof(ligne), f)) {
+        fclose(f);
+        return;
+    }
+    while (fgets(ligne, sizeof(ligne), f)) {
+        unsigned ip, p, tx, rx, d = 0;
+        if (sscanf(ligne, " %*d: %x:%x %*x:%*x %*x %x:%x %*x:%*x %*x %*u %*u %*u %*d %*x %u",
+                   &ip, &p, &tx, &rx, &d) >= 4 && p > 0 && p < 65536) {
+            file_port[p] += rx;
+            pertes_port[p] += d;
+        }
+    }
+    fclose(f);
+}
+
+static void oublier(Suivi *su)
+{
+    metriques_detacher(su->stats);
+    memset(su, 0, sizeof(*su));
+}
+
+/* (Ré)attache les métriques quand le slot change de processus */
+static void suivre(Suivi *su, const AnnuaireEntree *e)
+{
+    if (su->pid == e->pid && su->shm_key == e->shm_key) return;
+    oublier(su);
+    su->pid = e->pid;
+    su->shm_key = e->shm_key;
+    if (e->shm_key == 0) return;
+    su->stats = metriques_attacher((key_t)e->shm_key, 1);
+    if (su->stats && !metriques_valides(su->stats)) {
+        metriques_detacher(su->stats);
+        su->stats = NULL;
+    }
+    if (su->stats) {
+        /* Premier échantillon : pas de débit */
+        const GroupStats *s = su->stats;
+        su->messages = STAT_LIRE(s, nb_messages);
+        su->paquets_in = STAT_LIRE(s, paquets_recus);
+        su->paquets_out = STAT_LIRE(s, paquets_envoyes);
+        su->octets_out = STAT_LIRE(s, octets_envoyes);
+        su->diffusions = STAT_LIRE(s, diffusions);
+        su->destinataires = STAT_LIRE(s, destinataires);
+        su->echecs = STAT_LIRE(s, nb_echecs_envoi);
+        su->nacks = STAT_LIRE(s, nb_nacks);
+        su->commits = STAT_LIRE(s, journal_commits);
+        su->latence_ns = STAT_LIRE(s, journal_latence_ns);
+    }
+}
+
+/* Écart depuis l'échantillon précédent, qui est remplacé */
+static uint64_t ecart(uint64_t *precedent, uint64_t valeur)
+{
+    uint64_t d = valeur >= *precedent ? valeur - *precedent : 0;
+    *precedent = valeur;
+    return d;
+}
+
+static void echantillonner(Ligne *l, Suivi *su, double secondes, long long now)
+{
+    const GroupStats *s = su->stats;
+    l->s = s;
+    l->alerte = "";
+    if (l->e.pid > 0 && kill(l->e.pid, 0) < 0 && errno == ESRCH) l->alerte = "MORT";
+    int port = l->e.port > 0 && l->e.port < 65536 ? l->e.port : 0;
+    l->rxq = file_port[port];
+    l->drops = pertes_port[port];
+    if (!s) return;
+
+    l->msg_s = ecart(&su->messages, STAT_LIRE(s, nb_messages)) / secondes;
+    l->in_s = ecart(&su->paquets_in, STAT_LIRE(s, paquets_recus)) / secondes;
+    l->out_s = ecart(&su->paquets_out, STAT_LIRE(s, paquets_envoyes)) / secondes;
+    l->ko_s = ecart(&su->octets_out, STAT_LIRE(s, octets_envoyes)) / 1024.0 / secondes;
+    uint64_t diff = ecart(&su->diffusions, STAT_LIRE(s, diffusions));
+    uint64_t dest = ecart(&su->destinataires, STAT_LIRE(s, destinataires));
+    l->fanout = diff ? (double)dest / (double)diff : 0.0;
+    l->echecs_s = ecart(&su->echecs, STAT_LIRE(s, nb_echecs_envoi)) / secondes;
+    l->nak_s = ecart(&su->nacks, STAT_LIRE(s, nb_nacks)) / secondes;
+    uint64_t commits = ecart(&su->commits, STAT_LIRE(s, journal_commits));
+    uint64_t latence = ecart(&su->latence_ns, STAT_LIRE(s, journal_latence_ns));
+    l->jrn_ms = commits ? (double)latence / (double)commits / 1e6 : 0.0;
+
+    for (int e = 0; e < TRACE_ETAPES_GROUPE; ++e) {
+        uint64_t compte[TRACE_CLASSES];
+        metriques_lire_trace(s, e, compte);
+        l->trace_us[e] = trace_percentile_us(compte, 0.99);
+    }
+
+    uint64_t activite = STAT_LIRE(s, activite_ms);
+    l->inactif_ms = activite ? now - (long long)activite : -1;
+    if (!l->alerte[0] && l->rxq > 0 && l->inactif_ms > ISYTOP_INACTIF_MS)
+        l->alerte = "BLOQUE?";
+}
+
+static int par_debit(const void *a, const void *b)
+{
+    const Ligne *x = a, *y = b;
+    if (x->msg_s != y->msg_s) return x->msg_s < y->msg_s ? 1 : -1;
+    if (x->in_s != y->in_s) return x->in_s < y->in_s ? 1 : -1;
+    return x->slot - y->slot;
+}
+
+static const char *nom_etat(int etat)
+{
+    switch (etat) {
+    case PROC_DEMARRAGE: return "demar";
+    case PROC_ACTIF:     return "actif";
+    case PROC_MIGRATION: return "migr";
+    case PROC_ARRET:     return "arret";
+    default:             return "-";
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    double intervalle = 1.0;
+    int iterations = 0;             /* 0 : jusqu'à CTRL-C */
+    int effacer = 1;
+    int max_lignes = 40;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--intervalle") == 0 && i + 1 < argc)
+            intervalle = atof(argv[++i]);
+        else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+            iterations = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--lignes") == 0 && i + 1 < argc)
+            max_lignes = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--brut") == 0)
+            effacer = 0;
+        else {
+            fprintf(stderr, "Usage: %s [--intervalle s] [--iterations N] "
+                            "[--lignes N] [--brut]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (intervalle < 0.1) intervalle = 0.1;
+
+    const Annuaire *a = annuaire_attacher();
+    if (!a) {
+        fprintf(stderr, "isytop: annuaire absent (ServeurISY lancé ?)\n");
+        return EXIT_FAILURE;
+    }
+    suivis = calloc(a->capacite, sizeof(*suivis));
+    lignes = calloc(a->capacite, sizeof(*lignes));
+    check_fatal(!suivis || !lignes, "calloc isytop");
+
+    long long precedent = maintenant_ms();
+    for (int tour = 0; iterations == 0 || tour < iterations; ++tour) {
+        struct timespec pause = { (time_t)intervalle,
+                                  (long)((intervalle - (time_t)intervalle) * 1e9) };
+        nanosleep(&pause, NULL);
+
+        /* Le serveur a redémarré : l'ancien annuaire est orphelin */
+        if (kill(a->pid_serveur, 0) < 0 && errno == ESRCH) {
+            fprintf(stderr, "isytop: ServeurISY (pid %d) arrêté\n", (int)a->pid_serveur);
+            break;
+        }
+
+        long long now = maintenant_ms();
+        double secondes = (double)(now - precedent) / 1000.0;
+        precedent = now;
+
+        lire_files_udp();
+        int nb = 0, sans_metriques = 0;
+        double total_msg = 0, total_in = 0, total_out = 0;
+        uint32_t etendue = atomic_load_explicit(&a->etendue, memory_order_acquire);
+        for (uint32_t slot = 0; slot < etendue && slot < a->capacite; ++slot) {
+            Ligne *l = &lignes[nb];
+            if (!annuaire_lire(a, (int)slot, &l->e)) {
+                if (suivis[slot].pid) oublier(&suivis[slot]);
+                continue;
+            }
+            suivre(&suivis[slot], &l->e);
+            l->slot = (int)slot;
+            echantillonner(l, &suivis[slot], secondes, now);
+            if (!l->s) sans_metriques++;
+            total_msg += l->msg_s;
+            total_in += l->in_s;
+            total_out += l->out_s;
+            nb++;
+        }
+        qsort(lignes, (size_t)nb, sizeof(*lignes), par_debit);
+
+        if (effacer) printf("\033[H\033[2J");
+        printf("isytop - ServeurISY pid %d - %d groupes (%d sans métriques) - "
+               "%.0f msg/s, %.0f paq/s reçus, %.0f paq/s envoyés\n",
+               (int)a->pid_serveur, nb, sans_metriques, total_msg, total_in, total_out);
+        printf("%5s %-16s %7s %5s %4s %8s %8s %8s %8s %6s %6s %5s %6s %7s %5s %8s %8s %6s %6s %7s %s\n",
+               "SLOT", "GROUPE", "PID", "ETAT", "MEMB", "MSG/s", "IN/s", "OUT/s",
+               "Ko/s", "FANOUT", "ECH/s", "BAN", "NAK/s", "JRN_ms", "FILE",
+               "C>G_p99", "GRP_p99", "RXQ", "DROPS", "INACT_s", "");
+        for (int i = 0; i < nb && i < max_lignes; ++i) {
+            const Ligne *l = &lignes[i];
+            printf("%5d %-16.16s %7d %5s ", l->slot, l->e.nom, (int)l->e.pid,
+                   nom_etat(l->e.etat));
+            if (l->s) {
+                printf("%4u %8.1f %8.1f %8.1f %8.1f %6.1f %6.1f %5llu %6.1f %7.2f %5u ",
+                       STAT_LIRE(l->s, nb_clients), l->msg_s, l->in_s, l->out_s,
+                       l->ko_s, l->fanout, l->echecs_s,
+                       (unsigned long long)STAT_LIRE(l->s, rejets_bannis),
+                       l->nak_s, l->jrn_ms, STAT_LIRE(l->s, file_journal));
+                for (int e = 0; e < TRACE_ETAPES_GROUPE; ++e) {
+                    if (l->trace_us[e] > 0) printf("%8.0f ", l->trace_us[e]);
+                    else printf("%8s ", "-");
+                }
+            } else {
+                printf("%4s %8s %8s %8s %8s %6s %6s %5s %6s %7s %5s %8s %8s ",
+                       "-", "-", "-", "-", "-", "-", "-", "-", "-", "-", "-", "-", "-");
+            }
+            printf("%6u %6u ", l->rxq, l->drops);
+            if (l->s && l->inactif_ms >= 0) printf("%7.1f", l->inactif_ms / 1000.0);
+            else printf("%7s", "-");
+            printf(" %s\n", l->alerte);
+        }
+        if (nb > max_lignes) printf("... %d autres groupes\n", nb - max_lignes);
+        fflush(stdout);
+    }
+
+    for (uint32_t slot = 0; slot < a->capacite; ++slot)
+        if (suivis[slot].pid) oublier(&suivis[slot]);
+    free(suivis);
+    free(lignes);
+    shmdt(a);
+    return 0;
+}
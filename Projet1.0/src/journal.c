@@ -0,0 +1,821 @@
+#define _GNU_SOURCE
+#include "../include/journal.h"
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <time.h>
+
+#define JOURNAL_AJOUT   1u
+#define JOURNAL_RETRAIT 2u
+#define JOURNAL_BAN     3u
+
+#define INDEX_TAILLE_MIN   32
+#define CASE_VIDE          (-1)
+
+/* Enregistrement du journal, taille fixe */
+typedef struct {
+    uint32_t op;
+    union {
+        JournalMembre m;
+        JournalBan    b;
+    } u;
+} JournalEntree;
+
+typedef struct {
+    JournalEntree *e;
+    int nb;
+    int cap;
+} JournalFile;
+
+/* Index (IP, nom) -> position dans JournalEtat.membres, à adressage ouvert
+ * comme celui de membres.c */
+typedef struct {
+    uint32_t hash;
+    int32_t  pos;
+} IndexCase;
+
+typedef struct {
+    IndexCase *cases;
+    uint32_t taille;               /* puissance de 2, 0 : pas encore alloué */
+    uint32_t nb;
+} IndexMembres;
+
+struct JournalGroupe {
+    char nom[MAX_GROUP_NAME];
+    JournalFile attente;           /* remplie par le fil de réception (verrou) */
+    int fermeture;                 /* journal_fermer en cours (verrou) */
+    int ferme;                     /* l'écrivain a fini avec ce groupe (verrou) */
+    int lache;                     /* journal_lacher : l'écrivain le libère (verrou) */
+    uint32_t etiquette;            /* rendue par journal_liberes */
+    long long attente_depuis_ns;   /* premier enregistrement en attente (verrou) */
+    GroupStats *stats;             /* file et latence des commits, ou NULL */
+    int sale;                      /* dans la liste 'sales' (verrou) */
+    struct JournalGroupe *suivant_sale;
+    struct JournalGroupe *precedent, *suivant;
+
+    /* Réservé à l'écrivain */
+    JournalFile en_cours;
+    int fd;
+    int a_synchroniser;            /* dans 'non_synchronises' */
+    int depuis_compactage;
+    JournalEtat ombre;             /* état courant, pour le compactage */
+    IndexMembres index;            /* membres de l'ombre */
+    long long en_cours_depuis_ns;  /* 0 : rien pris en charge */
+};
+
+static pthread_mutex_t verrou = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  cond_travail = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  cond_ferme = PTHREAD_COND_INITIALIZER;
+static JournalGroupe  *groupes = NULL;
+static JournalGroupe  *sales = NULL;    /* à traiter au prochain passage */
+static int travail = 0;
+static int arret = 0;
+static int demarre = 0;
+static pthread_t ecrivain;
+
+static int fsync_lot = JOURNAL_FSYNC_DEFAUT;
+static int seuil_compactage = JOURNAL_COMPACTAGE_DEFAUT;
+static unsigned long nb_commits = 0;
+static int nb_fd_ouverts = 0;      /* journaux gardés ouverts (écrivain) */
+
+/* Réservés à l'écrivain : groupes du passage en cours, et journaux écrits
+ * depuis le dernier fsync de lot */
+static JournalGroupe **lot = NULL;
+static int nb_lot = 0;
+static int cap_lot = 0;
+static JournalGroupe **non_synchronises = NULL;
+static int nb_non_synchronises = 0;
+static int cap_non_synchronises = 0;
+
+/* Groupes lâchés déjà libérés, en attente de journal_liberes (verrou) */
+static int evfd = -1;
+static uint32_t *liberes = NULL;
+static int nb_liberes = 0;
+static int cap_liberes = 0;
+
+static long long maintenant_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void chemin_fichier(const char *nom_groupe, const char *suffixe,
+                           char *path, size_t size)
+{
+    snprintf(path, size, "infoGroup/%s%s", nom_groupe, suffixe);
+}
+
+static int file_pousser(JournalFile *f, const JournalEntree *e)
+{
+    if (f->nb == f->cap) {
+        int cap = f->cap ? f->cap * 2 : 16;
+        JournalEntree *p = realloc(f->e, (size_t)cap * sizeof(*p));
+        if (!p) return -1;
+        f->e = p;
+        f->cap = cap;
+    }
+    f->e[f->nb++] = *e;
+    return 0;
+}
+
+/* Agrandit un tableau de l'état pour contenir au moins 'besoin' éléments */
+static int reserver(void **tab, int *cap, int besoin, size_t taille)
+{
+    if (besoin <= *cap) return 0;
+    int c = *cap ? *cap : 16;
+    while (c < besoin) c *= 2;
+    void *p = realloc(*tab, (size_t)c * taille);
+    if (!p) return -1;
+    *tab = p;
+    *cap = c;
+    return 0;
+}
+
+/* Finaliseur de murmur3, sur l'IP et le FNV-1a du nom (borné comme
+ * l'enregistrement) */
+static uint32_t hash_membre(uint32_t ip, const char *nom)
+{
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < MAX_USERNAME - 1 && nom[i]; ++i) {
+        h ^= (unsigned char)nom[i];
+        h *= 16777619u;
+    }
+    h ^= ip;
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+    return h;
+}
+
+static int index_allouer(IndexMembres *x, uint32_t taille)
+{
+    IndexCase *cases = malloc(taille * sizeof(IndexCase));
+    if (!cases) return -1;
+    for (uint32_t i = 0; i < taille; ++i)
+        cases[i].pos = CASE_VIDE;
+
+    /* Réinsertion des entrées existantes */
+    for (uint32_t i = 0; i < x->taille; ++i) {
+        if (x->cases[i].pos == CASE_VIDE) continue;
+        uint32_t j = x->cases[i].hash & (taille - 1);
+        while (cases[j].pos != CASE_VIDE)
+            j = (j + 1) & (taille - 1);
+        cases[j] = x->cases[i];
+    }
+    free(x->cases);
+    x->cases = cases;
+    x->taille = taille;
+    return 0;
+}
+
+/* Place pour une entrée de plus (charge maximale 1/2) */
+static int index_reserver(IndexMembres *x)
+{
+    if ((x->nb + 1) * 2 <= x->taille) return 0;
+    return index_allouer(x, x->taille ? x->taille * 2 : INDEX_TAILLE_MIN);
+}
+
+static void index_inserer(IndexMembres *x, uint32_t h, int32_t pos)
+{
+    uint32_t j = h & (x->taille - 1);
+    while (x->cases[j].pos != CASE_VIDE)
+        j = (j + 1) & (x->taille - 1);
+    x->cases[j].hash = h;
+    x->cases[j].pos = pos;
+    x->nb++;
+}
+
+/* Case de l'entrée (h, pos), -1 si absente */
+static int64_t index_position(const IndexMembres *x, uint32_t h, int32_t pos)
+{
+    if (x->taille == 0) return -1;
+    uint32_t j = h & (x->taille - 1);
+    while (x->cases[j].pos != CASE_VIDE) {
+        if (x->cases[j].pos == pos && x->cases[j].hash == h) return j;
+        j = (j + 1) & (x->taille - 1);
+    }
+    return -1;
+}
+
+/* Suppression par décalage arrière, comme dans le registre des groupes */
+static void index_supprimer(IndexMembres *x, uint32_t j)
+{
+    uint32_t masque = x->taille - 1;
+    uint32_t trou = j;
+    uint32_t k = (j + 1) & masque;
+
+    while (x->cases[k].pos != CASE_VIDE) {
+        uint32_t ideal = x->cases[k].hash & masque;
+        if (((k - ideal) & masque) >= ((k - trou) & masque)) {
+            x->cases[trou] = x->cases[k];
+            trou = k;
+        }
+        k = (k + 1) & masque;
+    }
+    x->cases[trou].pos = CASE_VIDE;
+    x->nb--;
+}
+
+static void index_liberer(IndexMembres *x)
+{
+    free(x->cases);
+    memset(x, 0, sizeof(*x));
+}
+
+/* Indexe les membres déjà présents dans l'état */
+static int index_construire(IndexMembres *x, const JournalEtat *etat)
+{
+    uint32_t taille = INDEX_TAILLE_MIN;
+    while (taille < (uint32_t)etat->nb_membres * 2) taille *= 2;
+    if (index_allouer(x, taille) < 0) return -1;
+    for (int i = 0; i < etat->nb_membres; ++i)
+        index_inserer(x, hash_membre(etat->membres[i].ip, etat->membres[i].nom), i);
+    return 0;
+}
+
+/* Position du membre (ip, nom) dans l'état, -1 s'il est absent */
+static int chercher_membre(const JournalEtat *etat, const IndexMembres *x,
+                           uint32_t ip, const char *nom)
+{
+    if (x->taille == 0) return -1;
+    uint32_t h = hash_membre(ip, nom);
+    uint32_t j = h & (x->taille - 1);
+    while (x->cases[j].pos != CASE_VIDE) {
+        const JournalMembre *m = &etat->membres[x->cases[j].pos];
+        if (x->cases[j].hash == h && m->ip == ip &&
+            strncmp(m->nom, nom, MAX_USERNAME - 1) == 0)
+            return x->cases[j].pos;
+        j = (j + 1) & (x->taille - 1);
+    }
+    return -1;
+}
+
+/* Retire le membre i : le dernier prend sa place, et son entrée d'index suit */
+static void retirer_membre(JournalEtat *etat, IndexMembres *x, int i)
+{
+    int64_t j = index_position(x, hash_membre(etat->membres[i].ip, etat->membres[i].nom), i);
+    if (j >= 0) index_supprimer(x, (uint32_t)j);
+    int dernier = --etat->nb_membres;
+    if (i == dernier) return;
+    j = index_position(x, hash_membre(etat->membres[dernier].ip,
+                                      etat->membres[dernier].nom), dernier);
+    if (j >= 0) x->cases[j].pos = i;
+    etat->membres[i] = etat->membres[dernier];
+}
+
+/* Applique un enregistrement à un état (membres identifiés par IP et nom,
+ * retrouvés par l'index de l'état) */
+static void appliquer(JournalEtat *etat, IndexMembres *x, const JournalEntree *e)
+{
+    if (e->op == JOURNAL_BAN) {
+        for (int i = 0; i < etat->nb_bannis; ++i)
+            if (etat->bannis[i].reseau == e->u.b.reseau &&
+                etat->bannis[i].longueur == e->u.b.longueur) return;
+        if (reserver((void **)&etat->bannis, &etat->cap_bannis,
+                     etat->nb_bannis + 1, sizeof(JournalBan)) == 0)
+            etat->bannis[etat->nb_bannis++] = e->u.b;
+        return;
+    }
+
+    /* Un retrait sans nom (journaux antérieurs) vaut pour toute l'IP : seul
+     * cas parcouru */
+    if (e->op == JOURNAL_RETRAIT) {
+        if (e->u.m.nom[0] == '\0') {
+            for (int i = etat->nb_membres - 1; i >= 0; --i)
+                if (etat->membres[i].ip == e->u.m.ip)
+                    retirer_membre(etat, x, i);
+        } else {
+            int i = chercher_membre(etat, x, e->u.m.ip, e->u.m.nom);
+            if (i >= 0) retirer_membre(etat, x, i);
+        }
+        return;
+    }
+    if (e->op != JOURNAL_AJOUT) return;
+
+    int i = chercher_membre(etat, x, e->u.m.ip, e->u.m.nom);
+    if (i < 0) {
+        if (reserver((void **)&etat->membres, &etat->cap_membres,
+                     etat->nb_membres + 1, sizeof(JournalMembre)) < 0 ||
+            index_reserver(x) < 0) return;
+        i = etat->nb_membres++;
+        index_inserer(x, hash_membre(e->u.m.ip, e->u.m.nom), i);
+    }
+    etat->membres[i] = e->u.m;
+    etat->membres[i].nom[MAX_USERNAME - 1] = '\0';
+    etat->membres[i].emoji[MAX_EMOJI - 1] = '\0';
+}
+
+static int copier_etat(JournalEtat *dst, const JournalMembre *membres, int nb_membres,
+                       const JournalBan *bannis, int nb_bannis)
+{
+    if (reserver((void **)&dst->membres, &dst->cap_membres, nb_membres, sizeof(JournalMembre)) < 0 ||
+        reserver((void **)&dst->bannis, &dst->cap_bannis, nb_bannis, sizeof(JournalBan)) < 0)
+        return -1;
+    if (nb_membres) memcpy(dst->membres, membres, (size_t)nb_membres * sizeof(JournalMembre));
+    if (nb_bannis) memcpy(dst->bannis, bannis, (size_t)nb_bannis * sizeof(JournalBan));
+    dst->nb_membres = nb_membres;
+    dst->nb_bannis = nb_bannis;
+    for (int i = 0; i < nb_membres; ++i) {
+        dst->membres[i].nom[MAX_USERNAME - 1] = '\0';
+        dst->membres[i].emoji[MAX_EMOJI - 1] = '\0';
+    }
+    return 0;
+}
+
+/* Projette un fichier en lecture ; NULL si absent ou vide */
+static void *projeter(const char *path, size_t *taille)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    struct stat st;
+    void *carte = NULL;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        carte = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (carte == MAP_FAILED) carte = NULL;
+        else *taille = (size_t)st.st_size;
+    }
+    close(fd);
+    return carte;
+}
+
+int journal_charger(const char *nom_groupe, JournalEtat *etat)
+{
+    char path[256];
+    size_t taille = 0;
+    int ret = 0;
+    memset(etat, 0, sizeof(*etat));
+
+    chemin_fichier(nom_groupe, ".snap", path, sizeof(path));
+    const char *carte = projeter(path, &taille);
+    if (carte) {
+        const JournalEntete *h = (const JournalEntete *)carte;
+        size_t attendu = taille >= sizeof(*h) ?
+            sizeof(*h) + (size_t)h->nb_membres * sizeof(JournalMembre)
+                       + (size_t)h->nb_bannis * sizeof(JournalBan) : 0;
+        if (taille < sizeof(*h) || h->magic != JOURNAL_MAGIC ||
+            h->version != JOURNAL_VERSION ||
+            h->taille_membre != sizeof(JournalMembre) || taille < attendu) {
+            fprintf(stderr, "[JOURNAL] Instantane %s invalide, ignore\n", path);
+            ret = -1;
+        } else {
+            /* Les enregistrements sont utilisés tels quels : une copie par bloc */
+            const JournalMembre *membres = (const JournalMembre *)(h + 1);
+            const JournalBan *bannis = (const JournalBan *)(membres + h->nb_membres);
+            copier_etat(etat, membres, (int)h->nb_membres, bannis, (int)h->nb_bannis);
+        }
+        munmap((void *)carte, taille);
+    }
+
+    chemin_fichier(nom_groupe, ".journal", path, sizeof(path));
+    taille = 0;
+    carte = projeter(path, &taille);
+    if (carte) {
+        /* Un dernier enregistrement incomplet (arrêt brutal) est ignoré */
+        const JournalEntree *e = (const JournalEntree *)carte;
+        size_t nb = taille / sizeof(JournalEntree);
+        IndexMembres x = {0};
+        if (index_construire(&x, etat) < 0) perror("index journal");
+        for (size_t i = 0; i < nb; ++i)
+            appliquer(etat, &x, &e[i]);
+        index_liberer(&x);
+        munmap((void *)carte, taille);
+    }
+    return ret;
+}
+
+void journal_etat_liberer(JournalEtat *etat)
+{
+    free(etat->membres);
+    free(etat->bannis);
+    memset(etat, 0, sizeof(*etat));
+}
+
+/* Réécrit <nom>.snap depuis l'ombre (fichier temporaire puis rename) et
+ * vide le journal. Un arrêt entre les deux ne perd rien : le rejeu est
+ * idempotent. */
+static void compacter(JournalGroupe *j)
+{
+    char tmp[256], path[256];
+    chemin_fichier(j->nom, ".snap.tmp", tmp, sizeof(tmp));
+    chemin_fichier(j->nom, ".snap", path, sizeof(path));
+
+    JournalEntete h;
+    memset(&h, 0, sizeof(h));
+    h.magic = JOURNAL_MAGIC;
+    h.version = JOURNAL_VERSION;
+    h.taille_membre = sizeof(JournalMembre);
+    h.nb_membres = (uint32_t)j->ombre.nb_membres;
+    h.nb_bannis = (uint32_t)j->ombre.nb_bannis;
+
+    FILE *f = fopen(tmp, "w");
+    if (!f) return;
+    int ok = fwrite(&h, sizeof(h), 1, f) == 1;
+    if (ok && h.nb_membres)
+        ok = fwrite(j->ombre.membres, sizeof(JournalMembre), h.nb_membres, f) == h.nb_membres;
+    if (ok && h.nb_bannis)
+        ok = fwrite(j->ombre.bannis, sizeof(JournalBan), h.nb_bannis, f) == h.nb_bannis;
+    if (fflush(f) != 0) ok = 0;
+    if (ok && fsync_lot > 0) fsync(fileno(f));
+    fclose(f);
+
+    if (!ok || rename(tmp, path) < 0) {
+        perror("instantane journal");
+        unlink(tmp);
+        return;
+    }
+    if (j->fd >= 0) {
+        if (ftruncate(j->fd, 0) < 0) perror("ftruncate journal");
+    } else {
+        chemin_fichier(j->nom, ".journal", path, sizeof(path));
+        if (truncate(path, 0) < 0 && errno != ENOENT) perror("truncate journal");
+    }
+    j->depuis_compactage = 0;
+}
+
+/* fsync du journal au prochain fsync de lot (aussitôt si la liste ne peut
+ * pas grandir) */
+static void differer_fsync(JournalGroupe *j)
+{
+    if (fsync_lot <= 0 || j->a_synchroniser) return;
+    if (reserver((void **)&non_synchronises, &cap_non_synchronises,
+                 nb_non_synchronises + 1, sizeof(*non_synchronises)) < 0) {
+        fsync(j->fd);
+        return;
+    }
+    non_synchronises[nb_non_synchronises++] = j;
+    j->a_synchroniser = 1;
+}
+
+static void oublier_fsync(JournalGroupe *j)
+{
+    if (!j->a_synchroniser) return;
+    for (int k = 0; k < nb_non_synchronises; ++k) {
+        if (non_synchronises[k] == j) {
+            non_synchronises[k] = non_synchronises[--nb_non_synchronises];
+            break;
+        }
+    }
+    j->a_synchroniser = 0;
+}
+
+static void fermer_fd(JournalGroupe *j)
+{
+    if (j->fd < 0) return;
+    close(j->fd);
+    j->fd = -1;
+    nb_fd_ouverts--;
+}
+
+/* Écrit les enregistrements pris en charge pour un groupe, en un seul write.
+ * Au-delà de JOURNAL_FD_MAX journaux ouverts (milliers de groupes du
+ * moteur), celui-ci n'est ouvert que le temps de l'écriture, fsync compris. */
+static void ecrire(JournalGroupe *j)
+{
+    if (j->en_cours.nb == 0) return;
+
+    int transitoire = 0;
+    if (j->fd < 0) {
+        char path[256];
+        mkdir("infoGroup", 0755);
+        chemin_fichier(j->nom, ".journal", path, sizeof(path));
+        j->fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (j->fd < 0) perror("open journal");
+        else if (nb_fd_ouverts++ >= JOURNAL_FD_MAX) transitoire = 1;
+    }
+
+    for (int i = 0; i < j->en_cours.nb; ++i)
+        appliquer(&j->ombre, &j->index, &j->en_cours.e[i]);
+
+    if (j->fd >= 0) {
+        const char *buf = (const char *)j->en_cours.e;
+        size_t used = (size_t)j->en_cours.nb * sizeof(JournalEntree);
+        size_t off = 0;
+        while (off < used) {
+            ssize_t w = write(j->fd, buf + off, used - off);
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                perror("write journal");
+                break;
+            }
+            off += (size_t)w;
+        }
+        if (!transitoire) differer_fsync(j);
+    }
+    j->depuis_compactage += j->en_cours.nb;
+    j->en_cours.nb = 0;
+
+    if (j->depuis_compactage >= seuil_compactage)
+        compacter(j);
+    if (transitoire && j->fd >= 0) {
+        if (fsync_lot > 0) fsync(j->fd);
+        fermer_fd(j);
+    }
+}
+
+static void liberer_groupe(JournalGroupe *j)
+{
+    free(j->attente.e);
+    free(j->en_cours.e);
+    journal_etat_liberer(&j->ombre);
+    index_liberer(&j->index);
+    free(j);
+}
+
+/* Retire le groupe de la liste de tous les groupes. Appelé verrou tenu. */
+static void detacher(JournalGroupe *j)
+{
+    if (j->precedent) j->precedent->suivant = j->suivant;
+    else groupes = j->suivant;
+    if (j->suivant) j->suivant->precedent = j->precedent;
+}
+
+/* Le groupe sera traité au prochain passage de l'écrivain. Appelé verrou
+ * tenu. */
+static void marquer(JournalGroupe *j)
+{
+    if (!j->sale) {
+        j->sale = 1;
+        j->suivant_sale = sales;
+        sales = j;
+    }
+    if (!travail) {
+        travail = 1;
+        pthread_cond_signal(&cond_travail);
+    }
+}
+
+/* Range l'étiquette d'un groupe lâché et réveille le lecteur de evfd.
+ * Appelé verrou tenu. */
+static void signaler_libere(uint32_t etiquette)
+{
+    if (reserver((void **)&liberes, &cap_liberes, nb_liberes + 1, sizeof(uint32_t)) < 0) {
+        perror("journal liberes");
+        return;
+    }
+    liberes[nb_liberes++] = etiquette;
+    uint64_t un = 1;
+    if (evfd >= 0 && write(evfd, &un, sizeof(un)) < 0 && errno != EAGAIN)
+        perror("write eventfd journal");
+}
+
+static void *journal_ecrivain(void *arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&verrou);
+    for (;;) {
+        while (!travail && !arret)
+            pthread_cond_wait(&cond_travail, &verrou);
+        int fin = arret;
+        travail = 0;
+
+        /* Prise en charge de ce qui s'est accumulé (group commit) : seuls
+         * les groupes marqués depuis le passage précédent sont parcourus.
+         * Un groupe remarqué pendant l'écriture attend le passage suivant. */
+        nb_lot = 0;
+        JournalGroupe *j = sales;
+        while (j && reserver((void **)&lot, &cap_lot, nb_lot + 1, sizeof(*lot)) == 0) {
+            JournalFile t = j->en_cours;
+            j->en_cours = j->attente;
+            j->attente = t;
+            j->en_cours_depuis_ns = j->attente_depuis_ns;
+            j->attente_depuis_ns = 0;
+            if (j->stats) STAT_FIXER(j->stats, file_journal, 0);
+            j->sale = 0;
+            lot[nb_lot++] = j;
+            j = j->suivant_sale;
+        }
+        sales = j;                    /* faute de mémoire : au passage suivant */
+        if (sales) travail = 1;
+        pthread_mutex_unlock(&verrou);
+
+        int ecrit = 0;
+        for (int k = 0; k < nb_lot; ++k) {
+            if (lot[k]->en_cours.nb > 0) ecrit = 1;
+            ecrire(lot[k]);
+        }
+        if (ecrit) nb_commits++;
+        if (ecrit && fsync_lot > 0 && nb_commits % (unsigned long)fsync_lot == 0) {
+            for (int k = 0; k < nb_non_synchronises; ++k) {
+                if (non_synchronises[k]->fd >= 0) fsync(non_synchronises[k]->fd);
+                non_synchronises[k]->a_synchroniser = 0;
+            }
+            nb_non_synchronises = 0;
+        }
+
+        /* Latence de persistance : première mise en file -> écrit */
+        long long now = maintenant_ns();
+        for (int k = 0; k < nb_lot; ++k) {
+            j = lot[k];
+            if (!j->en_cours_depuis_ns) continue;
+            if (j->stats) {
+                uint64_t latence = (uint64_t)(now - j->en_cours_depuis_ns);
+                STAT_AJOUTER(j->stats, journal_commits, 1);
+                STAT_AJOUTER(j->stats, journal_latence_ns, latence);
+                if (latence > STAT_LIRE(j->stats, journal_latence_max_ns))
+                    STAT_FIXER(j->stats, journal_latence_max_ns, latence);
+            }
+            j->en_cours_depuis_ns = 0;
+        }
+
+        pthread_mutex_lock(&verrou);
+        /* Groupes fermés : tout ce qui précédait journal_fermer est écrit,
+         * sauf s'ils ont été remarqués entre-temps */
+        for (int k = 0; k < nb_lot; ++k) {
+            j = lot[k];
+            if (!j->fermeture || j->sale) continue;
+            if (j->depuis_compactage > 0 || j->fd >= 0) compacter(j);
+            oublier_fsync(j);
+            fermer_fd(j);
+            j->ferme = 1;
+            detacher(j);
+            if (j->lache) {
+                signaler_libere(j->etiquette);
+                liberer_groupe(j);
+            }
+        }
+        pthread_cond_broadcast(&cond_ferme);
+        if (fin) break;
+    }
+    pthread_mutex_unlock(&verrou);
+    return NULL;
+}
+
+int journal_demarrer(int fsync_n, int compactage)
+{
+    if (demarre) return 0;
+    fsync_lot = fsync_n < 0 ? 0 : fsync_n;
+    seuil_compactage = compactage > 0 ? compactage : JOURNAL_COMPACTAGE_DEFAUT;
+    arret = 0;
+    evfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (evfd < 0) {
+        perror("eventfd journal");
+        return -1;
+    }
+    if (pthread_create(&ecrivain, NULL, journal_ecrivain, NULL) != 0) {
+        perror("pthread_create journal");
+        close(evfd);
+        evfd = -1;
+        return -1;
+    }
+    demarre = 1;
+    return 0;
+}
+
+void journal_arreter(void)
+{
+    if (!demarre) return;
+    pthread_mutex_lock(&verrou);
+    arret = 1;
+    pthread_cond_signal(&cond_travail);
+    pthread_mutex_unlock(&verrou);
+    pthread_join(ecrivain, NULL);
+    demarre = 0;
+
+    /* Groupes jamais fermés : leur journal est déjà écrit, on compacte */
+    while (groupes) {
+        JournalGroupe *j = groupes;
+        groupes = j->suivant;
+        ecrire(j);
+        compacter(j);
+        fermer_fd(j);
+        liberer_groupe(j);
+    }
+    sales = NULL;
+    close(evfd);
+    evfd = -1;
+    free(liberes);
+    liberes = NULL;
+    nb_liberes = cap_liberes = 0;
+    free(lot);
+    free(non_synchronises);
+    lot = NULL;
+    non_synchronises = NULL;
+    nb_lot = cap_lot = 0;
+    nb_non_synchronises = cap_non_synchronises = 0;
+}
+
+JournalGroupe *journal_ouvrir(const char *nom_groupe, const JournalEtat *etat,
+                              GroupStats *stats)
+{
+    if (!demarre) return NULL;
+
+    JournalGroupe *j = calloc(1, sizeof(*j));
+    if (!j) return NULL;
+    snprintf(j->nom, sizeof(j->nom), "%s", nom_groupe);
+    j->fd = -1;
+    j->stats = stats;
+    if (etat)
+        copier_etat(&j->ombre, etat->membres, etat->nb_membres,
+                    etat->bannis, etat->nb_bannis);
+    if (index_construire(&j->index, &j->ombre) < 0) perror("index journal");
+
+    pthread_mutex_lock(&verrou);
+    j->suivant = groupes;
+    if (groupes) groupes->precedent = j;
+    groupes = j;
+    pthread_mutex_unlock(&verrou);
+    return j;
+}
+
+static void enfiler(JournalGroupe *j, const JournalEntree *e)
+{
+    pthread_mutex_lock(&verrou);
+    if (j->attente.nb == 0) j->attente_depuis_ns = maintenant_ns();
+    if (file_pousser(&j->attente, e) == 0)
+        marquer(j);
+    if (j->stats) STAT_FIXER(j->stats, file_journal, (uint32_t)j->attente.nb);
+    pthread_mutex_unlock(&verrou);
+}
+
+void journal_ajouter(JournalGroupe *j, const char *nom, struct in_addr ip,
+                     const char *emoji)
+{
+    if (!j) return;
+    JournalEntree e;
+    memset(&e, 0, sizeof(e));
+    e.op = JOURNAL_AJOUT;
+    e.u.m.ip = ip.s_addr;
+    snprintf(e.u.m.nom, sizeof(e.u.m.nom), "%s", nom);
+    snprintf(e.u.m.emoji, sizeof(e.u.m.emoji), "%s", emoji);
+    enfiler(j, &e);
+}
+
+void journal_retirer(JournalGroupe *j, const char *nom, struct in_addr ip)
+{
+    if (!j) return;
+    JournalEntree e;
+    memset(&e, 0, sizeof(e));
+    e.op = JOURNAL_RETRAIT;
+    e.u.m.ip = ip.s_addr;
+    snprintf(e.u.m.nom, sizeof(e.u.m.nom), "%s", nom);
+    enfiler(j, &e);
+}
+
+void journal_bannir(JournalGroupe *j, uint32_t reseau, int longueur)
+{
+    if (!j) return;
+    JournalEntree e;
+    memset(&e, 0, sizeof(e));
+    e.op = JOURNAL_BAN;
+    e.u.b.reseau = reseau;
+    e.u.b.longueur = (uint32_t)longueur;
+    enfiler(j, &e);
+}
+
+void journal_fermer(JournalGroupe *j)
+{
+    if (!j) return;
+    pthread_mutex_lock(&verrou);
+    j->fermeture = 1;
+    marquer(j);
+    while (!j->ferme && demarre)
+        pthread_cond_wait(&cond_ferme, &verrou);
+    pthread_mutex_unlock(&verrou);
+    liberer_groupe(j);
+}
+
+void journal_lacher(JournalGroupe *j, uint32_t etiquette)
+{
+    pthread_mutex_lock(&verrou);
+    if (!j) {
+        signaler_libere(etiquette);
+    } else {
+        j->fermeture = 1;
+        j->lache = 1;
+        j->etiquette = etiquette;
+        marquer(j);
+    }
+    pthread_mutex_unlock(&verrou);
+}
+
+int journal_evfd(void)
+{
+    return evfd;
+}
+
+int journal_liberes(uint32_t *etiquettes, int max)
+{
+    uint64_t n;
+    if (evfd >= 0 && read(evfd, &n, sizeof(n)) < 0 && errno != EAGAIN)
+        perror("read eventfd journal");
+
+    pthread_mutex_lock(&verrou);
+    int nb = nb_liberes < max ? nb_liberes : max;
+    if (nb > 0) {
+        memcpy(etiquettes, liberes, (size_t)nb * sizeof(uint32_t));
+        nb_liberes -= nb;
+        memmove(liberes, liberes + nb, (size_t)nb_liberes * sizeof(uint32_t));
+    }
+    if (nb_liberes > 0) {
+        uint64_t un = 1;
+        if (write(evfd, &un, sizeof(un)) < 0 && errno != EAGAIN)
+            perror("write eventfd journal");
+    }
+    pthread_mutex_unlock(&verrou);
+    return nb;
+}
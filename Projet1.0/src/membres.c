@@ -0,0 +1,300 @@
+#include "../include/membres.h"
+
+#define INDEX_TAILLE_MIN   32
+#define CASE_VIDE          (-1)
+
+/* Finaliseur de murmur3 : disperse les bits de l'adresse et du port */
+static uint32_t melanger(uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+    return h;
+}
+
+static uint32_t hash_cle(uint32_t ip, uint16_t port, unsigned int hache_nom)
+{
+    return melanger(ip ^ melanger(((uint32_t)port << 16) ^ hache_nom));
+}
+
+static uint32_t hash_ip(uint32_t ip)
+{
+    return melanger(ip);
+}
+
+/* Index */
+
+static int index_allouer(MembresIndex *x, uint32_t taille)
+{
+    MembresCase *cases = malloc(taille * sizeof(MembresCase));
+    if (!cases) return -1;
+    for (uint32_t i = 0; i < taille; ++i)
+        cases[i].slot = CASE_VIDE;
+
+    /* Réinsertion des entrées existantes */
+    for (uint32_t i = 0; i < x->taille; ++i) {
+        if (x->cases[i].slot == CASE_VIDE) continue;
+        uint32_t j = x->cases[i].hash & (taille - 1);
+        while (cases[j].slot != CASE_VIDE)
+            j = (j + 1) & (taille - 1);
+        cases[j] = x->cases[i];
+    }
+    free(x->cases);
+    x->cases = cases;
+    x->taille = taille;
+    return 0;
+}
+
+/* Place pour une entrée de plus (charge maximale 1/2) */
+static int index_reserver(MembresIndex *x)
+{
+    if ((x->nb + 1) * 2 <= x->taille) return 0;
+    return index_allouer(x, x->taille ? x->taille * 2 : INDEX_TAILLE_MIN);
+}
+
+static void index_inserer(MembresIndex *x, uint32_t h, int32_t slot)
+{
+    uint32_t j = h & (x->taille - 1);
+    while (x->cases[j].slot != CASE_VIDE)
+        j = (j + 1) & (x->taille - 1);
+    x->cases[j].hash = h;
+    x->cases[j].slot = slot;
+    x->nb++;
+}
+
+/* Position de l'entrée (h, slot) */
+static uint32_t index_position(const MembresIndex *x, uint32_t h, int32_t slot)
+{
+    uint32_t j = h & (x->taille - 1);
+    while (x->cases[j].slot != slot || x->cases[j].hash != h)
+        j = (j + 1) & (x->taille - 1);
+    return j;
+}
+
+/* Suppression par décalage arrière, comme dans le registre des groupes */
+static void index_supprimer(MembresIndex *x, uint32_t j)
+{
+    uint32_t masque = x->taille - 1;
+    uint32_t trou = j;
+    uint32_t k = (j + 1) & masque;
+
+    while (x->cases[k].slot != CASE_VIDE) {
+        uint32_t ideal = x->cases[k].hash & masque;
+        if (((k - ideal) & masque) >= ((k - trou) & masque)) {
+            x->cases[trou] = x->cases[k];
+            trou = k;
+        }
+        k = (k + 1) & masque;
+    }
+    x->cases[trou].slot = CASE_VIDE;
+    x->nb--;
+}
+
+static uint32_t hash_membre(const ClientInfo *m)
+{
+    return hash_cle(m->addr_cli.sin_addr.s_addr, m->addr_cli.sin_port, m->hache_nom);
+}
+
+/* Table */
+
+void membres_init(TableMembres *t)
+{
+    memset(t, 0, sizeof(*t));
+}
+
+void membres_liberer(TableMembres *t)
+{
+    for (int b = 0; b < t->nb_blocs; ++b)
+        free(t->blocs[b]);
+    free(t->blocs);
+    free(t->libres);
+    free(t->actifs);
+    free(t->par_cle.cases);
+    free(t->par_ip.cases);
+    membres_init(t);
+}
+
+int membres_chercher(const TableMembres *t, uint32_t ip, uint16_t port, const char *nom)
+{
+    if (t->par_cle.nb == 0) return -1;
+    unsigned int hn = hache_texte(nom);
+    uint32_t h = hash_cle(ip, port, hn);
+    uint32_t masque = t->par_cle.taille - 1;
+    for (uint32_t j = h & masque; t->par_cle.cases[j].slot != CASE_VIDE; j = (j + 1) & masque) {
+        if (t->par_cle.cases[j].hash != h) continue;
+        const ClientInfo *m = membres_case(t, t->par_cle.cases[j].slot);
+        if (m->addr_cli.sin_addr.s_addr == ip && m->addr_cli.sin_port == port &&
+            m->hache_nom == hn && strcmp(m->nom, nom) == 0)
+            return t->par_cle.cases[j].slot;
+    }
+    return -1;
+}
+
+int membres_premier_ip(const TableMembres *t, uint32_t ip)
+{
+    if (t->par_ip.nb == 0) return -1;
+    uint32_t h = hash_ip(ip);
+    uint32_t masque = t->par_ip.taille - 1;
+    for (uint32_t j = h & masque; t->par_ip.cases[j].slot != CASE_VIDE; j = (j + 1) & masque) {
+        int32_t c = t->par_ip.cases[j].slot;
+        if (t->par_ip.cases[j].hash == h && membres_case(t, c)->addr_cli.sin_addr.s_addr == ip)
+            return c;
+    }
+    return -1;
+}
+
+int membres_chercher_ip(const TableMembres *t, uint32_t ip, const char *nom)
+{
+    int c = membres_premier_ip(t, ip);
+    if (!nom) return c;
+    unsigned int hn = hache_texte(nom);
+    for (; c >= 0; c = membres_case(t, c)->ip_suivant) {
+        const ClientInfo *m = membres_case(t, c);
+        if (m->hache_nom == hn && strcmp(m->nom, nom) == 0) return c;
+    }
+    return -1;
+}
+
+int membres_chercher_affichage(const TableMembres *t, uint32_t ip, uint16_t port)
+{
+    for (int c = membres_premier_ip(t, ip); c >= 0; c = membres_case(t, c)->ip_suivant)
+        if (membres_case(t, c)->addr_cli.sin_port == port) return c;
+    return -1;
+}
+
+/* Liste des actifs */
+
+static void placer(TableMembres *t, int rang, int32_t c)
+{
+    t->actifs[rang] = c;
+    membres_case(t, c)->rang = rang;
+}
+
+static void echanger(TableMembres *t, int a, int b)
+{
+    int32_t ca = t->actifs[a];
+    placer(t, a, t->actifs[b]);
+    placer(t, b, ca);
+}
+
+/* Case libre : une case rendue, sinon la suivante (nouveau bloc au besoin) */
+static int prendre_case(TableMembres *t)
+{
+    if (t->nb_libres > 0) return t->libres[--t->nb_libres];
+    if (t->etendue == t->nb_blocs * MEMBRES_PAR_BLOC) {
+        ClientInfo **blocs = realloc(t->blocs, (size_t)(t->nb_blocs + 1) * sizeof(*blocs));
+        if (!blocs) return -1;
+        t->blocs = blocs;
+        t->blocs[t->nb_blocs] = calloc(MEMBRES_PAR_BLOC, sizeof(ClientInfo));
+        if (!t->blocs[t->nb_blocs]) return -1;
+        t->nb_blocs++;
+    }
+    return t->etendue++;
+}
+
+int membres_ajouter(TableMembres *t, uint32_t ip, uint16_t port, const char *nom)
+{
+    if (t->nb >= MAX_CLIENTS_GROUP) return -1;
+    if (index_reserver(&t->par_cle) < 0 || index_reserver(&t->par_ip) < 0)
+        return -1;
+    if (t->nb == t->cap_actifs) {
+        int cap = t->cap_actifs ? t->cap_actifs * 2 : 16;
+        int32_t *p = realloc(t->actifs, (size_t)cap * sizeof(*p));
+        if (!p) return -1;
+        t->actifs = p;
+        t->cap_actifs = cap;
+    }
+    int c = prendre_case(t);
+    if (c < 0) return -1;
+
+    ClientInfo *m = membres_case(t, c);
+    memset(m, 0, sizeof(*m));
+    m->actif = 1;
+    m->addr_cli.sin_family = AF_INET;
+    m->addr_cli.sin_addr.s_addr = ip;
+    m->addr_cli.sin_port = port;
+    snprintf(m->nom, MAX_USERNAME, "%s", nom);
+    m->hache_nom = hache_texte(m->nom);
+    placer(t, t->nb++, c);
+    echanger(t, m->rang, t->nb_directs++);     /* un nouveau membre est direct */
+    index_inserer(&t->par_cle, hash_membre(m), c);
+
+    /* Chaîne de l'IP : inséré derrière la tête, qui reste indexée */
+    int tete = membres_premier_ip(t, ip);
+    m->ip_precedent = tete;
+    m->ip_suivant = -1;
+    if (tete < 0) {
+        index_inserer(&t->par_ip, hash_ip(ip), c);
+    } else {
+        ClientInfo *h = membres_case(t, tete);
+        m->ip_suivant = h->ip_suivant;
+        if (h->ip_suivant >= 0) membres_case(t, h->ip_suivant)->ip_precedent = c;
+        h->ip_suivant = c;
+    }
+    t->generation++;
+    return c;
+}
+
+int membres_renommer(TableMembres *t, int c, uint16_t port, const char *nom)
+{
+    ClientInfo *m = membres_case(t, c);
+    int autre = membres_chercher(t, m->addr_cli.sin_addr.s_addr, port, nom);
+    if (autre >= 0) return autre == c ? 0 : -1;
+
+    index_supprimer(&t->par_cle, index_position(&t->par_cle, hash_membre(m), c));
+    m->addr_cli.sin_port = port;
+    snprintf(m->nom, MAX_USERNAME, "%s", nom);
+    m->hache_nom = hache_texte(m->nom);
+    index_inserer(&t->par_cle, hash_membre(m), c);
+    t->generation++;
+    return 0;
+}
+
+void membres_servir(TableMembres *t, int c, int service)
+{
+    ClientInfo *m = membres_valide(t, c);
+    if (!m) return;
+    /* La frontière entre les deux parties avance ou recule d'un rang */
+    int direct = m->service == SERVICE_DIRECT;
+    if (direct && service != SERVICE_DIRECT) echanger(t, m->rang, --t->nb_directs);
+    else if (!direct && service == SERVICE_DIRECT) echanger(t, m->rang, t->nb_directs++);
+    if (m->service != service) t->generation++;
+    m->service = service;
+}
+
+void membres_retirer(TableMembres *t, int c)
+{
+    ClientInfo *m = membres_valide(t, c);
+    if (!m) return;
+
+    index_supprimer(&t->par_cle, index_position(&t->par_cle, hash_membre(m), c));
+
+    /* Hors de la chaîne de l'IP ; la tête retirée est remplacée par la suivante */
+    if (m->ip_suivant >= 0)
+        membres_case(t, m->ip_suivant)->ip_precedent = m->ip_precedent;
+    if (m->ip_precedent >= 0) {
+        membres_case(t, m->ip_precedent)->ip_suivant = m->ip_suivant;
+    } else {
+        uint32_t j = index_position(&t->par_ip, hash_ip(m->addr_cli.sin_addr.s_addr), c);
+        if (m->ip_suivant >= 0) t->par_ip.cases[j].slot = m->ip_suivant;
+        else index_supprimer(&t->par_ip, j);
+    }
+
+    /* Le retiré passe en fin de sa partie, puis en fin de liste */
+    if (m->rang < t->nb_directs) echanger(t, m->rang, --t->nb_directs);
+    echanger(t, m->rang, --t->nb);
+    m->actif = 0;
+    m->service = SERVICE_DIRECT;
+    t->generation++;
+
+    if (t->nb_libres == t->cap_libres) {
+        int cap = t->cap_libres ? t->cap_libres * 2 : 16;
+        int32_t *p = realloc(t->libres, (size_t)cap * sizeof(*p));
+        if (!p) return;            /* case perdue, la table reste cohérente */
+        t->libres = p;
+        t->cap_libres = cap;
+    }
+    t->libres[t->nb_libres++] = c;
+}
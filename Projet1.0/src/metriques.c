@@ -0,0 +1,67 @@
+#define _GNU_SOURCE
+#include "../include/metriques.h"
+
+_Static_assert(sizeof(GroupStats) <= UINT16_MAX, "taille dans l'entête");
+
+void metriques_init(GroupStats *s, int id, const char *nom)
+{
+    memset(s, 0, sizeof(*s));
+    s->pid = (int32_t)getpid();
+    s->id = (uint32_t)id;
+    snprintf(s->nom, sizeof(s->nom), "%s", nom);
+    s->taille = sizeof(*s);
+    s->version = METRIQUES_VERSION;
+    /* Le magic en dernier : un lecteur qui le voit trouve l'entête rempli */
+    atomic_thread_fence(memory_order_release);
+    *(volatile uint32_t *)&s->magic = METRIQUES_MAGIC;
+}
+
+int metriques_creer(key_t key)
+{
+    int id = shmget(key, sizeof(GroupStats), IPC_CREAT | 0666);
+    if (id < 0 && errno == EINVAL) {
+        /* Segment laissé par une version précédente, trop petit */
+        int ancien = shmget(key, 0, 0);
+        if (ancien >= 0 && shmctl(ancien, IPC_RMID, NULL) == 0)
+            id = shmget(key, sizeof(GroupStats), IPC_CREAT | 0666);
+    }
+    return id;
+}
+
+GroupStats *metriques_attacher(key_t key, int lecture_seule)
+{
+    int id = shmget(key, 0, 0);
+    if (id < 0) return NULL;
+    struct shmid_ds ds;
+    if (shmctl(id, IPC_STAT, &ds) < 0 || ds.shm_segsz < sizeof(GroupStats))
+        return NULL;
+    GroupStats *s = shmat(id, NULL, lecture_seule ? SHM_RDONLY : 0);
+    if (s == (void *)-1) return NULL;
+    return s;
+}
+
+int metriques_valides(const GroupStats *s)
+{
+    uint32_t magic = *(const volatile uint32_t *)&s->magic;
+    atomic_thread_fence(memory_order_acquire);
+    return magic == METRIQUES_MAGIC && s->version == METRIQUES_VERSION &&
+           s->taille == sizeof(*s);
+}
+
+void metriques_detacher(GroupStats *s)
+{
+    if (s) shmdt(s);
+}
+
+void metriques_tracer(GroupStats *s, int etape, uint64_t debut, uint64_t fin)
+{
+    int c = trace_classe(debut, fin);
+    STAT_CUMULER(s, trace[etape][c], 1);
+    if (fin > debut) STAT_CUMULER(s, trace_total_ns[etape], fin - debut);
+}
+
+void metriques_lire_trace(const GroupStats *s, int etape, uint64_t compte[TRACE_CLASSES])
+{
+    for (int c = 0; c < TRACE_CLASSES; ++c)
+        compte[c] = STAT_LIRE(s, trace[etape][c]);
+}
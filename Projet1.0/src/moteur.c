@@ -0,0 +1,478 @@
+#define _GNU_SOURCE
+#include "../include/moteur.h"
+#include "../include/reception.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <sys/resource.h>
+
+#define MOTEUR_NB_BLOCS  (MOTEUR_MAX_GROUPS / MOTEUR_SLOTS_PAR_BLOC)
+#define MOTEUR_RAFALE    64            /* paquets traités par groupe avant de rendre la main */
+#define MOTEUR_EVENTS    64
+#define MOTEUR_EV_ARRET  UINT64_MAX
+/* Descripteurs hors sockets de groupe : journaux ouverts, epoll, fichiers */
+#define MOTEUR_FD_HORS_GROUPES (JOURNAL_FD_MAX + 64)
+
+/* Un slot de la table des groupes.
+ * La génération est incrémentée à chaque suppression : un événement epoll
+ * encore en vol pour un ancien groupe du même slot est ainsi ignoré.
+ */
+typedef struct {
+    pthread_mutex_t verrou;
+    uint32_t   generation;
+    int        actif;
+    GroupeEtat etat;
+} MoteurSlot;
+
+/* Les slots sont alloués par blocs et jamais déplacés */
+static _Atomic(MoteurSlot *) blocs[MOTEUR_NB_BLOCS];
+static pthread_mutex_t verrou_blocs = PTHREAD_MUTEX_INITIALIZER;
+
+static int epfd = -1;
+static int evfd_arret = -1;
+static pthread_t *threads = NULL;
+static int nb_threads = 0;
+
+/* Port partagé : une socket SO_REUSEPORT par thread, et son réassembleur
+ * (les fragments d'un émetteur arrivent tous sur la même socket) */
+typedef struct {
+    int sock;
+    Reassembleur reassemblage;
+} MoteurPoste;
+
+static int port_partage = 0;
+static MoteurPoste *postes = NULL;
+static int nb_postes = 0;
+static int capacite = MOTEUR_MAX_GROUPS;
+
+static MoteurSlot *slot_get(int slot, int creer)
+{
+    if (slot < 0 || slot >= MOTEUR_MAX_GROUPS) return NULL;
+
+    int b = slot / MOTEUR_SLOTS_PAR_BLOC;
+    MoteurSlot *bloc = atomic_load_explicit(&blocs[b], memory_order_acquire);
+    if (!bloc && creer) {
+        pthread_mutex_lock(&verrou_blocs);
+        bloc = atomic_load_explicit(&blocs[b], memory_order_relaxed);
+        if (!bloc) {
+            bloc = calloc(MOTEUR_SLOTS_PAR_BLOC, sizeof(MoteurSlot));
+            if (bloc) {
+                for (int i = 0; i < MOTEUR_SLOTS_PAR_BLOC; ++i)
+                    pthread_mutex_init(&bloc[i].verrou, NULL);
+                atomic_store_explicit(&blocs[b], bloc, memory_order_release);
+            }
+        }
+        pthread_mutex_unlock(&verrou_blocs);
+    }
+    return bloc ? &bloc[slot % MOTEUR_SLOTS_PAR_BLOC] : NULL;
+}
+
+static uint64_t cle_epoll(int slot, uint32_t generation)
+{
+    return ((uint64_t)generation << 32) | (uint32_t)slot;
+}
+
+/* Lot de réception du thread courant */
+static _Thread_local ReceptionLot reception;
+
+/* Lit au plus 'max' datagrammes sans bloquer. Appelé verrou du slot tenu. */
+static int traiter_rafale(MoteurSlot *s, int max)
+{
+    int traites = 0;
+
+    while (traites < max) {
+        int n = reception_lot(s->etat.sock, &reception,
+                              max - traites < RECEPTION_LOT_DEFAUT ?
+                              max - traites : RECEPTION_LOT_DEFAUT,
+                              MSG_DONTWAIT, &s->etat.reassemblage);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (int i = 0; i < n; ++i)
+            groupe_traiter(&s->etat, &reception.msgs[i], &reception.infos[i],
+                           &reception.srcs[i]);
+        reception_rendre(&reception);
+        traites += n;
+        if (n < RECEPTION_LOT_DEFAUT) break;
+    }
+    groupe_fin_lot(&s->etat);
+    return traites;
+}
+
+static void *moteur_worker(void *arg)
+{
+    (void)arg;
+    struct epoll_event evs[MOTEUR_EVENTS];
+
+    for (;;) {
+        int n = epoll_wait(epfd, evs, MOTEUR_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait moteur");
+            break;
+        }
+        for (int i = 0; i < n; ++i) {
+            uint64_t cle = evs[i].data.u64;
+            if (cle == MOTEUR_EV_ARRET)
+                return NULL;
+
+            int slot = (int)(cle & 0xFFFFFFFFu);
+            uint32_t gen = (uint32_t)(cle >> 32);
+            MoteurSlot *s = slot_get(slot, 0);
+            if (!s) continue;
+
+            pthread_mutex_lock(&s->verrou);
+            if (s->actif && s->generation == gen) {
+                traiter_rafale(s, MOTEUR_RAFALE);
+                /* EPOLLONESHOT : un seul thread par groupe, on réarme ensuite */
+                struct epoll_event ev;
+                ev.events = EPOLLIN | EPOLLONESHOT;
+                ev.data.u64 = cle;
+                if (epoll_ctl(epfd, EPOLL_CTL_MOD, s->etat.sock, &ev) < 0)
+                    perror("epoll_ctl MOD moteur");
+            }
+            pthread_mutex_unlock(&s->verrou);
+        }
+    }
+    return NULL;
+}
+
+/* Port partagé : route chaque message du lot vers son groupe. Les messages
+ * consécutifs d'un même groupe sont traités sous un seul verrou et leurs
+ * envois partent ensemble. */
+static void router_lot(MoteurPoste *p, int n)
+{
+    MoteurSlot *courant = NULL;
+
+    for (int i = 0; i < n; ++i) {
+        const ProtoInfo *info = &reception.infos[i];
+        MoteurSlot *s = info->version == PROTO_V2 ? slot_get(info->groupe, 0) : NULL;
+        if (s != courant) {
+            if (courant) {
+                groupe_fin_lot(&courant->etat);
+                pthread_mutex_unlock(&courant->verrou);
+                courant = NULL;
+            }
+            if (s) {
+                pthread_mutex_lock(&s->verrou);
+                if (s->actif) {
+                    s->etat.sock = p->sock;
+                    courant = s;
+                } else {
+                    pthread_mutex_unlock(&s->verrou);
+                }
+            }
+        }
+        /* Trame v1, id inconnu ou groupe supprimé : ignorée */
+        if (!courant) continue;
+        groupe_traiter(&courant->etat, &reception.msgs[i], &reception.infos[i],
+                       &reception.srcs[i]);
+    }
+    if (courant) {
+        groupe_fin_lot(&courant->etat);
+        pthread_mutex_unlock(&courant->verrou);
+    }
+}
+
+static void *moteur_worker_partage(void *arg)
+{
+    MoteurPoste *p = arg;
+    struct pollfd pfd[2] = {
+        { .fd = p->sock,     .events = POLLIN },
+        { .fd = evfd_arret,  .events = POLLIN },
+    };
+
+    for (;;) {
+        if (poll(pfd, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll moteur");
+            break;
+        }
+        if (pfd[1].revents)
+            return NULL;
+
+        int traites = 0;
+        while (traites < MOTEUR_RAFALE) {
+            int n = reception_lot(p->sock, &reception, RECEPTION_LOT_DEFAUT,
+                                  MSG_DONTWAIT, &p->reassemblage);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            router_lot(p, n);
+            reception_rendre(&reception);
+            traites += n;
+            if (n < RECEPTION_LOT_DEFAUT) break;
+        }
+    }
+    return NULL;
+}
+
+/* Une socket par thread sur le port partagé */
+static int ouvrir_postes(int nb, int port)
+{
+    postes = calloc((size_t)nb, sizeof(MoteurPoste));
+    if (!postes) return -1;
+    nb_postes = nb;
+    for (int i = 0; i < nb; ++i) postes[i].sock = -1;
+
+    for (int i = 0; i < nb; ++i) {
+        int sock = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (sock < 0) {
+            perror("socket moteur");
+            return -1;
+        }
+        postes[i].sock = sock;
+        int un = 1;
+        if (setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &un, sizeof(un)) < 0) {
+            perror("SO_REUSEPORT moteur");
+            return -1;
+        }
+        struct sockaddr_in addr;
+        fill_sockaddr(&addr, NULL, port);
+        if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+            perror("bind port partage");
+            return -1;
+        }
+        if (trace_horodater(sock) < 0) perror("SO_TIMESTAMPNS moteur");
+        if (groupe_preparer_socket(sock) < 0) perror("IP_MULTICAST_IF moteur");
+        reassembleur_init(&postes[i].reassemblage);
+    }
+    return 0;
+}
+
+/* Un port par groupe : une socket chacun. La limite douce est portée au
+ * besoin (dans la limite dure), la capacité ramenée à ce qu'elle permet. */
+static void ajuster_capacite(void)
+{
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) < 0) return;
+    rlim_t besoin = (rlim_t)MOTEUR_MAX_GROUPS + MOTEUR_FD_HORS_GROUPES;
+    if (rl.rlim_cur != RLIM_INFINITY && rl.rlim_cur < besoin) {
+        struct rlimit voulu = rl;
+        voulu.rlim_cur = (rl.rlim_max == RLIM_INFINITY || rl.rlim_max > besoin) ?
+                         besoin : rl.rlim_max;
+        if (setrlimit(RLIMIT_NOFILE, &voulu) == 0) rl = voulu;
+        else perror("setrlimit RLIMIT_NOFILE");
+    }
+    if (rl.rlim_cur != RLIM_INFINITY && rl.rlim_cur < besoin) {
+        long dispo = (long)rl.rlim_cur - MOTEUR_FD_HORS_GROUPES;
+        capacite = dispo > 0 ? (int)dispo : 0;
+        fprintf(stderr, "[MOTEUR] %ld descripteurs (nofile) : %d groupes au plus "
+                        "sur des ports par groupe (--port-partage pour davantage)\n",
+                (long)rl.rlim_cur, capacite);
+    }
+}
+
+int moteur_capacite(void)
+{
+    return capacite;
+}
+
+int moteur_demarrer(int nb, int port)
+{
+    if (nb <= 0) nb = MOTEUR_THREADS_DEFAUT;
+
+    evfd_arret = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (evfd_arret < 0) { perror("eventfd moteur"); return -1; }
+
+    if (port > 0) {
+        port_partage = port;
+        if (ouvrir_postes(nb, port) < 0) return -1;
+    } else {
+        ajuster_capacite();
+        epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (epfd < 0) { perror("epoll_create1 moteur"); return -1; }
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u64 = MOTEUR_EV_ARRET;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, evfd_arret, &ev) < 0) {
+            perror("epoll_ctl eventfd moteur");
+            return -1;
+        }
+    }
+
+    threads = calloc((size_t)nb, sizeof(pthread_t));
+    if (!threads) return -1;
+    for (int i = 0; i < nb; ++i) {
+        int r = port_partage ?
+                pthread_create(&threads[i], NULL, moteur_worker_partage, &postes[i]) :
+                pthread_create(&threads[i], NULL, moteur_worker, NULL);
+        if (r != 0) {
+            perror("pthread_create moteur");
+            break;
+        }
+        nb_threads++;
+    }
+    if (port_partage)
+        printf("[MOTEUR] %d threads de traitement, %d groupes max, port partage %d\n",
+               nb_threads, MOTEUR_MAX_GROUPS, port_partage);
+    else
+        printf("[MOTEUR] %d threads de traitement, %d groupes max\n",
+               nb_threads, capacite);
+    return nb_threads > 0 ? 0 : -1;
+}
+
+int moteur_creer_groupe(int slot, const char *nom, const char *moderateur, int port)
+{
+    MoteurSlot *s = slot_get(slot, 1);
+    if (!s) return -1;
+
+    if (port_partage) {
+        /* Ni socket ni epoll : le groupe devient joignable par son id */
+        pthread_mutex_lock(&s->verrou);
+        groupe_init(&s->etat, slot, nom, moderateur, postes[0].sock);
+        groupe_charger(&s->etat);
+        groupe_annoncer_bannis(&s->etat);
+        s->generation++;
+        s->actif = 1;
+        pthread_mutex_unlock(&s->verrou);
+        printf("[MOTEUR] Groupe '%s' heberge (slot %d, port partage %d)\n",
+               nom, slot, port_partage);
+        return 0;
+    }
+
+    int sock = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        perror("socket moteur");
+        return -1;
+    }
+    struct sockaddr_in addr;
+    fill_sockaddr(&addr, NULL, port);
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind moteur");
+        close(sock);
+        return -1;
+    }
+    if (trace_horodater(sock) < 0) perror("SO_TIMESTAMPNS moteur");
+
+    pthread_mutex_lock(&s->verrou);
+    groupe_init(&s->etat, slot, nom, moderateur, sock);
+    groupe_charger(&s->etat);
+    groupe_annoncer_bannis(&s->etat);
+    s->generation++;
+    s->actif = 1;
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLONESHOT;
+    ev.data.u64 = cle_epoll(slot, s->generation);
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, sock, &ev) < 0) {
+        perror("epoll_ctl ADD moteur");
+        s->actif = 0;
+        close(sock);
+        pthread_mutex_unlock(&s->verrou);
+        return -1;
+    }
+    pthread_mutex_unlock(&s->verrou);
+
+    printf("[MOTEUR] Groupe '%s' heberge (slot %d, port %d)\n", nom, slot, port);
+    return 0;
+}
+
+void moteur_supprimer_groupe(int slot)
+{
+    MoteurSlot *s = slot_get(slot, 0);
+    if (!s) return;
+
+    pthread_mutex_lock(&s->verrou);
+    JournalGroupe *journal = NULL;
+    if (s->actif) {
+        if (!port_partage) {
+            epoll_ctl(epfd, EPOLL_CTL_DEL, s->etat.sock, NULL);
+            /* Les ordres déjà reçus (ex: MIGRATE avant une fusion) sont traités */
+            traiter_rafale(s, 1024);
+            close(s->etat.sock);
+        }
+        s->etat.sock = -1;
+        /* Le journal est détaché : l'écrivain le termine et le libère seul */
+        journal = s->etat.journal;
+        s->etat.journal = NULL;
+        groupe_liberer(&s->etat);
+        s->actif = 0;
+        s->generation++;
+    }
+    pthread_mutex_unlock(&s->verrou);
+    journal_lacher(journal, (uint32_t)slot);
+}
+
+int moteur_evfd(void)
+{
+    return journal_evfd();
+}
+
+int moteur_groupes_fermes(int *slots, int max)
+{
+    uint32_t etiquettes[64];
+    int nb = 0;
+    while (nb < max) {
+        int voulu = max - nb < 64 ? max - nb : 64;
+        int n = journal_liberes(etiquettes, voulu);
+        for (int i = 0; i < n; ++i)
+            slots[nb++] = (int)etiquettes[i];
+        if (n < voulu) break;
+    }
+    return nb;
+}
+
+int moteur_remettre(int slot, const void *trame, size_t len,
+                    const struct sockaddr_in *src)
+{
+    MoteurSlot *s = slot_get(slot, 0);
+    ISYMessage msg;
+    ProtoInfo info;
+    if (!s || proto_lire(trame, len, &msg, &info) < 0 || info.opcode == OP_FRAGMENT)
+        return -1;
+
+    pthread_mutex_lock(&s->verrou);
+    int ok = s->actif;
+    if (ok) {
+        groupe_traiter(&s->etat, &msg, &info, src);
+        groupe_fin_lot(&s->etat);
+    }
+    pthread_mutex_unlock(&s->verrou);
+    return ok ? 0 : -1;
+}
+
+void moteur_arreter(void)
+{
+    if (evfd_arret < 0) return;
+
+    uint64_t un = 1;
+    if (write(evfd_arret, &un, sizeof(un)) < 0)
+        perror("write eventfd moteur");
+    for (int i = 0; i < nb_threads; ++i)
+        pthread_join(threads[i], NULL);
+    free(threads);
+    threads = NULL;
+    nb_threads = 0;
+
+    for (int b = 0; b < MOTEUR_NB_BLOCS; ++b) {
+        MoteurSlot *bloc = atomic_load(&blocs[b]);
+        if (!bloc) continue;
+        for (int i = 0; i < MOTEUR_SLOTS_PAR_BLOC; ++i) {
+            if (bloc[i].actif) {
+                if (!port_partage) close(bloc[i].etat.sock);
+                groupe_liberer(&bloc[i].etat);
+            }
+            pthread_mutex_destroy(&bloc[i].verrou);
+        }
+        free(bloc);
+        atomic_store(&blocs[b], NULL);
+    }
+    if (postes) {
+        for (int i = 0; i < nb_postes; ++i) {
+            close(postes[i].sock);
+            reassembleur_liberer(&postes[i].reassemblage);
+        }
+        free(postes);
+        postes = NULL;
+        nb_postes = 0;
+    }
+    close(evfd_arret);
+    if (epfd >= 0) close(epfd);
+    evfd_arret = epfd = -1;
+}
@@ -0,0 +1,306 @@
+#define _GNU_SOURCE
+#include "../include/protocole.h"
+#include <endian.h>
+
+/* Ordres v1, indexés par opcode */
+static const char *const ordres[OP_NB] = {
+    [OP_CMD]     = ORDRE_CMD,
+    [OP_RPL]     = ORDRE_RPL,
+    [OP_CON]     = ORDRE_CON,
+    [OP_MES]     = ORDRE_MSG,
+    [OP_MGR]     = ORDRE_MGR,
+    [OP_NAK]     = ORDRE_NAK,
+    [OP_MEMBRES] = ORDRE_MBR,
+    [OP_FRAGMENT] = ORDRE_FRG,
+    [OP_MULTICAST] = ORDRE_MCA,
+    [OP_RELAIS]  = ORDRE_RLY,
+};
+
+static const char *const mots[MOT_NB] = {
+    [MOT_LIST]         = "LIST",
+    [MOT_CREATE]       = "CREATE",
+    [MOT_JOIN]         = "JOIN",
+    [MOT_CHECKBAN]     = "CHECKBAN",
+    [MOT_MERGE]        = "MERGE",
+    [MOT_DELETE]       = "DELETE",
+    [MOT_MIGRATE]      = "MIGRATE",
+    [MOT_MIGRATEEXIST] = "MIGRATEEXIST",
+    [MOT_ADDCLIENT]    = "ADDCLIENT",
+    [MOT_MIGRATED]     = "MIGRATED",
+    [MOT_BANNED]       = "BANNED",
+};
+
+_Static_assert(sizeof(ProtoEntete) == 12, "entete v2 de 12 octets");
+_Static_assert(sizeof(ProtoTrace) == 24, "bloc de trace de 24 octets");
+_Static_assert(sizeof(ProtoEntete) + sizeof(ProtoTrace) + 3 + MAX_USERNAME + MAX_EMOJI + MAX_GROUP_NAME
+               + MAX_TEXT <= PROTO_TRAME_MAX, "ISYMessage v2 dans une trame");
+_Static_assert(sizeof(ProtoEntete) + 1 + MAX_GROUP_NAME + 1
+               + PROTO_MEMBRES_MAX * (3 + MAX_USERNAME - 1 + MAX_EMOJI - 1)
+               <= PROTO_TRAME_MAX, "table des membres dans une trame");
+_Static_assert(PROTO_V1_TAILLE == 164, "trame v1 de l'énoncé, gelée");
+_Static_assert(PROTO_V1_TAILLE_SEQ <= PROTO_TRAME_MAX, "ISYMessage v1 dans une trame");
+
+int proto_opcode(const char *ordre)
+{
+    for (int op = 1; op < OP_NB; ++op)
+        if (strncmp(ordre, ordres[op], 3) == 0) return op;
+    return 0;
+}
+
+int proto_mot(const char *texte, const char **args)
+{
+    size_t n = strcspn(texte, " ");
+    const char *suite = texte + n;
+    while (*suite == ' ') suite++;
+    if (args) *args = suite;
+    for (int m = 1; m < MOT_NB; ++m)
+        if (strlen(mots[m]) == n && strncmp(texte, mots[m], n) == 0) return m;
+    if (args) *args = texte;
+    return MOT_AUCUN;
+}
+
+/* Champ "longueur + octets" : copie tronquée dans dst (terminée par 0) */
+static int lire_champ(const unsigned char **p, const unsigned char *fin,
+                      char *dst, size_t cap)
+{
+    if (*p >= fin) return -1;
+    size_t n = **p;
+    if ((size_t)(fin - *p - 1) < n) return -1;
+    size_t c = n < cap - 1 ? n : cap - 1;
+    memcpy(dst, *p + 1, c);
+    dst[c] = '\0';
+    *p += 1 + n;
+    return 0;
+}
+
+static unsigned char *ecrire_champ(unsigned char *p, const char *s, size_t cap)
+{
+    size_t n = strnlen(s, cap - 1);
+    *p = (unsigned char)n;
+    memcpy(p + 1, s, n);
+    return p + 1 + n;
+}
+
+static void lire_trace(const unsigned char *p, ProtoTrace *t)
+{
+    uint64_t v[3];
+    memcpy(v, p, sizeof(v));
+    t->client_envoi = be64toh(v[0]);
+    t->groupe_reception = be64toh(v[1]);
+    t->groupe_envoi = be64toh(v[2]);
+}
+
+static unsigned char *ecrire_trace(unsigned char *p, const ProtoTrace *t)
+{
+    uint64_t v[3] = { htobe64(t->client_envoi), htobe64(t->groupe_reception),
+                      htobe64(t->groupe_envoi) };
+    memcpy(p, v, sizeof(v));
+    return p + sizeof(v);
+}
+
+int proto_lire(const void *trame, size_t len, ISYMessage *msg, ProtoInfo *info)
+{
+    const unsigned char *octets = trame;
+    memset(info, 0, sizeof(*info));
+    info->groupe = PROTO_GROUPE_AUCUN;
+    info->emetteur = PROTO_MEMBRE_AUCUN;
+    info->taille = len;
+    if (len == 0) return -1;
+
+    if (octets[0] != PROTO_V2) {
+        /* v1 : un datagramme court laisse les champs suivants à zéro */
+        size_t n = len < PROTO_V1_TAILLE ? len : PROTO_V1_TAILLE;
+        memset(msg, 0, sizeof(*msg));
+        memcpy(msg, trame, n);
+        if (len >= PROTO_V1_TAILLE_SEQ) {
+            uint32_t seq;
+            memcpy(&seq, octets + PROTO_V1_TAILLE, sizeof(seq));
+            msg->seq = ntohl(seq);
+        }
+        msg->ordre[3] = '\0';
+        msg->emetteur[MAX_USERNAME - 1] = '\0';
+        msg->emoji[MAX_EMOJI - 1] = '\0';
+        msg->groupe[MAX_GROUP_NAME - 1] = '\0';
+        msg->texte[MAX_TEXT - 1] = '\0';
+        info->version = PROTO_V1;
+        info->opcode = proto_opcode(msg->ordre);
+        return info->opcode ? 0 : -1;
+    }
+
+    ProtoEntete h;
+    if (len < sizeof(h)) return -1;
+    memcpy(&h, trame, sizeof(h));
+    size_t longueur = ntohs(h.longueur);
+    if (h.opcode == 0 || h.opcode >= OP_NB || longueur > len - sizeof(h))
+        return -1;
+
+    memset(msg, 0, sizeof(*msg));
+    memcpy(msg->ordre, ordres[h.opcode], 3);
+    msg->seq = ntohl(h.seq);
+    info->version = PROTO_V2;
+    info->opcode = h.opcode;
+    info->groupe = ntohs(h.groupe);
+    info->emetteur = h.emetteur;
+
+    const unsigned char *p = octets + sizeof(h);
+    const unsigned char *fin = p + longueur;
+    if (h.champs & PROTO_CHAMP_TRACE) {
+        if ((size_t)(fin - p) < sizeof(ProtoTrace)) return -1;
+        lire_trace(p, &info->horodatage);
+        info->trace = 1;
+        p += sizeof(ProtoTrace);
+    }
+    if ((h.champs & PROTO_CHAMP_EMETTEUR) &&
+        lire_champ(&p, fin, msg->emetteur, sizeof(msg->emetteur)) < 0) return -1;
+    if ((h.champs & PROTO_CHAMP_EMOJI) &&
+        lire_champ(&p, fin, msg->emoji, sizeof(msg->emoji)) < 0) return -1;
+    if ((h.champs & PROTO_CHAMP_GROUPE) &&
+        lire_champ(&p, fin, msg->groupe, sizeof(msg->groupe)) < 0) return -1;
+
+    info->charge = p;
+    info->nb_charge = (size_t)(fin - p);
+    if (h.opcode == OP_MEMBRES || h.opcode == OP_FRAGMENT) return 0;
+
+    /* CMD et MGR : le mot-clé est un code d'un octet, remis en toutes lettres */
+    size_t used = 0;
+    if ((h.opcode == OP_CMD || h.opcode == OP_MGR) && p < fin) {
+        int mot = *p++;
+        if (mot > 0 && mot < MOT_NB)
+            used = (size_t)snprintf(msg->texte, sizeof(msg->texte), "%s%s",
+                                    mots[mot], p < fin ? " " : "");
+    }
+    size_t n = (size_t)(fin - p);
+    if (n > sizeof(msg->texte) - 1 - used) n = sizeof(msg->texte) - 1 - used;
+    memcpy(msg->texte + used, p, n);
+    msg->texte[used + n] = '\0';
+    return 0;
+}
+
+size_t proto_ecrire(const ISYMessage *msg, int version, uint16_t groupe,
+                    uint8_t emetteur, void *trame)
+{
+    return proto_ecrire_texte(msg, msg->texte, strnlen(msg->texte, sizeof(msg->texte)),
+                              version, groupe, emetteur, trame, PROTO_TRAME_MAX, NULL);
+}
+
+size_t proto_ecrire_texte(const ISYMessage *msg, const char *texte, size_t nb,
+                          int version, uint16_t groupe, uint8_t emetteur,
+                          void *trame, size_t cap, const ProtoTrace *trace)
+{
+    int op = proto_opcode(msg->ordre);
+    if (version != PROTO_V2 || op == 0) {
+        /* v1 : texte tronqué à MAX_TEXT, seq en queue s'il y en a un */
+        ISYMessage *copie = trame;
+        memcpy(copie, msg, PROTO_V1_TAILLE);
+        if (texte != msg->texte) {
+            size_t c = nb < sizeof(copie->texte) - 1 ? nb : sizeof(copie->texte) - 1;
+            memcpy(copie->texte, texte, c);
+            memset(copie->texte + c, 0, sizeof(copie->texte) - c);
+        }
+        if (msg->seq == 0) return PROTO_V1_TAILLE;
+        uint32_t seq = htonl(msg->seq);
+        memcpy((unsigned char *)trame + PROTO_V1_TAILLE, &seq, sizeof(seq));
+        return PROTO_V1_TAILLE_SEQ;
+    }
+
+    ProtoEntete h;
+    memset(&h, 0, sizeof(h));
+    h.version = PROTO_V2;
+    h.opcode = (uint8_t)op;
+    h.seq = htonl(msg->seq);
+    h.groupe = htons(groupe);
+    h.emetteur = emetteur;
+
+    unsigned char *debut = (unsigned char *)trame + sizeof(h);
+    unsigned char *p = debut;
+    if (trace) {
+        h.champs |= PROTO_CHAMP_TRACE;
+        p = ecrire_trace(p, trace);
+    }
+    if (emetteur == PROTO_MEMBRE_AUCUN && msg->emetteur[0]) {
+        h.champs |= PROTO_CHAMP_EMETTEUR;
+        p = ecrire_champ(p, msg->emetteur, sizeof(msg->emetteur));
+    }
+    if (emetteur == PROTO_MEMBRE_AUCUN && msg->emoji[0]) {
+        h.champs |= PROTO_CHAMP_EMOJI;
+        p = ecrire_champ(p, msg->emoji, sizeof(msg->emoji));
+    }
+    if (groupe == PROTO_GROUPE_AUCUN && msg->groupe[0]) {
+        h.champs |= PROTO_CHAMP_GROUPE;
+        p = ecrire_champ(p, msg->groupe, sizeof(msg->groupe));
+    }
+
+    if (op == OP_CMD || op == OP_MGR) {
+        const char *args;
+        int mot = proto_mot(texte, &args);
+        nb -= (size_t)(args - texte);
+        texte = args;
+        *p++ = (unsigned char)mot;
+    }
+    if (cap > PROTO_MESSAGE_MAX) cap = PROTO_MESSAGE_MAX;
+    size_t place = cap - (size_t)(p - (unsigned char *)trame);
+    if (nb > place) nb = place;
+    memcpy(p, texte, nb);
+    p += nb;
+
+    h.longueur = htons((uint16_t)(p - debut));
+    memcpy(trame, &h, sizeof(h));
+    return (size_t)(p - (unsigned char *)trame);
+}
+
+int proto_horodater_envoi(void *trame, size_t len, uint64_t envoi, uint64_t *reception)
+{
+    unsigned char *octets = trame;
+    if (len < sizeof(ProtoEntete) + sizeof(ProtoTrace) || octets[0] != PROTO_V2)
+        return 0;
+    ProtoEntete h;
+    memcpy(&h, trame, sizeof(h));
+    if (!(h.champs & PROTO_CHAMP_TRACE) || h.opcode == OP_FRAGMENT) return 0;
+
+    ProtoTrace t;
+    lire_trace(octets + sizeof(h), &t);
+    t.groupe_envoi = envoi;
+    ecrire_trace(octets + sizeof(h), &t);
+    *reception = t.groupe_reception;
+    return 1;
+}
+
+size_t proto_ecrire_membres(const char *nom_groupe, uint16_t groupe,
+                            const ProtoMembre *membres, int nb, void *trame)
+{
+    ProtoEntete h;
+    memset(&h, 0, sizeof(h));
+    h.version = PROTO_V2;
+    h.opcode = OP_MEMBRES;
+    h.groupe = htons(groupe);
+    h.emetteur = PROTO_MEMBRE_AUCUN;
+    h.champs = PROTO_CHAMP_GROUPE;
+
+    unsigned char *debut = (unsigned char *)trame + sizeof(h);
+    unsigned char *p = ecrire_champ(debut, nom_groupe, MAX_GROUP_NAME);
+    for (int i = 0; i < nb && i < PROTO_MEMBRES_MAX; ++i) {
+        *p++ = membres[i].id;
+        p = ecrire_champ(p, membres[i].nom, MAX_USERNAME);
+        p = ecrire_champ(p, membres[i].emoji, MAX_EMOJI);
+    }
+
+    h.longueur = htons((uint16_t)(p - debut));
+    memcpy(trame, &h, sizeof(h));
+    return (size_t)(p - (unsigned char *)trame);
+}
+
+int proto_lire_membres(const ProtoInfo *info, ProtoMembre *membres, int max)
+{
+    const unsigned char *p = info->charge;
+    const unsigned char *fin = p + info->nb_charge;
+    int nb = 0;
+    while (p < fin && nb < max) {
+        ProtoMembre *m = &membres[nb];
+        m->id = *p++;
+        if (lire_champ(&p, fin, m->nom, sizeof(m->nom)) < 0 ||
+            lire_champ(&p, fin, m->emoji, sizeof(m->emoji)) < 0)
+            break;
+        nb++;
+    }
+    return nb;
+}
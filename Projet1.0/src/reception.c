@@ -0,0 +1,62 @@
+#define _GNU_SOURCE
+#include "../include/reception.h"
+
+int reception_lot(int sock, ReceptionLot *lot, int max, int flags, Reassembleur *r)
+{
+    lot->reassembleur = r;
+    lot->nb_slabs = 0;
+    if (max <= 0 || max > RECEPTION_LOT_MAX) max = RECEPTION_LOT_MAX;
+
+    for (int i = 0; i < max; ++i) {
+        lot->iovs[i].iov_base = lot->trames[i];
+        lot->iovs[i].iov_len  = sizeof(lot->trames[i]);
+        memset(&lot->hdrs[i], 0, sizeof(lot->hdrs[i]));
+        lot->hdrs[i].msg_hdr.msg_name    = &lot->srcs[i];
+        lot->hdrs[i].msg_hdr.msg_namelen = sizeof(lot->srcs[i]);
+        lot->hdrs[i].msg_hdr.msg_iov     = &lot->iovs[i];
+        lot->hdrs[i].msg_hdr.msg_iovlen  = 1;
+        lot->hdrs[i].msg_hdr.msg_control    = lot->controles[i];
+        lot->hdrs[i].msg_hdr.msg_controllen = sizeof(lot->controles[i]);
+    }
+
+    if (!(flags & MSG_DONTWAIT)) flags |= MSG_WAITFORONE;
+    int n = recvmmsg(sock, lot->hdrs, (unsigned int)max, flags, NULL);
+    if (n < 0) {
+        lot->n = 0;
+        return -1;
+    }
+
+    /* Décodage ; les messages valides sont tassés en tête du lot (les
+     * charges v2 restent dans leur trame d'origine, ou dans leur slab) */
+    int k = 0;
+    for (int i = 0; i < n; ++i) {
+        if (proto_lire(lot->trames[i], lot->hdrs[i].msg_len,
+                       &lot->msgs[k], &lot->infos[k]) < 0)
+            continue;
+        if (lot->infos[k].opcode == OP_FRAGMENT) {
+            const unsigned char *trame;
+            size_t len;
+            int slab = r ? reassembleur_ajouter(r, &lot->infos[k], &lot->srcs[i],
+                                                &trame, &len) : -1;
+            if (slab < 0) continue;
+            if (proto_lire(trame, len, &lot->msgs[k], &lot->infos[k]) < 0 ||
+                lot->infos[k].opcode == OP_FRAGMENT) {
+                reassembleur_rendre(r, slab);
+                continue;
+            }
+            lot->slabs[lot->nb_slabs++] = slab;
+        }
+        lot->infos[k].recu_ns = trace_heure(&lot->hdrs[i].msg_hdr);
+        if (k != i) lot->srcs[k] = lot->srcs[i];
+        k++;
+    }
+    lot->n = k;
+    return k;
+}
+
+void reception_rendre(ReceptionLot *lot)
+{
+    for (int i = 0; i < lot->nb_slabs; ++i)
+        reassembleur_rendre(lot->reassembleur, lot->slabs[i]);
+    lot->nb_slabs = 0;
+}
@@ -0,0 +1,217 @@
+#include "../include/registre.h"
+#include <stdint.h>
+
+#define REGISTRE_NB_BLOCS  (REGISTRE_MAX_GROUPES / REGISTRE_SLOTS_PAR_BLOC)
+#define INDEX_TAILLE_MIN   64
+#define CASE_VIDE          (-1)
+
+/* Case de l'index : le hash est gardé pour éviter la plupart des strcmp */
+typedef struct {
+    uint32_t hash;
+    int32_t  slot;
+} IndexCase;
+
+static GroupeInfo *blocs[REGISTRE_NB_BLOCS];
+static int capacite_max = REGISTRE_MAX_GROUPES;
+static int etendue = 0;              /* slots [0, etendue) déjà alloués */
+static int nb_actifs = 0;
+
+/* Slots rendus, réutilisés avant d'en allouer de nouveaux */
+static int *libres = NULL;
+static int nb_libres = 0;
+static int cap_libres = 0;
+
+static IndexCase *index_cases = NULL;
+static uint32_t index_taille = 0;    /* puissance de 2 */
+static uint32_t index_nb = 0;
+
+/* FNV-1a */
+static uint32_t hash_nom(const char *nom)
+{
+    uint32_t h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)nom; *p; ++p) {
+        h ^= *p;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static int index_allouer(uint32_t taille)
+{
+    IndexCase *cases = malloc(taille * sizeof(IndexCase));
+    if (!cases) return -1;
+    for (uint32_t i = 0; i < taille; ++i)
+        cases[i].slot = CASE_VIDE;
+
+    /* Réinsertion des entrées existantes */
+    for (uint32_t i = 0; i < index_taille; ++i) {
+        if (index_cases[i].slot == CASE_VIDE) continue;
+        uint32_t j = index_cases[i].hash & (taille - 1);
+        while (cases[j].slot != CASE_VIDE)
+            j = (j + 1) & (taille - 1);
+        cases[j] = index_cases[i];
+    }
+    free(index_cases);
+    index_cases = cases;
+    index_taille = taille;
+    return 0;
+}
+
+/* Position du nom dans l'index, ou -1 */
+static int64_t index_trouver(const char *nom, uint32_t h)
+{
+    if (index_taille == 0) return -1;
+    uint32_t j = h & (index_taille - 1);
+    while (index_cases[j].slot != CASE_VIDE) {
+        if (index_cases[j].hash == h &&
+            strcmp(registre_groupe(index_cases[j].slot)->nom, nom) == 0)
+            return j;
+        j = (j + 1) & (index_taille - 1);
+    }
+    return -1;
+}
+
+/* Suppression par décalage arrière : pas de pierres tombales, les chaînes
+ * de sondage restent courtes même après beaucoup de CREATE/DELETE. */
+static void index_supprimer(uint32_t j)
+{
+    uint32_t masque = index_taille - 1;
+    uint32_t trou = j;
+    uint32_t k = (j + 1) & masque;
+
+    while (index_cases[k].slot != CASE_VIDE) {
+        uint32_t ideal = index_cases[k].hash & masque;
+        /* L'entrée k peut remplir le trou si sa position idéale n'est pas
+         * dans l'intervalle circulaire ]trou, k] */
+        if (((k - ideal) & masque) >= ((k - trou) & masque)) {
+            index_cases[trou] = index_cases[k];
+            trou = k;
+        }
+        k = (k + 1) & masque;
+    }
+    index_cases[trou].slot = CASE_VIDE;
+    index_nb--;
+}
+
+int registre_init(int capacite)
+{
+    if (capacite <= 0 || capacite > REGISTRE_MAX_GROUPES)
+        capacite = REGISTRE_MAX_GROUPES;
+    capacite_max = capacite;
+    return index_allouer(INDEX_TAILLE_MIN);
+}
+
+void registre_detruire(void)
+{
+    for (int b = 0; b < REGISTRE_NB_BLOCS; ++b) {
+        free(blocs[b]);
+        blocs[b] = NULL;
+    }
+    free(libres);
+    free(index_cases);
+    libres = NULL;
+    index_cases = NULL;
+    nb_libres = cap_libres = 0;
+    index_taille = index_nb = 0;
+    etendue = nb_actifs = 0;
+}
+
+GroupeInfo *registre_groupe(int slot)
+{
+    if (slot < 0 || slot >= etendue) return NULL;
+    return &blocs[slot / REGISTRE_SLOTS_PAR_BLOC][slot % REGISTRE_SLOTS_PAR_BLOC];
+}
+
+int registre_chercher(const char *nom)
+{
+    int64_t j = index_trouver(nom, hash_nom(nom));
+    return j < 0 ? -1 : index_cases[j].slot;
+}
+
+int registre_allouer(const char *nom)
+{
+    /* Charge maximale 1/2 */
+    if ((index_nb + 1) * 2 > index_taille &&
+        index_allouer(index_taille * 2) < 0)
+        return -1;
+
+    int slot;
+    if (nb_libres > 0) {
+        slot = libres[--nb_libres];
+    } else {
+        if (etendue >= capacite_max) return -1;
+        slot = etendue;
+        int b = slot / REGISTRE_SLOTS_PAR_BLOC;
+        if (!blocs[b]) {
+            blocs[b] = calloc(REGISTRE_SLOTS_PAR_BLOC, sizeof(GroupeInfo));
+            if (!blocs[b]) return -1;
+        }
+        etendue++;
+    }
+
+    GroupeInfo *gi = &blocs[slot / REGISTRE_SLOTS_PAR_BLOC][slot % REGISTRE_SLOTS_PAR_BLOC];
+    memset(gi, 0, sizeof(*gi));
+    gi->actif = 1;
+    snprintf(gi->nom, MAX_GROUP_NAME, "%s", nom);
+    gi->port_groupe = GROUP_PORT_BASE + slot;
+    gi->shm_id = -1;
+    gi->pidfd = -1;
+    gi->fd_pret = -1;
+    gi->etat = PROC_LIBRE;
+
+    uint32_t h = hash_nom(gi->nom);
+    uint32_t j = h & (index_taille - 1);
+    while (index_cases[j].slot != CASE_VIDE)
+        j = (j + 1) & (index_taille - 1);
+    index_cases[j].hash = h;
+    index_cases[j].slot = slot;
+    index_nb++;
+    nb_actifs++;
+    return slot;
+}
+
+void registre_retirer(int slot)
+{
+    GroupeInfo *gi = registre_groupe(slot);
+    if (!gi || !gi->actif) return;
+
+    uint32_t h = hash_nom(gi->nom);
+    uint32_t j = h & (index_taille - 1);
+    while (index_cases[j].slot != CASE_VIDE) {
+        if (index_cases[j].slot == slot) {
+            index_supprimer(j);
+            break;
+        }
+        j = (j + 1) & (index_taille - 1);
+    }
+    gi->actif = 0;
+    bannis_liberer(&gi->bannis);
+    nb_actifs--;
+}
+
+void registre_liberer(int slot)
+{
+    GroupeInfo *gi = registre_groupe(slot);
+    if (!gi || gi->port_groupe == 0) return;      /* déjà libre */
+    registre_retirer(slot);
+    gi->port_groupe = 0;
+
+    if (nb_libres == cap_libres) {
+        int cap = cap_libres ? cap_libres * 2 : 64;
+        int *p = realloc(libres, (size_t)cap * sizeof(int));
+        if (!p) return;             /* slot perdu, mais registre cohérent */
+        libres = p;
+        cap_libres = cap;
+    }
+    libres[nb_libres++] = slot;
+}
+
+int registre_etendue(void)
+{
+    return etendue;
+}
+
+int registre_nb_actifs(void)
+{
+    return nb_actifs;
+}
@@ -0,0 +1,37 @@
+#include "../include/relais.h"
+#include <stdio.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+int relais_ecrire_entree(char *maj, size_t cap, size_t *nb, int ajout,
+                         const struct sockaddr_in *addr)
+{
+    char ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &addr->sin_addr, ip, sizeof(ip));
+    int w = snprintf(maj + *nb, cap - *nb, " %c%s:%u", ajout ? '+' : '-', ip,
+                     (unsigned)ntohs(addr->sin_port));
+    if (w < 0 || (size_t)w >= cap - *nb) {
+        maj[*nb] = '\0';
+        return -1;
+    }
+    *nb += (size_t)w;
+    return 0;
+}
+
+const char *relais_lire_entree(const char *p, int *ajout, struct sockaddr_in *addr)
+{
+    while (*p == ' ') p++;
+    if (*p != '+' && *p != '-') return NULL;
+    *ajout = *p++ == '+';
+
+    char ip[INET_ADDRSTRLEN];
+    unsigned int port;
+    int lus = 0;
+    if (sscanf(p, "%15[0-9.]:%u%n", ip, &port, &lus) != 2 || port == 0 || port > 65535)
+        return NULL;
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    if (inet_pton(AF_INET, ip, &addr->sin_addr) != 1) return NULL;
+    addr->sin_port = htons((uint16_t)port);
+    return p + lus;
+}
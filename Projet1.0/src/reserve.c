@@ -0,0 +1,64 @@
+#define _GNU_SOURCE
+#include "../include/reserve.h"
+#include <sys/socket.h>
+
+/* Place des descripteurs d'un ordre, alignée pour struct cmsghdr */
+typedef union {
+    char buf[CMSG_SPACE(RESERVE_SOCKETS_MAX * sizeof(int))];
+    struct cmsghdr aligne;
+} ReserveControle;
+
+int reserve_envoyer(int canal, const ReserveOrdre *o, const int *socks, int nb)
+{
+    if (nb < 1 || nb > RESERVE_SOCKETS_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+    ReserveControle ctl;
+    memset(&ctl, 0, sizeof(ctl));
+    struct iovec iov = { .iov_base = (void *)o, .iov_len = sizeof(*o) };
+    struct msghdr mh = {
+        .msg_iov = &iov, .msg_iovlen = 1,
+        .msg_control = ctl.buf, .msg_controllen = CMSG_SPACE((size_t)nb * sizeof(int)),
+    };
+    struct cmsghdr *c = CMSG_FIRSTHDR(&mh);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN((size_t)nb * sizeof(int));
+    memcpy(CMSG_DATA(c), socks, (size_t)nb * sizeof(int));
+
+    /* MSG_NOSIGNAL : un processus mort donne EPIPE, pas SIGPIPE */
+    return sendmsg(canal, &mh, MSG_NOSIGNAL) == (ssize_t)sizeof(*o) ? 0 : -1;
+}
+
+int reserve_recevoir(int canal, ReserveOrdre *o, int *socks, int max)
+{
+    ReserveControle ctl;
+    struct iovec iov = { .iov_base = o, .iov_len = sizeof(*o) };
+    struct msghdr mh = {
+        .msg_iov = &iov, .msg_iovlen = 1,
+        .msg_control = ctl.buf, .msg_controllen = sizeof(ctl.buf),
+    };
+    ssize_t n = recvmsg(canal, &mh, MSG_CMSG_CLOEXEC);
+    if (n <= 0) return (int)n;
+
+    int nb = 0;
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(&mh); c; c = CMSG_NXTHDR(&mh, c)) {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+        int recus = (int)((c->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        int fds[RESERVE_SOCKETS_MAX];
+        memcpy(fds, CMSG_DATA(c), (size_t)recus * sizeof(int));
+        for (int k = 0; k < recus; ++k) {
+            if (nb < max) socks[nb++] = fds[k];
+            else close(fds[k]);
+        }
+    }
+    if (n != (ssize_t)sizeof(*o) || nb == 0) {
+        for (int k = 0; k < nb; ++k) close(socks[k]);
+        errno = EPROTO;
+        return -1;
+    }
+    o->nom[MAX_GROUP_NAME - 1] = '\0';
+    o->moderateur[MAX_USERNAME - 1] = '\0';
+    return nb;
+}
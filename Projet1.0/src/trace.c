@@ -0,0 +1,62 @@
+#define _GNU_SOURCE
+#include "../include/trace.h"
+#include <string.h>
+
+static const char *const noms[TRACE_NB] = {
+    [TRACE_CLIENT_GROUPE]    = "client>groupe",
+    [TRACE_GROUPE]           = "groupe",
+    [TRACE_GROUPE_AFFICHAGE] = "groupe>affichage",
+    [TRACE_AFFICHAGE]        = "affichage",
+};
+
+uint64_t trace_maintenant(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+int trace_classe(uint64_t debut, uint64_t fin)
+{
+    if (fin <= debut) return 0;
+    uint64_t us = (fin - debut) / 1000;
+    if (us == 0) return 0;
+    int c = 64 - __builtin_clzll(us);
+    return c < TRACE_CLASSES ? c : TRACE_CLASSES - 1;
+}
+
+double trace_percentile_us(const uint64_t compte[TRACE_CLASSES], double p)
+{
+    uint64_t total = 0;
+    for (int c = 0; c < TRACE_CLASSES; ++c) total += compte[c];
+    if (total == 0) return 0.0;
+    uint64_t rang = (uint64_t)(p * (double)(total - 1)) + 1, cumul = 0;
+    for (int c = 0; c < TRACE_CLASSES; ++c) {
+        cumul += compte[c];
+        if (cumul >= rang) return (double)(1ull << c);
+    }
+    return (double)(1ull << (TRACE_CLASSES - 1));
+}
+
+const char *trace_nom(int etape)
+{
+    return etape >= 0 && etape < TRACE_NB ? noms[etape] : "?";
+}
+
+int trace_horodater(int sock)
+{
+    int un = 1;
+    return setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &un, sizeof(un));
+}
+
+uint64_t trace_heure(const struct msghdr *mh)
+{
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(mh); c; c = CMSG_NXTHDR((struct msghdr *)mh, c)) {
+        if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPNS) {
+            struct timespec ts;
+            memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+            return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+        }
+    }
+    return 0;
+}